@@ -44,9 +44,10 @@ def parse_arguments():
     parser = argparse.ArgumentParser(description="Run spec tests using a provided harness.")
     parser.add_argument("--json_folder", help="Path to the folder containing generated spec test JSON files. Default: {}".format(default_json_folder), type=str, default=default_json_folder)
     parser.add_argument("--harness", help="Path to the harness binary used to run the tests. Default: {}".format(selected_harness), type=str, default=selected_harness)
+    parser.add_argument("--simd", help="Also run the SIMD tests, the harness has to be built with SILVERFIR_ENABLE_SIMD=1", action="store_true")
     return parser.parse_args()
 
-def run_spec_test(json_folder, harness):
+def run_spec_test(json_folder, harness, simd):
     if not os.path.exists(json_folder):
         sys.stderr.write("Error: The provided JSON folder does not exist: {}\n".format(json_folder))
         return 1
@@ -55,7 +56,7 @@ def run_spec_test(json_folder, harness):
         return 1
 
     # Blacklist for tests that should not run
-    blacklist_prefix = ["simd"]
+    blacklist_prefix = [] if simd else ["simd"]
 
     for file in glob.glob(os.path.join(json_folder, "*.json")):
         # Check if the file is in the blacklist
@@ -73,7 +74,7 @@ def run_spec_test(json_folder, harness):
 
 def main():
     args = parse_arguments()
-    ret = run_spec_test(args.json_folder, args.harness)
+    ret = run_spec_test(args.json_folder, args.harness, args.simd)
     sys.exit(ret)
 
 if __name__ == "__main__":
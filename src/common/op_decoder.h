@@ -29,13 +29,19 @@ typedef r (*cb_br_or_if)(void * payload, wasm_opcode opcode, stream imm, u8 lth)
 typedef r (*cb_u32)(void * payload, stream imm, u32 u1);
 typedef r (*cb_u32_u32)(void * payload, stream imm, u32 u1, u32 u2);
 typedef r (*cb_typeid)(void * payload, wasm_opcode opcode, stream imm, type_id type);
-typedef r (*cb_load_store)(void * payload, wasm_opcode opcode, stream imm, u8 align, u32 offset);
+typedef r (*cb_load_store)(void * payload, wasm_opcode opcode, stream imm, u8 align, u64 offset);
 typedef r (*cb_i32)(void * payload, stream imm, i32 val);
 typedef r (*cb_i64)(void * payload, stream imm, i64 val);
 typedef r (*cb_f32)(void * payload, stream imm, f32 val);
 typedef r (*cb_f64)(void * payload, stream imm, f64 val);
 typedef r (*cb_fc_none)(void * payload, wasm_opcode_fc opcode, stream imm);
 typedef r (*cb_fd_none)(void * payload, wasm_opcode_fd opcode, stream imm);
+typedef r (*cb_simd_memory)(void * payload, wasm_opcode_fd opcode, stream imm, u8 align, u64 offset);
+typedef r (*cb_simd_memory_lane)(void * payload, wasm_opcode_fd opcode, stream imm, u8 align, u64 offset, u8 lane);
+typedef r (*cb_simd_lane)(void * payload, wasm_opcode_fd opcode, stream imm, u8 lane);
+typedef r (*cb_simd_bytes)(void * payload, wasm_opcode_fd opcode, stream imm, const u8 * bytes); // 16 bytes
+typedef r (*cb_fe_none)(void * payload, wasm_opcode_fe opcode, stream imm);
+typedef r (*cb_atomic_memory)(void * payload, wasm_opcode_fe opcode, stream imm, u8 align, u64 offset);
 typedef r (*cb_decode_end)(void * payload);
 
 typedef struct op_decoder_callbacks {
@@ -51,6 +57,8 @@ typedef struct op_decoder_callbacks {
     cb_none on_return;
     cb_u32 on_call;
     cb_u32_u32 on_call_indirect;
+    cb_u32 on_return_call;
+    cb_u32_u32 on_return_call_indirect;
     cb_none on_drop;
     cb_none on_select;
     cb_typeid on_select_t;
@@ -97,6 +105,15 @@ typedef struct op_decoder_callbacks {
     cb_u32 on_table_size;
     cb_u32 on_table_fill;
     cb_fd_none on_opcode_fd;
+    cb_simd_memory on_simd_memory; // v128 loads and stores, including the splat and zero loads
+    cb_simd_memory_lane on_simd_memory_lane;
+    cb_simd_bytes on_v128_const;
+    cb_simd_bytes on_i8x16_shuffle;
+    cb_simd_lane on_simd_lane; // extract_lane & replace_lane
+    cb_fd_none on_simd; // all the other 0xfd instructions
+    cb_fe_none on_opcode_fe;
+    cb_atomic_memory on_atomic_memory; // all the 0xfe instructions with a memarg
+    cb_fe_none on_atomic_fence;
     cb_decode_end on_decode_end;
 } op_decoder_callbacks;
 
@@ -43,3 +43,12 @@ const char * get_op_fd_name(wasm_opcode_fd op) {
     return op_fd_names[op];
 }
 
+
+#define OPCODE_FE_NAME(label, b1, b2, name) [b2] = #name,
+static const char * const op_fe_names[256] = {
+    FOR_EACH_WASM_OPCODE_FE(OPCODE_FE_NAME)
+};
+
+const char * get_op_fe_name(wasm_opcode_fe op) {
+    return op_fe_names[op];
+}
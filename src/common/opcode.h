@@ -35,7 +35,9 @@ macro(br_table                         , 0x0e , _    , br_table
 macro(return                           , 0x0f , _    , return                        )\
 macro(call                             , 0x10 , _    , call                          )\
 macro(call_indirect                    , 0x11 , _    , call_indirect                 )\
-/* unused 0x12 - 0x19 */                                                              \
+macro(return_call                      , 0x12 , _    , return_call                   )\
+macro(return_call_indirect             , 0x13 , _    , return_call_indirect          )\
+/* unused 0x14 - 0x19 */                                                              \
 macro(drop                             , 0x1a , _    , drop                          )\
 macro(select                           , 0x1b , _    , select                        )\
 macro(select_t                         , 0x1c , _    , select_t                      )\
@@ -212,7 +214,8 @@ macro(ref_func                         , 0xd2 , _    , ref.func
 /* unused 0xd3 - 0xfb */                                                              \
 macro(prefix_fc                        , 0xfc , _    , prefix_fc                     )\
 macro(prefix_fd                        , 0xfd , _    , prefix_fd                     )\
-/* unused 0xfe - 0xff */
+macro(prefix_fe                        , 0xfe , _    , prefix_fe                     )\
+/* unused 0xff */
 
 #define FOR_EACH_WASM_OPCODE_FC(macro) \
 macro(i32_trunc_sat_f32_s              , 0xfc , 0x00 , i32.trunc_sat_f32_s           )\
@@ -472,6 +475,76 @@ macro(i32x4_trunc_sat_f64x2_u_zero     , 0xfd , 0xfd , i32x4.trunc_sat_f64x2_u_z
 macro(f64x2_convert_low_i32x4_s        , 0xfd , 0xfe , f64x2.convert_low_i32x4_s     )\
 macro(f64x2_convert_low_i32x4_u        , 0xfd , 0xff , f64x2.convert_low_i32x4_u     )
 
+#define FOR_EACH_WASM_OPCODE_FE(macro) \
+macro(memory_atomic_notify             , 0xfe , 0x00 , memory.atomic.notify          )\
+macro(memory_atomic_wait32             , 0xfe , 0x01 , memory.atomic.wait32          )\
+macro(memory_atomic_wait64             , 0xfe , 0x02 , memory.atomic.wait64          )\
+macro(atomic_fence                     , 0xfe , 0x03 , atomic.fence                  )\
+/* unused 0x04 - 0x0f */                                                              \
+macro(i32_atomic_load                  , 0xfe , 0x10 , i32.atomic.load               )\
+macro(i64_atomic_load                  , 0xfe , 0x11 , i64.atomic.load               )\
+macro(i32_atomic_load8_u               , 0xfe , 0x12 , i32.atomic.load8_u            )\
+macro(i32_atomic_load16_u              , 0xfe , 0x13 , i32.atomic.load16_u           )\
+macro(i64_atomic_load8_u               , 0xfe , 0x14 , i64.atomic.load8_u            )\
+macro(i64_atomic_load16_u              , 0xfe , 0x15 , i64.atomic.load16_u           )\
+macro(i64_atomic_load32_u              , 0xfe , 0x16 , i64.atomic.load32_u           )\
+macro(i32_atomic_store                 , 0xfe , 0x17 , i32.atomic.store              )\
+macro(i64_atomic_store                 , 0xfe , 0x18 , i64.atomic.store              )\
+macro(i32_atomic_store8                , 0xfe , 0x19 , i32.atomic.store8             )\
+macro(i32_atomic_store16               , 0xfe , 0x1a , i32.atomic.store16            )\
+macro(i64_atomic_store8                , 0xfe , 0x1b , i64.atomic.store8             )\
+macro(i64_atomic_store16               , 0xfe , 0x1c , i64.atomic.store16            )\
+macro(i64_atomic_store32               , 0xfe , 0x1d , i64.atomic.store32            )\
+macro(i32_atomic_rmw_add               , 0xfe , 0x1e , i32.atomic.rmw.add            )\
+macro(i64_atomic_rmw_add               , 0xfe , 0x1f , i64.atomic.rmw.add            )\
+macro(i32_atomic_rmw8_add_u            , 0xfe , 0x20 , i32.atomic.rmw8.add_u         )\
+macro(i32_atomic_rmw16_add_u           , 0xfe , 0x21 , i32.atomic.rmw16.add_u        )\
+macro(i64_atomic_rmw8_add_u            , 0xfe , 0x22 , i64.atomic.rmw8.add_u         )\
+macro(i64_atomic_rmw16_add_u           , 0xfe , 0x23 , i64.atomic.rmw16.add_u        )\
+macro(i64_atomic_rmw32_add_u           , 0xfe , 0x24 , i64.atomic.rmw32.add_u        )\
+macro(i32_atomic_rmw_sub               , 0xfe , 0x25 , i32.atomic.rmw.sub            )\
+macro(i64_atomic_rmw_sub               , 0xfe , 0x26 , i64.atomic.rmw.sub            )\
+macro(i32_atomic_rmw8_sub_u            , 0xfe , 0x27 , i32.atomic.rmw8.sub_u         )\
+macro(i32_atomic_rmw16_sub_u           , 0xfe , 0x28 , i32.atomic.rmw16.sub_u        )\
+macro(i64_atomic_rmw8_sub_u            , 0xfe , 0x29 , i64.atomic.rmw8.sub_u         )\
+macro(i64_atomic_rmw16_sub_u           , 0xfe , 0x2a , i64.atomic.rmw16.sub_u        )\
+macro(i64_atomic_rmw32_sub_u           , 0xfe , 0x2b , i64.atomic.rmw32.sub_u        )\
+macro(i32_atomic_rmw_and               , 0xfe , 0x2c , i32.atomic.rmw.and            )\
+macro(i64_atomic_rmw_and               , 0xfe , 0x2d , i64.atomic.rmw.and            )\
+macro(i32_atomic_rmw8_and_u            , 0xfe , 0x2e , i32.atomic.rmw8.and_u         )\
+macro(i32_atomic_rmw16_and_u           , 0xfe , 0x2f , i32.atomic.rmw16.and_u        )\
+macro(i64_atomic_rmw8_and_u            , 0xfe , 0x30 , i64.atomic.rmw8.and_u         )\
+macro(i64_atomic_rmw16_and_u           , 0xfe , 0x31 , i64.atomic.rmw16.and_u        )\
+macro(i64_atomic_rmw32_and_u           , 0xfe , 0x32 , i64.atomic.rmw32.and_u        )\
+macro(i32_atomic_rmw_or                , 0xfe , 0x33 , i32.atomic.rmw.or             )\
+macro(i64_atomic_rmw_or                , 0xfe , 0x34 , i64.atomic.rmw.or             )\
+macro(i32_atomic_rmw8_or_u             , 0xfe , 0x35 , i32.atomic.rmw8.or_u          )\
+macro(i32_atomic_rmw16_or_u            , 0xfe , 0x36 , i32.atomic.rmw16.or_u         )\
+macro(i64_atomic_rmw8_or_u             , 0xfe , 0x37 , i64.atomic.rmw8.or_u          )\
+macro(i64_atomic_rmw16_or_u            , 0xfe , 0x38 , i64.atomic.rmw16.or_u         )\
+macro(i64_atomic_rmw32_or_u            , 0xfe , 0x39 , i64.atomic.rmw32.or_u         )\
+macro(i32_atomic_rmw_xor               , 0xfe , 0x3a , i32.atomic.rmw.xor            )\
+macro(i64_atomic_rmw_xor               , 0xfe , 0x3b , i64.atomic.rmw.xor            )\
+macro(i32_atomic_rmw8_xor_u            , 0xfe , 0x3c , i32.atomic.rmw8.xor_u         )\
+macro(i32_atomic_rmw16_xor_u           , 0xfe , 0x3d , i32.atomic.rmw16.xor_u        )\
+macro(i64_atomic_rmw8_xor_u            , 0xfe , 0x3e , i64.atomic.rmw8.xor_u         )\
+macro(i64_atomic_rmw16_xor_u           , 0xfe , 0x3f , i64.atomic.rmw16.xor_u        )\
+macro(i64_atomic_rmw32_xor_u           , 0xfe , 0x40 , i64.atomic.rmw32.xor_u        )\
+macro(i32_atomic_rmw_xchg              , 0xfe , 0x41 , i32.atomic.rmw.xchg           )\
+macro(i64_atomic_rmw_xchg              , 0xfe , 0x42 , i64.atomic.rmw.xchg           )\
+macro(i32_atomic_rmw8_xchg_u           , 0xfe , 0x43 , i32.atomic.rmw8.xchg_u        )\
+macro(i32_atomic_rmw16_xchg_u          , 0xfe , 0x44 , i32.atomic.rmw16.xchg_u       )\
+macro(i64_atomic_rmw8_xchg_u           , 0xfe , 0x45 , i64.atomic.rmw8.xchg_u        )\
+macro(i64_atomic_rmw16_xchg_u          , 0xfe , 0x46 , i64.atomic.rmw16.xchg_u       )\
+macro(i64_atomic_rmw32_xchg_u          , 0xfe , 0x47 , i64.atomic.rmw32.xchg_u       )\
+macro(i32_atomic_rmw_cmpxchg           , 0xfe , 0x48 , i32.atomic.rmw.cmpxchg        )\
+macro(i64_atomic_rmw_cmpxchg           , 0xfe , 0x49 , i64.atomic.rmw.cmpxchg        )\
+macro(i32_atomic_rmw8_cmpxchg_u        , 0xfe , 0x4a , i32.atomic.rmw8.cmpxchg_u     )\
+macro(i32_atomic_rmw16_cmpxchg_u       , 0xfe , 0x4b , i32.atomic.rmw16.cmpxchg_u    )\
+macro(i64_atomic_rmw8_cmpxchg_u        , 0xfe , 0x4c , i64.atomic.rmw8.cmpxchg_u     )\
+macro(i64_atomic_rmw16_cmpxchg_u       , 0xfe , 0x4d , i64.atomic.rmw16.cmpxchg_u    )\
+macro(i64_atomic_rmw32_cmpxchg_u       , 0xfe , 0x4e , i64.atomic.rmw32.cmpxchg_u    )
+
 #define DEFINE_OPCODE(label, b1, b2, name) op_##label = (u8)(b1),
 typedef enum wasm_opcode {
     FOR_EACH_WASM_OPCODE(DEFINE_OPCODE)
@@ -487,7 +560,13 @@ typedef enum wasm_opcode_fd {
     FOR_EACH_WASM_OPCODE_FD(DEFINE_OPCODE_FD)
 } wasm_opcode_fd;
 
+#define DEFINE_OPCODE_FE(label, b1, b2, name) op_##label = (u8)(b2),
+typedef enum wasm_opcode_fe {
+    FOR_EACH_WASM_OPCODE_FE(DEFINE_OPCODE_FE)
+} wasm_opcode_fe;
+
 const char * get_op_name(wasm_opcode op);
 const char * get_op_fc_name(wasm_opcode_fc op);
 const char * get_op_fd_name(wasm_opcode_fd op);
+const char * get_op_fe_name(wasm_opcode_fe op);
 
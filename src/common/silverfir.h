@@ -30,6 +30,14 @@
     #define SILVERFIR_LOCAL_COUNT_LIMIT (1024)
 #endif
 
+// Use 4-byte stack slots instead of the 8-byte value_u ones, the 64-bit values take two slots.
+// It halves the stack and locals for the guests that mostly use i32, at the cost of the features
+// that operate on the whole value_u slots: the TCO interpreter, SIMD and the threads proposal.
+// The stack sizes and the jump tables are all counted in slots.
+#if !defined(SILVERFIR_STACK_SLOT_32)
+    #define SILVERFIR_STACK_SLOT_32 0
+#endif
+
 // Enable the direct-threading or the traditional switch-case based in-place interpreter
 // Disable this option to fallback to TCO interpreter.
 #if !defined(SILVERFIR_INTERP_INPLACE_DT)
@@ -38,10 +46,74 @@
 
 // Enable the tail-call optimized in-place interpreter
 #if !defined(SILVERFIR_INTERP_INPLACE_TCO)
-    #define SILVERFIR_INTERP_INPLACE_TCO 1
+    #define SILVERFIR_INTERP_INPLACE_TCO (!SILVERFIR_STACK_SLOT_32)
 #endif
 
 #if !SILVERFIR_INTERP_INPLACE_DT && !SILVERFIR_INTERP_INPLACE_TCO
 // TODO: in the future we may allow JIT only mode.
 #error All interpreters are disabled.
 #endif
+
+// Enable the threads proposal: shared memories and the atomic instructions.
+// It requires C11 atomics, when disabled the modules using them are rejected.
+#if !defined(SILVERFIR_ENABLE_THREADS)
+    #if defined(__STDC_NO_ATOMICS__) || SILVERFIR_STACK_SLOT_32
+        #define SILVERFIR_ENABLE_THREADS 0
+    #else
+        #define SILVERFIR_ENABLE_THREADS 1
+    #endif
+#endif
+
+// A shared memory must not move, so its address space is reserved up to its max (see
+// mem_image.h). Where it can't be reserved, a shared memory with a max up to this many bytes
+// is allocated upfront instead, and a larger one is rejected.
+#if !defined(SILVERFIR_SHARED_MEMORY_HEAP_MAX)
+    #define SILVERFIR_SHARED_MEMORY_HEAP_MAX (16 * 1024 * 1024)
+#endif
+
+// Enable the fixed-width SIMD proposal. It's off by default because every stack slot, local
+// and global becomes 16 bytes wide so that a v128 fits in one slot, which doubles the stacks of
+// all the guests, not just the ones using v128.
+#if !defined(SILVERFIR_ENABLE_SIMD)
+    #define SILVERFIR_ENABLE_SIMD 0
+#endif
+
+#if SILVERFIR_STACK_SLOT_32 && (SILVERFIR_INTERP_INPLACE_TCO || SILVERFIR_ENABLE_THREADS || SILVERFIR_ENABLE_SIMD)
+#error The 32-bit stack slots only work with the DT interpreter, without SIMD and threads.
+#endif
+
+// Enable the memory64 proposal, the memories indexed with i64 instead of i32.
+#if !defined(SILVERFIR_ENABLE_MEMORY64)
+    #define SILVERFIR_ENABLE_MEMORY64 1
+#endif
+
+// Enable the custom-page-sizes proposal, so that a memory can declare 1-byte pages and allocate
+// exactly the size it asks for instead of multiples of 64KiB.
+#if !defined(SILVERFIR_ENABLE_CUSTOM_PAGE_SIZES)
+    #define SILVERFIR_ENABLE_CUSTOM_PAGE_SIZES 1
+#endif
+
+// The address space reserved upfront for a 64-bit memory so that it grows in place, capped by
+// the memory's max. Where it can't be reserved (see mem_image.h) the memory is reallocated as
+// it grows instead.
+#if !defined(SILVERFIR_MEMORY64_RESERVE)
+    #define SILVERFIR_MEMORY64_RESERVE (1ull << 40)
+#endif
+
+// The default budget in bytes of the decompressed function bodies of a module with compressed
+// code, see code_cache.h.
+#if !defined(SILVERFIR_CODE_CACHE_SIZE)
+    #define SILVERFIR_CODE_CACHE_SIZE (16 * 1024)
+#endif
+
+// Use malloc and free when no allocator is given (see alloc.h). Without it every allocation
+// fails until alloc_enter() picks one, e.g. a fixed buffer for the builds without a heap.
+#if !defined(SILVERFIR_SYSTEM_ALLOCATOR)
+    #define SILVERFIR_SYSTEM_ALLOCATOR 1
+#endif
+
+// The size of the blocks an arena allocator takes from its parent, the bigger allocations get
+// a block of their own.
+#if !defined(SILVERFIR_ARENA_CHUNK_SIZE)
+    #define SILVERFIR_ARENA_CHUNK_SIZE (16 * 1024)
+#endif
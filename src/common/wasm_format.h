@@ -16,13 +16,16 @@
 
 #pragma once
 
+#include "silverfir.h"
 #include "types.h"
 #include "vec.h"
 
 #include <stdbool.h>
 
 #define WASM_PAGE_SIZE (65536)
+#define WASM_PAGE_SIZE_LOG2 (16)
 #define WASM_MEM_MAX_PAGES (65536)
+#define WASM_MEM64_MAX_PAGES (1ull << 48)
 
 // sections, in order
 #define FOR_EACH_WASM_SECTION(macro) \
@@ -86,6 +89,20 @@ VEC_DECL_FOR_TYPE(type_id)
 RESULT_TYPE_DECL(type_id)
 RESULT_TYPE_DECL(vec_type_id)
 
+// little-endian lanes, the same layout as in the linear memory.
+typedef union v128 {
+    u8 u8x16[16];
+    i8 i8x16[16];
+    u16 u16x8[8];
+    i16 i16x8[8];
+    u32 u32x4[4];
+    i32 i32x4[4];
+    u64 u64x2[2];
+    i64 i64x2[2];
+    f32 f32x4[4];
+    f64 f64x2[2];
+} v128;
+
 typedef union value_u {
     i32 u_i32;
     i64 u_i64;
@@ -95,10 +112,46 @@ typedef union value_u {
     // u32 and u64 are not wasm basic types. We use it for easier reinterpretation casts.
     u32 u_u32;
     u64 u_u64;
+#if SILVERFIR_ENABLE_SIMD
+    v128 u_v128;
+#endif
 } value_u;
 VEC_DECL_FOR_TYPE(value_u)
 RESULT_TYPE_DECL(value_u)
 
+// The operand stack and the locals are arrays of slots. A slot is a whole value_u unless
+// SILVERFIR_STACK_SLOT_32 is on, then the values wider than 4 bytes take more than one slot,
+// the lower half first.
+#if SILVERFIR_STACK_SLOT_32
+typedef union value_slot {
+    i32 u_i32;
+    f32 u_f32;
+    u32 u_u32;
+} value_slot;
+#else
+typedef value_u value_slot;
+#endif
+
+#define SLOTS_OF(type) ((u32)((sizeof(type) + sizeof(value_slot) - 1) / sizeof(value_slot)))
+
+INLINE u32 type_slot_count(type_id id) {
+    switch (id) {
+        case TYPE_ID_i64:
+        case TYPE_ID_f64:
+            return SLOTS_OF(i64);
+        case TYPE_ID_funcref:
+        case TYPE_ID_externref:
+        case TYPE_ID_ref:
+            return SLOTS_OF(ref);
+#if SILVERFIR_ENABLE_SIMD
+        case TYPE_ID_v128:
+            return SLOTS_OF(v128);
+#endif
+        default:
+            return 1;
+    }
+}
+
 INLINE bool is_num(type_id id) {
     switch (id) {
         case TYPE_ID_i32:
@@ -113,7 +166,12 @@ INLINE bool is_num(type_id id) {
 }
 
 INLINE bool is_vec(type_id id) {
+#if SILVERFIR_ENABLE_SIMD
     return (id == TYPE_ID_v128) || (id == TYPE_ID_unknown);
+#else
+    // v128 doesn't fit in a stack slot, so the type is rejected everywhere.
+    return id == TYPE_ID_unknown;
+#endif
 }
 
 INLINE bool is_ref(type_id id) {
@@ -30,66 +30,28 @@
     #include "wasi_impl_uv.h"
 #endif
 
-const host_func_info * find_host_func_info(str name, const host_func_info * info, size_t info_len) {
-    for (size_t i = 0; i < info_len; i++) {
-        const host_func_info * in = &info[i];
-        if (str_eq(name, s_p(in->name))) {
-            return in;
-        }
-    }
-    return NULL;
-}
-
-r inject_host_functions(module * mod, const host_func_info * info, size_t info_len) {
-    check_prep(r);
-
-    VEC_FOR_EACH(&mod->exports, export, exp) {
-        if (exp->external_kind == EXTERNAL_KIND_Function) {
-            func * f = vec_at_func(&mod->funcs, exp->external_idx);
-            if (is_imported(f->linkage)) {
-                return err(e_general, "Host functions should not be marked as imported");
-            }
-            const host_func_info * in = find_host_func_info(exp->name, info, info_len);
-            if (!in) {
-                return err(e_general, "Missing hosted function implementation");
-            }
-            f->tr = in->tr;
-            f->host_func = in->host_func;
-        }
-    }
-    return ok_r;
-}
-
 r_module host_mod_new(str name) {
     check_prep(r_module);
 
 #ifdef SILVERFIR_ENABLE_SPECTEST
     if (str_eq(name, s("spectest"))) {
-        module mod = {0};
-        vstr mod_bin = vs_pl(spectest_wasm, spectest_wasm_len);
-        check(module_init(&mod, mod_bin, vs("spectest")), {
-            module_drop(&mod);
-        });
-        check(inject_host_functions(&mod, spectest_host_info, spectest_host_info_len), {
-            module_drop(&mod);
-        });
+        module mod = spectest_module_desc;
+        mod.serial = module_next_serial();
+        check(vec_push_vstr(&mod.names, vs("spectest")));
         return ok(mod);
     }
 #endif
 #ifdef SILVERFIR_ENABLE_WASI
     if (str_eq(name, s("wasi_snapshot_preview1"))) {
-        module mod = {0};
+        module mod = wasi_module_desc;
+        mod.serial = module_next_serial();
         wasi_ctx * wctx = wasi_ctx_get();
         if (!wctx) {
             return err(e_general, "Failed to create wasi context");
         }
         mod.resource_payload = wctx;
         mod.resource_drop_cb = wasi_ctx_drop;
-        vstr mod_bin = vs_pl(wasi_wasm, wasi_wasm_len);
-        check(module_init(&mod, mod_bin, vs("wasi_snapshot_preview1")), {
-            module_drop(&mod);
-        });
-        check(inject_host_functions(&mod, wasi_host_info, wasi_host_info_len), {
+        check(vec_push_vstr(&mod.names, vs("wasi_snapshot_preview1")), {
             module_drop(&mod);
         });
         check(module_register_name(&mod, vs("wasi_unstable")), {
@@ -21,15 +21,23 @@
 #include "trampoline.h"
 #include "vm.h"
 
-typedef struct host_func_info {
-    char * name;
-    trampoline tr;
-    void * host_func;
-} host_func_info;
-
 // native module instances works just like normal module instances where
 // exporting functions/memories/globals/tables are all allowed.
 // Except for the functions, everything else in the native modules are handles
 // the same way as normal modules.
+//
+// The host modules are not parsed at runtime. trampo_gen.py generates a constant module
+// descriptor from the interface wat file with the types, exports and trampolines all resolved,
+// and the vectors of the descriptor point to the static arrays directly. Creating a host module
+// is just a copy of the descriptor.
+
+// Wrap a static array into a fixed vector for the descriptors. The storage is not owned.
+#define HOST_MOD_VEC(type, arr)            \
+    {                                      \
+        ._size = array_len(arr),           \
+        ._capacity = array_len(arr),       \
+        ._data = (type *)(arr),            \
+        .fixed = true,                     \
+    }
 
 r_module host_mod_new(str name);
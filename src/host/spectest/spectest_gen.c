@@ -7,29 +7,6 @@
 #include <stddef.h>
 #include "spectest_gen.h"
 
-const size_t spectest_wasm_len = 283;
-
-const u8 spectest_wasm[] = {
-0x00,0x61,0x73,0x6d,0x01,0x00,0x00,0x00,0x01,0x1e,0x07,0x60,0x00,0x00,0x60,0x01,
-0x7f,0x00,0x60,0x01,0x7e,0x00,0x60,0x01,0x7d,0x00,0x60,0x01,0x7c,0x00,0x60,0x02,
-0x7f,0x7d,0x00,0x60,0x02,0x7c,0x7c,0x00,0x03,0x08,0x07,0x00,0x01,0x02,0x03,0x04,
-0x05,0x06,0x04,0x05,0x01,0x70,0x01,0x0a,0x14,0x05,0x04,0x01,0x01,0x01,0x02,0x06,
-0x21,0x04,0x7f,0x00,0x41,0x9a,0x05,0x0b,0x7e,0x00,0x42,0x9a,0x05,0x0b,0x7d,0x00,
-0x43,0x00,0x80,0x26,0x44,0x0b,0x7c,0x00,0x44,0x00,0x00,0x00,0x00,0x00,0xd0,0x84,
-0x40,0x0b,0x07,0x9e,0x01,0x0d,0x05,0x70,0x72,0x69,0x6e,0x74,0x00,0x00,0x09,0x70,
-0x72,0x69,0x6e,0x74,0x5f,0x69,0x33,0x32,0x00,0x01,0x09,0x70,0x72,0x69,0x6e,0x74,
-0x5f,0x69,0x36,0x34,0x00,0x02,0x09,0x70,0x72,0x69,0x6e,0x74,0x5f,0x66,0x33,0x32,
-0x00,0x03,0x09,0x70,0x72,0x69,0x6e,0x74,0x5f,0x66,0x36,0x34,0x00,0x04,0x0d,0x70,
-0x72,0x69,0x6e,0x74,0x5f,0x69,0x33,0x32,0x5f,0x66,0x33,0x32,0x00,0x05,0x0d,0x70,
-0x72,0x69,0x6e,0x74,0x5f,0x66,0x36,0x34,0x5f,0x66,0x36,0x34,0x00,0x06,0x05,0x74,
-0x61,0x62,0x6c,0x65,0x01,0x00,0x06,0x6d,0x65,0x6d,0x6f,0x72,0x79,0x02,0x00,0x0a,
-0x67,0x6c,0x6f,0x62,0x61,0x6c,0x5f,0x69,0x33,0x32,0x03,0x00,0x0a,0x67,0x6c,0x6f,
-0x62,0x61,0x6c,0x5f,0x69,0x36,0x34,0x03,0x01,0x0a,0x67,0x6c,0x6f,0x62,0x61,0x6c,
-0x5f,0x66,0x33,0x32,0x03,0x02,0x0a,0x67,0x6c,0x6f,0x62,0x61,0x6c,0x5f,0x66,0x36,
-0x34,0x03,0x03,0x0a,0x16,0x07,0x02,0x00,0x0b,0x02,0x00,0x0b,0x02,0x00,0x0b,0x02,
-0x00,0x0b,0x02,0x00,0x0b,0x02,0x00,0x0b,0x02,0x00,0x0b
-};
-
 typedef r (*_p__tr_void_result_void__)(tr_ctx);
 static r __tr_void_result_void__ (tr_ctx ctx, void * f) {
     check_prep(r);
@@ -80,14 +57,100 @@ static r __tr_f64_f64_result_void__ (tr_ctx ctx, void * f) {
 }
 
 
-const host_func_info spectest_host_info[] = {
-    {"print", __tr_void_result_void__, (void*)spectest_print},
-    {"print_i32", __tr_i32_result_void__, (void*)spectest_print_i32},
-    {"print_i64", __tr_i64_result_void__, (void*)spectest_print_i64},
-    {"print_f32", __tr_f32_result_void__, (void*)spectest_print_f32},
-    {"print_f64", __tr_f64_result_void__, (void*)spectest_print_f64},
-    {"print_i32_f32", __tr_i32_f32_result_void__, (void*)spectest_print_i32_f32},
-    {"print_f64_f64", __tr_f64_f64_result_void__, (void*)spectest_print_f64_f64},
+static const func_type spectest_func_types[] = {
+    {.param_count = 0, .result_count = 0, .params = {0}, .results = {0}},
+    {.param_count = 1, .result_count = 0, .params = {(str_iter_t) "\x7f", 1}, .results = {0}},
+    {.param_count = 1, .result_count = 0, .params = {(str_iter_t) "\x7e", 1}, .results = {0}},
+    {.param_count = 1, .result_count = 0, .params = {(str_iter_t) "\x7d", 1}, .results = {0}},
+    {.param_count = 1, .result_count = 0, .params = {(str_iter_t) "\x7c", 1}, .results = {0}},
+    {.param_count = 2, .result_count = 0, .params = {(str_iter_t) "\x7f\x7d", 2}, .results = {0}},
+    {.param_count = 2, .result_count = 0, .params = {(str_iter_t) "\x7c\x7c", 2}, .results = {0}},
+};
+
+static const func spectest_funcs[] = {
+    {.fn_type = {.param_count = 0, .result_count = 0, .params = {0}, .results = {0}}, .linkage = linkage_exported, .local_count = 0, .tr = __tr_void_result_void__, .host_func = (void *)spectest_print},
+    {.fn_type = {.param_count = 1, .result_count = 0, .params = {(str_iter_t) "\x7f", 1}, .results = {0}}, .linkage = linkage_exported, .local_count = 1, .tr = __tr_i32_result_void__, .host_func = (void *)spectest_print_i32},
+    {.fn_type = {.param_count = 1, .result_count = 0, .params = {(str_iter_t) "\x7e", 1}, .results = {0}}, .linkage = linkage_exported, .local_count = 1, .tr = __tr_i64_result_void__, .host_func = (void *)spectest_print_i64},
+    {.fn_type = {.param_count = 1, .result_count = 0, .params = {(str_iter_t) "\x7d", 1}, .results = {0}}, .linkage = linkage_exported, .local_count = 1, .tr = __tr_f32_result_void__, .host_func = (void *)spectest_print_f32},
+    {.fn_type = {.param_count = 1, .result_count = 0, .params = {(str_iter_t) "\x7c", 1}, .results = {0}}, .linkage = linkage_exported, .local_count = 1, .tr = __tr_f64_result_void__, .host_func = (void *)spectest_print_f64},
+    {.fn_type = {.param_count = 2, .result_count = 0, .params = {(str_iter_t) "\x7f\x7d", 2}, .results = {0}}, .linkage = linkage_exported, .local_count = 2, .tr = __tr_i32_f32_result_void__, .host_func = (void *)spectest_print_i32_f32},
+    {.fn_type = {.param_count = 2, .result_count = 0, .params = {(str_iter_t) "\x7c\x7c", 2}, .results = {0}}, .linkage = linkage_exported, .local_count = 2, .tr = __tr_f64_f64_result_void__, .host_func = (void *)spectest_print_f64_f64},
+};
+
+static const table spectest_tables[] = {
+    {.valtype = TYPE_ID_funcref, .lim = {10, 20}, .linkage = linkage_exported},
+};
+
+static const memory spectest_memories[] = {
+    {.lim = {1, 2}, .linkage = linkage_exported},
 };
 
-const size_t spectest_host_info_len = array_len(spectest_host_info);
+static const global spectest_globals[] = {
+    {.valtype = TYPE_ID_i32, .mut = false, .expr = {(str_iter_t) "\x41\x9a\x05\x0b", 4}, .linkage = linkage_exported},
+    {.valtype = TYPE_ID_i64, .mut = false, .expr = {(str_iter_t) "\x42\x9a\x05\x0b", 4}, .linkage = linkage_exported},
+    {.valtype = TYPE_ID_f32, .mut = false, .expr = {(str_iter_t) "\x43\x00\x80\x26\x44\x0b", 6}, .linkage = linkage_exported},
+    {.valtype = TYPE_ID_f64, .mut = false, .expr = {(str_iter_t) "\x44\x00\x00\x00\x00\x00\xd0\x84\x40\x0b", 10}, .linkage = linkage_exported},
+};
+
+static const export spectest_exports[] = {
+    {.name = {(str_iter_t) "print", 5}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 0},
+    {.name = {(str_iter_t) "print_i32", 9}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 1},
+    {.name = {(str_iter_t) "print_i64", 9}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 2},
+    {.name = {(str_iter_t) "print_f32", 9}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 3},
+    {.name = {(str_iter_t) "print_f64", 9}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 4},
+    {.name = {(str_iter_t) "print_i32_f32", 13}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 5},
+    {.name = {(str_iter_t) "print_f64_f64", 13}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 6},
+    {.name = {(str_iter_t) "table", 5}, .external_kind = EXTERNAL_KIND_Table, .external_idx = 0},
+    {.name = {(str_iter_t) "memory", 6}, .external_kind = EXTERNAL_KIND_Memory, .external_idx = 0},
+    {.name = {(str_iter_t) "global_i32", 10}, .external_kind = EXTERNAL_KIND_Global, .external_idx = 0},
+    {.name = {(str_iter_t) "global_i64", 10}, .external_kind = EXTERNAL_KIND_Global, .external_idx = 1},
+    {.name = {(str_iter_t) "global_f32", 10}, .external_kind = EXTERNAL_KIND_Global, .external_idx = 2},
+    {.name = {(str_iter_t) "global_f64", 10}, .external_kind = EXTERNAL_KIND_Global, .external_idx = 3},
+};
+
+static const str_map_entry spectest_export_index[] = {
+    {.key = {(str_iter_t) "global_i32", 10}, .value = 9, .used = true},
+    {.used = false},
+    {.key = {(str_iter_t) "global_f32", 10}, .value = 11, .used = true},
+    {.used = false},
+    {.key = {(str_iter_t) "print_f64_f64", 13}, .value = 6, .used = true},
+    {.key = {(str_iter_t) "global_i64", 10}, .value = 10, .used = true},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "print", 5}, .value = 0, .used = true},
+    {.key = {(str_iter_t) "print_i32_f32", 13}, .value = 5, .used = true},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "global_f64", 10}, .value = 12, .used = true},
+    {.key = {(str_iter_t) "memory", 6}, .value = 8, .used = true},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "print_f32", 9}, .value = 3, .used = true},
+    {.key = {(str_iter_t) "print_i32", 9}, .value = 1, .used = true},
+    {.key = {(str_iter_t) "print_i64", 9}, .value = 2, .used = true},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "print_f64", 9}, .value = 4, .used = true},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "table", 5}, .value = 7, .used = true},
+};
+
+const module spectest_module_desc = {
+    .format_version = 1,
+    .func_types = HOST_MOD_VEC(func_type, spectest_func_types),
+    .funcs = HOST_MOD_VEC(func, spectest_funcs),
+    .tables = HOST_MOD_VEC(table, spectest_tables),
+    .memories = HOST_MOD_VEC(memory, spectest_memories),
+    .globals = HOST_MOD_VEC(global, spectest_globals),
+    .exports = HOST_MOD_VEC(export, spectest_exports),
+    .export_index = {.slots = HOST_MOD_VEC(str_map_entry, spectest_export_index), .count = 13},
+    .is_static = true,
+};
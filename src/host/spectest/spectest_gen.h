@@ -5,13 +5,8 @@
 #include "vm.h"
 #include <stddef.h>
 
-extern const u8 spectest_wasm[];
-
-extern const size_t spectest_wasm_len;
-
-extern const host_func_info spectest_host_info[];
-
-extern const size_t spectest_host_info_len;
+// The module with everything resolved, see host_modules.h
+extern const module spectest_module_desc;
 
 // The following functions needs to be manually implemented
 extern r spectest_print (tr_ctx);
@@ -4,40 +4,19 @@
 import argparse
 import os
 import re
-import shutil
-import subprocess
+import struct
 import sys
 
-def normalize(text):
-    for ch in ['\\','`','*','{','}','[',']','(',')','>','#','+','-','.','!','$','\'']:
-        text = text.replace(ch,"_")
-    return text
-
 parser = argparse.ArgumentParser()
 parser.add_argument("file", help="Interface WAT file", type=str)
 parser.add_argument("out_dir", help="Output folder", type=str)
 args = parser.parse_args()
 
-wasm_file = args.file
-
-def to_hex(data):
-    counter = 0
-    hexdata = []
-    for b in data:
-        hexdata.append("0x{0:02x},".format(b))
-        counter = counter + 1
-        if counter == 16:
-            hexdata.append("\n");
-            counter = 0
-    hexdata[-1] = hexdata[-1].rstrip(',')
-    return hexdata
+TYPE_IDS = {"i32": 0x7f, "i64": 0x7e, "f32": 0x7d, "f64": 0x7c, "funcref": 0x70, "externref": 0x6f}
 
 # I know I know this code is ugly as hell but whatever
 
-def write_wasm_binary_info(fout_h, fout_c, wasm_file):
-    wasm_data = wasm_file.read() # it's fine to read everything into memory since we're not like converting huge binary file into headers.
-    var_name = normalize(os.path.basename(wasm_file.name))
-    module_name = os.path.splitext(os.path.basename(wasm_file.name))[0]
+def write_headers(fout_h, fout_c, module_name):
     fout_c.write("// Generated from " + module_name + ".wat do not modify!\n")
     fout_c.write("\n#include \"types.h\"")
     fout_c.write("\n#include \"trampoline.h\"")
@@ -45,57 +24,85 @@ def write_wasm_binary_info(fout_h, fout_c, wasm_file):
     fout_c.write("\n#include \"vm.h\"")
     fout_c.write("\n#include <stddef.h>")
     fout_c.write("\n#include \"{}_gen.h\"".format(module_name))
-    fout_c.write("\n")
-    fout_c.write("\nconst size_t {}_len = {};\n".format(var_name, len(wasm_data)))
-    fout_c.write("\nconst u8 {}[] = {{\n".format(var_name))
-    fout_c.write("".join(to_hex(wasm_data)))
-    fout_c.write("\n};\n\n")
+    fout_c.write("\n\n")
     fout_h.write("// Generated from " + module_name + ".wat do not modify!\n")
     fout_h.write("\n#include \"host_modules.h\"")
     fout_h.write("\n#include \"types.h\"")
     fout_h.write("\n#include \"vm.h\"")
     fout_h.write("\n#include <stddef.h>")
     fout_h.write("\n")
-    fout_h.write("\nextern const u8 {}[];\n".format(var_name))
-    fout_h.write("\nextern const size_t {}_len;\n".format(var_name))
-    fout_h.write("\nextern const host_func_info {}_host_info[];\n".format(module_name))
-    fout_h.write("\nextern const size_t {}_host_info_len;\n".format(module_name))
+    fout_h.write("\n// The module with everything resolved, see host_modules.h\n")
+    fout_h.write("extern const module {}_module_desc;\n".format(module_name))
     return 0
 
-def process_wat(wat_file, out_dir):
-    if shutil.which("wat2wasm") is None:
-        sys.stderr.write("wat2wasm not found. Please make sure it's in the PATH")
-        return None
-    wasm_file = os.path.splitext(os.path.basename(wat_file))[0] +".wasm"
-    cmd = ["wat2wasm", wat_file, "-o", os.path.join(out_dir, wasm_file)]
-    return_code = subprocess.call(cmd)
-    if return_code != 0:
-        return None
-    return os.path.join(out_dir, wasm_file)
+def sleb(val):
+    out = []
+    while True:
+        b = val & 0x7f
+        val >>= 7
+        if (val == 0 and not (b & 0x40)) or (val == -1 and (b & 0x40)):
+            out.append(b)
+            return out
+        out.append(b | 0x80)
+
+# the const expr in binary form, including the end opcode.
+def const_expr(vtype, literal):
+    if vtype == "i32":
+        return [0x41] + sleb(int(literal, 0))
+    if vtype == "i64":
+        return [0x42] + sleb(int(literal, 0))
+    if vtype == "f32":
+        return [0x43] + list(struct.pack("<f", float(literal)))
+    if vtype == "f64":
+        return [0x44] + list(struct.pack("<d", float(literal)))
+    return None
 
 # It's not necessary to fully parse the s-expr. A simple regexp should just work but you have to keep everything in
 # one line
-def get_function_signatures(fout_h, fout_c, wat_file_name):
+def get_module_items(wat_file_name):
     wat_file = open(wat_file_name, "r")
     lines = wat_file.readlines()
-    sigs = []
+    wat_file.close()
+    items = {"func": [], "table": [], "memory": [], "global": [], "export": []}
     re_func = re.compile(r'^.*func.*export\s*"([a-zA-Z0-9_]*)"\)')
     re_param = re.compile(r'\(param\s*(.+?)\)')
     re_result = re.compile(r'\(result\s*(.+?)\)')
+    re_table = re.compile(r'^\s*\(table\s*\(export\s*"([a-zA-Z0-9_]*)"\)\s*(\d+)\s*(\d*)\s*(funcref|externref)\)')
+    re_memory = re.compile(r'^\s*\(memory\s*\(export\s*"([a-zA-Z0-9_]*)"\)\s*(\d+)\s*(\d*)\)')
+    re_global = re.compile(r'^\s*\(global\s*\(export\s*"([a-zA-Z0-9_]*)"\)\s*(i32|i64|f32|f64)\s*\((\w+)\.const\s*([^)]+)\)\)')
     for line in lines:
-        fsig = {}
         fn = re_func.search(line)
-        if fn == None:
-            continue;
-        fsig["name"] = fn.group(1)
-        pa = re_param.search(line)
-        if pa != None:
-            fsig["param"] = pa.group(1).split()
-        res = re_result.search(line)
-        if res != None:
-            fsig["result"] = res.group(1).split()
-        sigs.append(fsig)
-    return sigs
+        if fn != None:
+            fsig = {"name": fn.group(1)}
+            pa = re_param.search(line)
+            if pa != None:
+                fsig["param"] = pa.group(1).split()
+            res = re_result.search(line)
+            if res != None:
+                fsig["result"] = res.group(1).split()
+            items["export"].append((fsig["name"], "Function", len(items["func"])))
+            items["func"].append(fsig)
+            continue
+        tab = re_table.search(line)
+        if tab != None:
+            items["export"].append((tab.group(1), "Table", len(items["table"])))
+            items["table"].append({"min": tab.group(2), "max": tab.group(3) or "u32_MAX", "type": tab.group(4)})
+            continue
+        mem = re_memory.search(line)
+        if mem != None:
+            items["export"].append((mem.group(1), "Memory", len(items["memory"])))
+            items["memory"].append({"min": mem.group(2), "max": mem.group(3) or "WASM_MEM_MAX_PAGES"})
+            continue
+        glob = re_global.search(line)
+        if glob != None:
+            expr = const_expr(glob.group(3), glob.group(4).strip())
+            if expr == None or glob.group(2) != glob.group(3):
+                sys.stderr.write("Unsupported global: " + line)
+                return None
+            items["export"].append((glob.group(1), "Global", len(items["global"])))
+            items["global"].append({"type": glob.group(2), "expr": expr + [0x0b]})
+            continue
+    return items
 
 def write_func_decl(fout_h, sigs, prefix):
     fout_h.write("\n// The following functions needs to be manually implemented")
@@ -159,20 +166,108 @@ def write_trampoline(fout_c, sigs):
         write_trampoline_func(fout_c, tr_name, param, result)
     return 0
 
-def write_host_info(fout_c, sigs, prefix):
-    fout_c.write("\nconst host_func_info {}_host_info[] = {{\n".format(prefix));
-    for sig in sigs:
-        param = ["void"]
-        result = ["void"]
-        fname = sig["name"]
-        if "param" in sig:
-            param = sig["param"]
-        if "result" in sig:
-            result = sig["result"]
-        tr_name = to_tr_name(param, result)
-        fout_c.write('    {{"{}", {}, (void*){}}},\n'.format(fname, tr_name, prefix + "_" + fname))
-    fout_c.write("};\n");
-    fout_c.write("\nconst size_t {}_host_info_len = array_len({}_host_info);\n".format(prefix, prefix))
+def to_c_str(data):
+    if len(data) == 0:
+        return "{0}"
+    return '{{(str_iter_t) "{}", {}}}'.format("".join("\\x{0:02x}".format(b) for b in data), len(data))
+
+def to_c_func_type(sig):
+    param = [TYPE_IDS[t] for t in sig.get("param", [])]
+    result = [TYPE_IDS[t] for t in sig.get("result", [])]
+    return "{{.param_count = {}, .result_count = {}, .params = {}, .results = {}}}".format(
+        len(param), len(result), to_c_str(param), to_c_str(result))
+
+def to_c_vec(type_name, array_name, count):
+    if count == 0:
+        return "{0}"
+    return "HOST_MOD_VEC({}, {})".format(type_name, array_name)
+
+# Same as str_hash()
+def fnv1a(data):
+    h = 2166136261
+    for b in data:
+        h = ((h ^ b) * 16777619) & 0xffffffff
+    return h
+
+# The str_map slots of the export names, see str_map.h. The load factor is kept under 1/2 and
+# the capacity is a power of two, with linear probing.
+def build_export_index(exports):
+    if len(exports) == 0:
+        return []
+    capacity = 8
+    while capacity < len(exports) * 2:
+        capacity *= 2
+    slots = [None] * capacity
+    for (idx, (name, kind, _)) in enumerate(exports):
+        i = fnv1a(name.encode()) & (capacity - 1)
+        while slots[i] != None:
+            i = (i + 1) & (capacity - 1)
+        slots[i] = (name, idx)
+    return slots
+
+# Everything the parser would produce from the wasm binary, resolved at build time so that
+# the module can be used as-is.
+def write_descriptor(fout_c, items, prefix):
+    func_types = []
+    for sig in items["func"]:
+        ft = to_c_func_type(sig)
+        if ft not in func_types:
+            func_types.append(ft)
+    if len(func_types):
+        fout_c.write("\nstatic const func_type {}_func_types[] = {{\n".format(prefix))
+        for ft in func_types:
+            fout_c.write("    {},\n".format(ft))
+        fout_c.write("};\n")
+    if len(items["func"]):
+        fout_c.write("\nstatic const func {}_funcs[] = {{\n".format(prefix))
+        for sig in items["func"]:
+            param = sig.get("param", ["void"])
+            result = sig.get("result", ["void"])
+            fout_c.write("    {{.fn_type = {}, .linkage = linkage_exported, .local_count = {}, .tr = {}, .host_func = (void *){}}},\n".format(
+                to_c_func_type(sig), len(sig.get("param", [])), to_tr_name(param, result), prefix + "_" + sig["name"]))
+        fout_c.write("};\n")
+    if len(items["table"]):
+        fout_c.write("\nstatic const table {}_tables[] = {{\n".format(prefix))
+        for tab in items["table"]:
+            fout_c.write("    {{.valtype = TYPE_ID_{}, .lim = {{{}, {}}}, .linkage = linkage_exported}},\n".format(tab["type"], tab["min"], tab["max"]))
+        fout_c.write("};\n")
+    if len(items["memory"]):
+        fout_c.write("\nstatic const memory {}_memories[] = {{\n".format(prefix))
+        for mem in items["memory"]:
+            fout_c.write("    {{.lim = {{{}, {}}}, .linkage = linkage_exported}},\n".format(mem["min"], mem["max"]))
+        fout_c.write("};\n")
+    if len(items["global"]):
+        fout_c.write("\nstatic const global {}_globals[] = {{\n".format(prefix))
+        for glob in items["global"]:
+            fout_c.write("    {{.valtype = TYPE_ID_{}, .mut = false, .expr = {}, .linkage = linkage_exported}},\n".format(glob["type"], to_c_str(glob["expr"])))
+        fout_c.write("};\n")
+    if len(items["export"]):
+        fout_c.write("\nstatic const export {}_exports[] = {{\n".format(prefix))
+        for (name, kind, idx) in items["export"]:
+            fout_c.write('    {{.name = {}, .external_kind = EXTERNAL_KIND_{}, .external_idx = {}}},\n'.format('{{(str_iter_t) "{}", {}}}'.format(name, len(name)), kind, idx))
+        fout_c.write("};\n")
+    index = build_export_index(items["export"])
+    if len(index):
+        fout_c.write("\nstatic const str_map_entry {}_export_index[] = {{\n".format(prefix))
+        for entry in index:
+            if entry == None:
+                fout_c.write("    {.used = false},\n")
+            else:
+                (name, idx) = entry
+                fout_c.write('    {{.key = {{(str_iter_t) "{}", {}}}, .value = {}, .used = true}},\n'.format(name, len(name), idx))
+        fout_c.write("};\n")
+    fout_c.write("\nconst module {}_module_desc = {{\n".format(prefix))
+    fout_c.write("    .format_version = 1,\n")
+    fout_c.write("    .func_types = {},\n".format(to_c_vec("func_type", prefix + "_func_types", len(func_types))))
+    fout_c.write("    .funcs = {},\n".format(to_c_vec("func", prefix + "_funcs", len(items["func"]))))
+    fout_c.write("    .tables = {},\n".format(to_c_vec("table", prefix + "_tables", len(items["table"]))))
+    fout_c.write("    .memories = {},\n".format(to_c_vec("memory", prefix + "_memories", len(items["memory"]))))
+    fout_c.write("    .globals = {},\n".format(to_c_vec("global", prefix + "_globals", len(items["global"]))))
+    fout_c.write("    .exports = {},\n".format(to_c_vec("export", prefix + "_exports", len(items["export"]))))
+    if len(index):
+        fout_c.write("    .export_index = {{.slots = HOST_MOD_VEC(str_map_entry, {}_export_index), .count = {}}},\n".format(prefix, len(items["export"])))
+    fout_c.write("    .is_static = true,\n")
+    fout_c.write("};\n")
 
 def do_convert(args):
     wat_file_name = args.file
@@ -185,32 +280,24 @@ def do_convert(args):
         sys.stderr.write("Target dir " + out_dir_name + " does not exist")
         return 1
 
-    wasm_file_name = process_wat(wat_file_name, out_dir_name)
-    if wasm_file_name == None:
+    # strip the wat part and use its basename for the .c and .h
+    name = os.path.splitext(os.path.basename(wat_file_name))[0]
+    items = get_module_items(wat_file_name)
+    if items == None:
         return 1
 
-    # strip the wat part and use its basename for the .c and .h
-    name = os.path.splitext(os.path.basename(wasm_file_name))[0]
     out_c = os.path.join(args.out_dir, name + "_gen.c")
     out_h = os.path.join(args.out_dir, name + "_gen.h")
     fout_c = open(out_c, 'w')
     fout_h = open(out_h, 'w')
-    fwasm = open(wasm_file_name, 'rb')
 
-    if write_wasm_binary_info(fout_h, fout_c, fwasm) != 0:
-        return 1
-
-    sigs = get_function_signatures(fout_h, fout_c, wat_file_name)
-    if sigs == None:
-        return 1
-
-    write_func_decl(fout_h, sigs, name)
-    write_trampoline(fout_c, sigs)
-    write_host_info(fout_c, sigs, name)
+    write_headers(fout_h, fout_c, name)
+    write_func_decl(fout_h, items["func"], name)
+    write_trampoline(fout_c, items["func"])
+    write_descriptor(fout_c, items, name)
 
     fout_c.close()
     fout_h.close()
-    fwasm.close()
-    os.remove(wasm_file_name)
+    return 0
 
 exit(do_convert(args))
@@ -7,83 +7,6 @@
 #include <stddef.h>
 #include "wasi_gen.h"
 
-const size_t wasi_wasm_len = 1144;
-
-const u8 wasi_wasm[] = {
-0x00,0x61,0x73,0x6d,0x01,0x00,0x00,0x00,0x01,0x86,0x01,0x11,0x60,0x02,0x7f,0x7f,
-0x01,0x7f,0x60,0x03,0x7f,0x7e,0x7f,0x01,0x7f,0x60,0x04,0x7f,0x7e,0x7e,0x7f,0x01,
-0x7f,0x60,0x03,0x7f,0x7e,0x7e,0x01,0x7f,0x60,0x01,0x7f,0x01,0x7f,0x60,0x02,0x7f,
-0x7e,0x01,0x7f,0x60,0x05,0x7f,0x7f,0x7f,0x7e,0x7f,0x01,0x7f,0x60,0x03,0x7f,0x7f,
-0x7f,0x01,0x7f,0x60,0x04,0x7f,0x7f,0x7f,0x7f,0x01,0x7f,0x60,0x04,0x7f,0x7e,0x7f,
-0x7f,0x01,0x7f,0x60,0x05,0x7f,0x7f,0x7f,0x7f,0x7f,0x01,0x7f,0x60,0x07,0x7f,0x7f,
-0x7f,0x7f,0x7e,0x7e,0x7f,0x01,0x7f,0x60,0x07,0x7f,0x7f,0x7f,0x7f,0x7f,0x7f,0x7f,
-0x01,0x7f,0x60,0x09,0x7f,0x7f,0x7f,0x7f,0x7f,0x7e,0x7e,0x7f,0x7f,0x01,0x7f,0x60,
-0x06,0x7f,0x7f,0x7f,0x7f,0x7f,0x7f,0x01,0x7f,0x60,0x01,0x7f,0x00,0x60,0x00,0x01,
-0x7f,0x03,0x2f,0x2e,0x00,0x00,0x00,0x01,0x00,0x00,0x02,0x03,0x04,0x04,0x00,0x00,
-0x03,0x00,0x05,0x02,0x06,0x07,0x00,0x06,0x08,0x06,0x00,0x09,0x04,0x00,0x08,0x07,
-0x0a,0x0b,0x0c,0x0d,0x0e,0x07,0x0e,0x0a,0x07,0x08,0x0f,0x04,0x00,0x10,0x07,0x0e,
-0x0a,0x00,0x07,0xcb,0x05,0x2e,0x08,0x61,0x72,0x67,0x73,0x5f,0x67,0x65,0x74,0x00,
-0x00,0x0e,0x61,0x72,0x67,0x73,0x5f,0x73,0x69,0x7a,0x65,0x73,0x5f,0x67,0x65,0x74,
-0x00,0x01,0x0d,0x63,0x6c,0x6f,0x63,0x6b,0x5f,0x72,0x65,0x73,0x5f,0x67,0x65,0x74,
-0x00,0x02,0x0e,0x63,0x6c,0x6f,0x63,0x6b,0x5f,0x74,0x69,0x6d,0x65,0x5f,0x67,0x65,
-0x74,0x00,0x03,0x0b,0x65,0x6e,0x76,0x69,0x72,0x6f,0x6e,0x5f,0x67,0x65,0x74,0x00,
-0x04,0x11,0x65,0x6e,0x76,0x69,0x72,0x6f,0x6e,0x5f,0x73,0x69,0x7a,0x65,0x73,0x5f,
-0x67,0x65,0x74,0x00,0x05,0x09,0x66,0x64,0x5f,0x61,0x64,0x76,0x69,0x73,0x65,0x00,
-0x06,0x0b,0x66,0x64,0x5f,0x61,0x6c,0x6c,0x6f,0x63,0x61,0x74,0x65,0x00,0x07,0x08,
-0x66,0x64,0x5f,0x63,0x6c,0x6f,0x73,0x65,0x00,0x08,0x0b,0x66,0x64,0x5f,0x64,0x61,
-0x74,0x61,0x73,0x79,0x6e,0x63,0x00,0x09,0x0d,0x66,0x64,0x5f,0x66,0x64,0x73,0x74,
-0x61,0x74,0x5f,0x67,0x65,0x74,0x00,0x0a,0x13,0x66,0x64,0x5f,0x66,0x64,0x73,0x74,
-0x61,0x74,0x5f,0x73,0x65,0x74,0x5f,0x66,0x6c,0x61,0x67,0x73,0x00,0x0b,0x14,0x66,
-0x64,0x5f,0x66,0x64,0x73,0x74,0x61,0x74,0x5f,0x73,0x65,0x74,0x5f,0x72,0x69,0x67,
-0x68,0x74,0x73,0x00,0x0c,0x0f,0x66,0x64,0x5f,0x66,0x69,0x6c,0x65,0x73,0x74,0x61,
-0x74,0x5f,0x67,0x65,0x74,0x00,0x0d,0x14,0x66,0x64,0x5f,0x66,0x69,0x6c,0x65,0x73,
-0x74,0x61,0x74,0x5f,0x73,0x65,0x74,0x5f,0x73,0x69,0x7a,0x65,0x00,0x0e,0x15,0x66,
-0x64,0x5f,0x66,0x69,0x6c,0x65,0x73,0x74,0x61,0x74,0x5f,0x73,0x65,0x74,0x5f,0x74,
-0x69,0x6d,0x65,0x73,0x00,0x0f,0x08,0x66,0x64,0x5f,0x70,0x72,0x65,0x61,0x64,0x00,
-0x10,0x13,0x66,0x64,0x5f,0x70,0x72,0x65,0x73,0x74,0x61,0x74,0x5f,0x64,0x69,0x72,
-0x5f,0x6e,0x61,0x6d,0x65,0x00,0x11,0x0e,0x66,0x64,0x5f,0x70,0x72,0x65,0x73,0x74,
-0x61,0x74,0x5f,0x67,0x65,0x74,0x00,0x12,0x09,0x66,0x64,0x5f,0x70,0x77,0x72,0x69,
-0x74,0x65,0x00,0x13,0x07,0x66,0x64,0x5f,0x72,0x65,0x61,0x64,0x00,0x14,0x0a,0x66,
-0x64,0x5f,0x72,0x65,0x61,0x64,0x64,0x69,0x72,0x00,0x15,0x0b,0x66,0x64,0x5f,0x72,
-0x65,0x6e,0x75,0x6d,0x62,0x65,0x72,0x00,0x16,0x07,0x66,0x64,0x5f,0x73,0x65,0x65,
-0x6b,0x00,0x17,0x07,0x66,0x64,0x5f,0x73,0x79,0x6e,0x63,0x00,0x18,0x07,0x66,0x64,
-0x5f,0x74,0x65,0x6c,0x6c,0x00,0x19,0x08,0x66,0x64,0x5f,0x77,0x72,0x69,0x74,0x65,
-0x00,0x1a,0x15,0x70,0x61,0x74,0x68,0x5f,0x63,0x72,0x65,0x61,0x74,0x65,0x5f,0x64,
-0x69,0x72,0x65,0x63,0x74,0x6f,0x72,0x79,0x00,0x1b,0x11,0x70,0x61,0x74,0x68,0x5f,
-0x66,0x69,0x6c,0x65,0x73,0x74,0x61,0x74,0x5f,0x67,0x65,0x74,0x00,0x1c,0x17,0x70,
-0x61,0x74,0x68,0x5f,0x66,0x69,0x6c,0x65,0x73,0x74,0x61,0x74,0x5f,0x73,0x65,0x74,
-0x5f,0x74,0x69,0x6d,0x65,0x73,0x00,0x1d,0x09,0x70,0x61,0x74,0x68,0x5f,0x6c,0x69,
-0x6e,0x6b,0x00,0x1e,0x09,0x70,0x61,0x74,0x68,0x5f,0x6f,0x70,0x65,0x6e,0x00,0x1f,
-0x0d,0x70,0x61,0x74,0x68,0x5f,0x72,0x65,0x61,0x64,0x6c,0x69,0x6e,0x6b,0x00,0x20,
-0x15,0x70,0x61,0x74,0x68,0x5f,0x72,0x65,0x6d,0x6f,0x76,0x65,0x5f,0x64,0x69,0x72,
-0x65,0x63,0x74,0x6f,0x72,0x79,0x00,0x21,0x0b,0x70,0x61,0x74,0x68,0x5f,0x72,0x65,
-0x6e,0x61,0x6d,0x65,0x00,0x22,0x0c,0x70,0x61,0x74,0x68,0x5f,0x73,0x79,0x6d,0x6c,
-0x69,0x6e,0x6b,0x00,0x23,0x10,0x70,0x61,0x74,0x68,0x5f,0x75,0x6e,0x6c,0x69,0x6e,
-0x6b,0x5f,0x66,0x69,0x6c,0x65,0x00,0x24,0x0b,0x70,0x6f,0x6c,0x6c,0x5f,0x6f,0x6e,
-0x65,0x6f,0x66,0x66,0x00,0x25,0x09,0x70,0x72,0x6f,0x63,0x5f,0x65,0x78,0x69,0x74,
-0x00,0x26,0x0a,0x70,0x72,0x6f,0x63,0x5f,0x72,0x61,0x69,0x73,0x65,0x00,0x27,0x0a,
-0x72,0x61,0x6e,0x64,0x6f,0x6d,0x5f,0x67,0x65,0x74,0x00,0x28,0x0b,0x73,0x63,0x68,
-0x65,0x64,0x5f,0x79,0x69,0x65,0x6c,0x64,0x00,0x29,0x0b,0x73,0x6f,0x63,0x6b,0x5f,
-0x61,0x63,0x63,0x65,0x70,0x74,0x00,0x2a,0x09,0x73,0x6f,0x63,0x6b,0x5f,0x72,0x65,
-0x63,0x76,0x00,0x2b,0x09,0x73,0x6f,0x63,0x6b,0x5f,0x73,0x65,0x6e,0x64,0x00,0x2c,
-0x0d,0x73,0x6f,0x63,0x6b,0x5f,0x73,0x68,0x75,0x74,0x64,0x6f,0x77,0x6e,0x00,0x2d,
-0x0a,0xe5,0x01,0x2e,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,
-0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,
-0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,
-0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,
-0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,
-0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,
-0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,
-0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,
-0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,
-0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,
-0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,
-0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,
-0x01,0x0b,0x02,0x00,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,
-0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b,0x04,0x00,
-0x41,0x01,0x0b,0x04,0x00,0x41,0x01,0x0b
-};
-
 typedef r (*_p__tr_i32_i32_result_i32__)(tr_ctx, i32, i32, i32*);
 static r __tr_i32_i32_result_i32__ (tr_ctx ctx, void * f) {
     check_prep(r);
@@ -236,53 +159,263 @@ static r __tr_void_result_i32__ (tr_ctx ctx, void * f) {
 }
 
 
-const host_func_info wasi_host_info[] = {
-    {"args_get", __tr_i32_i32_result_i32__, (void*)wasi_args_get},
-    {"args_sizes_get", __tr_i32_i32_result_i32__, (void*)wasi_args_sizes_get},
-    {"clock_res_get", __tr_i32_i32_result_i32__, (void*)wasi_clock_res_get},
-    {"clock_time_get", __tr_i32_i64_i32_result_i32__, (void*)wasi_clock_time_get},
-    {"environ_get", __tr_i32_i32_result_i32__, (void*)wasi_environ_get},
-    {"environ_sizes_get", __tr_i32_i32_result_i32__, (void*)wasi_environ_sizes_get},
-    {"fd_advise", __tr_i32_i64_i64_i32_result_i32__, (void*)wasi_fd_advise},
-    {"fd_allocate", __tr_i32_i64_i64_result_i32__, (void*)wasi_fd_allocate},
-    {"fd_close", __tr_i32_result_i32__, (void*)wasi_fd_close},
-    {"fd_datasync", __tr_i32_result_i32__, (void*)wasi_fd_datasync},
-    {"fd_fdstat_get", __tr_i32_i32_result_i32__, (void*)wasi_fd_fdstat_get},
-    {"fd_fdstat_set_flags", __tr_i32_i32_result_i32__, (void*)wasi_fd_fdstat_set_flags},
-    {"fd_fdstat_set_rights", __tr_i32_i64_i64_result_i32__, (void*)wasi_fd_fdstat_set_rights},
-    {"fd_filestat_get", __tr_i32_i32_result_i32__, (void*)wasi_fd_filestat_get},
-    {"fd_filestat_set_size", __tr_i32_i64_result_i32__, (void*)wasi_fd_filestat_set_size},
-    {"fd_filestat_set_times", __tr_i32_i64_i64_i32_result_i32__, (void*)wasi_fd_filestat_set_times},
-    {"fd_pread", __tr_i32_i32_i32_i64_i32_result_i32__, (void*)wasi_fd_pread},
-    {"fd_prestat_dir_name", __tr_i32_i32_i32_result_i32__, (void*)wasi_fd_prestat_dir_name},
-    {"fd_prestat_get", __tr_i32_i32_result_i32__, (void*)wasi_fd_prestat_get},
-    {"fd_pwrite", __tr_i32_i32_i32_i64_i32_result_i32__, (void*)wasi_fd_pwrite},
-    {"fd_read", __tr_i32_i32_i32_i32_result_i32__, (void*)wasi_fd_read},
-    {"fd_readdir", __tr_i32_i32_i32_i64_i32_result_i32__, (void*)wasi_fd_readdir},
-    {"fd_renumber", __tr_i32_i32_result_i32__, (void*)wasi_fd_renumber},
-    {"fd_seek", __tr_i32_i64_i32_i32_result_i32__, (void*)wasi_fd_seek},
-    {"fd_sync", __tr_i32_result_i32__, (void*)wasi_fd_sync},
-    {"fd_tell", __tr_i32_i32_result_i32__, (void*)wasi_fd_tell},
-    {"fd_write", __tr_i32_i32_i32_i32_result_i32__, (void*)wasi_fd_write},
-    {"path_create_directory", __tr_i32_i32_i32_result_i32__, (void*)wasi_path_create_directory},
-    {"path_filestat_get", __tr_i32_i32_i32_i32_i32_result_i32__, (void*)wasi_path_filestat_get},
-    {"path_filestat_set_times", __tr_i32_i32_i32_i32_i64_i64_i32_result_i32__, (void*)wasi_path_filestat_set_times},
-    {"path_link", __tr_i32_i32_i32_i32_i32_i32_i32_result_i32__, (void*)wasi_path_link},
-    {"path_open", __tr_i32_i32_i32_i32_i32_i64_i64_i32_i32_result_i32__, (void*)wasi_path_open},
-    {"path_readlink", __tr_i32_i32_i32_i32_i32_i32_result_i32__, (void*)wasi_path_readlink},
-    {"path_remove_directory", __tr_i32_i32_i32_result_i32__, (void*)wasi_path_remove_directory},
-    {"path_rename", __tr_i32_i32_i32_i32_i32_i32_result_i32__, (void*)wasi_path_rename},
-    {"path_symlink", __tr_i32_i32_i32_i32_i32_result_i32__, (void*)wasi_path_symlink},
-    {"path_unlink_file", __tr_i32_i32_i32_result_i32__, (void*)wasi_path_unlink_file},
-    {"poll_oneoff", __tr_i32_i32_i32_i32_result_i32__, (void*)wasi_poll_oneoff},
-    {"proc_exit", __tr_i32_result_void__, (void*)wasi_proc_exit},
-    {"proc_raise", __tr_i32_result_i32__, (void*)wasi_proc_raise},
-    {"random_get", __tr_i32_i32_result_i32__, (void*)wasi_random_get},
-    {"sched_yield", __tr_void_result_i32__, (void*)wasi_sched_yield},
-    {"sock_accept", __tr_i32_i32_i32_result_i32__, (void*)wasi_sock_accept},
-    {"sock_recv", __tr_i32_i32_i32_i32_i32_i32_result_i32__, (void*)wasi_sock_recv},
-    {"sock_send", __tr_i32_i32_i32_i32_i32_result_i32__, (void*)wasi_sock_send},
-    {"sock_shutdown", __tr_i32_i32_result_i32__, (void*)wasi_sock_shutdown},
+static const func_type wasi_func_types[] = {
+    {.param_count = 2, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f", 2}, .results = {(str_iter_t) "\x7f", 1}},
+    {.param_count = 3, .result_count = 1, .params = {(str_iter_t) "\x7f\x7e\x7f", 3}, .results = {(str_iter_t) "\x7f", 1}},
+    {.param_count = 4, .result_count = 1, .params = {(str_iter_t) "\x7f\x7e\x7e\x7f", 4}, .results = {(str_iter_t) "\x7f", 1}},
+    {.param_count = 3, .result_count = 1, .params = {(str_iter_t) "\x7f\x7e\x7e", 3}, .results = {(str_iter_t) "\x7f", 1}},
+    {.param_count = 1, .result_count = 1, .params = {(str_iter_t) "\x7f", 1}, .results = {(str_iter_t) "\x7f", 1}},
+    {.param_count = 2, .result_count = 1, .params = {(str_iter_t) "\x7f\x7e", 2}, .results = {(str_iter_t) "\x7f", 1}},
+    {.param_count = 5, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7e\x7f", 5}, .results = {(str_iter_t) "\x7f", 1}},
+    {.param_count = 3, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f", 3}, .results = {(str_iter_t) "\x7f", 1}},
+    {.param_count = 4, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7f", 4}, .results = {(str_iter_t) "\x7f", 1}},
+    {.param_count = 4, .result_count = 1, .params = {(str_iter_t) "\x7f\x7e\x7f\x7f", 4}, .results = {(str_iter_t) "\x7f", 1}},
+    {.param_count = 5, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7f\x7f", 5}, .results = {(str_iter_t) "\x7f", 1}},
+    {.param_count = 7, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7f\x7e\x7e\x7f", 7}, .results = {(str_iter_t) "\x7f", 1}},
+    {.param_count = 7, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7f\x7f\x7f\x7f", 7}, .results = {(str_iter_t) "\x7f", 1}},
+    {.param_count = 9, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7f\x7f\x7e\x7e\x7f\x7f", 9}, .results = {(str_iter_t) "\x7f", 1}},
+    {.param_count = 6, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7f\x7f\x7f", 6}, .results = {(str_iter_t) "\x7f", 1}},
+    {.param_count = 1, .result_count = 0, .params = {(str_iter_t) "\x7f", 1}, .results = {0}},
+    {.param_count = 0, .result_count = 1, .params = {0}, .results = {(str_iter_t) "\x7f", 1}},
+};
+
+static const func wasi_funcs[] = {
+    {.fn_type = {.param_count = 2, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f", 2}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 2, .tr = __tr_i32_i32_result_i32__, .host_func = (void *)wasi_args_get},
+    {.fn_type = {.param_count = 2, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f", 2}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 2, .tr = __tr_i32_i32_result_i32__, .host_func = (void *)wasi_args_sizes_get},
+    {.fn_type = {.param_count = 2, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f", 2}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 2, .tr = __tr_i32_i32_result_i32__, .host_func = (void *)wasi_clock_res_get},
+    {.fn_type = {.param_count = 3, .result_count = 1, .params = {(str_iter_t) "\x7f\x7e\x7f", 3}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 3, .tr = __tr_i32_i64_i32_result_i32__, .host_func = (void *)wasi_clock_time_get},
+    {.fn_type = {.param_count = 2, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f", 2}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 2, .tr = __tr_i32_i32_result_i32__, .host_func = (void *)wasi_environ_get},
+    {.fn_type = {.param_count = 2, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f", 2}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 2, .tr = __tr_i32_i32_result_i32__, .host_func = (void *)wasi_environ_sizes_get},
+    {.fn_type = {.param_count = 4, .result_count = 1, .params = {(str_iter_t) "\x7f\x7e\x7e\x7f", 4}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 4, .tr = __tr_i32_i64_i64_i32_result_i32__, .host_func = (void *)wasi_fd_advise},
+    {.fn_type = {.param_count = 3, .result_count = 1, .params = {(str_iter_t) "\x7f\x7e\x7e", 3}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 3, .tr = __tr_i32_i64_i64_result_i32__, .host_func = (void *)wasi_fd_allocate},
+    {.fn_type = {.param_count = 1, .result_count = 1, .params = {(str_iter_t) "\x7f", 1}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 1, .tr = __tr_i32_result_i32__, .host_func = (void *)wasi_fd_close},
+    {.fn_type = {.param_count = 1, .result_count = 1, .params = {(str_iter_t) "\x7f", 1}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 1, .tr = __tr_i32_result_i32__, .host_func = (void *)wasi_fd_datasync},
+    {.fn_type = {.param_count = 2, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f", 2}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 2, .tr = __tr_i32_i32_result_i32__, .host_func = (void *)wasi_fd_fdstat_get},
+    {.fn_type = {.param_count = 2, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f", 2}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 2, .tr = __tr_i32_i32_result_i32__, .host_func = (void *)wasi_fd_fdstat_set_flags},
+    {.fn_type = {.param_count = 3, .result_count = 1, .params = {(str_iter_t) "\x7f\x7e\x7e", 3}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 3, .tr = __tr_i32_i64_i64_result_i32__, .host_func = (void *)wasi_fd_fdstat_set_rights},
+    {.fn_type = {.param_count = 2, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f", 2}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 2, .tr = __tr_i32_i32_result_i32__, .host_func = (void *)wasi_fd_filestat_get},
+    {.fn_type = {.param_count = 2, .result_count = 1, .params = {(str_iter_t) "\x7f\x7e", 2}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 2, .tr = __tr_i32_i64_result_i32__, .host_func = (void *)wasi_fd_filestat_set_size},
+    {.fn_type = {.param_count = 4, .result_count = 1, .params = {(str_iter_t) "\x7f\x7e\x7e\x7f", 4}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 4, .tr = __tr_i32_i64_i64_i32_result_i32__, .host_func = (void *)wasi_fd_filestat_set_times},
+    {.fn_type = {.param_count = 5, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7e\x7f", 5}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 5, .tr = __tr_i32_i32_i32_i64_i32_result_i32__, .host_func = (void *)wasi_fd_pread},
+    {.fn_type = {.param_count = 3, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f", 3}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 3, .tr = __tr_i32_i32_i32_result_i32__, .host_func = (void *)wasi_fd_prestat_dir_name},
+    {.fn_type = {.param_count = 2, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f", 2}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 2, .tr = __tr_i32_i32_result_i32__, .host_func = (void *)wasi_fd_prestat_get},
+    {.fn_type = {.param_count = 5, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7e\x7f", 5}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 5, .tr = __tr_i32_i32_i32_i64_i32_result_i32__, .host_func = (void *)wasi_fd_pwrite},
+    {.fn_type = {.param_count = 4, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7f", 4}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 4, .tr = __tr_i32_i32_i32_i32_result_i32__, .host_func = (void *)wasi_fd_read},
+    {.fn_type = {.param_count = 5, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7e\x7f", 5}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 5, .tr = __tr_i32_i32_i32_i64_i32_result_i32__, .host_func = (void *)wasi_fd_readdir},
+    {.fn_type = {.param_count = 2, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f", 2}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 2, .tr = __tr_i32_i32_result_i32__, .host_func = (void *)wasi_fd_renumber},
+    {.fn_type = {.param_count = 4, .result_count = 1, .params = {(str_iter_t) "\x7f\x7e\x7f\x7f", 4}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 4, .tr = __tr_i32_i64_i32_i32_result_i32__, .host_func = (void *)wasi_fd_seek},
+    {.fn_type = {.param_count = 1, .result_count = 1, .params = {(str_iter_t) "\x7f", 1}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 1, .tr = __tr_i32_result_i32__, .host_func = (void *)wasi_fd_sync},
+    {.fn_type = {.param_count = 2, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f", 2}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 2, .tr = __tr_i32_i32_result_i32__, .host_func = (void *)wasi_fd_tell},
+    {.fn_type = {.param_count = 4, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7f", 4}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 4, .tr = __tr_i32_i32_i32_i32_result_i32__, .host_func = (void *)wasi_fd_write},
+    {.fn_type = {.param_count = 3, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f", 3}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 3, .tr = __tr_i32_i32_i32_result_i32__, .host_func = (void *)wasi_path_create_directory},
+    {.fn_type = {.param_count = 5, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7f\x7f", 5}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 5, .tr = __tr_i32_i32_i32_i32_i32_result_i32__, .host_func = (void *)wasi_path_filestat_get},
+    {.fn_type = {.param_count = 7, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7f\x7e\x7e\x7f", 7}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 7, .tr = __tr_i32_i32_i32_i32_i64_i64_i32_result_i32__, .host_func = (void *)wasi_path_filestat_set_times},
+    {.fn_type = {.param_count = 7, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7f\x7f\x7f\x7f", 7}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 7, .tr = __tr_i32_i32_i32_i32_i32_i32_i32_result_i32__, .host_func = (void *)wasi_path_link},
+    {.fn_type = {.param_count = 9, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7f\x7f\x7e\x7e\x7f\x7f", 9}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 9, .tr = __tr_i32_i32_i32_i32_i32_i64_i64_i32_i32_result_i32__, .host_func = (void *)wasi_path_open},
+    {.fn_type = {.param_count = 6, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7f\x7f\x7f", 6}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 6, .tr = __tr_i32_i32_i32_i32_i32_i32_result_i32__, .host_func = (void *)wasi_path_readlink},
+    {.fn_type = {.param_count = 3, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f", 3}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 3, .tr = __tr_i32_i32_i32_result_i32__, .host_func = (void *)wasi_path_remove_directory},
+    {.fn_type = {.param_count = 6, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7f\x7f\x7f", 6}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 6, .tr = __tr_i32_i32_i32_i32_i32_i32_result_i32__, .host_func = (void *)wasi_path_rename},
+    {.fn_type = {.param_count = 5, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7f\x7f", 5}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 5, .tr = __tr_i32_i32_i32_i32_i32_result_i32__, .host_func = (void *)wasi_path_symlink},
+    {.fn_type = {.param_count = 3, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f", 3}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 3, .tr = __tr_i32_i32_i32_result_i32__, .host_func = (void *)wasi_path_unlink_file},
+    {.fn_type = {.param_count = 4, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7f", 4}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 4, .tr = __tr_i32_i32_i32_i32_result_i32__, .host_func = (void *)wasi_poll_oneoff},
+    {.fn_type = {.param_count = 1, .result_count = 0, .params = {(str_iter_t) "\x7f", 1}, .results = {0}}, .linkage = linkage_exported, .local_count = 1, .tr = __tr_i32_result_void__, .host_func = (void *)wasi_proc_exit},
+    {.fn_type = {.param_count = 1, .result_count = 1, .params = {(str_iter_t) "\x7f", 1}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 1, .tr = __tr_i32_result_i32__, .host_func = (void *)wasi_proc_raise},
+    {.fn_type = {.param_count = 2, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f", 2}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 2, .tr = __tr_i32_i32_result_i32__, .host_func = (void *)wasi_random_get},
+    {.fn_type = {.param_count = 0, .result_count = 1, .params = {0}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 0, .tr = __tr_void_result_i32__, .host_func = (void *)wasi_sched_yield},
+    {.fn_type = {.param_count = 3, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f", 3}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 3, .tr = __tr_i32_i32_i32_result_i32__, .host_func = (void *)wasi_sock_accept},
+    {.fn_type = {.param_count = 6, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7f\x7f\x7f", 6}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 6, .tr = __tr_i32_i32_i32_i32_i32_i32_result_i32__, .host_func = (void *)wasi_sock_recv},
+    {.fn_type = {.param_count = 5, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f\x7f\x7f\x7f", 5}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 5, .tr = __tr_i32_i32_i32_i32_i32_result_i32__, .host_func = (void *)wasi_sock_send},
+    {.fn_type = {.param_count = 2, .result_count = 1, .params = {(str_iter_t) "\x7f\x7f", 2}, .results = {(str_iter_t) "\x7f", 1}}, .linkage = linkage_exported, .local_count = 2, .tr = __tr_i32_i32_result_i32__, .host_func = (void *)wasi_sock_shutdown},
+};
+
+static const export wasi_exports[] = {
+    {.name = {(str_iter_t) "args_get", 8}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 0},
+    {.name = {(str_iter_t) "args_sizes_get", 14}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 1},
+    {.name = {(str_iter_t) "clock_res_get", 13}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 2},
+    {.name = {(str_iter_t) "clock_time_get", 14}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 3},
+    {.name = {(str_iter_t) "environ_get", 11}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 4},
+    {.name = {(str_iter_t) "environ_sizes_get", 17}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 5},
+    {.name = {(str_iter_t) "fd_advise", 9}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 6},
+    {.name = {(str_iter_t) "fd_allocate", 11}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 7},
+    {.name = {(str_iter_t) "fd_close", 8}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 8},
+    {.name = {(str_iter_t) "fd_datasync", 11}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 9},
+    {.name = {(str_iter_t) "fd_fdstat_get", 13}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 10},
+    {.name = {(str_iter_t) "fd_fdstat_set_flags", 19}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 11},
+    {.name = {(str_iter_t) "fd_fdstat_set_rights", 20}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 12},
+    {.name = {(str_iter_t) "fd_filestat_get", 15}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 13},
+    {.name = {(str_iter_t) "fd_filestat_set_size", 20}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 14},
+    {.name = {(str_iter_t) "fd_filestat_set_times", 21}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 15},
+    {.name = {(str_iter_t) "fd_pread", 8}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 16},
+    {.name = {(str_iter_t) "fd_prestat_dir_name", 19}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 17},
+    {.name = {(str_iter_t) "fd_prestat_get", 14}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 18},
+    {.name = {(str_iter_t) "fd_pwrite", 9}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 19},
+    {.name = {(str_iter_t) "fd_read", 7}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 20},
+    {.name = {(str_iter_t) "fd_readdir", 10}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 21},
+    {.name = {(str_iter_t) "fd_renumber", 11}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 22},
+    {.name = {(str_iter_t) "fd_seek", 7}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 23},
+    {.name = {(str_iter_t) "fd_sync", 7}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 24},
+    {.name = {(str_iter_t) "fd_tell", 7}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 25},
+    {.name = {(str_iter_t) "fd_write", 8}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 26},
+    {.name = {(str_iter_t) "path_create_directory", 21}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 27},
+    {.name = {(str_iter_t) "path_filestat_get", 17}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 28},
+    {.name = {(str_iter_t) "path_filestat_set_times", 23}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 29},
+    {.name = {(str_iter_t) "path_link", 9}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 30},
+    {.name = {(str_iter_t) "path_open", 9}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 31},
+    {.name = {(str_iter_t) "path_readlink", 13}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 32},
+    {.name = {(str_iter_t) "path_remove_directory", 21}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 33},
+    {.name = {(str_iter_t) "path_rename", 11}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 34},
+    {.name = {(str_iter_t) "path_symlink", 12}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 35},
+    {.name = {(str_iter_t) "path_unlink_file", 16}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 36},
+    {.name = {(str_iter_t) "poll_oneoff", 11}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 37},
+    {.name = {(str_iter_t) "proc_exit", 9}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 38},
+    {.name = {(str_iter_t) "proc_raise", 10}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 39},
+    {.name = {(str_iter_t) "random_get", 10}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 40},
+    {.name = {(str_iter_t) "sched_yield", 11}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 41},
+    {.name = {(str_iter_t) "sock_accept", 11}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 42},
+    {.name = {(str_iter_t) "sock_recv", 9}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 43},
+    {.name = {(str_iter_t) "sock_send", 9}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 44},
+    {.name = {(str_iter_t) "sock_shutdown", 13}, .external_kind = EXTERNAL_KIND_Function, .external_idx = 45},
 };
 
-const size_t wasi_host_info_len = array_len(wasi_host_info);
+static const str_map_entry wasi_export_index[] = {
+    {.used = false},
+    {.key = {(str_iter_t) "path_rename", 11}, .value = 34, .used = true},
+    {.used = false},
+    {.key = {(str_iter_t) "fd_filestat_get", 15}, .value = 13, .used = true},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "fd_datasync", 11}, .value = 9, .used = true},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "sock_accept", 11}, .value = 42, .used = true},
+    {.key = {(str_iter_t) "path_unlink_file", 16}, .value = 36, .used = true},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "proc_exit", 9}, .value = 38, .used = true},
+    {.key = {(str_iter_t) "fd_readdir", 10}, .value = 21, .used = true},
+    {.key = {(str_iter_t) "sock_recv", 9}, .value = 43, .used = true},
+    {.key = {(str_iter_t) "path_filestat_set_times", 23}, .value = 29, .used = true},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "fd_allocate", 11}, .value = 7, .used = true},
+    {.key = {(str_iter_t) "fd_prestat_get", 14}, .value = 18, .used = true},
+    {.key = {(str_iter_t) "fd_seek", 7}, .value = 23, .used = true},
+    {.key = {(str_iter_t) "path_symlink", 12}, .value = 35, .used = true},
+    {.key = {(str_iter_t) "fd_sync", 7}, .value = 24, .used = true},
+    {.key = {(str_iter_t) "path_filestat_get", 17}, .value = 28, .used = true},
+    {.used = false},
+    {.key = {(str_iter_t) "fd_filestat_set_times", 21}, .value = 15, .used = true},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "fd_filestat_set_size", 20}, .value = 14, .used = true},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "clock_res_get", 13}, .value = 2, .used = true},
+    {.key = {(str_iter_t) "fd_pwrite", 9}, .value = 19, .used = true},
+    {.key = {(str_iter_t) "path_open", 9}, .value = 31, .used = true},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "clock_time_get", 14}, .value = 3, .used = true},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "fd_fdstat_set_rights", 20}, .value = 12, .used = true},
+    {.key = {(str_iter_t) "sock_shutdown", 13}, .value = 45, .used = true},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "fd_tell", 7}, .value = 25, .used = true},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "environ_sizes_get", 17}, .value = 5, .used = true},
+    {.used = false},
+    {.key = {(str_iter_t) "proc_raise", 10}, .value = 39, .used = true},
+    {.key = {(str_iter_t) "fd_fdstat_get", 13}, .value = 10, .used = true},
+    {.key = {(str_iter_t) "path_link", 9}, .value = 30, .used = true},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "path_readlink", 13}, .value = 32, .used = true},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "fd_write", 8}, .value = 26, .used = true},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "args_get", 8}, .value = 0, .used = true},
+    {.key = {(str_iter_t) "fd_pread", 8}, .value = 16, .used = true},
+    {.key = {(str_iter_t) "fd_renumber", 11}, .value = 22, .used = true},
+    {.key = {(str_iter_t) "path_remove_directory", 21}, .value = 33, .used = true},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "sock_send", 9}, .value = 44, .used = true},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "fd_prestat_dir_name", 19}, .value = 17, .used = true},
+    {.used = false},
+    {.key = {(str_iter_t) "environ_get", 11}, .value = 4, .used = true},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "fd_advise", 9}, .value = 6, .used = true},
+    {.used = false},
+    {.key = {(str_iter_t) "sched_yield", 11}, .value = 41, .used = true},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "random_get", 10}, .value = 40, .used = true},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "args_sizes_get", 14}, .value = 1, .used = true},
+    {.key = {(str_iter_t) "path_create_directory", 21}, .value = 27, .used = true},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.used = false},
+    {.key = {(str_iter_t) "fd_close", 8}, .value = 8, .used = true},
+    {.key = {(str_iter_t) "fd_read", 7}, .value = 20, .used = true},
+    {.key = {(str_iter_t) "poll_oneoff", 11}, .value = 37, .used = true},
+    {.key = {(str_iter_t) "fd_fdstat_set_flags", 19}, .value = 11, .used = true},
+};
+
+const module wasi_module_desc = {
+    .format_version = 1,
+    .func_types = HOST_MOD_VEC(func_type, wasi_func_types),
+    .funcs = HOST_MOD_VEC(func, wasi_funcs),
+    .tables = {0},
+    .memories = {0},
+    .globals = {0},
+    .exports = HOST_MOD_VEC(export, wasi_exports),
+    .export_index = {.slots = HOST_MOD_VEC(str_map_entry, wasi_export_index), .count = 46},
+    .is_static = true,
+};
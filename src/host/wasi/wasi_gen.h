@@ -5,13 +5,8 @@
 #include "vm.h"
 #include <stddef.h>
 
-extern const u8 wasi_wasm[];
-
-extern const size_t wasi_wasm_len;
-
-extern const host_func_info wasi_host_info[];
-
-extern const size_t wasi_host_info_len;
+// The module with everything resolved, see host_modules.h
+extern const module wasi_module_desc;
 
 // The following functions needs to be manually implemented
 extern r wasi_args_get (tr_ctx, i32, i32, i32*);
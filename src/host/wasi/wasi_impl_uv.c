@@ -259,11 +259,11 @@ r wasi_fd_pread(tr_ctx ctx, i32 fd, i32 iovs, i32 iovs_len, i64 offset, i32 nrea
     }
     uvwasi_size_t _nread;
     err = uvwasi_serdes_readv_iovec_t(pmem0, pmem0_size, iovs, p_iovec, iovs_len);
-    check_err(err, free(p_iovec));
+    check_err(err, array_free(p_iovec));
     err = uvwasi_fd_pread(to_wasi(ctx), fd, p_iovec, iovs_len, offset, &_nread);
-    check_err(err, free(p_iovec));
+    check_err(err, array_free(p_iovec));
     uvwasi_serdes_write_size_t(pmem0, nread, _nread);
-    free(p_iovec);
+    array_free(p_iovec);
     *result = WASI_ERRNO_OK;
     return ok_r;
 }
@@ -295,11 +295,11 @@ r wasi_fd_pwrite(tr_ctx ctx, i32 fd, i32 iovs, i32 iovs_len, i64 offset, i32 nwr
     }
     uvwasi_size_t _nwritten;
     err = uvwasi_serdes_readv_ciovec_t(pmem0, pmem0_size, iovs, p_iovec, iovs_len);
-    check_err(err, free(p_iovec));
+    check_err(err, array_free(p_iovec));
     err = uvwasi_fd_pwrite(to_wasi(ctx), fd, p_iovec, iovs_len, offset, &_nwritten);
-    check_err(err, free(p_iovec));
+    check_err(err, array_free(p_iovec));
     uvwasi_serdes_write_size_t(pmem0, nwritten, _nwritten);
-    free(p_iovec);
+    array_free(p_iovec);
     *result = WASI_ERRNO_OK;
     return ok_r;
 }
@@ -313,11 +313,11 @@ r wasi_fd_read(tr_ctx ctx, i32 fd, i32 iovs, i32 iovs_len, i32 nread, i32 * resu
     }
     uvwasi_size_t _nread;
     err = uvwasi_serdes_readv_iovec_t(pmem0, pmem0_size, iovs, p_iovec, iovs_len);
-    check_err(err, free(p_iovec));
+    check_err(err, array_free(p_iovec));
     err = uvwasi_fd_read(to_wasi(ctx), fd, p_iovec, iovs_len, &_nread);
-    check_err(err, free(p_iovec));
+    check_err(err, array_free(p_iovec));
     uvwasi_serdes_write_size_t(pmem0, nread, _nread);
-    free(p_iovec);
+    array_free(p_iovec);
     *result = WASI_ERRNO_OK;
     return ok_r;
 }
@@ -376,11 +376,11 @@ r wasi_fd_write(tr_ctx ctx, i32 fd, i32 iovs, i32 iovs_len, i32 nwritten, i32 *
     }
     uvwasi_size_t _nwritten;
     err = uvwasi_serdes_readv_ciovec_t(pmem0, pmem0_size, iovs, p_iovec, iovs_len);
-    check_err(err, free(p_iovec));
+    check_err(err, array_free(p_iovec));
     err = uvwasi_fd_write(to_wasi(ctx), fd, p_iovec, iovs_len, &_nwritten);
-    check_err(err, free(p_iovec));
+    check_err(err, array_free(p_iovec));
     uvwasi_serdes_write_size_t(pmem0, nwritten, _nwritten);
-    free(p_iovec);
+    array_free(p_iovec);
     *result = WASI_ERRNO_OK;
     return ok_r;
 }
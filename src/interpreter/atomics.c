@@ -0,0 +1,202 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The 0xfe prefixed instructions (threads proposal), shared by both interpreters. They are
+// rare enough compared to the regular memory accesses that one out-of-line helper is fine.
+
+#include "silverfir.h"
+#include "interpreter.h"
+#include "opcode.h"
+#include "shared_memory.h"
+#include "stream.h"
+
+#if SILVERFIR_ENABLE_THREADS
+
+#include <stdatomic.h>
+
+// The loads, the stores and each group of the rmw instructions all come in the same order.
+// (see FOR_EACH_WASM_OPCODE_FE)
+#define ATOMIC_GROUP_SIZE (7)
+static const u8 atomic_group_access_size[ATOMIC_GROUP_SIZE] = {4, 8, 1, 2, 1, 2, 4};
+static const bool atomic_group_is_i64[ATOMIC_GROUP_SIZE] = {false, true, false, false, true, true, true};
+
+typedef enum atomic_kind {
+    atomic_kind_load = 0,
+    atomic_kind_store,
+    atomic_kind_add,
+    atomic_kind_sub,
+    atomic_kind_and,
+    atomic_kind_or,
+    atomic_kind_xor,
+    atomic_kind_xchg,
+    atomic_kind_cmpxchg,
+} atomic_kind;
+
+// all the values are zero-extended to u64.
+static u64 atomic_load_n(u8 * p, u32 size) {
+    switch (size) {
+        case 1: return atomic_load((_Atomic u8 *)p);
+        case 2: return atomic_load((_Atomic u16 *)p);
+        case 4: return atomic_load((_Atomic u32 *)p);
+        default: return atomic_load((_Atomic u64 *)p);
+    }
+}
+
+static void atomic_store_n(u8 * p, u32 size, u64 val) {
+    switch (size) {
+        case 1: atomic_store((_Atomic u8 *)p, (u8)val); break;
+        case 2: atomic_store((_Atomic u16 *)p, (u16)val); break;
+        case 4: atomic_store((_Atomic u32 *)p, (u32)val); break;
+        default: atomic_store((_Atomic u64 *)p, val); break;
+    }
+}
+
+#define ATOMIC_RMW_N(func, p, size, val)                           \
+    switch (size) {                                                \
+        case 1: return func((_Atomic u8 *)(p), (u8)(val));         \
+        case 2: return func((_Atomic u16 *)(p), (u16)(val));       \
+        case 4: return func((_Atomic u32 *)(p), (u32)(val));       \
+        default: return func((_Atomic u64 *)(p), (u64)(val));      \
+    }
+
+// returns the old value.
+static u64 atomic_rmw_n(u8 * p, u32 size, atomic_kind kind, u64 val) {
+    switch (kind) {
+        case atomic_kind_add: ATOMIC_RMW_N(atomic_fetch_add, p, size, val);
+        case atomic_kind_sub: ATOMIC_RMW_N(atomic_fetch_sub, p, size, val);
+        case atomic_kind_and: ATOMIC_RMW_N(atomic_fetch_and, p, size, val);
+        case atomic_kind_or: ATOMIC_RMW_N(atomic_fetch_or, p, size, val);
+        case atomic_kind_xor: ATOMIC_RMW_N(atomic_fetch_xor, p, size, val);
+        default: ATOMIC_RMW_N(atomic_exchange, p, size, val);
+    }
+}
+
+#define ATOMIC_CMPXCHG_N(type, p, expected, replacement)                                       \
+    {                                                                                          \
+        type e = (type)(expected);                                                             \
+        atomic_compare_exchange_strong((_Atomic type *)(p), &e, (type)(replacement));          \
+        return e;                                                                              \
+    }
+
+// returns the old value, the expected value is wrapped to the access size like the replacement.
+static u64 atomic_cmpxchg_n(u8 * p, u32 size, u64 expected, u64 replacement) {
+    switch (size) {
+        case 1: ATOMIC_CMPXCHG_N(u8, p, expected, replacement);
+        case 2: ATOMIC_CMPXCHG_N(u16, p, expected, replacement);
+        case 4: ATOMIC_CMPXCHG_N(u32, p, expected, replacement);
+        default: ATOMIC_CMPXCHG_N(u64, p, expected, replacement);
+    }
+}
+
+// The address is always popped last.
+#define ATOMIC_EFFECTIVE_ADDR(size)                                                 \
+    u64 ea = mem_effective_addr(*--sp, offset, memory_is64(mem0->mem));             \
+    if (unlikely(ea + (size) > vec_size_u8(&mem0->mdata))) {                        \
+        return err(e_general, "atomic: out-of-bound memory access");                \
+    }                                                                               \
+    if (unlikely(ea & ((size)-1))) {                                                \
+        return err(e_general, "atomic: unaligned atomic");                          \
+    }                                                                               \
+    u8 * p = vec_at_u8(&mem0->mdata, ea)
+
+NOINLINE r interp_atomic_op(memory_inst * mem0, const u8 ** ppc, value_slot ** psp) {
+    check_prep(r);
+    const u8 * pc = *ppc;
+    value_u * sp = *psp;
+
+    u32 opcode;
+    stream_read_vu32_unchecked(opcode, pc);
+    if (opcode == op_atomic_fence) {
+        stream_seek_unchecked(pc, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        *ppc = pc;
+        return ok_r;
+    }
+    // the alignment is checked by the validator.
+    u64 offset;
+    stream_seek_unchecked(pc, 1);
+    stream_read_vu64_unchecked(offset, pc);
+    *ppc = pc;
+    // the validator makes sure there's a memory.
+    assert(mem0);
+
+    switch (opcode) {
+        case op_memory_atomic_notify: {
+            u32 count = (--sp)->u_u32;
+            ATOMIC_EFFECTIVE_ADDR(4);
+            UNUSED(p);
+            // nobody can wait on an unshared memory.
+            u32 woken = mem0->shared ? shared_memory_notify(mem0->shared, (u32)ea, count) : 0;
+            *sp++ = (value_u){.u_u32 = woken};
+            break;
+        }
+        case op_memory_atomic_wait32:
+        case op_memory_atomic_wait64: {
+            bool is64 = (opcode == op_memory_atomic_wait64);
+            i64 timeout_ns = (--sp)->u_i64;
+            u64 expected = is64 ? (--sp)->u_u64 : (--sp)->u_u32;
+            ATOMIC_EFFECTIVE_ADDR(is64 ? 8 : 4);
+            UNUSED(p);
+            if (!mem0->shared) {
+                return err(e_general, "atomic.wait: expected shared memory");
+            }
+            shared_wait_result result = shared_memory_wait(mem0->shared, (u32)ea, expected, is64, timeout_ns);
+            *sp++ = (value_u){.u_u32 = (u32)result};
+            break;
+        }
+        default: {
+            if ((opcode < op_i32_atomic_load) || (opcode > op_i64_atomic_rmw32_cmpxchg_u)) {
+                return err(e_malformed, "Unsupported opcode");
+            }
+            u32 idx = opcode - op_i32_atomic_load;
+            atomic_kind kind = (atomic_kind)(idx / ATOMIC_GROUP_SIZE);
+            u32 size = atomic_group_access_size[idx % ATOMIC_GROUP_SIZE];
+            bool is64 = atomic_group_is_i64[idx % ATOMIC_GROUP_SIZE];
+            u64 old;
+            if (kind == atomic_kind_load) {
+                ATOMIC_EFFECTIVE_ADDR(size);
+                old = atomic_load_n(p, size);
+            } else if (kind == atomic_kind_store) {
+                u64 val = (--sp)->u_u64;
+                ATOMIC_EFFECTIVE_ADDR(size);
+                atomic_store_n(p, size, val);
+                break;
+            } else if (kind == atomic_kind_cmpxchg) {
+                u64 replacement = (--sp)->u_u64;
+                u64 expected = is64 ? (--sp)->u_u64 : (--sp)->u_u32;
+                ATOMIC_EFFECTIVE_ADDR(size);
+                old = atomic_cmpxchg_n(p, size, expected, replacement);
+            } else {
+                u64 val = (--sp)->u_u64;
+                ATOMIC_EFFECTIVE_ADDR(size);
+                old = atomic_rmw_n(p, size, kind, val);
+            }
+            *sp++ = is64 ? (value_u){.u_u64 = old} : (value_u){.u_u32 = (u32)old};
+            break;
+        }
+    }
+    *psp = sp;
+    return ok_r;
+}
+
+#else
+
+NOINLINE r interp_atomic_op(memory_inst * mem0, const u8 ** ppc, value_slot ** psp) {
+    check_prep(r);
+    return err(e_general, "Atomic instructions are disabled");
+}
+
+#endif // SILVERFIR_ENABLE_THREADS
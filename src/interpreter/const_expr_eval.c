@@ -19,6 +19,8 @@
 #include "stream.h"
 #include "vec.h"
 
+#include <string.h>
+
 // Reducing constant expressions into one output value.
 // The arity needs to be one.
 // Unlike the main reducer, this function will also validate the sequence.
@@ -105,6 +107,20 @@ r_typed_value interp_reduce_const_expr(module_inst * mod_inst, stream code, bool
                                                          }));
                 continue;
             }
+#if SILVERFIR_ENABLE_SIMD
+            case op_prefix_fd: {
+                unwrap(u32, opcode_fd, stream_read_vu32(&code));
+                if (opcode_fd != op_v128_const) {
+                    vec_clear_typed_value(&value_stack);
+                    return err(e_invalid, "illegal opcode");
+                }
+                unwrap(stream, bytes, stream_slice(&code, sizeof(v128)));
+                typed_value tv = {.type = TYPE_ID_v128};
+                memcpy(&tv.val.u_v128, bytes.p, sizeof(v128));
+                check(vec_push_typed_value(&value_stack, tv));
+                continue;
+            }
+#endif
             case op_end: {
                 goto end_of_loop;
             }
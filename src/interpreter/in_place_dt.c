@@ -16,7 +16,9 @@
 
 // An interpreter implementation with the most basic switch-case loop or
 // direct threading (computed goto) if available.
+#include "code_cache.h"
 #include "interpreter.h"
+#include "jt_cache.h"
 #include "mem_util.h"
 #include "opcode.h"
 #include "silverfir.h"
@@ -30,7 +32,7 @@
 #define LOGI(fmt, ...) LOG_INFO(log_channel_in_place_dt, fmt, ##__VA_ARGS__)
 #define LOGW(fmt, ...) LOG_WARNING(log_channel_in_place_dt, fmt, ##__VA_ARGS__)
 
-r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
+r in_place_dt_call(thread * t, func_addr f_addr, value_slot * args) {
     assert(f_addr);
     assert(args);
     check_prep(r);
@@ -43,45 +45,135 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
         return err(e_exhaustion, "Stack reached size limit");
     }
 
-#define pop() (*--sp)
-#define pop_drop() (--sp)
-#define push(val) ((*sp++) = val)
+    if (unlikely(thread_stack_exhausted(t, f_addr->fn->stack_size_max * sizeof(value_slot)))) {
+        return err(e_exhaustion, "Stack reached size limit");
+    }
+
+    if (THREAD_SAFEPOINT_DUE(t)) {
+        check(thread_safepoint(t));
+    }
+
+// The values take SLOTS_OF(type) slots, so they can only be accessed with the types.
+#define pop(type) (sp -= SLOTS_OF(type), slot_read(type, sp))
+#define push(type, val) (slot_write(type, sp, val), sp += SLOTS_OF(type))
+#define top(type) slot_read(type, sp - SLOTS_OF(type))
+#define set_top(type, val) slot_write(type, sp - SLOTS_OF(type), val)
+
+// With a budget (see jt_cache.h), the jump table is built on demand and any call can evict it,
+// so it's acquired again after the calls.
+#define load_jt()                                    \
+    jt = fn->jt._data;                               \
+    jt_escapes = fn->jt_escapes._data;               \
+    jt_size = vec_size_jump_table(&fn->jt);          \
+    load_wide_operands();
+#define reload_jt()                                  \
+    if (unlikely(mod_inst->mod->jt_cache)) {         \
+        check(jt_cache_acquire(mod_inst->mod, fn));  \
+        load_jt();                                   \
+    }
+// The same for the compressed code (see code_cache.h), the body can be somewhere else when
+// it's decompressed again, so the pc is moved with it.
+#define reload_code()                                                  \
+    if (unlikely(mod_inst->mod->code_cache)) {                         \
+        check(code_cache_acquire(mod_inst->mod, fn));                  \
+        pc = fn->code.ptr + ((uptr)pc - (uptr)code.ptr);               \
+        code = fn->code;                                               \
+    }
+
+#if SILVERFIR_STACK_SLOT_32
+// An address or a size is an i64 for a 64-bit memory, which takes two slots.
+#define pop_addr() (mem0_is64 ? (value_u){.u_u64 = pop(u64)} : (value_u){.u_u32 = pop(u32)})
+// drop and the untyped select don't know the width of the operand, the validator marks the wide
+// ones by their pc.
+#define operand_width() (1u + func_wide_operand(wide_operands, (u32)(pc - code.ptr)))
+#define load_wide_operands() \
+    wide_operands = vec_size_u8(&fn->wide_operands) ? fn->wide_operands._data : NULL
+#define local_slot(idx, offset, width)                      \
+    if (local_offsets) {                                    \
+        offset = local_offsets[idx];                        \
+        width = local_offsets[idx + 1] - offset;            \
+    } else {                                                \
+        offset = idx;                                       \
+        width = 1;                                          \
+    }
+#else
+#define pop_addr() (*--sp)
+#define operand_width() 1u
+#define load_wide_operands()
+#define local_slot(idx, offset, width) \
+    offset = idx;                      \
+    width = 1;
+#endif
 
     t->frame_depth++;
     func * fn = f_addr->fn;
     module_inst * mod_inst = f_addr->mod_inst;
 
     // zero-out the reset of the locals. This is *required* by the spec.
-    register value_u * local = args;
-    memset(local + fn->fn_type.param_count, 0, (fn->local_count - fn->fn_type.param_count) * sizeof(value_u));
+    register value_slot * local = args;
+    memset(local + func_param_slots(fn), 0, (func_local_slots(fn) - func_param_slots(fn)) * sizeof(value_slot));
     // local and stack are NOT continuous! locals belongs to the caller's stack frame
     // whereas the stack is allocated in this frame
-    value_u * stack_base = array_alloca(value_u, fn->stack_size_max);
+    value_slot * stack_base = array_alloca(value_slot, fn->stack_size_max);
     if (!stack_base) {
         return err(e_general, "Stack overflow!");
     }
     t->stack_size += fn->stack_size_max;
-    register value_u * sp = stack_base;
+    // a tail call runs the callee in place of this frame, see tail_call below.
+    tail_call_area tail_area = {
+        .local = args,
+        .local_cap = func_local_slots(fn),
+        .stack = stack_base,
+        .stack_cap = fn->stack_size_max,
+    };
+    func_addr tail_addr = NULL;
 
-    str code = fn->code;
-    register const u8 * pc = code.ptr;
+    register value_slot * sp;
+    str code;
+    register const u8 * pc;
+    mem_addr mem_inst0;
+    vec_u8 * pmem0;
+    bool mem0_is64;
+    jump_table * jt;
+    jump_table_escape * jt_escapes;
+    size_t jt_size;
+    u16 next_jt_idx;
+#if SILVERFIR_STACK_SLOT_32
+    const u32 * local_offsets;
+    const u8 * wide_operands;
+#endif
 
-    mem_addr mem_inst0 = NULL;
+enter:
+    sp = stack_base;
+#if SILVERFIR_STACK_SLOT_32
+    local_offsets = fn->local_offsets._data;
+#endif
+    if (unlikely(mod_inst->mod->code_cache)) {
+        check(code_cache_acquire(mod_inst->mod, fn));
+    }
+    code = fn->code;
+    pc = code.ptr;
+
+    mem_inst0 = NULL;
     // we CANNOT cache the memory size or u8 pointer here because the memory can grow in
     // the callee frames, and when the execution returns here, the cached size and pointer
     // will be invalid.
     // size_t mem0_size = 0;
-    vec_u8 * pmem0 = NULL;
+    pmem0 = NULL;
+    mem0_is64 = false;
     if (vec_size_mem_addr(&mod_inst->m_addrs)) {
         mem_inst0 = *vec_at_mem_addr(&mod_inst->m_addrs, 0);
         pmem0 = &mem_inst0->mdata;
+        mem0_is64 = memory_is64(mem_inst0->mem);
     }
 
     // the next_jt_idx also needs to be backed up like pc.
-    jump_table * jt = fn->jt._data;
-    size_t jt_size = vec_size_jump_table(&fn->jt);
+    if (unlikely(mod_inst->mod->jt_cache)) {
+        check(jt_cache_acquire(mod_inst->mod, fn));
+    }
+    load_jt();
     UNUSED(jt_size);
-    u16 next_jt_idx = 0;
+    next_jt_idx = 0;
 
     register u8 opcode;
     while (true) {
@@ -116,24 +208,22 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
                 stream_seek_unchecked(pc, 1);
             });
             OP(if, {
-                i32 c = pop().u_i32;
+                i32 c = pop(i32);
                 if (c) {
                     stream_seek_unchecked(pc, 1); //block type
                     next_jt_idx++;
                 } else {
                     jump_table * tbl = jt + next_jt_idx;
                     assert(next_jt_idx < jt_size || next_jt_idx == JUMP_TABLE_IDX_INVALID);
-                    assert(code.ptr + tbl->pc == pc);
                     next_jt_idx = tbl->next_idx;
-                    pc += tbl->target_offset;
+                    pc += jump_table_decode(tbl, jt_escapes).target_offset;
                 }
             });
             OP(else, {
                 jump_table * tbl = jt + next_jt_idx;
                 assert(next_jt_idx < jt_size || next_jt_idx == JUMP_TABLE_IDX_INVALID);
-                assert(code.ptr + tbl->pc == pc);
                 next_jt_idx = tbl->next_idx;
-                pc += tbl->target_offset;
+                pc += jump_table_decode(tbl, jt_escapes).target_offset;
             });
             OP(end, {
                 // it's the end of the function.
@@ -145,22 +235,27 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
                 handle_br:;
                     jump_table * tbl = jt + next_jt_idx;
                     assert(next_jt_idx < jt_size || next_jt_idx == JUMP_TABLE_IDX_INVALID);
-                    assert(code.ptr + tbl->pc == pc);
+                    jump_table_escape offsets = jump_table_decode(tbl, jt_escapes);
                     next_jt_idx = tbl->next_idx;
-                    pc += tbl->target_offset;
-                    if (unlikely(tbl->stack_offset)) {
-                        u32 stack_offset = tbl->stack_offset;
+                    pc += offsets.target_offset;
+                    if (unlikely(offsets.stack_offset)) {
+                        u32 stack_offset = offsets.stack_offset;
                         u16 arity = tbl->arity;
-                        assert(stack_offset < 32767);
                         assert(sp - stack_base >= stack_offset + arity);
-                        value_u * dst = sp - stack_offset - arity;
-                        value_u * src = sp - arity;
-                        memmove(dst, src, sizeof(value_u) * arity);
+                        value_slot * dst = sp - stack_offset - arity;
+                        value_slot * src = sp - arity;
+                        memmove(dst, src, sizeof(value_slot) * arity);
                         sp -= stack_offset;
                     }
+                    if (unlikely(offsets.target_offset < 0) && THREAD_SAFEPOINT_DUE(t)) {
+                        // another green thread can run the same module meanwhile.
+                        check(thread_safepoint(t));
+                        reload_code();
+                        reload_jt();
+                    }
             });
             OP(br_if, {
-                i32 c = pop().u_i32;
+                i32 c = pop(i32);
                 if (c) {
                     goto handle_br;
                 } else {
@@ -169,7 +264,7 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
                 }
             });
             OP(br_table, {
-                u32 i = pop().u_u32;
+                u32 i = pop(u32);
                 u32 table_len;
                 stream_read_vu32_unchecked(table_len, pc);
                 stream_seek_unchecked(pc, table_len + 1);
@@ -188,23 +283,20 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
                 assert(fn_idx_local < vec_size_func(&mod_inst->mod->funcs));
                 func_addr callee_addr = *vec_at_func_addr(&mod_inst->f_addrs, fn_idx_local);
                 func * callee_fn = callee_addr->fn;
-                func_type callee_type = callee_fn->fn_type;
-                assert(sp - stack_base >= callee_type.param_count);
-                sp -= callee_type.param_count;
+                u32 param_slots = func_param_slots(callee_fn);
+                assert(sp - stack_base >= param_slots);
+                sp -= param_slots;
                 // Just double check to make sure the stack is enough to hold the callee's all local variables
-                assert(sp - stack_base + callee_fn->local_count <= fn->stack_size_max);
+                assert(sp - stack_base + func_local_slots(callee_fn) <= fn->stack_size_max);
                 if (unlikely(callee_fn->tr)) {
                     // native call, we're passing in the caller's context.
-                    check(callee_fn->tr((tr_ctx){
-                                            .f_addr = callee_addr,
-                                            .args = sp,
-                                            .mem0 = mem_inst0,
-                                        },
-                                        callee_fn->host_func));
+                    check(interp_call_host(callee_addr, sp, mem_inst0));
                 } else {
                     check(in_place_dt_call(t, callee_addr, sp));
                 }
-                sp += callee_type.result_count;
+                sp += func_result_slots(callee_fn);
+                reload_code();
+                reload_jt();
             });
             OP(call_indirect, {
                 // source
@@ -216,7 +308,7 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
                 stream_read_vu32_unchecked(table_idx, pc);
                 assert(table_idx < vec_size_tab_addr(&mod_inst->t_addrs));
                 tab_addr t_addr = *vec_at_tab_addr(&mod_inst->t_addrs, table_idx);
-                size_t i = pop().u_i32;
+                size_t i = pop(i32);
                 if (i >= vec_size_ref(&t_addr->tdata)) {
                     return err(e_general, "call_indirect: invalid table element index");
                 }
@@ -226,12 +318,13 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
                 }
                 func_addr callee_addr = to_func_addr(fref);
                 func * callee_fn = callee_addr->fn;
-                func_type callee_type = callee_fn->fn_type;
-                if (!func_type_eq(callee_type, src_type)) {
+                if (!func_type_eq(callee_fn->fn_type, src_type)) {
                     return err(e_general, "call_indirect: function type mismatch");
                 }
-                assert(sp - stack_base >= callee_type.param_count);
-                sp -= callee_type.param_count;
+                u32 param_slots = func_param_slots(callee_fn);
+                u32 local_slots = func_local_slots(callee_fn);
+                assert(sp - stack_base >= param_slots);
+                sp -= param_slots;
                 // Unlike statically dispatched functions where locals(including args) are allocated in
                 // the caller to make sure it's in linear memory for the callee, for dynamically dispatched
                 // functions we don't know the callee's local size, therefore can't pre-calculate the
@@ -239,120 +332,161 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
                 // However, it's just the 'pure' locals that needs to be allcoated, the arguments are
                 // still in our stack frame. So there's a tiny optimization when there is no 'real' locals
                 // we just pass the sp to the callee.
-                value_u * callee_local = NULL;
-                if (callee_fn->local_count - callee_type.param_count) {
+                value_slot * callee_local = NULL;
+                if (local_slots - param_slots) {
                     // We can't use alloca here because it's function scope, otherwise a loop calling
                     // to here will lead to stack overflow.
-                    callee_local = array_alloc(value_u, callee_fn->local_count);
+                    callee_local = array_alloc(value_slot, local_slots);
                     if (!callee_local) {
                         return err(e_general, "Stack overflow!");
                     }
-                    memcpy(callee_local, sp, callee_type.param_count * sizeof (value_u));
+                    memcpy(callee_local, sp, param_slots * sizeof (value_slot));
                 }
                 if (unlikely(callee_fn->tr)) {
                     // native call, we're passing in the caller's context.
-                    check(callee_fn->tr((tr_ctx){
-                                            .f_addr = callee_addr,
-                                            .args = callee_local != NULL ? callee_local : sp,
-                                            .mem0 = mem_inst0,
-                                        },
-                                        callee_fn->host_func));
+                    check(interp_call_host(callee_addr, callee_local != NULL ? callee_local : sp, mem_inst0));
                 } else {
                     check(in_place_dt_call(t, callee_addr, callee_local != NULL ? callee_local : sp));
                 }
                 if (callee_local) {
                     // copy stack back
-                    memcpy(sp, callee_local, callee_type.result_count * sizeof (value_u));
+                    memcpy(sp, callee_local, func_result_slots(callee_fn) * sizeof (value_slot));
                     array_free(callee_local);
                 }
-                sp += callee_type.result_count;
+                sp += func_result_slots(callee_fn);
+                reload_code();
+                reload_jt();
+            });
+            OP(return_call, {
+                u32 fn_idx_local;
+                stream_read_vu32_unchecked(fn_idx_local, pc);
+                assert(fn_idx_local < vec_size_func(&mod_inst->mod->funcs));
+                tail_addr = *vec_at_func_addr(&mod_inst->f_addrs, fn_idx_local);
+                goto tail_call;
+            });
+            OP(return_call_indirect, {
+                u32 type_idx;
+                stream_read_vu32_unchecked(type_idx, pc);
+                func_type src_type = *vec_at_func_type(&mod_inst->mod->func_types, type_idx);
+                u32 table_idx;
+                stream_read_vu32_unchecked(table_idx, pc);
+                assert(table_idx < vec_size_tab_addr(&mod_inst->t_addrs));
+                tab_addr t_addr = *vec_at_tab_addr(&mod_inst->t_addrs, table_idx);
+                size_t i = pop(i32);
+                if (i >= vec_size_ref(&t_addr->tdata)) {
+                    return err(e_general, "return_call_indirect: invalid table element index");
+                }
+                ref fref = *vec_at_ref(&t_addr->tdata, i);
+                if (fref == nullref) {
+                    return err(e_general, "return_call_indirect: element is ref.null");
+                }
+                tail_addr = to_func_addr(fref);
+                if (!func_type_eq(tail_addr->fn->fn_type, src_type)) {
+                    return err(e_general, "return_call_indirect: function type mismatch");
+                }
+                goto tail_call;
             });
             OP(drop, {
-                pop_drop();
+                sp -= operand_width();
             });
+// the two operands take the same number of slots.
+#define SELECT(width)                          \
+    {                                          \
+        i32 cond = pop(i32);                   \
+        u32 w = (width);                       \
+        sp -= w;                               \
+        if (!cond) {                           \
+            slots_copy(sp - w, sp, w);         \
+        }                                      \
+    }
             OP(select, {
-                handle_op_select:;
-                    i32 cond = pop().u_i32;
-                    value_u false_val = pop();
-                    value_u true_val = pop();
-                    if (cond) {
-                        push(true_val);
-                    } else {
-                        push(false_val);
-                    }
+                SELECT(operand_width());
             });
             OP(select_t, {
-                stream_seek_unchecked(pc, 2);
-                goto handle_op_select;
+                i8 type;
+                stream_seek_unchecked(pc, 1); // the type count is always 1.
+                stream_read_vi7_unchecked(type, pc);
+                SELECT(type_slot_count((type_id)type));
             });
             OP(local_get, {
                 u32 local_idx;
                 stream_read_vu32_unchecked(local_idx, pc);
-                push(local[local_idx]);
+                u32 offset;
+                u32 width;
+                local_slot(local_idx, offset, width);
+                slots_copy(sp, local + offset, width);
+                sp += width;
             });
             OP(local_set, {
                 u32 local_idx;
-                value_u v = pop();
                 stream_read_vu32_unchecked(local_idx, pc);
-                local[local_idx] = v;
+                u32 offset;
+                u32 width;
+                local_slot(local_idx, offset, width);
+                sp -= width;
+                slots_copy(local + offset, sp, width);
             });
             OP(local_tee, {
                 u32 local_idx;
-                value_u v = *(sp - 1);
                 stream_read_vu32_unchecked(local_idx, pc);
-                local[local_idx] = v;
+                u32 offset;
+                u32 width;
+                local_slot(local_idx, offset, width);
+                slots_copy(local + offset, sp - width, width);
             });
             OP(global_get, {
                 u32 global_idx;
                 stream_read_vu32_unchecked(global_idx, pc);
                 assert(global_idx < vec_size_global_inst(&mod_inst->globals));
                 glob_addr g_addr = *vec_at_glob_addr(&mod_inst->g_addrs, global_idx);
-                push(g_addr->gvalue);
+                u32 width = type_slot_count(g_addr->glob->valtype);
+                value_to_slots(sp, g_addr->gvalue, width);
+                sp += width;
             });
             OP(global_set, {
                 u32 global_idx;
                 stream_read_vu32_unchecked(global_idx, pc);
                 assert(global_idx < vec_size_global_inst(&mod_inst->globals));
                 glob_addr g_addr = *vec_at_glob_addr(&mod_inst->g_addrs, global_idx);
-                g_addr->gvalue = pop();
+                u32 width = type_slot_count(g_addr->glob->valtype);
+                sp -= width;
+                g_addr->gvalue = value_from_slots(sp, width);
             });
             OP(table_get, {
                 u32 table_idx;
                 stream_read_vu32_unchecked(table_idx, pc);
                 assert(table_idx < vec_size_tab_addr(&mod_inst->t_addrs));
                 tab_addr t_addr = *vec_at_tab_addr(&mod_inst->t_addrs, table_idx);
-                u32 elem_idx = pop().u_i32;
+                u32 elem_idx = pop(u32);
                 if (elem_idx >= vec_size_ref(&t_addr->tdata)) {
                     return err(e_general, "table_get: invalid table element index");
                 }
-                value_u ref = {.u_ref = *vec_at_ref(&t_addr->tdata, elem_idx)};
-                push(ref);
+                push(ref, *vec_at_ref(&t_addr->tdata, elem_idx));
             });
             OP(table_set, {
                 u32 table_idx;
                 stream_read_vu32_unchecked(table_idx, pc);
                 assert(table_idx < vec_size_tab_addr(&mod_inst->t_addrs));
                 tab_addr t_addr = *vec_at_tab_addr(&mod_inst->t_addrs, table_idx);
-                ref ref = pop().u_ref;
-                u32 elem_idx = pop().u_u32;
+                ref elem = pop(ref);
+                u32 elem_idx = pop(u32);
                 if (elem_idx >= vec_size_ref(&t_addr->tdata)) {
                     return err(e_general, "table_set: invalid table element index");
                 }
-                *vec_at_ref(&t_addr->tdata, elem_idx) = ref;
+                *vec_at_ref(&t_addr->tdata, elem_idx) = elem;
             });
 // Although the spec says the popped up value is a signed i32, it should be treated
 // as unsigned. Furthermore, the size should be widened to avoid overflow.
 #define MEM_LOAD(dst_type, src_type)                                                    \
     {                                                                                   \
         stream_seek_unchecked(pc, 1);                                                   \
-        u32 offset;                                                                     \
-        stream_read_vu32_unchecked(offset, pc);                                         \
-        u64 mem_idx = (u64)(u32)(pop().u_i32) + offset;                                 \
+        u64 offset;                                                                     \
+        stream_read_vu64_unchecked(offset, pc);                                         \
+        u64 mem_idx = mem_effective_addr(pop_addr(), offset, mem0_is64);                \
         if (unlikely(mem_idx + sizeof(src_type) > vec_size_u8(pmem0))) {                \
             return err(e_general, "t.load: out-of-bound memory access");                \
         }                                                                               \
-        value_u val = {.u_##dst_type = mem_read_##src_type(vec_at_u8(pmem0, mem_idx))}; \
-        push(val);                                                                      \
+        push(dst_type, mem_read_##src_type(vec_at_u8(pmem0, mem_idx)));                 \
     }
 
             OP(i32_load, {MEM_LOAD(i32, i32)});
@@ -373,14 +507,14 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
 #define MEM_STORE(dst_type, src_type)                                                    \
     {                                                                                    \
         stream_seek_unchecked(pc, 1);                                                    \
-        u32 offset;                                                                      \
-        stream_read_vu32_unchecked(offset, pc);                                          \
-        value_u val = pop();                                                             \
-        u64 mem_idx = (u64)(u32)(pop().u_i32) + offset;                                  \
+        u64 offset;                                                                      \
+        stream_read_vu64_unchecked(offset, pc);                                          \
+        src_type val = pop(src_type);                                                    \
+        u64 mem_idx = mem_effective_addr(pop_addr(), offset, mem0_is64);                 \
         if (unlikely(mem_idx + sizeof(dst_type) > vec_size_u8(pmem0))) {                 \
             return err(e_general, "t.store: out-of-bound memory access");                \
         }                                                                                \
-        mem_write_##dst_type(vec_at_u8(pmem0, mem_idx), ((dst_type)(val.u_##src_type))); \
+        mem_write_##dst_type(vec_at_u8(pmem0, mem_idx), ((dst_type)(val)));              \
     }
 
             OP(i32_store, {MEM_STORE(u32, i32)});
@@ -395,72 +529,77 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
 
             OP(memory_size, {
                 stream_seek_unchecked(pc, 1);
-                push((value_u){.u_i32 = (i32)(vec_size_u8(pmem0) / WASM_PAGE_SIZE)});
+                u64 pages = vec_size_u8(pmem0) >> memory_page_shift(mem_inst0->mem);
+                if (mem0_is64) {
+                    push(u64, pages);
+                } else {
+                    push(u32, (u32)pages);
+                }
             });
             OP(memory_grow, {
                 stream_seek_unchecked(pc, 1);
-                size_t sz = vec_size_u8(pmem0) / WASM_PAGE_SIZE;
-                size_t n_pages = (size_t)(pop().u_u32);
-                if (sz + n_pages <= mem_inst0->mem->lim.max) {
-                    r ret_resize = vec_resize_u8(pmem0, (sz + n_pages) * WASM_PAGE_SIZE);
-                    if (is_ok(ret_resize)) {
-                        push((value_u){.u_i32 = (i32)(sz)});
-                        continue;
-                    }
+                u64 n_pages = mem_index(pop_addr(), mem0_is64);
+                i64 prev_pages = memory_inst_grow(mem_inst0, n_pages);
+                if (mem0_is64) {
+                    push(i64, prev_pages);
+                } else {
+                    push(i32, (i32)prev_pages);
                 }
-                // failed
-                push((value_u){.u_i32 = (i32)(-1)});
             });
             OP(i32_const, {
-                value_u v;
-                stream_read_vi32_unchecked(v.u_i32, pc);
-                push(v);
+                i32 v;
+                stream_read_vi32_unchecked(v, pc);
+                push(i32, v);
             });
             OP(i64_const, {
-                value_u v;
-                stream_read_vi64_unchecked(v.u_i64, pc);
-                push(v);
+                i64 v;
+                stream_read_vi64_unchecked(v, pc);
+                push(i64, v);
             });
             OP(f32_const, {
-                value_u v;
-                stream_read_f32_unchecked(v.u_f32, pc);
-                push(v);
+                f32 v;
+                stream_read_f32_unchecked(v, pc);
+                push(f32, v);
             });
             OP(f64_const, {
-                value_u v;
-                stream_read_f64_unchecked(v.u_f64, pc);
-                push(v);
+                f64 v;
+                stream_read_f64_unchecked(v, pc);
+                push(f64, v);
             });
 
-#define FDIV_TRAP(type)                              \
-    if (fpclassify((sp - 1)->u_##type) == FP_ZERO) { \
-        return err(e_general, "div: divided by zero");          \
+#define FDIV_TRAP(type)                                \
+    if (fpclassify(top(type)) == FP_ZERO) {            \
+        return err(e_general, "div: divided by zero"); \
     }
 
-#define UNOP(type, op)                                       \
-    {                                                        \
-        (sp - 1)->u_##type = (type)(op((sp - 1)->u_##type)); \
+#define UNOP(type, op)                  \
+    {                                   \
+        type v = top(type);             \
+        set_top(type, (type)(op(v)));   \
     }
 
-#define BINOP(tgt_type, op, op_type)                                    \
-    {                                                                   \
-        value_u v2 = pop();                                             \
-        tgt_type v = (tgt_type)(op(pop().u_##op_type, v2.u_##op_type)); \
-        push((value_u){.u_##tgt_type = v});                             \
+#define BINOP(tgt_type, op, op_type)            \
+    {                                           \
+        op_type v2 = pop(op_type);              \
+        op_type v1 = pop(op_type);              \
+        push(tgt_type, (tgt_type)(op(v1, v2))); \
     }
 
 // RELOP always produce i32 results.
 #define RELOP(op_type, op) BINOP(i32, op, op_type)
 
-#define CONVERT_OP(tgt_type, op, src_type)                               \
-    {                                                                    \
-        (sp - 1)->u_##tgt_type = (tgt_type)(op((sp - 1)->u_##src_type)); \
+// the result could take a different number of slots.
+#define CONVERT_OP(tgt_type, op, src_type)  \
+    {                                       \
+        src_type v = pop(src_type);         \
+        push(tgt_type, (tgt_type)(op(v)));  \
     }
 
-#define REINTERPRET_OP(tgt_type, src_type)                                   \
-    {                                                                        \
-        assert(sizeof(tgt_type) == sizeof(src_type));                        \
-        (sp - 1)->u_##tgt_type = *((tgt_type *)(&((sp - 1)->u_##src_type))); \
+#define REINTERPRET_OP(tgt_type, src_type)             \
+    {                                                  \
+        assert(sizeof(tgt_type) == sizeof(src_type));  \
+        src_type v = top(src_type);                    \
+        set_top(tgt_type, *((tgt_type *)(&v)));        \
     }
 
             OP(i32_eqz, { UNOP(i32, s_eqz); });
@@ -474,7 +613,7 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
             OP(i32_le_u, { RELOP(u32, s_le); });
             OP(i32_ge_s, { RELOP(i32, s_ge); });
             OP(i32_ge_u, { RELOP(u32, s_ge); });
-            OP(i64_eqz, { UNOP(i64, s_eqz); });
+            OP(i64_eqz, { CONVERT_OP(i32, s_eqz, i64); });
             OP(i64_eq, { RELOP(i64, s_eq); });
             OP(i64_ne, { RELOP(i64, s_ne); });
             OP(i64_lt_s, { RELOP(i64, s_lt); });
@@ -504,40 +643,40 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
             OP(i32_sub, { BINOP(i32, s_sub, i32); });
             OP(i32_mul, { BINOP(i32, s_mul, i32); });
             OP(i32_div_s, {
-                value_u v2 = pop();
-                value_u v1 = pop();
-                if (unlikely(((v1.u_i32 == i32_MIN) && (v2.u_i32 == -1)) || (v2.u_i32 == 0))) {
+                i32 v2 = pop(i32);
+                i32 v1 = pop(i32);
+                if (unlikely(((v1 == i32_MIN) && (v2 == -1)) || (v2 == 0))) {
                     return err(e_general, "div trap");
                 }
-                push((value_u){.u_i32 = s_div(v1.u_i32, v2.u_i32)});
+                push(i32, s_div(v1, v2));
             });
             OP(i32_div_u, {
-                value_u v2 = pop();
-                value_u v1 = pop();
-                if (v2.u_u32 == 0) {
+                u32 v2 = pop(u32);
+                u32 v1 = pop(u32);
+                if (v2 == 0) {
                     return err(e_general, "div trap");
                 }
-                push((value_u){.u_u32 = s_div(v1.u_u32, v2.u_u32)});
+                push(u32, s_div(v1, v2));
             });
             OP(i32_rem_s, {
-                value_u v2 = pop();
-                value_u v1 = pop();
-                if (unlikely((v1.u_i32 == i32_MIN) && (v2.u_i32 == -1))) {
-                    push((value_u){.u_i32 = 0});
+                i32 v2 = pop(i32);
+                i32 v1 = pop(i32);
+                if (unlikely((v1 == i32_MIN) && (v2 == -1))) {
+                    push(i32, 0);
                     continue;
                 }
-                if (unlikely(v2.u_i32 == 0)) {
+                if (unlikely(v2 == 0)) {
                     return err(e_general, "trap");
                 }
-                push((value_u){.u_i32 = s_rem(v1.u_i32, v2.u_i32)});
+                push(i32, s_rem(v1, v2));
             });
             OP(i32_rem_u, {
-                value_u v2 = pop();
-                value_u v1 = pop();
-                if (unlikely(v2.u_u32 == 0)) {
+                u32 v2 = pop(u32);
+                u32 v1 = pop(u32);
+                if (unlikely(v2 == 0)) {
                     return err(e_general, "rem trap");
                 }
-                push((value_u){.u_u32 = s_rem(v1.u_u32, v2.u_u32)});
+                push(u32, s_rem(v1, v2));
             });
             OP(i32_and, { BINOP(i32, s_and, i32); });
             OP(i32_or, { BINOP(i32, s_or, i32); });
@@ -554,40 +693,40 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
             OP(i64_sub, { BINOP(i64, s_sub, i64); });
             OP(i64_mul, { BINOP(i64, s_mul, i64); });
             OP(i64_div_s, {
-                value_u v2 = pop();
-                value_u v1 = pop();
-                if (unlikely(((v1.u_i64 == i64_MIN) && (v2.u_i64 == -1)) || (v2.u_i64 == 0))) {
+                i64 v2 = pop(i64);
+                i64 v1 = pop(i64);
+                if (unlikely(((v1 == i64_MIN) && (v2 == -1)) || (v2 == 0))) {
                     return err(e_general, "div trap");
                 }
-                push((value_u){.u_i64 = s_div(v1.u_i64, v2.u_i64)});
+                push(i64, s_div(v1, v2));
             });
             OP(i64_div_u, {
-                value_u v2 = pop();
-                value_u v1 = pop();
-                if (unlikely(v2.u_u64 == 0)) {
+                u64 v2 = pop(u64);
+                u64 v1 = pop(u64);
+                if (unlikely(v2 == 0)) {
                     return err(e_general, "div trap");
                 }
-                push((value_u){.u_u64 = s_div(v1.u_u64, v2.u_u64)});
+                push(u64, s_div(v1, v2));
             });
             OP(i64_rem_s, {
-                value_u v2 = pop();
-                value_u v1 = pop();
-                if (unlikely((v1.u_i64 == i64_MIN) && (v2.u_i64 == -1))) {
-                    push((value_u){.u_i64 = 0});
+                i64 v2 = pop(i64);
+                i64 v1 = pop(i64);
+                if (unlikely((v1 == i64_MIN) && (v2 == -1))) {
+                    push(i64, 0);
                     continue;
                 }
-                if (unlikely(v2.u_i64 == 0)) {
+                if (unlikely(v2 == 0)) {
                     return err(e_general, "trap");
                 }
-                push((value_u){.u_i64 = s_rem(v1.u_i64, v2.u_i64)});
+                push(i64, s_rem(v1, v2));
             });
             OP(i64_rem_u, {
-                value_u v2 = pop();
-                value_u v1 = pop();
-                if (unlikely(v2.u_u64 == 0)) {
+                u64 v2 = pop(u64);
+                u64 v1 = pop(u64);
+                if (unlikely(v2 == 0)) {
                     return err(e_general, "rem trap");
                 }
-                push((value_u){.u_u64 = s_rem(v1.u_u64, v2.u_u64)});
+                push(u64, s_rem(v1, v2));
             });
             OP(i64_and, { BINOP(i64, s_and, i64); });
             OP(i64_or, { BINOP(i64, s_or, i64); });
@@ -629,25 +768,25 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
             OP(f64_copysign, { BINOP(f64, s_copysign64, f64); });
             OP(i32_wrap_i64, { CONVERT_OP(i32, s_nop, i64); });
             OP(i32_trunc_f32_s, {
-                if (unlikely(s_isnan32((sp - 1)->u_f32) || (sp - 1)->u_f32 < -2147483648.f || (sp - 1)->u_f32 >= 2147483648.f)) {
+                if (unlikely(s_isnan32(top(f32)) || top(f32) < -2147483648.f || top(f32) >= 2147483648.f)) {
                     return err(e_general, "trap");
                 }
                 CONVERT_OP(i32, s_truncf32i, f32);
             });
             OP(i32_trunc_f32_u, {
-                if (unlikely(s_isnan32((sp - 1)->u_f32) || (sp - 1)->u_f32 <= -1.f || (sp - 1)->u_f32 >= 4294967296.f)) {
+                if (unlikely(s_isnan32(top(f32)) || top(f32) <= -1.f || top(f32) >= 4294967296.f)) {
                     return err(e_general, "trap");
                 }
                 CONVERT_OP(i32, s_truncf32u, f32);
             });
             OP(i32_trunc_f64_s, {
-                if (unlikely(s_isnan64((sp - 1)->u_f64) || (sp - 1)->u_f64 <= -2147483649. || (sp - 1)->u_f64 >= 2147483648.)) {
+                if (unlikely(s_isnan64(top(f64)) || top(f64) <= -2147483649. || top(f64) >= 2147483648.)) {
                     return err(e_general, "trap");
                 }
                 CONVERT_OP(i32, s_truncf64i, f64);
             });
             OP(i32_trunc_f64_u, {
-                if (unlikely(s_isnan64((sp - 1)->u_f64) || (sp - 1)->u_f64 <= -1. || (sp - 1)->u_f64 >= 4294967296.)) {
+                if (unlikely(s_isnan64(top(f64)) || top(f64) <= -1. || top(f64) >= 4294967296.)) {
                     return err(e_general, "trap");
                 }
                 CONVERT_OP(i32, s_truncf64u, f64);
@@ -655,25 +794,25 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
             OP(i64_extend_i32_s, { CONVERT_OP(i64, s_as_i32, i32); });
             OP(i64_extend_i32_u, { CONVERT_OP(i64, s_as_i32u, i32); });
             OP(i64_trunc_f32_s, {
-                if (unlikely(s_isnan32((sp - 1)->u_f32) || (sp - 1)->u_f32 < -9223372036854775808.f || (sp - 1)->u_f32 >= 9223372036854775808.f)) {
+                if (unlikely(s_isnan32(top(f32)) || top(f32) < -9223372036854775808.f || top(f32) >= 9223372036854775808.f)) {
                     return err(e_general, "trap");
                 }
                 CONVERT_OP(i64, s_truncf32i, f32);
             });
             OP(i64_trunc_f32_u, {
-                if (unlikely(s_isnan32((sp - 1)->u_f32) || (sp - 1)->u_f32 <= -1.f || (sp - 1)->u_f32 >= 18446744073709551616.f)) {
+                if (unlikely(s_isnan32(top(f32)) || top(f32) <= -1.f || top(f32) >= 18446744073709551616.f)) {
                     return err(e_general, "trap");
                 }
                 CONVERT_OP(i64, s_truncf32u, f32);
             });
             OP(i64_trunc_f64_s, {
-                if (unlikely(s_isnan64((sp - 1)->u_f64) || (sp - 1)->u_f64 < -9223372036854775808. || (sp - 1)->u_f64 >= 9223372036854775808.)) {
+                if (unlikely(s_isnan64(top(f64)) || top(f64) < -9223372036854775808. || top(f64) >= 9223372036854775808.)) {
                     return err(e_general, "trap");
                 }
                 CONVERT_OP(i64, s_truncf64i, f64);
             });
             OP(i64_trunc_f64_u, {
-                if (unlikely(s_isnan64((sp - 1)->u_f64) || (sp - 1)->u_f64 <= -1. || (sp - 1)->u_f64 >= 18446744073709551616.)) {
+                if (unlikely(s_isnan64(top(f64)) || top(f64) <= -1. || top(f64) >= 18446744073709551616.)) {
                     return err(e_general, "trap");
                 }
                 CONVERT_OP(i64, s_truncf64u, f64);
@@ -694,22 +833,23 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
             OP(f64_reinterpret_i64, { REINTERPRET_OP(f64, i64); });
             OP(i32_extend8_s, { CONVERT_OP(i32, s_as_i8, i32); });
             OP(i32_extend16_s, { CONVERT_OP(i32, s_as_i16, i32); });
-            OP(i64_extend8_s, { CONVERT_OP(i64, s_as_i8, i32); });
-            OP(i64_extend16_s, { CONVERT_OP(i64, s_as_i16, i32); });
+            OP(i64_extend8_s, { CONVERT_OP(i64, s_as_i8, i64); });
+            OP(i64_extend16_s, { CONVERT_OP(i64, s_as_i16, i64); });
             OP(i64_extend32_s, { CONVERT_OP(i64, s_as_i32, i64); });
 
             OP(ref_null, {
                 stream_seek_unchecked(pc, 1);
-                push((value_u){.u_ref = nullref});
+                push(ref, nullref);
             });
             OP(ref_is_null, {
-                (sp - 1)->u_i32 = ((sp - 1)->u_ref == nullref);
+                ref v = pop(ref);
+                push(i32, v == nullref);
             });
             OP(ref_func, {
                 u32 f_idx;
                 stream_read_vu32_unchecked(f_idx, pc);
                 ref fref = to_ref(*vec_at_func_addr(&mod_inst->f_addrs, f_idx));
-                push((value_u){.u_ref = fref});
+                push(ref, fref);
             });
 
             // fc and fd prefixes.
@@ -718,90 +858,98 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
                 stream_read_vu32_unchecked(opcode_fc, pc);
                 switch (opcode_fc) {
                     case op_i32_trunc_sat_f32_s: {
-                        if (s_isnan32((sp - 1)->u_f32)) {
-                            (sp - 1)->u_i32 = 0;
-                        } else if ((sp - 1)->u_f32 < -2147483648.f) {
-                            (sp - 1)->u_i32 = i32_MIN;
-                        } else if ((sp - 1)->u_f32 >= 2147483648.f) {
-                            (sp - 1)->u_i32 = i32_MAX;
+                        f32 v = pop(f32);
+                        if (s_isnan32(v)) {
+                            push(i32, 0);
+                        } else if (v < -2147483648.f) {
+                            push(i32, i32_MIN);
+                        } else if (v >= 2147483648.f) {
+                            push(i32, i32_MAX);
                         } else {
-                            CONVERT_OP(i32, s_truncf32i, f32);
+                            push(i32, (i32)(s_truncf32i(v)));
                         }
                         continue;
                     }
                     case op_i32_trunc_sat_f32_u: {
-                        if (s_isnan32((sp - 1)->u_f32) || (sp - 1)->u_f32 <= -1.f) {
-                            (sp - 1)->u_u32 = 0;
-                        } else if ((sp - 1)->u_f32 >= 4294967296.f) {
-                            (sp - 1)->u_u32 = u32_MAX;
+                        f32 v = pop(f32);
+                        if (s_isnan32(v) || v <= -1.f) {
+                            push(u32, 0);
+                        } else if (v >= 4294967296.f) {
+                            push(u32, u32_MAX);
                         } else {
-                            CONVERT_OP(i32, s_truncf32u, f32);
+                            push(i32, (i32)(s_truncf32u(v)));
                         }
                         continue;
                     }
                     case op_i32_trunc_sat_f64_s: {
-                        if (s_isnan64((sp - 1)->u_f64)) {
-                            (sp - 1)->u_i32 = 0;
-                        } else if ((sp - 1)->u_f64 <= -2147483649.) {
-                            (sp - 1)->u_i32 = i32_MIN;
-                        } else if ((sp - 1)->u_f64 >= 2147483648.) {
-                            (sp - 1)->u_i32 = i32_MAX;
+                        f64 v = pop(f64);
+                        if (s_isnan64(v)) {
+                            push(i32, 0);
+                        } else if (v <= -2147483649.) {
+                            push(i32, i32_MIN);
+                        } else if (v >= 2147483648.) {
+                            push(i32, i32_MAX);
                         } else {
-                            CONVERT_OP(i32, s_truncf64i, f64);
+                            push(i32, (i32)(s_truncf64i(v)));
                         }
                         continue;
                     }
                     case op_i32_trunc_sat_f64_u: {
-                        if (s_isnan64((sp - 1)->u_f64) || (sp - 1)->u_f64 <= -1.) {
-                            (sp - 1)->u_u32 = 0;
-                        } else if ((sp - 1)->u_f64 >= 4294967296.) {
-                            (sp - 1)->u_u32 = u32_MAX;
+                        f64 v = pop(f64);
+                        if (s_isnan64(v) || v <= -1.) {
+                            push(u32, 0);
+                        } else if (v >= 4294967296.) {
+                            push(u32, u32_MAX);
                         } else {
-                            CONVERT_OP(i32, s_truncf64u, f64);
+                            push(i32, (i32)(s_truncf64u(v)));
                         }
                         continue;
                     }
                     case op_i64_trunc_sat_f32_s: {
-                        if (s_isnan32((sp - 1)->u_f32)) {
-                            (sp - 1)->u_i64 = 0;
-                        } else if ((sp - 1)->u_f32 < -9223372036854775808.f) {
-                            (sp - 1)->u_i64 = i64_MIN;
-                        } else if ((sp - 1)->u_f32 >= 9223372036854775808.f) {
-                            (sp - 1)->u_i64 = i64_MAX;
+                        f32 v = pop(f32);
+                        if (s_isnan32(v)) {
+                            push(i64, 0);
+                        } else if (v < -9223372036854775808.f) {
+                            push(i64, i64_MIN);
+                        } else if (v >= 9223372036854775808.f) {
+                            push(i64, i64_MAX);
                         } else {
-                            CONVERT_OP(i64, s_truncf32i, f32);
+                            push(i64, (i64)(s_truncf32i(v)));
                         }
                         continue;
                     }
                     case op_i64_trunc_sat_f32_u: {
-                        if (s_isnan32((sp - 1)->u_f32) || (sp - 1)->u_f32 <= -1.f) {
-                            (sp - 1)->u_u64 = 0;
-                        } else if ((sp - 1)->u_f32 >= 18446744073709551616.f) {
-                            (sp - 1)->u_u64 = u64_MAX;
+                        f32 v = pop(f32);
+                        if (s_isnan32(v) || v <= -1.f) {
+                            push(u64, 0);
+                        } else if (v >= 18446744073709551616.f) {
+                            push(u64, u64_MAX);
                         } else {
-                            CONVERT_OP(i64, s_truncf32u, f32);
+                            push(i64, (i64)(s_truncf32u(v)));
                         }
                         continue;
                     }
                     case op_i64_trunc_sat_f64_s: {
-                        if (s_isnan64((sp - 1)->u_f64)) {
-                            (sp - 1)->u_i64 = 0;
-                        } else if ((sp - 1)->u_f64 < -9223372036854775808.) {
-                            (sp - 1)->u_i64 = i64_MIN;
-                        } else if ((sp - 1)->u_f64 >= 9223372036854775808.) {
-                            (sp - 1)->u_i64 = i64_MAX;
+                        f64 v = pop(f64);
+                        if (s_isnan64(v)) {
+                            push(i64, 0);
+                        } else if (v < -9223372036854775808.) {
+                            push(i64, i64_MIN);
+                        } else if (v >= 9223372036854775808.) {
+                            push(i64, i64_MAX);
                         } else {
-                            CONVERT_OP(i64, s_truncf64i, f64);
+                            push(i64, (i64)(s_truncf64i(v)));
                         }
                         continue;
                     }
                     case op_i64_trunc_sat_f64_u: {
-                        if (s_isnan64((sp - 1)->u_f64) || (sp - 1)->u_f64 <= -1.) {
-                            (sp - 1)->u_u64 = 0;
-                        } else if ((sp - 1)->u_f64 >= 18446744073709551616.) {
-                            (sp - 1)->u_u64 = u64_MAX;
+                        f64 v = pop(f64);
+                        if (s_isnan64(v) || v <= -1.) {
+                            push(u64, 0);
+                        } else if (v >= 18446744073709551616.) {
+                            push(u64, u64_MAX);
                         } else {
-                            CONVERT_OP(i64, s_truncf64u, f64);
+                            push(i64, (i64)(s_truncf64u(v)));
                         }
                         continue;
                     }
@@ -813,9 +961,9 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
                         assert(mod);
                         assert(data_idx < vec_size_data(&mod->data));
                         data * d = vec_at_data(&mod->data, data_idx);
-                        u64 size = pop().u_u32;
-                        u64 src = pop().u_u32;
-                        u64 dst = pop().u_u32;
+                        u64 size = pop(u32);
+                        u64 src = pop(u32);
+                        u64 dst = mem_index(pop_addr(), mem0_is64);
                         if (unlikely(((src + size) > str_len(d->bytes)) || ((dst + size) > vec_size_u8(pmem0)))) {
                             return err(e_general, "Invalid data access");
                         }
@@ -836,9 +984,9 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
                     }
                     case op_memory_copy: {
                         stream_seek_unchecked(pc, 2);
-                        u64 size = pop().u_u32;
-                        u64 src = pop().u_u32;
-                        u64 dst = pop().u_u32;
+                        u64 size = mem_index(pop_addr(), mem0_is64);
+                        u64 src = mem_index(pop_addr(), mem0_is64);
+                        u64 dst = mem_index(pop_addr(), mem0_is64);
                         if (unlikely(((src + size) > vec_size_u8(pmem0)) || ((dst + size) > vec_size_u8(pmem0)))) {
                             return err(e_general, "Invalid memory access");
                         }
@@ -849,9 +997,9 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
                     }
                     case op_memory_fill: {
                         stream_seek_unchecked(pc, 1);
-                        u64 size = pop().u_u32;
-                        u64 val = pop().u_i32;
-                        u64 dst = pop().u_u32;
+                        u64 size = mem_index(pop_addr(), mem0_is64);
+                        u64 val = pop(i32);
+                        u64 dst = mem_index(pop_addr(), mem0_is64);
                         if (unlikely((dst + size) > vec_size_u8(pmem0))) {
                             return err(e_general, "Invalid memory access");
                         }
@@ -869,9 +1017,9 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
                         module * mod = mod_inst->mod;
                         assert(mod);
                         element * elem = vec_at_element(&mod->elements, elem_idx);
-                        u64 size = pop().u_u32;
-                        u64 src = pop().u_u32;
-                        u64 dst = pop().u_u32;
+                        u64 size = pop(u32);
+                        u64 src = pop(u32);
+                        u64 dst = pop(u32);
                         if (unlikely(((src + size) > elem->data_len) || ((dst + size) > vec_size_ref(&t_addr->tdata)))) {
                             return err(e_general, "Invalid table access");
                         }
@@ -923,9 +1071,9 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
                         stream_read_vu32_unchecked(table_idx_src, pc);
                         tab_addr t_addr_dst = *vec_at_tab_addr(&mod_inst->t_addrs, table_idx_dst);
                         tab_addr t_addr_src = *vec_at_tab_addr(&mod_inst->t_addrs, table_idx_src);
-                        u64 size = pop().u_u32;
-                        u64 src = pop().u_u32;
-                        u64 dst = pop().u_u32;
+                        u64 size = pop(u32);
+                        u64 src = pop(u32);
+                        u64 dst = pop(u32);
                         if (unlikely(((src + size) > vec_size_ref(&t_addr_src->tdata)) || ((dst + size) > vec_size_ref(&t_addr_dst->tdata)))) {
                             return err(e_general, "Invalid table access");
                         }
@@ -937,19 +1085,19 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
                     case op_table_grow: {
                         u32 table_idx;
                         stream_read_vu32_unchecked(table_idx, pc);
-                        u64 size = pop().u_u32;
-                        ref type = pop().u_ref;
+                        u64 size = pop(u32);
+                        ref type = pop(ref);
                         tab_addr t_addr = *vec_at_tab_addr(&mod_inst->t_addrs, table_idx);
                         size_t curr_size = vec_size_ref(&t_addr->tdata);
                         if ((curr_size + size > t_addr->tab->lim.max) || !is_ok(vec_resize_ref(&t_addr->tdata, curr_size + size))) {
-                            push((value_u){.u_i32 = -1});
+                            push(i32, -1);
                             continue;
                         }
                         check(vec_resize_ref(&t_addr->tdata, curr_size + size));
                         for (size_t i = 0; i < size; i++) {
                             *vec_at_ref(&t_addr->tdata, curr_size + i) = type;
                         }
-                        push((value_u){.u_i32 = (i32)curr_size});
+                        push(i32, (i32)curr_size);
                         continue;
                     }
                     case op_table_size: {
@@ -957,16 +1105,16 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
                         stream_read_vu32_unchecked(table_idx, pc);
                         tab_addr t_addr = *vec_at_tab_addr(&mod_inst->t_addrs, table_idx);
                         size_t curr_size = vec_size_ref(&t_addr->tdata);
-                        push((value_u){.u_i32 = (i32)curr_size});
+                        push(i32, (i32)curr_size);
                         continue;
                     }
                     case op_table_fill: {
                         u32 table_idx;
                         stream_read_vu32_unchecked(table_idx, pc);
                         tab_addr t_addr = *vec_at_tab_addr(&mod_inst->t_addrs, table_idx);
-                        u64 size = pop().u_u32;
-                        ref type = pop().u_ref;
-                        u64 offset = pop().u_i32;
+                        u64 size = pop(u32);
+                        ref type = pop(ref);
+                        u64 offset = pop(i32);
                         if (unlikely(offset + size > vec_size_ref(&t_addr->tdata))) {
                             return err(e_invalid, "Invalid table access");
                         }
@@ -982,17 +1130,20 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
                 continue;
             });
             OP(prefix_fd, {
-                u32 opcode_fd;
-                stream_read_vu32_unchecked(opcode_fd, pc);
-                switch (opcode_fd) {
-                    case op_v128_load: {
-                        continue;
-                    }
-                    default: {
-                        return err(e_malformed, "Unsupported opcode");
-                    }
-                }
-                continue;
+                // pc and sp live in registers.
+                const u8 * simd_pc = pc;
+                value_slot * simd_sp = sp;
+                check(interp_simd_op(mem_inst0, &simd_pc, &simd_sp));
+                pc = simd_pc;
+                sp = simd_sp;
+            });
+            OP(prefix_fe, {
+                // pc and sp live in registers.
+                const u8 * atomic_pc = pc;
+                value_slot * atomic_sp = sp;
+                check(interp_atomic_op(mem_inst0, &atomic_pc, &atomic_sp));
+                pc = atomic_pc;
+                sp = atomic_sp;
             });
 #if !defined(HAS_COMPUTED_GOTO)
             default: {
@@ -1003,12 +1154,40 @@ r in_place_dt_call(thread * t, func_addr f_addr, value_u * args) {
     }
 
 end:;
-    u32 arity = fn->fn_type.result_count;
+    u32 arity = func_result_slots(fn);
     assert(sp - stack_base >= arity);
-    memmove(local, sp - arity, sizeof(value_u) * arity);
+    // the results go to where the caller passed the args in, a tail call doesn't change the arity.
+    memmove(args, sp - arity, sizeof(value_slot) * arity);
+    interp_tail_call_leave(t, &tail_area);
     t->frame_depth--;
-    t->stack_size -= fn->stack_size_max;
+    t->stack_size -= tail_area.stack_cap;
     return ok_r;
+
+tail_call:;
+    {
+        func * callee_fn = tail_addr->fn;
+        u32 param_slots = func_param_slots(callee_fn);
+        assert(sp - stack_base >= param_slots);
+        sp -= param_slots;
+        if (unlikely(callee_fn->tr)) {
+            // the host functions don't have a frame to reuse, call it as usual and return.
+            check(interp_call_host(tail_addr, sp, mem_inst0));
+            sp += func_result_slots(callee_fn);
+            goto end;
+        }
+        value_slot * callee_local;
+        value_slot * callee_stack;
+        check(interp_tail_call_enter(t, &tail_area, callee_fn, sp, &callee_local, &callee_stack));
+        local = callee_local;
+        stack_base = callee_stack;
+        fn = callee_fn;
+        mod_inst = tail_addr->mod_inst;
+        // the function entry is a safe point.
+        if (THREAD_SAFEPOINT_DUE(t)) {
+            check(thread_safepoint(t));
+        }
+        goto enter;
+    }
 }
 
 #endif // SILVERFIR_INTERP_INPLACE_DT
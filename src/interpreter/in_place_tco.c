@@ -21,6 +21,8 @@
 #include "alloc.h"
 #include "compiler.h"
 #include "interpreter.h"
+#include "code_cache.h"
+#include "jt_cache.h"
 #include "mem_util.h"
 #include "opcode.h"
 #include "silverfir.h"
@@ -45,11 +47,52 @@ typedef struct call_ctx {
     mem_addr mem_inst0;
     u8 * mem0;
     size_t mem0_size;
+    bool mem0_is64;
     // better put them in the reg
     jump_table * jt;
+    jump_table_escape * jt_escapes;
     u16 next_jt_idx;
+    // set by the tail call handlers before returning tail_call_pending.
+    func_addr tail_addr;
+    value_u * tail_args;
 } call_ctx;
 
+// Returned by the tail call handlers instead of an error, in_place_tco_call then runs the callee
+// in place of the frame.
+static const char tail_call_pending[] = "tail call";
+
+// With a budget (see jt_cache.h), the jump table is built on demand and any call can evict it,
+// so it's acquired again after the calls.
+static r tco_ctx_load_jt(call_ctx * ctx) {
+    check_prep(r);
+    if (unlikely(ctx->mod->jt_cache)) {
+        check(jt_cache_acquire(ctx->mod, ctx->fn));
+    }
+    ctx->jt = ctx->fn->jt._data;
+    ctx->jt_escapes = ctx->fn->jt_escapes._data;
+    return ok_r;
+}
+
+// The same for the compressed code (see code_cache.h), the body can be somewhere else when it's
+// decompressed again.
+static r tco_ctx_reload(call_ctx * ctx) {
+    check_prep(r);
+    if (unlikely(ctx->mod->code_cache)) {
+        check(code_cache_acquire(ctx->mod, ctx->fn));
+        ctx->code = ctx->fn->code;
+    }
+    return tco_ctx_load_jt(ctx);
+}
+
+// The pc is moved with the code. It's rebased from the offset instead of being passed by address,
+// which would keep the handler's pc in memory and stop the compiler from tail calling the next one.
+#define TCO_CTX_RELOAD(ret)                              \
+    do {                                                 \
+        size_t pc_offset = (size_t)(pc - ctx->code.ptr); \
+        (ret) = tco_ctx_reload(ctx);                     \
+        pc = ctx->code.ptr + pc_offset;                  \
+    } while (0)
+
 #define TCO_CALL_CONVENTION
 
 #define OP_HANDLER_ARGS const u8 *pc, void *handler_base, value_u *sp, value_u *local, call_ctx *ctx
@@ -70,6 +113,19 @@ typedef err_msg_t(TCO_CALL_CONVENTION * op_handler)(OP_HANDLER_ARGS);
 #define NEXT_OP_TAIL() MUSTTAIL return (handler(pc, handler_base, sp, local, ctx))
 #endif
 
+// loops are the only backward branches. Another green thread can run the same module meanwhile,
+// so the code and the jump table are loaded again.
+#define BACKWARD_BRANCH_SAFEPOINT(offsets)                                       \
+    if (unlikely((offsets).target_offset < 0) && THREAD_SAFEPOINT_DUE(ctx->t)) { \
+        r ret_safepoint = thread_safepoint(ctx->t);                              \
+        if (is_ok(ret_safepoint)) {                                              \
+            TCO_CTX_RELOAD(ret_safepoint);                                       \
+        }                                                                        \
+        if (!is_ok(ret_safepoint)) {                                             \
+            return ret_safepoint.msg;                                            \
+        }                                                                        \
+    }
+
 #define CHECK_STACK() (assert(sp >= ctx->stack_base && sp <= ctx->stack_base + ctx->fn->stack_size_max))
 #define pop() (CHECK_STACK(), *--sp)
 #define pop_drop() (CHECK_STACK(), --sp)
@@ -78,10 +134,10 @@ typedef err_msg_t(TCO_CALL_CONVENTION * op_handler)(OP_HANDLER_ARGS);
 #define MEM_LOAD_OP(name, dst_type, src_type)                                     \
     OP(name) {                                                                    \
         stream_seek_unchecked(pc, 1);                                             \
-        u32 offset;                                                               \
-        stream_read_vu32_unchecked(offset, pc);                                   \
+        u64 offset;                                                               \
+        stream_read_vu64_unchecked(offset, pc);                                   \
         READ_NEXT_OP();                                                           \
-        u64 mem_idx = (u64)(u32)(pop().u_i32) + offset;                           \
+        u64 mem_idx = mem_effective_addr(pop(), offset, ctx->mem0_is64);          \
         if (unlikely(mem_idx + sizeof(src_type) > ctx->mem0_size)) {              \
             return "t.load: out-of-bound memory access";                          \
         }                                                                         \
@@ -93,11 +149,11 @@ typedef err_msg_t(TCO_CALL_CONVENTION * op_handler)(OP_HANDLER_ARGS);
 #define MEM_STORE_OP(name, dst_type, src_type)                                     \
     OP(name) {                                                                     \
         stream_seek_unchecked(pc, 1);                                              \
-        u32 offset;                                                                \
-        stream_read_vu32_unchecked(offset, pc);                                    \
+        u64 offset;                                                                \
+        stream_read_vu64_unchecked(offset, pc);                                    \
         READ_NEXT_OP();                                                            \
         value_u val = pop();                                                       \
-        u64 mem_idx = (u64)(u32)(pop().u_i32) + offset;                            \
+        u64 mem_idx = mem_effective_addr(pop(), offset, ctx->mem0_is64);           \
         if (unlikely(mem_idx + sizeof(dst_type) > ctx->mem0_size)) {               \
             return "t.store: out-of-bound memory access";                          \
         }                                                                          \
@@ -171,9 +227,8 @@ OP(if) {
         ctx->next_jt_idx++;
     } else {
         jump_table * tbl = ctx->jt + ctx->next_jt_idx;
-        assert(ctx->code.ptr + tbl->pc == pc);
         ctx->next_jt_idx = tbl->next_idx;
-        pc += tbl->target_offset;
+        pc += jump_table_decode(tbl, ctx->jt_escapes).target_offset;
         READ_NEXT_OP_NODECL();
     }
     NEXT_OP();
@@ -181,9 +236,8 @@ OP(if) {
 
 OP(else) {
     jump_table * tbl = ctx->jt + ctx->next_jt_idx;
-    assert(ctx->code.ptr + tbl->pc == pc);
     ctx->next_jt_idx = tbl->next_idx;
-    pc += tbl->target_offset;
+    pc += jump_table_decode(tbl, ctx->jt_escapes).target_offset;
     READ_NEXT_OP();
     NEXT_OP();
 }
@@ -202,18 +256,18 @@ OP(end) {
 
 OP(br) {
     jump_table * tbl = ctx->jt + ctx->next_jt_idx;
-    assert(ctx->code.ptr + tbl->pc == pc);
+    jump_table_escape offsets = jump_table_decode(tbl, ctx->jt_escapes);
     ctx->next_jt_idx = tbl->next_idx;
-    pc += tbl->target_offset;
+    pc += offsets.target_offset;
     READ_NEXT_OP();
-    if (unlikely(tbl->stack_offset)) {
-        u32 stack_offset = tbl->stack_offset;
+    if (unlikely(offsets.stack_offset)) {
+        u32 stack_offset = offsets.stack_offset;
         u16 arity = tbl->arity;
-        assert(stack_offset < 32767);
         assert(sp - ctx->stack_base >= stack_offset + arity);
         memmove(sp - stack_offset - arity, sp - arity, sizeof(value_u) * arity);
         sp -= stack_offset;
     }
+    BACKWARD_BRANCH_SAFEPOINT(offsets);
     NEXT_OP();
 }
 
@@ -223,20 +277,20 @@ OP(br_if) {
     if (c) {
         // copy of OP(br), except for the read next op
         jump_table * tbl = ctx->jt + ctx->next_jt_idx;
-        assert(ctx->code.ptr + tbl->pc == pc);
+        jump_table_escape offsets = jump_table_decode(tbl, ctx->jt_escapes);
         ctx->next_jt_idx = tbl->next_idx;
-        pc += tbl->target_offset;
+        pc += offsets.target_offset;
         READ_NEXT_OP_NODECL();
-        if (unlikely(tbl->stack_offset)) {
-            u32 stack_offset = tbl->stack_offset;
+        if (unlikely(offsets.stack_offset)) {
+            u32 stack_offset = offsets.stack_offset;
             u16 arity = tbl->arity;
-            assert(stack_offset < 32767);
             assert(sp - ctx->stack_base >= stack_offset + arity);
             value_u * dst = sp - stack_offset - arity;
             value_u * src = sp - arity;
             memmove(dst, src, sizeof(value_u) * arity);
             sp -= stack_offset;
         }
+        BACKWARD_BRANCH_SAFEPOINT(offsets);
     } else {
         stream_seek_unchecked(pc, 1); //lth
         READ_NEXT_OP_NODECL();
@@ -256,20 +310,20 @@ OP(br_table) {
     ctx->next_jt_idx += (u16)i;
     // copy of OP(br)
     jump_table * tbl = ctx->jt + ctx->next_jt_idx;
-    assert(ctx->code.ptr + tbl->pc == pc);
+    jump_table_escape offsets = jump_table_decode(tbl, ctx->jt_escapes);
     ctx->next_jt_idx = tbl->next_idx;
-    pc += tbl->target_offset;
+    pc += offsets.target_offset;
     READ_NEXT_OP();
-    if (unlikely(tbl->stack_offset)) {
-        u32 stack_offset = tbl->stack_offset;
+    if (unlikely(offsets.stack_offset)) {
+        u32 stack_offset = offsets.stack_offset;
         u16 arity = tbl->arity;
-        assert(stack_offset < 32767);
         assert(sp - ctx->stack_base >= stack_offset + arity);
         value_u * dst = sp - stack_offset - arity;
         value_u * src = sp - arity;
         memmove(dst, src, sizeof(value_u) * arity);
         sp -= stack_offset;
     }
+    BACKWARD_BRANCH_SAFEPOINT(offsets);
     NEXT_OP();
 }
 
@@ -314,6 +368,12 @@ OP(call) {
         return ret.msg;
     }
     sp += callee_type.result_count;
+    if (unlikely(ctx->mod->jt_cache || ctx->mod->code_cache)) {
+        TCO_CTX_RELOAD(ret);
+        if (!is_ok(ret)) {
+            return ret.msg;
+        }
+    }
     NEXT_OP_TAIL();
 }
 
@@ -375,9 +435,52 @@ OP(call_indirect) {
         array_free(callee_local);
     }
     sp += callee_type.result_count;
+    if (unlikely(ctx->mod->jt_cache || ctx->mod->code_cache)) {
+        TCO_CTX_RELOAD(ret);
+        if (!is_ok(ret)) {
+            return ret.msg;
+        }
+    }
     NEXT_OP_TAIL();
 }
 
+OP(return_call) {
+    u32 fn_idx_local;
+    stream_read_vu32_unchecked(fn_idx_local, pc);
+    assert(fn_idx_local < vec_size_func(&ctx->mod->funcs));
+    func_addr callee_addr = *vec_at_func_addr(&ctx->mod_inst->f_addrs, fn_idx_local);
+    assert(sp - ctx->stack_base >= callee_addr->fn->fn_type.param_count);
+    ctx->tail_addr = callee_addr;
+    ctx->tail_args = sp - callee_addr->fn->fn_type.param_count;
+    return tail_call_pending;
+}
+
+OP(return_call_indirect) {
+    u32 type_idx;
+    stream_read_vu32_unchecked(type_idx, pc);
+    func_type src_type = *vec_at_func_type(&ctx->mod->func_types, type_idx);
+    u32 table_idx;
+    stream_read_vu32_unchecked(table_idx, pc);
+    assert(table_idx < vec_size_tab_addr(&ctx->mod_inst->t_addrs));
+    tab_addr t_addr = *vec_at_tab_addr(&ctx->mod_inst->t_addrs, table_idx);
+    size_t i = pop().u_i32;
+    if (i >= vec_size_ref(&t_addr->tdata)) {
+        return "return_call_indirect: invalid table element index";
+    }
+    ref fref = *vec_at_ref(&t_addr->tdata, i);
+    if (fref == nullref) {
+        return "return_call_indirect: element is ref.null";
+    }
+    func_addr callee_addr = to_func_addr(fref);
+    if (!func_type_eq(callee_addr->fn->fn_type, src_type)) {
+        return "return_call_indirect: function type mismatch";
+    }
+    assert(sp - ctx->stack_base >= src_type.param_count);
+    ctx->tail_addr = callee_addr;
+    ctx->tail_args = sp - src_type.param_count;
+    return tail_call_pending;
+}
+
 OP(drop) {
     READ_NEXT_OP();
     pop_drop();
@@ -517,28 +620,21 @@ MEM_STORE_OP(i64_store32, u32, i64)
 OP(memory_size) {
     stream_seek_unchecked(pc, 1);
     READ_NEXT_OP();
-    push((value_u){.u_i32 = (i32)(ctx->mem0_size / WASM_PAGE_SIZE)});
+    u64 pages = ctx->mem0_size >> memory_page_shift(ctx->mem_inst0->mem);
+    push(ctx->mem0_is64 ? (value_u){.u_u64 = pages} : (value_u){.u_u32 = (u32)pages});
     NEXT_OP();
 }
 
 OP(memory_grow) {
     stream_seek_unchecked(pc, 1);
     READ_NEXT_OP();
-    u32 pages = (u32)(ctx->mem0_size / WASM_PAGE_SIZE);
-    size_t n_pages = (size_t)(pop().u_u32);
-    if (pages + n_pages <= ctx->mem_inst0->mem->lim.max) {
-        size_t new_size = (pages + n_pages) * WASM_PAGE_SIZE;
-        r ret_resize = vec_resize_u8(&ctx->mem_inst0->mdata, new_size);
-        if (is_ok(ret_resize)) {
-            ctx->mem0_size = new_size;
-            ctx->mem0 = vec_at_u8(&ctx->mem_inst0->mdata, 0);
-        } else {
-            pages = (u32)(-1);
-        }
-    } else {
-        pages = (u32)(-1);
+    u64 n_pages = mem_index(pop(), ctx->mem0_is64);
+    i64 pages = memory_inst_grow(ctx->mem_inst0, n_pages);
+    if (pages >= 0) {
+        ctx->mem0_size = vec_size_u8(&ctx->mem_inst0->mdata);
+        ctx->mem0 = ctx->mem_inst0->mdata._data;
     }
-    push((value_u){.u_i32 = (i32)(pages)});
+    push(ctx->mem0_is64 ? (value_u){.u_i64 = pages} : (value_u){.u_i32 = (i32)pages});
     NEXT_OP();
 }
 
@@ -984,7 +1080,7 @@ OP(prefix_fc) {
             data * d = vec_at_data(&mod->data, data_idx);
             u64 size = pop().u_u32;
             u64 src = pop().u_u32;
-            u64 dst = pop().u_u32;
+            u64 dst = mem_index(pop(), ctx->mem0_is64);
             if (((src + size) > str_len(d->bytes)) || ((dst + size) > ctx->mem0_size)) {
                 return "Invalid data access";
             }
@@ -1005,9 +1101,9 @@ OP(prefix_fc) {
         }
         case op_memory_copy: {
             stream_seek_unchecked(pc, 2);
-            u64 size = pop().u_u32;
-            u64 src = pop().u_u32;
-            u64 dst = pop().u_u32;
+            u64 size = mem_index(pop(), ctx->mem0_is64);
+            u64 src = mem_index(pop(), ctx->mem0_is64);
+            u64 dst = mem_index(pop(), ctx->mem0_is64);
             if (((src + size) > ctx->mem0_size) || ((dst + size) > ctx->mem0_size)) {
                 return "Invalid memory access";
             }
@@ -1018,9 +1114,9 @@ OP(prefix_fc) {
         }
         case op_memory_fill: {
             stream_seek_unchecked(pc, 1);
-            u64 size = pop().u_u32;
+            u64 size = mem_index(pop(), ctx->mem0_is64);
             u64 val = pop().u_i32;
-            u64 dst = pop().u_u32;
+            u64 dst = mem_index(pop(), ctx->mem0_is64);
             if ((dst + size) > ctx->mem0_size) {
                 return "Invalid memory access";
             }
@@ -1160,12 +1256,55 @@ OP(prefix_fc) {
 }
 
 OP(prefix_fd) {
-    return "Unsupported opcode";
+    err_msg_t msg = interp_simd_op(ctx->mem_inst0, &pc, &sp).msg;
+    if (unlikely(msg)) {
+        return msg;
+    }
+    READ_NEXT_OP();
+    NEXT_OP();
+}
+
+OP(prefix_fe) {
+    err_msg_t msg = interp_atomic_op(ctx->mem_inst0, &pc, &sp).msg;
+    if (unlikely(msg)) {
+        return msg;
+    }
+    // a shared memory can be grown by other threads, catch up with it here.
+    if (ctx->mem_inst0) {
+        ctx->mem0_size = vec_size_u8(&ctx->mem_inst0->mdata);
+    }
+    READ_NEXT_OP();
+    NEXT_OP();
 }
 
 #define HANDLER_ADDR(name, _1, _2, _3) [op_##name] = h_##name,
 static const op_handler handlers[256] = {FOR_EACH_WASM_OPCODE(HANDLER_ADDR)};
 
+// point the context to a function, the stack and the locals are set up by the caller.
+static r tco_ctx_enter(call_ctx * ctx, func_addr f_addr) {
+    check_prep(r);
+    ctx->f_addr = f_addr;
+    ctx->fn = f_addr->fn;
+    ctx->mod_inst = f_addr->mod_inst;
+    ctx->mod = ctx->mod_inst->mod;
+    if (unlikely(ctx->mod->code_cache)) {
+        check(code_cache_acquire(ctx->mod, ctx->fn));
+    }
+    ctx->code = f_addr->fn->code;
+    ctx->mem_inst0 = NULL;
+    ctx->mem0 = NULL;
+    ctx->mem0_size = 0;
+    ctx->mem0_is64 = false;
+    if (vec_size_mem_addr(&f_addr->mod_inst->m_addrs)) {
+        ctx->mem_inst0 = *vec_at_mem_addr(&ctx->mod_inst->m_addrs, 0);
+        ctx->mem0 = ctx->mem_inst0->mdata._data;
+        ctx->mem0_size = vec_size_u8(&ctx->mem_inst0->mdata);
+        ctx->mem0_is64 = memory_is64(ctx->mem_inst0->mem);
+    }
+    ctx->next_jt_idx = 0;
+    return tco_ctx_load_jt(ctx);
+}
+
 r in_place_tco_call(thread * t, func_addr f_addr, value_u * args) {
     assert(t);
     assert(f_addr);
@@ -1180,41 +1319,83 @@ r in_place_tco_call(thread * t, func_addr f_addr, value_u * args) {
         return err(e_exhaustion, "Stack reached size limit");
     }
 
+    if (unlikely(thread_stack_exhausted(t, f_addr->fn->stack_size_max * sizeof(value_u)))) {
+        return err(e_exhaustion, "Stack reached size limit");
+    }
+
+    if (THREAD_SAFEPOINT_DUE(t)) {
+        check(thread_safepoint(t));
+    }
+
     const u8 * pc;
-    value_u * sp;
     value_u * local = args;
 
     call_ctx ctx = {0};
     ctx.t = t;
-    ctx.f_addr = f_addr;
-    ctx.fn = f_addr->fn;
+    check(tco_ctx_enter(&ctx, f_addr));
 
     // zero-out the reset of the locals. This is *required* by the spec.
     memset(local + ctx.fn->fn_type.param_count, 0, (ctx.fn->local_count - ctx.fn->fn_type.param_count) * sizeof(value_u));
 
-    ctx.code = f_addr->fn->code;
-    pc = ctx.code.ptr;
-    op_handler handler = handlers[stream_read_u8_unchecked(pc)];
-    ctx.mod_inst = f_addr->mod_inst;
-    ctx.mod = ctx.mod_inst->mod;
     ctx.stack_base = array_alloca(value_u, ctx.fn->stack_size_max);
     if (!ctx.stack_base) {
         return err(e_exhaustion, "OOM");
     }
-    sp = ctx.stack_base;
-    if (vec_size_mem_addr(&f_addr->mod_inst->m_addrs)) {
-        ctx.mem_inst0 = *vec_at_mem_addr(&ctx.mod_inst->m_addrs, 0);
-        ctx.mem0 = ctx.mem_inst0->mdata._data;
-        ctx.mem0_size = vec_size_u8(&ctx.mem_inst0->mdata);
-    }
-    ctx.jt = ctx.fn->jt._data;
-    ctx.next_jt_idx = 0;
+    // a tail call runs the callee in place of this frame.
+    tail_call_area tail_area = {
+        .local = args,
+        .local_cap = ctx.fn->local_count,
+        .stack = ctx.stack_base,
+        .stack_cap = ctx.fn->stack_size_max,
+    };
     t->frame_depth++;
     t->stack_size += ctx.fn->stack_size_max;
-    err_msg_t result = handler(pc, (void *)(&handlers[0]), sp, local, &ctx);
+    pc = ctx.code.ptr;
+    op_handler handler = handlers[stream_read_u8_unchecked(pc)];
+    err_msg_t result = handler(pc, (void *)(&handlers[0]), ctx.stack_base, local, &ctx);
+    while (result == tail_call_pending) {
+        func * callee_fn = ctx.tail_addr->fn;
+        if (unlikely(callee_fn->tr)) {
+            // the host functions don't have a frame to reuse, call it as usual and return.
+            r ret = callee_fn->tr((tr_ctx){
+                                      .f_addr = ctx.tail_addr,
+                                      .args = ctx.tail_args,
+                                      .mem0 = ctx.mem_inst0,
+                                  },
+                                  callee_fn->host_func);
+            local = ctx.tail_args;
+            result = ret.msg;
+            break;
+        }
+        r ret = interp_tail_call_enter(t, &tail_area, callee_fn, ctx.tail_args, &local, &ctx.stack_base);
+        if (!is_ok(ret)) {
+            result = ret.msg;
+            break;
+        }
+        // the function entry is a safe point.
+        if (THREAD_SAFEPOINT_DUE(t)) {
+            ret = thread_safepoint(t);
+            if (!is_ok(ret)) {
+                result = ret.msg;
+                break;
+            }
+        }
+        ret = tco_ctx_enter(&ctx, ctx.tail_addr);
+        if (!is_ok(ret)) {
+            result = ret.msg;
+            break;
+        }
+        pc = ctx.code.ptr;
+        handler = handlers[stream_read_u8_unchecked(pc)];
+        result = handler(pc, (void *)(&handlers[0]), ctx.stack_base, local, &ctx);
+    }
+    // the return value should be in the local, move it to the args if a tail call has replaced them.
+    if (!result && (local != args)) {
+        memmove(args, local, sizeof(value_u) * ctx.fn->fn_type.result_count);
+    }
+    interp_tail_call_leave(t, &tail_area);
     t->frame_depth--;
-    t->stack_size -= ctx.fn->stack_size_max;
-    // the return value should be in the local, which is the args now.
+    t->stack_size -= tail_area.stack_cap;
     return (r){.msg = result};
 }
 
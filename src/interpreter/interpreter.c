@@ -21,7 +21,9 @@
 #include "silverfir.h"
 #include "interpreter.h"
 
-r interp_call_in_thread(thread * t, func_addr f_addr, vec_typed_value argv) {
+#include <string.h>
+
+static r interp_call_in_thread_in(thread * t, func_addr f_addr, vec_typed_value argv) {
     check_prep(r);
 
     if (!is_little_endian()) {
@@ -51,41 +53,142 @@ r interp_call_in_thread(thread * t, func_addr f_addr, vec_typed_value argv) {
     }
 
     // copy the arguments to the stack (local)
-    u32 stack_size_needed = f_addr->fn->local_count > ft.result_count ? f_addr->fn->local_count : ft.result_count;
-    value_u * stack_base = array_alloca(value_u, stack_size_needed);
+    u32 local_slots = func_local_slots(f_addr->fn);
+    u32 result_slots = func_result_slots(f_addr->fn);
+    u32 stack_size_needed = local_slots > result_slots ? local_slots : result_slots;
+    value_slot * stack_base = array_alloca(value_slot, stack_size_needed);
     if (!stack_base) {
         vec_clear_typed_value(&argv);
         return err(e_general, "Stack overflow!");
     }
-    for (u32 i = 0; i < vec_size_typed_value(&argv); i++) {
-        stack_base[i] = vec_at_typed_value(&argv, i)->val;
+    value_slot * arg_slot = stack_base;
+    VEC_FOR_EACH(&argv, typed_value, arg) {
+        u32 width = type_slot_count(arg->type);
+        value_to_slots(arg_slot, arg->val, width);
+        arg_slot += width;
     }
 
+    if (f_addr->fn->tr) {
+        // host functions don't have a body, call the trampoline directly.
+        memory_inst * mem0 = NULL;
+        if (vec_size_mem_addr(&f_addr->mod_inst->m_addrs)) {
+            mem0 = *vec_at_mem_addr(&f_addr->mod_inst->m_addrs, 0);
+        }
+        check(interp_call_host(f_addr, stack_base, mem0),
+              {
+                  t->trapped = true;
+                  vec_clear_typed_value(&argv);
+              });
+    } else {
 // Use DT first
 #if SILVERFIR_INTERP_INPLACE_DT
-    check(in_place_dt_call(t, f_addr, stack_base), {
-        t->trapped = true;
-        vec_clear_typed_value(&argv);
-    });
+        check(in_place_dt_call(t, f_addr, stack_base), {
+            t->trapped = true;
+            vec_clear_typed_value(&argv);
+        });
 #elif SILVERFIR_INTERP_INPLACE_TCO
-    check(in_place_tco_call(t, f_addr, stack_base), {
-        t->trapped = true;
-        vec_clear_typed_value(&argv);
-    });
+        check(in_place_tco_call(t, f_addr, stack_base), {
+            t->trapped = true;
+            vec_clear_typed_value(&argv);
+        });
 #endif
+    }
 
     vec_clear_typed_value(&argv);
 
     // prepare the typed return values
     vec_clear_typed_value(&t->results);
     st = stream_from(ft.results);
+    value_slot * result_slot = stack_base;
     for (u32 i = 0; i < ft.result_count; i++) {
         unwrap(i8, type, stream_read_vi7(&st));
+        u32 width = type_slot_count((type_id)type);
         check(vec_push_typed_value(&t->results, (typed_value){
                                                     .type = type,
-                                                    .val = stack_base[i],
+                                                    .val = value_from_slots(result_slot, width),
                                                 }));
+        result_slot += width;
     }
 
     return ok_r;
 }
+
+r interp_call_in_thread(thread * t, func_addr f_addr, vec_typed_value argv) {
+    allocator * prev = alloc_enter(t->alloc);
+    r ret = interp_call_in_thread_in(t, f_addr, argv);
+    alloc_leave(prev);
+    return ret;
+}
+
+#if SILVERFIR_STACK_SLOT_32
+r interp_call_host(func_addr f_addr, value_slot * args, memory_inst * mem0) {
+    check_prep(r);
+    func_type ft = f_addr->fn->fn_type;
+    value_u * values = array_alloca(value_u, ft.param_count > ft.result_count ? ft.param_count : ft.result_count);
+    if (!values) {
+        return err(e_general, "Stack overflow!");
+    }
+    value_slot * slot = args;
+    for (u32 i = 0; i < ft.param_count; i++) {
+        u32 width = type_slot_count(types_at(ft.params, i));
+        values[i] = value_from_slots(slot, width);
+        slot += width;
+    }
+    check(f_addr->fn->tr((tr_ctx){
+                             .f_addr = f_addr,
+                             .args = values,
+                             .mem0 = mem0,
+                         },
+                         f_addr->fn->host_func));
+    slot = args;
+    for (u32 i = 0; i < ft.result_count; i++) {
+        u32 width = type_slot_count(types_at(ft.results, i));
+        value_to_slots(slot, values[i], width);
+        slot += width;
+    }
+    return ok_r;
+}
+#endif
+
+r interp_tail_call_enter(thread * t, tail_call_area * area, func * callee, value_slot * args, value_slot ** local, value_slot ** stack_base) {
+    assert(t);
+    assert(area);
+    assert(callee && !callee->tr);
+    check_prep(r);
+
+    u32 param_slots = func_param_slots(callee);
+    u32 local_slots = func_local_slots(callee);
+    value_slot * new_local = area->local;
+    value_slot * new_stack = area->stack;
+    if ((local_slots > area->local_cap) || (callee->stack_size_max > area->stack_cap)) {
+        u32 cap = local_slots + callee->stack_size_max;
+        tail_frame * heap = area->heap;
+        if (!heap || (heap->cap < cap)) {
+            heap = thread_tail_frame_alloc(t, cap);
+            if (!heap) {
+                return err(e_general, "Stack overflow!");
+            }
+            // the args could be in the old one.
+            memcpy(heap->slots, args, sizeof(value_slot) * param_slots);
+            args = heap->slots;
+            if (area->heap) {
+                thread_tail_frame_free(t, area->heap);
+            }
+            area->heap = heap;
+        }
+        new_local = heap->slots;
+        new_stack = heap->slots + local_slots;
+    }
+    memmove(new_local, args, sizeof(value_slot) * param_slots);
+    memset(new_local + param_slots, 0, (local_slots - param_slots) * sizeof(value_slot));
+    *local = new_local;
+    *stack_base = new_stack;
+    return ok_r;
+}
+
+void interp_tail_call_leave(thread * t, tail_call_area * area) {
+    if (unlikely(area->heap)) {
+        thread_tail_frame_free(t, area->heap);
+        area->heap = NULL;
+    }
+}
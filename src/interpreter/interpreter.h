@@ -19,6 +19,8 @@
 #include "result.h"
 #include "vm.h"
 
+#include <string.h>
+
 // Call a function in a thread. The state (including the return values) will be recorded in the thread.
 // This function will take the ownership of the argv.
 r interp_call_in_thread(thread * t, func_addr f_addr, vec_typed_value argv);
@@ -26,7 +28,117 @@ r interp_call_in_thread(thread * t, func_addr f_addr, vec_typed_value argv);
 // Note: passive element section allows ref.null and ref.func only.
 r_typed_value interp_reduce_const_expr(module_inst * mod_inst, stream code, bool passive_elem);
 
-r in_place_dt_call(thread * t, func_addr f_addr, value_u * args);
+// Count down the preemption budget at a safe point, see thread.
+#define THREAD_SAFEPOINT_DUE(t) (unlikely(--(t)->budget < 0))
+
+// Whether a frame of the given size would take the native stack below the floor of the thread,
+// see thread. The address of a local stands for the stack pointer, the stack grows down.
+INLINE bool thread_stack_exhausted(const thread * t, size_t frame_bytes) {
+    volatile u8 probe = 0;
+    return t->stack_floor && ((uptr)&probe < t->stack_floor + frame_bytes);
+}
+
+// Read a memory index (an address, a size or a page count) from an operand, which is an i64 for a
+// 64-bit memory. The 64-bit ones are clamped to MEMORY64_SIZE_LIMIT, which is out of bounds anyway.
+INLINE u64 mem_index(value_u v, bool is64) {
+    if (is64) {
+        return likely(v.u_u64 < MEMORY64_SIZE_LIMIT) ? v.u_u64 : MEMORY64_SIZE_LIMIT;
+    }
+    return v.u_u32;
+}
+
+// The offset is read as a u64 for both, it always fits in a u32 for a 32-bit memory. Adding the
+// access size to the result never overflows.
+INLINE u64 mem_effective_addr(value_u v, u64 offset, bool is64) {
+    if (is64) {
+        return mem_index(v, true) + (likely(offset < MEMORY64_SIZE_LIMIT) ? offset : MEMORY64_SIZE_LIMIT);
+    }
+    return (u64)v.u_u32 + offset;
+}
+
+// Typed access to the slots. A slot is a value_u unless SILVERFIR_STACK_SLOT_32 is on, then the
+// values are copied in and out since the 64-bit ones are split into two slots.
+#if SILVERFIR_STACK_SLOT_32
+    #define SLOT_ACCESSORS(type)                                   \
+        INLINE type slot_read_##type(const value_slot * p) {       \
+            type v;                                                \
+            memcpy(&v, p, sizeof(type));                           \
+            return v;                                              \
+        }                                                          \
+        INLINE void slot_write_##type(value_slot * p, type v) {    \
+            memcpy(p, &v, sizeof(type));                           \
+        }
+SLOT_ACCESSORS(i32)
+SLOT_ACCESSORS(u32)
+SLOT_ACCESSORS(f32)
+SLOT_ACCESSORS(i64)
+SLOT_ACCESSORS(u64)
+SLOT_ACCESSORS(f64)
+SLOT_ACCESSORS(ref)
+    #define slot_read(type, p) slot_read_##type(p)
+    #define slot_write(type, p, v) slot_write_##type((p), (v))
+#else
+    #define slot_read(type, p) ((p)->u_##type)
+    #define slot_write(type, p, v) ((p)->u_##type = (v))
+#endif
+
+INLINE void slots_copy(value_slot * dst, const value_slot * src, u32 count) {
+    for (u32 i = 0; i < count; i++) {
+        dst[i] = src[i];
+    }
+}
+
+// Move a value of the given width in slots between a value_u and the slots.
+INLINE void value_to_slots(value_slot * dst, value_u v, u32 width) {
+    memcpy(dst, &v, sizeof(value_slot) * width);
+}
+
+INLINE value_u value_from_slots(const value_slot * src, u32 width) {
+    value_u v = {0};
+    memcpy(&v, src, sizeof(value_slot) * width);
+    return v;
+}
+
+// Call a host function with the args on a stack, the results are left there. The host functions
+// always take value_u, so the args and results are converted if the slots are narrower.
+#if SILVERFIR_STACK_SLOT_32
+r interp_call_host(func_addr f_addr, value_slot * args, memory_inst * mem0);
+#else
+INLINE r interp_call_host(func_addr f_addr, value_slot * args, memory_inst * mem0) {
+    return f_addr->fn->tr((tr_ctx){
+                              .f_addr = f_addr,
+                              .args = args,
+                              .mem0 = mem0,
+                          },
+                          f_addr->fn->host_func);
+}
+#endif
+
+// Run one 0xfe prefixed instruction, pc points right after the prefix. pc and sp are updated.
+r interp_atomic_op(memory_inst * mem0, const u8 ** pc, value_slot ** sp);
+
+// Run one 0xfd prefixed instruction, same as interp_atomic_op.
+r interp_simd_op(memory_inst * mem0, const u8 ** pc, value_slot ** sp);
+
+// Where a frame can put its callee's locals and stack on a tail call.
+typedef struct tail_call_area {
+    // the areas the frame was entered with.
+    value_slot * local;
+    u32 local_cap;
+    value_slot * stack;
+    u32 stack_cap;
+    // only allocated once a callee doesn't fit into them.
+    tail_frame * heap;
+} tail_call_area;
+
+// Move the args of a tail call to the callee's locals and zero out the rest of them, so that the
+// callee can run in place of the current frame. Neither the wasm nor the C stack grows.
+r interp_tail_call_enter(thread * t, tail_call_area * area, func * callee, value_slot * args, value_slot ** local, value_slot ** stack_base);
+
+// Called when a frame that may have done a tail call returns.
+void interp_tail_call_leave(thread * t, tail_call_area * area);
+
+r in_place_dt_call(thread * t, func_addr f_addr, value_slot * args);
 
 r in_place_tco_call(thread * t, func_addr f_addr, value_u * args);
 
@@ -0,0 +1,852 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The 0xfd prefixed instructions (fixed-width SIMD), shared by both interpreters.
+// Every instruction has a portable lane-by-lane implementation. On x86 the common ones
+// are mapped to SSE2 (always available on x86-64), SSSE3 and SSE4.1 when the compiler is
+// allowed to use them. 128-bit vectors don't gain anything from AVX2.
+
+#include "silverfir.h"
+#include "interpreter.h"
+#include "opcode.h"
+#include "smath.h"
+#include "stream.h"
+
+#include <string.h>
+
+#if SILVERFIR_ENABLE_SIMD
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+    #define SSE2_OR(sse, scalar) sse
+#else
+    #define SSE2_OR(sse, scalar) scalar
+#endif
+#if defined(__SSSE3__)
+    #include <tmmintrin.h>
+    #define SSSE3_OR(sse, scalar) sse
+#else
+    #define SSSE3_OR(sse, scalar) scalar
+#endif
+#if defined(__SSE4_1__)
+    #include <smmintrin.h>
+    #define SSE41_OR(sse, scalar) sse
+#else
+    #define SSE41_OR(sse, scalar) scalar
+#endif
+
+#if defined(__SSE2__)
+INLINE __m128i ld_i(v128 v) {
+    return _mm_loadu_si128((const __m128i *)&v);
+}
+
+INLINE __m128 ld_f(v128 v) {
+    return _mm_loadu_ps(v.f32x4);
+}
+
+INLINE __m128d ld_d(v128 v) {
+    return _mm_loadu_pd(v.f64x2);
+}
+
+INLINE v128 st_i(__m128i m) {
+    v128 v;
+    _mm_storeu_si128((__m128i *)&v, m);
+    return v;
+}
+
+INLINE v128 st_f(__m128 m) {
+    v128 v;
+    _mm_storeu_ps(v.f32x4, m);
+    return v;
+}
+
+INLINE v128 st_d(__m128d m) {
+    v128 v;
+    _mm_storeu_pd(v.f64x2, m);
+    return v;
+}
+#endif
+
+// The float min and max have to propagate NaNs and order -0 below +0, unlike the C or the
+// SSE ones. Adding NaNs together gives a quiet NaN.
+INLINE f32 simd_fmin32(f32 x, f32 y) {
+    if (s_isnan32(x) || s_isnan32(y)) {
+        return x + y;
+    }
+    if (x == y) {
+        // the same number, or zeros of (maybe) different signs.
+        u32 u = s_as_i32u(x) | s_as_i32u(y);
+        return *((f32 *)&u);
+    }
+    return (x < y) ? x : y;
+}
+
+INLINE f32 simd_fmax32(f32 x, f32 y) {
+    if (s_isnan32(x) || s_isnan32(y)) {
+        return x + y;
+    }
+    if (x == y) {
+        u32 u = s_as_i32u(x) & s_as_i32u(y);
+        return *((f32 *)&u);
+    }
+    return (x > y) ? x : y;
+}
+
+INLINE f64 simd_fmin64(f64 x, f64 y) {
+    if (s_isnan64(x) || s_isnan64(y)) {
+        return x + y;
+    }
+    if (x == y) {
+        u64 u = *((u64 *)&x) | *((u64 *)&y);
+        return *((f64 *)&u);
+    }
+    return (x < y) ? x : y;
+}
+
+INLINE f64 simd_fmax64(f64 x, f64 y) {
+    if (s_isnan64(x) || s_isnan64(y)) {
+        return x + y;
+    }
+    if (x == y) {
+        u64 u = *((u64 *)&x) & *((u64 *)&y);
+        return *((f64 *)&u);
+    }
+    return (x > y) ? x : y;
+}
+
+INLINE i32 simd_trunc_sat_f32_s(f32 x) {
+    if (s_isnan32(x)) {
+        return 0;
+    } else if (x < -2147483648.f) {
+        return i32_MIN;
+    } else if (x >= 2147483648.f) {
+        return i32_MAX;
+    }
+    return (i32)x;
+}
+
+INLINE u32 simd_trunc_sat_f32_u(f32 x) {
+    if (s_isnan32(x) || (x <= -1.f)) {
+        return 0;
+    } else if (x >= 4294967296.f) {
+        return u32_MAX;
+    }
+    return (u32)x;
+}
+
+INLINE i32 simd_trunc_sat_f64_s(f64 x) {
+    if (s_isnan64(x)) {
+        return 0;
+    } else if (x <= -2147483649.) {
+        return i32_MIN;
+    } else if (x >= 2147483648.) {
+        return i32_MAX;
+    }
+    return (i32)x;
+}
+
+INLINE u32 simd_trunc_sat_f64_u(f64 x) {
+    if (s_isnan64(x) || (x <= -1.)) {
+        return 0;
+    } else if (x >= 4294967296.) {
+        return u32_MAX;
+    }
+    return (u32)x;
+}
+
+// The C rounding functions may pass a signaling NaN through once they're inlined, so the
+// NaN lanes are quieted the same way as above.
+#define ROUND32(fn, x) (s_isnan32(x) ? (x) + (x) : fn(x))
+#define ROUND64(fn, x) (s_isnan64(x) ? (x) + (x) : fn(x))
+
+INLINE i32 simd_clamp(i32 x, i32 lo, i32 hi) {
+    return (x < lo) ? lo : (x > hi) ? hi : x;
+}
+
+#define pop_v128() ((--sp)->u_v128)
+#define push_v128(v) ((sp++)->u_v128 = (v))
+#define push_scalar(type, v) (*sp++ = (value_u){.u_##type = (v)})
+
+// a lane mask of all ones or zeros, it's truncated to the lane size.
+#define MASK(cond) (-(i32)(cond))
+
+// the right operand is on the top of the stack.
+#define UNOP(stmt)           \
+    {                        \
+        v128 a = pop_v128(); \
+        v128 res;            \
+        stmt;                \
+        push_v128(res);      \
+        break;               \
+    }
+#define BINOP(stmt)          \
+    {                        \
+        v128 b = pop_v128(); \
+        v128 a = pop_v128(); \
+        v128 res;            \
+        stmt;                \
+        push_v128(res);      \
+        break;               \
+    }
+#define SHIFTOP(stmt)                    \
+    {                                    \
+        u32 count = (--sp)->u_u32;       \
+        v128 a = pop_v128();             \
+        v128 res;                        \
+        stmt;                            \
+        push_v128(res);                  \
+        break;                           \
+    }
+#define LANEWISE(shape, n, expr)        \
+    for (u32 i = 0; i < (n); i++) {     \
+        res.shape[i] = (expr);          \
+    }
+// the upper half is zeroed.
+#define LANEWISE_ZERO(shape, n, expr)   \
+    for (u32 i = 0; i < (n); i++) {     \
+        res.shape[i] = (expr);          \
+    }                                   \
+    for (u32 i = (n); i < 2 * (n); i++) { \
+        res.shape[i] = 0;               \
+    }
+
+#define I2(intrin) res = st_i(intrin(ld_i(a), ld_i(b)))
+#define F2(intrin) res = st_f(intrin(ld_f(a), ld_f(b)))
+#define D2(intrin) res = st_d(intrin(ld_d(a), ld_d(b)))
+
+// The address is always popped last.
+#define SIMD_EFFECTIVE_ADDR(size)                                                 \
+    u64 ea = mem_effective_addr(*--sp, offset, memory_is64(mem0->mem));           \
+    if (unlikely(ea + (size) > vec_size_u8(&mem0->mdata))) {                      \
+        return err(e_general, "v128: out-of-bound memory access");                \
+    }                                                                             \
+    u8 * p = vec_at_u8(&mem0->mdata, ea)
+
+// load half a vector and extend every lane to twice the size.
+#define LOAD_EXTEND(dst_shape, src_type, n)       \
+    {                                             \
+        SIMD_EFFECTIVE_ADDR(8);                   \
+        src_type half[n];                         \
+        memcpy(half, p, 8);                       \
+        v128 res;                                 \
+        LANEWISE(dst_shape, n, half[i]);          \
+        push_v128(res);                           \
+        break;                                    \
+    }
+
+#define LOAD_SPLAT(shape, type, n)                \
+    {                                             \
+        SIMD_EFFECTIVE_ADDR(sizeof(type));        \
+        type val;                                 \
+        memcpy(&val, p, sizeof(type));            \
+        v128 res;                                 \
+        LANEWISE(shape, n, val);                  \
+        push_v128(res);                           \
+        break;                                    \
+    }
+
+#define LOAD_ZERO(type)                           \
+    {                                             \
+        SIMD_EFFECTIVE_ADDR(sizeof(type));        \
+        v128 res = {0};                           \
+        memcpy(&res, p, sizeof(type));            \
+        push_v128(res);                           \
+        break;                                    \
+    }
+
+#define LOAD_LANE(size)                                 \
+    {                                                   \
+        u8 lane = stream_read_u8_unchecked(pc);         \
+        v128 res = pop_v128();                          \
+        SIMD_EFFECTIVE_ADDR(size);                      \
+        memcpy(&res.u8x16[lane * (size)], p, (size));   \
+        push_v128(res);                                 \
+        break;                                          \
+    }
+
+#define STORE_LANE(size)                                \
+    {                                                   \
+        u8 lane = stream_read_u8_unchecked(pc);         \
+        v128 a = pop_v128();                            \
+        SIMD_EFFECTIVE_ADDR(size);                      \
+        memcpy(p, &a.u8x16[lane * (size)], (size));     \
+        break;                                          \
+    }
+
+#define SPLAT(shape, n, scalar)                \
+    {                                          \
+        value_u val = *(--sp);                 \
+        v128 res;                              \
+        LANEWISE(shape, n, val.u_##scalar);    \
+        push_v128(res);                        \
+        break;                                 \
+    }
+#define EXTRACT_LANE(shape, scalar, cast)                     \
+    {                                                         \
+        u8 lane = stream_read_u8_unchecked(pc);               \
+        v128 a = pop_v128();                                  \
+        push_scalar(scalar, (cast)a.shape[lane]);             \
+        break;                                                \
+    }
+#define REPLACE_LANE(shape, scalar, cast)                     \
+    {                                                         \
+        u8 lane = stream_read_u8_unchecked(pc);               \
+        value_u val = *(--sp);                                \
+        v128 res = pop_v128();                                \
+        res.shape[lane] = (cast)val.u_##scalar;               \
+        push_v128(res);                                       \
+        break;                                                \
+    }
+
+// the integer comparisons of one shape.
+#define ICMP_CASES(prefix, s_shape, u_shape, n)                                    \
+    case op_##prefix##_eq:                                                         \
+        BINOP(LANEWISE(u_shape, n, MASK(a.u_shape[i] == b.u_shape[i])));           \
+    case op_##prefix##_ne:                                                         \
+        BINOP(LANEWISE(u_shape, n, MASK(a.u_shape[i] != b.u_shape[i])));           \
+    case op_##prefix##_lt_s:                                                       \
+        BINOP(LANEWISE(u_shape, n, MASK(a.s_shape[i] < b.s_shape[i])));            \
+    case op_##prefix##_lt_u:                                                       \
+        BINOP(LANEWISE(u_shape, n, MASK(a.u_shape[i] < b.u_shape[i])));            \
+    case op_##prefix##_gt_s:                                                       \
+        BINOP(LANEWISE(u_shape, n, MASK(a.s_shape[i] > b.s_shape[i])));            \
+    case op_##prefix##_gt_u:                                                       \
+        BINOP(LANEWISE(u_shape, n, MASK(a.u_shape[i] > b.u_shape[i])));            \
+    case op_##prefix##_le_s:                                                       \
+        BINOP(LANEWISE(u_shape, n, MASK(a.s_shape[i] <= b.s_shape[i])));           \
+    case op_##prefix##_le_u:                                                       \
+        BINOP(LANEWISE(u_shape, n, MASK(a.u_shape[i] <= b.u_shape[i])));           \
+    case op_##prefix##_ge_s:                                                       \
+        BINOP(LANEWISE(u_shape, n, MASK(a.s_shape[i] >= b.s_shape[i])));           \
+    case op_##prefix##_ge_u:                                                       \
+        BINOP(LANEWISE(u_shape, n, MASK(a.u_shape[i] >= b.u_shape[i])));
+
+#define FCMP_CASES(prefix, f_shape, u_shape, n, sse2_prefix)                               \
+    case op_##prefix##_eq:                                                                 \
+        BINOP(SSE2_OR(sse2_prefix(cmpeq), LANEWISE(u_shape, n, MASK(a.f_shape[i] == b.f_shape[i])))); \
+    case op_##prefix##_ne:                                                                 \
+        BINOP(SSE2_OR(sse2_prefix(cmpneq), LANEWISE(u_shape, n, MASK(a.f_shape[i] != b.f_shape[i])))); \
+    case op_##prefix##_lt:                                                                 \
+        BINOP(SSE2_OR(sse2_prefix(cmplt), LANEWISE(u_shape, n, MASK(a.f_shape[i] < b.f_shape[i])))); \
+    case op_##prefix##_gt:                                                                 \
+        BINOP(SSE2_OR(sse2_prefix(cmpgt), LANEWISE(u_shape, n, MASK(a.f_shape[i] > b.f_shape[i])))); \
+    case op_##prefix##_le:                                                                 \
+        BINOP(SSE2_OR(sse2_prefix(cmple), LANEWISE(u_shape, n, MASK(a.f_shape[i] <= b.f_shape[i])))); \
+    case op_##prefix##_ge:                                                                 \
+        BINOP(SSE2_OR(sse2_prefix(cmpge), LANEWISE(u_shape, n, MASK(a.f_shape[i] >= b.f_shape[i]))));
+#define SSE_PS(name) F2(_mm_##name##_ps)
+#define SSE_PD(name) D2(_mm_##name##_pd)
+
+// the shifts take the count modulo the lane width.
+#define SHIFT_CASES(prefix, s_shape, u_shape, n, bits)                                         \
+    case op_##prefix##_shl:                                                                    \
+        SHIFTOP(LANEWISE(u_shape, n, a.u_shape[i] << (count % bits)));                         \
+    case op_##prefix##_shr_s:                                                                  \
+        SHIFTOP(LANEWISE(s_shape, n, a.s_shape[i] >> (count % bits)));                         \
+    case op_##prefix##_shr_u:                                                                  \
+        SHIFTOP(LANEWISE(u_shape, n, a.u_shape[i] >> (count % bits)));
+
+#define BITMASK(shape, n, bits)                       \
+    {                                                 \
+        v128 a = pop_v128();                          \
+        u32 mask = 0;                                 \
+        for (u32 i = 0; i < (n); i++) {               \
+            mask |= (u32)(a.shape[i] >> (bits - 1)) << i; \
+        }                                             \
+        push_scalar(u32, mask);                       \
+        break;                                        \
+    }
+
+#define ALL_TRUE(shape, n)                            \
+    {                                                 \
+        v128 a = pop_v128();                          \
+        u32 all = 1;                                  \
+        for (u32 i = 0; i < (n); i++) {               \
+            all &= (a.shape[i] != 0);                 \
+        }                                             \
+        push_scalar(u32, all);                        \
+        break;                                        \
+    }
+
+// dst lane i is the product of the src lanes (i + base).
+#define EXTMUL(dst_shape, src_shape, n, base, wide) \
+    BINOP(LANEWISE(dst_shape, n, (wide)a.src_shape[i + (base)] * (wide)b.src_shape[i + (base)]))
+
+#define EXTEND(dst_shape, src_shape, n, base) UNOP(LANEWISE(dst_shape, n, a.src_shape[i + (base)]))
+
+#define EXTADD_PAIRWISE(dst_shape, src_shape, n, wide) \
+    UNOP(LANEWISE(dst_shape, n, (wide)a.src_shape[2 * i] + (wide)a.src_shape[2 * i + 1]))
+
+NOINLINE r interp_simd_op(memory_inst * mem0, const u8 ** ppc, value_slot ** psp) {
+    check_prep(r);
+    const u8 * pc = *ppc;
+    value_u * sp = *psp;
+
+    u32 opcode;
+    stream_read_vu32_unchecked(opcode, pc);
+    u64 offset = 0;
+    if ((opcode <= op_v128_store) ||
+        ((opcode >= op_v128_load8_lane) && (opcode <= op_v128_load64_zero))) {
+        // the alignment is only a hint, and the validator makes sure there's a memory.
+        stream_seek_unchecked(pc, 1);
+        stream_read_vu64_unchecked(offset, pc);
+        assert(mem0);
+    }
+
+    switch (opcode) {
+        case op_v128_load: {
+            SIMD_EFFECTIVE_ADDR(16);
+            v128 res;
+            memcpy(&res, p, 16);
+            push_v128(res);
+            break;
+        }
+        case op_v128_load8x8_s:
+            LOAD_EXTEND(i16x8, i8, 8);
+        case op_v128_load8x8_u:
+            LOAD_EXTEND(u16x8, u8, 8);
+        case op_v128_load16x4_s:
+            LOAD_EXTEND(i32x4, i16, 4);
+        case op_v128_load16x4_u:
+            LOAD_EXTEND(u32x4, u16, 4);
+        case op_v128_load32x2_s:
+            LOAD_EXTEND(i64x2, i32, 2);
+        case op_v128_load32x2_u:
+            LOAD_EXTEND(u64x2, u32, 2);
+        case op_v128_load8_splat:
+            LOAD_SPLAT(u8x16, u8, 16);
+        case op_v128_load16_splat:
+            LOAD_SPLAT(u16x8, u16, 8);
+        case op_v128_load32_splat:
+            LOAD_SPLAT(u32x4, u32, 4);
+        case op_v128_load64_splat:
+            LOAD_SPLAT(u64x2, u64, 2);
+        case op_v128_store: {
+            v128 a = pop_v128();
+            SIMD_EFFECTIVE_ADDR(16);
+            memcpy(p, &a, 16);
+            break;
+        }
+        case op_v128_load32_zero:
+            LOAD_ZERO(u32);
+        case op_v128_load64_zero:
+            LOAD_ZERO(u64);
+        case op_v128_load8_lane:
+            LOAD_LANE(1);
+        case op_v128_load16_lane:
+            LOAD_LANE(2);
+        case op_v128_load32_lane:
+            LOAD_LANE(4);
+        case op_v128_load64_lane:
+            LOAD_LANE(8);
+        case op_v128_store8_lane:
+            STORE_LANE(1);
+        case op_v128_store16_lane:
+            STORE_LANE(2);
+        case op_v128_store32_lane:
+            STORE_LANE(4);
+        case op_v128_store64_lane:
+            STORE_LANE(8);
+        case op_v128_const: {
+            v128 res;
+            memcpy(&res, pc, 16);
+            stream_seek_unchecked(pc, 16);
+            push_v128(res);
+            break;
+        }
+        case op_i8x16_shuffle: {
+            const u8 * lanes = pc;
+            stream_seek_unchecked(pc, 16);
+            BINOP(LANEWISE(u8x16, 16, (lanes[i] < 16) ? a.u8x16[lanes[i]] : b.u8x16[lanes[i] - 16]));
+        }
+        case op_i8x16_swizzle:
+            // out of range indexes get zero, pshufb does it if the top bit is set.
+            BINOP(SSSE3_OR(res = st_i(_mm_shuffle_epi8(ld_i(a), _mm_adds_epu8(ld_i(b), _mm_set1_epi8(0x70)))),
+                           LANEWISE(u8x16, 16, (b.u8x16[i] < 16) ? a.u8x16[b.u8x16[i]] : 0)));
+        case op_i8x16_splat:
+            SPLAT(u8x16, 16, u32);
+        case op_i16x8_splat:
+            SPLAT(u16x8, 8, u32);
+        case op_i32x4_splat:
+            SPLAT(u32x4, 4, u32);
+        case op_i64x2_splat:
+            SPLAT(u64x2, 2, u64);
+        case op_f32x4_splat:
+            SPLAT(f32x4, 4, f32);
+        case op_f64x2_splat:
+            SPLAT(f64x2, 2, f64);
+        case op_i8x16_extract_lane_s:
+            EXTRACT_LANE(i8x16, i32, i32);
+        case op_i8x16_extract_lane_u:
+            EXTRACT_LANE(u8x16, u32, u32);
+        case op_i8x16_replace_lane:
+            REPLACE_LANE(u8x16, u32, u8);
+        case op_i16x8_extract_lane_s:
+            EXTRACT_LANE(i16x8, i32, i32);
+        case op_i16x8_extract_lane_u:
+            EXTRACT_LANE(u16x8, u32, u32);
+        case op_i16x8_replace_lane:
+            REPLACE_LANE(u16x8, u32, u16);
+        case op_i32x4_extract_lane:
+            EXTRACT_LANE(u32x4, u32, u32);
+        case op_i32x4_replace_lane:
+            REPLACE_LANE(u32x4, u32, u32);
+        case op_i64x2_extract_lane:
+            EXTRACT_LANE(u64x2, u64, u64);
+        case op_i64x2_replace_lane:
+            REPLACE_LANE(u64x2, u64, u64);
+        case op_f32x4_extract_lane:
+            EXTRACT_LANE(f32x4, f32, f32);
+        case op_f32x4_replace_lane:
+            REPLACE_LANE(f32x4, f32, f32);
+        case op_f64x2_extract_lane:
+            EXTRACT_LANE(f64x2, f64, f64);
+        case op_f64x2_replace_lane:
+            REPLACE_LANE(f64x2, f64, f64);
+
+        // comparisons
+        ICMP_CASES(i8x16, i8x16, u8x16, 16)
+        ICMP_CASES(i16x8, i16x8, u16x8, 8)
+        ICMP_CASES(i32x4, i32x4, u32x4, 4)
+        case op_i64x2_eq:
+            BINOP(SSE41_OR(I2(_mm_cmpeq_epi64), LANEWISE(u64x2, 2, MASK(a.u64x2[i] == b.u64x2[i]))));
+        case op_i64x2_ne:
+            BINOP(LANEWISE(u64x2, 2, MASK(a.u64x2[i] != b.u64x2[i])));
+        case op_i64x2_lt_s:
+            BINOP(LANEWISE(u64x2, 2, MASK(a.i64x2[i] < b.i64x2[i])));
+        case op_i64x2_gt_s:
+            BINOP(LANEWISE(u64x2, 2, MASK(a.i64x2[i] > b.i64x2[i])));
+        case op_i64x2_le_s:
+            BINOP(LANEWISE(u64x2, 2, MASK(a.i64x2[i] <= b.i64x2[i])));
+        case op_i64x2_ge_s:
+            BINOP(LANEWISE(u64x2, 2, MASK(a.i64x2[i] >= b.i64x2[i])));
+        FCMP_CASES(f32x4, f32x4, u32x4, 4, SSE_PS)
+        FCMP_CASES(f64x2, f64x2, u64x2, 2, SSE_PD)
+
+        // bitwise
+        case op_v128_not:
+            UNOP(LANEWISE(u64x2, 2, ~a.u64x2[i]));
+        case op_v128_and:
+            BINOP(SSE2_OR(I2(_mm_and_si128), LANEWISE(u64x2, 2, a.u64x2[i] & b.u64x2[i])));
+        case op_v128_andnot:
+            BINOP(SSE2_OR(res = st_i(_mm_andnot_si128(ld_i(b), ld_i(a))), LANEWISE(u64x2, 2, a.u64x2[i] & ~b.u64x2[i])));
+        case op_v128_or:
+            BINOP(SSE2_OR(I2(_mm_or_si128), LANEWISE(u64x2, 2, a.u64x2[i] | b.u64x2[i])));
+        case op_v128_xor:
+            BINOP(SSE2_OR(I2(_mm_xor_si128), LANEWISE(u64x2, 2, a.u64x2[i] ^ b.u64x2[i])));
+        case op_v128_bitselect: {
+            v128 c = pop_v128();
+            BINOP(LANEWISE(u64x2, 2, (a.u64x2[i] & c.u64x2[i]) | (b.u64x2[i] & ~c.u64x2[i])));
+        }
+        case op_v128_any_true: {
+            v128 a = pop_v128();
+            push_scalar(u32, (a.u64x2[0] | a.u64x2[1]) != 0);
+            break;
+        }
+
+        // i8x16
+        case op_i8x16_abs:
+            UNOP(SSSE3_OR(res = st_i(_mm_abs_epi8(ld_i(a))), LANEWISE(u8x16, 16, (a.i8x16[i] < 0) ? -a.i8x16[i] : a.i8x16[i])));
+        case op_i8x16_neg:
+            UNOP(LANEWISE(u8x16, 16, -a.u8x16[i]));
+        case op_i8x16_popcnt:
+            UNOP(LANEWISE(u8x16, 16, (u8)s_popcnt32(a.u8x16[i])));
+        case op_i8x16_all_true:
+            ALL_TRUE(u8x16, 16);
+        case op_i8x16_bitmask:
+            BITMASK(u8x16, 16, 8);
+        case op_i8x16_narrow_i16x8_s:
+            BINOP(SSE2_OR(I2(_mm_packs_epi16),
+                          LANEWISE(i8x16, 16, (i8)simd_clamp((i < 8) ? a.i16x8[i] : b.i16x8[i - 8], i8_MIN, i8_MAX))));
+        case op_i8x16_narrow_i16x8_u:
+            BINOP(SSE2_OR(I2(_mm_packus_epi16),
+                          LANEWISE(u8x16, 16, (u8)simd_clamp((i < 8) ? a.i16x8[i] : b.i16x8[i - 8], 0, u8_MAX))));
+        SHIFT_CASES(i8x16, i8x16, u8x16, 16, 8)
+        case op_i8x16_add:
+            BINOP(SSE2_OR(I2(_mm_add_epi8), LANEWISE(u8x16, 16, a.u8x16[i] + b.u8x16[i])));
+        case op_i8x16_add_sat_s:
+            BINOP(SSE2_OR(I2(_mm_adds_epi8), LANEWISE(i8x16, 16, (i8)simd_clamp(a.i8x16[i] + b.i8x16[i], i8_MIN, i8_MAX))));
+        case op_i8x16_add_sat_u:
+            BINOP(SSE2_OR(I2(_mm_adds_epu8), LANEWISE(u8x16, 16, (u8)simd_clamp(a.u8x16[i] + b.u8x16[i], 0, u8_MAX))));
+        case op_i8x16_sub:
+            BINOP(SSE2_OR(I2(_mm_sub_epi8), LANEWISE(u8x16, 16, a.u8x16[i] - b.u8x16[i])));
+        case op_i8x16_sub_sat_s:
+            BINOP(SSE2_OR(I2(_mm_subs_epi8), LANEWISE(i8x16, 16, (i8)simd_clamp(a.i8x16[i] - b.i8x16[i], i8_MIN, i8_MAX))));
+        case op_i8x16_sub_sat_u:
+            BINOP(SSE2_OR(I2(_mm_subs_epu8), LANEWISE(u8x16, 16, (u8)simd_clamp(a.u8x16[i] - b.u8x16[i], 0, u8_MAX))));
+        case op_i8x16_min_s:
+            BINOP(SSE41_OR(I2(_mm_min_epi8), LANEWISE(i8x16, 16, (a.i8x16[i] < b.i8x16[i]) ? a.i8x16[i] : b.i8x16[i])));
+        case op_i8x16_min_u:
+            BINOP(SSE2_OR(I2(_mm_min_epu8), LANEWISE(u8x16, 16, (a.u8x16[i] < b.u8x16[i]) ? a.u8x16[i] : b.u8x16[i])));
+        case op_i8x16_max_s:
+            BINOP(SSE41_OR(I2(_mm_max_epi8), LANEWISE(i8x16, 16, (a.i8x16[i] > b.i8x16[i]) ? a.i8x16[i] : b.i8x16[i])));
+        case op_i8x16_max_u:
+            BINOP(SSE2_OR(I2(_mm_max_epu8), LANEWISE(u8x16, 16, (a.u8x16[i] > b.u8x16[i]) ? a.u8x16[i] : b.u8x16[i])));
+        case op_i8x16_avgr_u:
+            BINOP(SSE2_OR(I2(_mm_avg_epu8), LANEWISE(u8x16, 16, (a.u8x16[i] + b.u8x16[i] + 1) >> 1)));
+
+        // i16x8
+        case op_i16x8_extadd_pairwise_i8x16_s:
+            EXTADD_PAIRWISE(i16x8, i8x16, 8, i16);
+        case op_i16x8_extadd_pairwise_i8x16_u:
+            EXTADD_PAIRWISE(u16x8, u8x16, 8, u16);
+        case op_i16x8_abs:
+            UNOP(SSSE3_OR(res = st_i(_mm_abs_epi16(ld_i(a))), LANEWISE(u16x8, 8, (a.i16x8[i] < 0) ? -a.i16x8[i] : a.i16x8[i])));
+        case op_i16x8_neg:
+            UNOP(LANEWISE(u16x8, 8, -a.u16x8[i]));
+        case op_i16x8_q15mulr_sat_s:
+            BINOP(LANEWISE(i16x8, 8, (i16)simd_clamp((a.i16x8[i] * b.i16x8[i] + 0x4000) >> 15, i16_MIN, i16_MAX)));
+        case op_i16x8_all_true:
+            ALL_TRUE(u16x8, 8);
+        case op_i16x8_bitmask:
+            BITMASK(u16x8, 8, 16);
+        case op_i16x8_narrow_i32x4_s:
+            BINOP(SSE2_OR(I2(_mm_packs_epi32),
+                          LANEWISE(i16x8, 8, (i16)simd_clamp((i < 4) ? a.i32x4[i] : b.i32x4[i - 4], i16_MIN, i16_MAX))));
+        case op_i16x8_narrow_i32x4_u:
+            BINOP(SSE41_OR(I2(_mm_packus_epi32),
+                           LANEWISE(u16x8, 8, (u16)simd_clamp((i < 4) ? a.i32x4[i] : b.i32x4[i - 4], 0, u16_MAX))));
+        case op_i16x8_extend_low_i8x16_s:
+            EXTEND(i16x8, i8x16, 8, 0);
+        case op_i16x8_extend_high_i8x16_s:
+            EXTEND(i16x8, i8x16, 8, 8);
+        case op_i16x8_extend_low_i8x16_u:
+            EXTEND(u16x8, u8x16, 8, 0);
+        case op_i16x8_extend_high_i8x16_u:
+            EXTEND(u16x8, u8x16, 8, 8);
+        SHIFT_CASES(i16x8, i16x8, u16x8, 8, 16)
+        case op_i16x8_add:
+            BINOP(SSE2_OR(I2(_mm_add_epi16), LANEWISE(u16x8, 8, a.u16x8[i] + b.u16x8[i])));
+        case op_i16x8_add_sat_s:
+            BINOP(SSE2_OR(I2(_mm_adds_epi16), LANEWISE(i16x8, 8, (i16)simd_clamp(a.i16x8[i] + b.i16x8[i], i16_MIN, i16_MAX))));
+        case op_i16x8_add_sat_u:
+            BINOP(SSE2_OR(I2(_mm_adds_epu16), LANEWISE(u16x8, 8, (u16)simd_clamp(a.u16x8[i] + b.u16x8[i], 0, u16_MAX))));
+        case op_i16x8_sub:
+            BINOP(SSE2_OR(I2(_mm_sub_epi16), LANEWISE(u16x8, 8, a.u16x8[i] - b.u16x8[i])));
+        case op_i16x8_sub_sat_s:
+            BINOP(SSE2_OR(I2(_mm_subs_epi16), LANEWISE(i16x8, 8, (i16)simd_clamp(a.i16x8[i] - b.i16x8[i], i16_MIN, i16_MAX))));
+        case op_i16x8_sub_sat_u:
+            BINOP(SSE2_OR(I2(_mm_subs_epu16), LANEWISE(u16x8, 8, (u16)simd_clamp(a.u16x8[i] - b.u16x8[i], 0, u16_MAX))));
+        case op_i16x8_mul:
+            BINOP(SSE2_OR(I2(_mm_mullo_epi16), LANEWISE(u16x8, 8, (u16)((u32)a.u16x8[i] * b.u16x8[i]))));
+        case op_i16x8_min_s:
+            BINOP(SSE2_OR(I2(_mm_min_epi16), LANEWISE(i16x8, 8, (a.i16x8[i] < b.i16x8[i]) ? a.i16x8[i] : b.i16x8[i])));
+        case op_i16x8_min_u:
+            BINOP(SSE41_OR(I2(_mm_min_epu16), LANEWISE(u16x8, 8, (a.u16x8[i] < b.u16x8[i]) ? a.u16x8[i] : b.u16x8[i])));
+        case op_i16x8_max_s:
+            BINOP(SSE2_OR(I2(_mm_max_epi16), LANEWISE(i16x8, 8, (a.i16x8[i] > b.i16x8[i]) ? a.i16x8[i] : b.i16x8[i])));
+        case op_i16x8_max_u:
+            BINOP(SSE41_OR(I2(_mm_max_epu16), LANEWISE(u16x8, 8, (a.u16x8[i] > b.u16x8[i]) ? a.u16x8[i] : b.u16x8[i])));
+        case op_i16x8_avgr_u:
+            BINOP(SSE2_OR(I2(_mm_avg_epu16), LANEWISE(u16x8, 8, (a.u16x8[i] + b.u16x8[i] + 1) >> 1)));
+        case op_i16x8_extmul_low_i8x16_s:
+            EXTMUL(i16x8, i8x16, 8, 0, i16);
+        case op_i16x8_extmul_high_i8x16_s:
+            EXTMUL(i16x8, i8x16, 8, 8, i16);
+        case op_i16x8_extmul_low_i8x16_u:
+            EXTMUL(u16x8, u8x16, 8, 0, u16);
+        case op_i16x8_extmul_high_i8x16_u:
+            EXTMUL(u16x8, u8x16, 8, 8, u16);
+
+        // i32x4
+        case op_i32x4_extadd_pairwise_i16x8_s:
+            EXTADD_PAIRWISE(i32x4, i16x8, 4, i32);
+        case op_i32x4_extadd_pairwise_i16x8_u:
+            EXTADD_PAIRWISE(u32x4, u16x8, 4, u32);
+        case op_i32x4_abs:
+            UNOP(SSSE3_OR(res = st_i(_mm_abs_epi32(ld_i(a))), LANEWISE(u32x4, 4, (a.i32x4[i] < 0) ? 0u - a.u32x4[i] : a.u32x4[i])));
+        case op_i32x4_neg:
+            UNOP(LANEWISE(u32x4, 4, 0u - a.u32x4[i]));
+        case op_i32x4_all_true:
+            ALL_TRUE(u32x4, 4);
+        case op_i32x4_bitmask:
+            BITMASK(u32x4, 4, 32);
+        case op_i32x4_extend_low_i16x8_s:
+            EXTEND(i32x4, i16x8, 4, 0);
+        case op_i32x4_extend_high_i16x8_s:
+            EXTEND(i32x4, i16x8, 4, 4);
+        case op_i32x4_extend_low_i16x8_u:
+            EXTEND(u32x4, u16x8, 4, 0);
+        case op_i32x4_extend_high_i16x8_u:
+            EXTEND(u32x4, u16x8, 4, 4);
+        SHIFT_CASES(i32x4, i32x4, u32x4, 4, 32)
+        case op_i32x4_add:
+            BINOP(SSE2_OR(I2(_mm_add_epi32), LANEWISE(u32x4, 4, a.u32x4[i] + b.u32x4[i])));
+        case op_i32x4_sub:
+            BINOP(SSE2_OR(I2(_mm_sub_epi32), LANEWISE(u32x4, 4, a.u32x4[i] - b.u32x4[i])));
+        case op_i32x4_mul:
+            BINOP(SSE41_OR(I2(_mm_mullo_epi32), LANEWISE(u32x4, 4, a.u32x4[i] * b.u32x4[i])));
+        case op_i32x4_min_s:
+            BINOP(SSE41_OR(I2(_mm_min_epi32), LANEWISE(i32x4, 4, (a.i32x4[i] < b.i32x4[i]) ? a.i32x4[i] : b.i32x4[i])));
+        case op_i32x4_min_u:
+            BINOP(SSE41_OR(I2(_mm_min_epu32), LANEWISE(u32x4, 4, (a.u32x4[i] < b.u32x4[i]) ? a.u32x4[i] : b.u32x4[i])));
+        case op_i32x4_max_s:
+            BINOP(SSE41_OR(I2(_mm_max_epi32), LANEWISE(i32x4, 4, (a.i32x4[i] > b.i32x4[i]) ? a.i32x4[i] : b.i32x4[i])));
+        case op_i32x4_max_u:
+            BINOP(SSE41_OR(I2(_mm_max_epu32), LANEWISE(u32x4, 4, (a.u32x4[i] > b.u32x4[i]) ? a.u32x4[i] : b.u32x4[i])));
+        case op_i32x4_dot_i16x8_s:
+            // wraps around only when all four inputs are -32768.
+            BINOP(SSE2_OR(I2(_mm_madd_epi16),
+                          LANEWISE(u32x4, 4, (u32)(a.i16x8[2 * i] * b.i16x8[2 * i]) + (u32)(a.i16x8[2 * i + 1] * b.i16x8[2 * i + 1]))));
+        case op_i32x4_extmul_low_i16x8_s:
+            EXTMUL(i32x4, i16x8, 4, 0, i32);
+        case op_i32x4_extmul_high_i16x8_s:
+            EXTMUL(i32x4, i16x8, 4, 4, i32);
+        case op_i32x4_extmul_low_i16x8_u:
+            EXTMUL(u32x4, u16x8, 4, 0, u32);
+        case op_i32x4_extmul_high_i16x8_u:
+            EXTMUL(u32x4, u16x8, 4, 4, u32);
+
+        // i64x2
+        case op_i64x2_abs:
+            UNOP(LANEWISE(u64x2, 2, (a.i64x2[i] < 0) ? 0u - a.u64x2[i] : a.u64x2[i]));
+        case op_i64x2_neg:
+            UNOP(LANEWISE(u64x2, 2, 0u - a.u64x2[i]));
+        case op_i64x2_all_true:
+            ALL_TRUE(u64x2, 2);
+        case op_i64x2_bitmask:
+            BITMASK(u64x2, 2, 64);
+        case op_i64x2_extend_low_i32x4_s:
+            EXTEND(i64x2, i32x4, 2, 0);
+        case op_i64x2_extend_high_i32x4_s:
+            EXTEND(i64x2, i32x4, 2, 2);
+        case op_i64x2_extend_low_i32x4_u:
+            EXTEND(u64x2, u32x4, 2, 0);
+        case op_i64x2_extend_high_i32x4_u:
+            EXTEND(u64x2, u32x4, 2, 2);
+        SHIFT_CASES(i64x2, i64x2, u64x2, 2, 64)
+        case op_i64x2_add:
+            BINOP(SSE2_OR(I2(_mm_add_epi64), LANEWISE(u64x2, 2, a.u64x2[i] + b.u64x2[i])));
+        case op_i64x2_sub:
+            BINOP(SSE2_OR(I2(_mm_sub_epi64), LANEWISE(u64x2, 2, a.u64x2[i] - b.u64x2[i])));
+        case op_i64x2_mul:
+            BINOP(LANEWISE(u64x2, 2, a.u64x2[i] * b.u64x2[i]));
+        case op_i64x2_extmul_low_i32x4_s:
+            EXTMUL(i64x2, i32x4, 2, 0, i64);
+        case op_i64x2_extmul_high_i32x4_s:
+            EXTMUL(i64x2, i32x4, 2, 2, i64);
+        case op_i64x2_extmul_low_i32x4_u:
+            EXTMUL(u64x2, u32x4, 2, 0, u64);
+        case op_i64x2_extmul_high_i32x4_u:
+            EXTMUL(u64x2, u32x4, 2, 2, u64);
+
+        // f32x4
+        case op_f32x4_ceil:
+            UNOP(SSE41_OR(res = st_f(_mm_ceil_ps(ld_f(a))), LANEWISE(f32x4, 4, ROUND32(ceilf, a.f32x4[i]))));
+        case op_f32x4_floor:
+            UNOP(SSE41_OR(res = st_f(_mm_floor_ps(ld_f(a))), LANEWISE(f32x4, 4, ROUND32(floorf, a.f32x4[i]))));
+        case op_f32x4_trunc:
+            UNOP(SSE41_OR(res = st_f(_mm_round_ps(ld_f(a), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)),
+                          LANEWISE(f32x4, 4, ROUND32(truncf, a.f32x4[i]))));
+        case op_f32x4_nearest:
+            UNOP(SSE41_OR(res = st_f(_mm_round_ps(ld_f(a), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)),
+                          LANEWISE(f32x4, 4, ROUND32(rintf, a.f32x4[i]))));
+        case op_f32x4_abs:
+            UNOP(LANEWISE(u32x4, 4, a.u32x4[i] & 0x7fffffffU));
+        case op_f32x4_neg:
+            UNOP(LANEWISE(u32x4, 4, a.u32x4[i] ^ 0x80000000U));
+        case op_f32x4_sqrt:
+            UNOP(SSE2_OR(res = st_f(_mm_sqrt_ps(ld_f(a))), LANEWISE(f32x4, 4, sqrtf(a.f32x4[i]))));
+        case op_f32x4_add:
+            BINOP(SSE2_OR(F2(_mm_add_ps), LANEWISE(f32x4, 4, a.f32x4[i] + b.f32x4[i])));
+        case op_f32x4_sub:
+            BINOP(SSE2_OR(F2(_mm_sub_ps), LANEWISE(f32x4, 4, a.f32x4[i] - b.f32x4[i])));
+        case op_f32x4_mul:
+            BINOP(SSE2_OR(F2(_mm_mul_ps), LANEWISE(f32x4, 4, a.f32x4[i] * b.f32x4[i])));
+        case op_f32x4_div:
+            BINOP(SSE2_OR(F2(_mm_div_ps), LANEWISE(f32x4, 4, a.f32x4[i] / b.f32x4[i])));
+        case op_f32x4_min:
+            BINOP(LANEWISE(f32x4, 4, simd_fmin32(a.f32x4[i], b.f32x4[i])));
+        case op_f32x4_max:
+            BINOP(LANEWISE(f32x4, 4, simd_fmax32(a.f32x4[i], b.f32x4[i])));
+        case op_f32x4_pmin:
+            // minps returns the second operand unless the first one is less.
+            BINOP(SSE2_OR(res = st_f(_mm_min_ps(ld_f(b), ld_f(a))), LANEWISE(f32x4, 4, (b.f32x4[i] < a.f32x4[i]) ? b.f32x4[i] : a.f32x4[i])));
+        case op_f32x4_pmax:
+            BINOP(SSE2_OR(res = st_f(_mm_max_ps(ld_f(b), ld_f(a))), LANEWISE(f32x4, 4, (a.f32x4[i] < b.f32x4[i]) ? b.f32x4[i] : a.f32x4[i])));
+
+        // f64x2
+        case op_f64x2_ceil:
+            UNOP(SSE41_OR(res = st_d(_mm_ceil_pd(ld_d(a))), LANEWISE(f64x2, 2, ROUND64(ceil, a.f64x2[i]))));
+        case op_f64x2_floor:
+            UNOP(SSE41_OR(res = st_d(_mm_floor_pd(ld_d(a))), LANEWISE(f64x2, 2, ROUND64(floor, a.f64x2[i]))));
+        case op_f64x2_trunc:
+            UNOP(SSE41_OR(res = st_d(_mm_round_pd(ld_d(a), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)),
+                          LANEWISE(f64x2, 2, ROUND64(trunc, a.f64x2[i]))));
+        case op_f64x2_nearest:
+            UNOP(SSE41_OR(res = st_d(_mm_round_pd(ld_d(a), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)),
+                          LANEWISE(f64x2, 2, ROUND64(rint, a.f64x2[i]))));
+        case op_f64x2_abs:
+            UNOP(LANEWISE(u64x2, 2, a.u64x2[i] & 0x7fffffffffffffffULL));
+        case op_f64x2_neg:
+            UNOP(LANEWISE(u64x2, 2, a.u64x2[i] ^ 0x8000000000000000ULL));
+        case op_f64x2_sqrt:
+            UNOP(SSE2_OR(res = st_d(_mm_sqrt_pd(ld_d(a))), LANEWISE(f64x2, 2, sqrt(a.f64x2[i]))));
+        case op_f64x2_add:
+            BINOP(SSE2_OR(D2(_mm_add_pd), LANEWISE(f64x2, 2, a.f64x2[i] + b.f64x2[i])));
+        case op_f64x2_sub:
+            BINOP(SSE2_OR(D2(_mm_sub_pd), LANEWISE(f64x2, 2, a.f64x2[i] - b.f64x2[i])));
+        case op_f64x2_mul:
+            BINOP(SSE2_OR(D2(_mm_mul_pd), LANEWISE(f64x2, 2, a.f64x2[i] * b.f64x2[i])));
+        case op_f64x2_div:
+            BINOP(SSE2_OR(D2(_mm_div_pd), LANEWISE(f64x2, 2, a.f64x2[i] / b.f64x2[i])));
+        case op_f64x2_min:
+            BINOP(LANEWISE(f64x2, 2, simd_fmin64(a.f64x2[i], b.f64x2[i])));
+        case op_f64x2_max:
+            BINOP(LANEWISE(f64x2, 2, simd_fmax64(a.f64x2[i], b.f64x2[i])));
+        case op_f64x2_pmin:
+            BINOP(SSE2_OR(res = st_d(_mm_min_pd(ld_d(b), ld_d(a))), LANEWISE(f64x2, 2, (b.f64x2[i] < a.f64x2[i]) ? b.f64x2[i] : a.f64x2[i])));
+        case op_f64x2_pmax:
+            BINOP(SSE2_OR(res = st_d(_mm_max_pd(ld_d(b), ld_d(a))), LANEWISE(f64x2, 2, (a.f64x2[i] < b.f64x2[i]) ? b.f64x2[i] : a.f64x2[i])));
+
+        // conversions
+        case op_f32x4_demote_f64x2_zero:
+            UNOP(LANEWISE_ZERO(f32x4, 2, (f32)a.f64x2[i]));
+        case op_f64x2_promote_low_f32x4:
+            UNOP(LANEWISE(f64x2, 2, (f64)a.f32x4[i]));
+        case op_i32x4_trunc_sat_f32x4_s:
+            UNOP(LANEWISE(i32x4, 4, simd_trunc_sat_f32_s(a.f32x4[i])));
+        case op_i32x4_trunc_sat_f32x4_u:
+            UNOP(LANEWISE(u32x4, 4, simd_trunc_sat_f32_u(a.f32x4[i])));
+        case op_f32x4_convert_i32x4_s:
+            UNOP(SSE2_OR(res = st_f(_mm_cvtepi32_ps(ld_i(a))), LANEWISE(f32x4, 4, (f32)a.i32x4[i])));
+        case op_f32x4_convert_i32x4_u:
+            UNOP(LANEWISE(f32x4, 4, (f32)a.u32x4[i]));
+        case op_i32x4_trunc_sat_f64x2_s_zero:
+            UNOP(LANEWISE_ZERO(i32x4, 2, simd_trunc_sat_f64_s(a.f64x2[i])));
+        case op_i32x4_trunc_sat_f64x2_u_zero:
+            UNOP(LANEWISE_ZERO(u32x4, 2, simd_trunc_sat_f64_u(a.f64x2[i])));
+        case op_f64x2_convert_low_i32x4_s:
+            UNOP(SSE2_OR(res = st_d(_mm_cvtepi32_pd(ld_i(a))), LANEWISE(f64x2, 2, (f64)a.i32x4[i])));
+        case op_f64x2_convert_low_i32x4_u:
+            UNOP(LANEWISE(f64x2, 2, (f64)a.u32x4[i]));
+        default: {
+            return err(e_malformed, "Unsupported opcode");
+        }
+    }
+    *ppc = pc;
+    *psp = sp;
+    return ok_r;
+}
+
+#else
+
+NOINLINE r interp_simd_op(memory_inst * mem0, const u8 ** ppc, value_slot ** psp) {
+    check_prep(r);
+    return err(e_general, "SIMD instructions are disabled");
+}
+
+#endif // SILVERFIR_ENABLE_SIMD
@@ -388,7 +388,7 @@ static r ir_builder_on_table_set(void * payload, stream imm, u32 table_idx) {
     return ok_r;
 }
 
-static r ir_builder_on_memory_load_store(void * payload, wasm_opcode opcode, stream imm, u8 align, u32 offset) {
+static r ir_builder_on_memory_load_store(void * payload, wasm_opcode opcode, stream imm, u8 align, u64 offset) {
     return ok_r;
 }
 
@@ -622,15 +622,18 @@ r build_ir(module * mod, func * f) {
 
         // fill in the local vector with the types from params and locals
         check(vec_resize_local_slot(&ctx.local_mappings, f->local_count), ir_builder_context_drop(&ctx));
-        assert(f->fn_type.param_count + vec_size_type_id(&f->local_types) == f->local_count);
         unwrap(vec_type_id, param_types, parse_types(f->fn_type.param_count, f->fn_type.params));
         for (size_t i = 0; i < vec_size_type_id(&param_types); i++) {
             vec_at_local_slot(&ctx.local_mappings, i)->type = TYPEID_TO_REG_TYPE(*vec_at_type_id(&param_types, i));
         }
         vec_clear_type_id(&param_types);
-        for (size_t j = f->fn_type.param_count; j < f->local_count; j++) {
-            vec_at_local_slot(&ctx.local_mappings, j)->type = TYPEID_TO_REG_TYPE(*vec_at_type_id(&f->local_types, j - f->fn_type.param_count));
+        size_t j = f->fn_type.param_count;
+        SVEC_FOR_EACH(&f->local_groups, local_group, g) {
+            for (; j < g->end; j++) {
+                vec_at_local_slot(&ctx.local_mappings, j)->type = TYPEID_TO_REG_TYPE(g->type);
+            }
         }
+        assert(j == f->local_count);
         // defaults to not assigned.
         VEC_FOR_EACH(&ctx.local_mappings, local_slot, slot) {
             slot->reg_idx = INVALID_IDX_U16;
@@ -46,9 +46,18 @@
 #define s_popcnt32(x) __builtin_popcount(x)
 #define s_popcnt64(x) __builtin_popcountll(x)
 
+// atomics on u32, the inc/dec return the new value.
+#define s_atomic_inc32(p) __atomic_add_fetch((p), 1, __ATOMIC_RELAXED)
+#define s_atomic_dec32(p) __atomic_sub_fetch((p), 1, __ATOMIC_ACQ_REL)
+#define s_atomic_load32(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+// atomics on pointers, the cas returns true if *p was expected and now is desired.
+#define s_atomic_load_ptr(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define s_atomic_cas_ptr(p, expected, desired) __sync_bool_compare_and_swap((p), (expected), (desired))
+
 #define HAS_COMPUTED_GOTO
 
 #define NOINLINE __attribute__((noinline))
+#define THREAD_LOCAL __thread
 #define MUSTTAIL __attribute__((musttail))
 #define INLINE __attribute__((always_inline)) static inline
 
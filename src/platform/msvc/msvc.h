@@ -20,6 +20,7 @@
 
 #include <assert.h>
 #include <crtdbg.h>
+#include <intrin.h>
 #include <malloc.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -43,7 +44,17 @@
 #define s_popcnt32(x) __popcnt(x)
 #define s_popcnt64(x) __popcnt64(x)
 
+// atomics on u32, the inc/dec return the new value.
+#define s_atomic_inc32(p) ((u32)_InterlockedIncrement((volatile long *)(p)))
+#define s_atomic_dec32(p) ((u32)_InterlockedDecrement((volatile long *)(p)))
+#define s_atomic_load32(p) ((u32)_InterlockedOr((volatile long *)(p), 0))
+// atomics on pointers, the cas returns true if *p was expected and now is desired.
+#define s_atomic_load_ptr(p) _InterlockedCompareExchangePointer((void * volatile *)(p), NULL, NULL)
+#define s_atomic_cas_ptr(p, expected, desired) \
+    (_InterlockedCompareExchangePointer((void * volatile *)(p), (desired), (expected)) == (void *)(expected))
+
 #define NOINLINE __declspec(noinline)
+#define THREAD_LOCAL __declspec(thread)
 #define MUSTTAIL
 #define INLINE __forceinline static
 
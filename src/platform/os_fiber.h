@@ -0,0 +1,146 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Stackful fibers, switched in user space: Win32 fibers, ucontext elsewhere. The stacks
+// have a guard page below them on both.
+// The fiber function must never return, switch away for the last time instead.
+// On macOS the ucontext functions are only declared with _XOPEN_SOURCE, so the
+// translation unit has to define it before any system header, with _DARWIN_C_SOURCE for mmap.
+
+#pragma once
+
+#include "compiler.h"
+#include "types.h"
+
+#include <stdlib.h>
+
+typedef void (*os_fiber_func)(void * arg);
+
+#if defined(_WIN32)
+    #include <windows.h>
+
+typedef struct os_fiber {
+    LPVOID handle;
+    os_fiber_func fn;
+    void * arg;
+    // the thread was converted by os_fiber_init_main.
+    bool converted;
+} os_fiber;
+
+static inline VOID WINAPI os_fiber_entry(LPVOID p) {
+    os_fiber * f = (os_fiber *)p;
+    f->fn(f->arg);
+    abort();
+}
+
+// make the current thread a fiber so that it can switch to the others and back.
+INLINE bool os_fiber_init_main(os_fiber * f) {
+    *f = (os_fiber){0};
+    if (IsThreadAFiber()) {
+        f->handle = GetCurrentFiber();
+        return true;
+    }
+    f->handle = ConvertThreadToFiber(NULL);
+    f->converted = true;
+    return f->handle != NULL;
+}
+
+INLINE bool os_fiber_create(os_fiber * f, size_t stack_size, os_fiber_func fn, void * arg) {
+    *f = (os_fiber){.fn = fn, .arg = arg};
+    // reserve the whole stack_size, the stack limit of the green threads relies on it.
+    f->handle = CreateFiberEx(0, stack_size, 0, os_fiber_entry, f);
+    return f->handle != NULL;
+}
+
+INLINE void os_fiber_switch(os_fiber * from, os_fiber * to) {
+    UNUSED(from);
+    SwitchToFiber(to->handle);
+}
+
+INLINE void os_fiber_drop(os_fiber * f) {
+    if (f->converted) {
+        ConvertFiberToThread();
+    } else if (f->fn && f->handle) {
+        DeleteFiber(f->handle);
+    }
+    *f = (os_fiber){0};
+}
+
+#else
+    #include <sys/mman.h>
+    #include <ucontext.h>
+    #include <unistd.h>
+
+typedef struct os_fiber {
+    ucontext_t ctx;
+    // the mapping of the stack, with a guard page at the low end.
+    void * stack;
+    size_t mapped;
+    os_fiber_func fn;
+    void * arg;
+} os_fiber;
+
+// makecontext only passes ints.
+static inline void os_fiber_entry(unsigned int hi, unsigned int lo) {
+    os_fiber * f = (os_fiber *)(uptr)(((u64)hi << 32) | lo);
+    f->fn(f->arg);
+    abort();
+}
+
+INLINE bool os_fiber_init_main(os_fiber * f) {
+    *f = (os_fiber){0};
+    return true;
+}
+
+// getcontext can't be force-inlined.
+static inline bool os_fiber_create(os_fiber * f, size_t stack_size, os_fiber_func fn, void * arg) {
+    *f = (os_fiber){.fn = fn, .arg = arg};
+    if (getcontext(&f->ctx)) {
+        return false;
+    }
+    // an overflow hits the guard page instead of the memory below.
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    stack_size = (stack_size + page - 1) & ~(page - 1);
+    void * stack = mmap(NULL, stack_size + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (stack == MAP_FAILED) {
+        return false;
+    }
+    f->stack = stack;
+    f->mapped = stack_size + page;
+    if (mprotect(stack, page, PROT_NONE)) {
+        return false;
+    }
+    f->ctx.uc_stack.ss_sp = (u8 *)stack + page;
+    f->ctx.uc_stack.ss_size = stack_size;
+    f->ctx.uc_link = NULL;
+    u64 p = (u64)(uptr)f;
+    makecontext(&f->ctx, (void (*)(void))os_fiber_entry, 2, (unsigned int)(p >> 32), (unsigned int)p);
+    return true;
+}
+
+// swapcontext saves and restores the signal mask as well, which is a system call each way.
+static inline void os_fiber_switch(os_fiber * from, os_fiber * to) {
+    swapcontext(&from->ctx, &to->ctx);
+}
+
+INLINE void os_fiber_drop(os_fiber * f) {
+    if (f->stack) {
+        munmap(f->stack, f->mapped);
+    }
+    *f = (os_fiber){0};
+}
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A minimal wrapper of the OS threads, mutexes, condition variables and the monotonic clock.
+
+#pragma once
+
+#include "compiler.h"
+#include "types.h"
+
+#if defined(_WIN32)
+    #include <process.h>
+    #include <windows.h>
+
+typedef HANDLE os_thread;
+typedef SRWLOCK os_mutex;
+typedef CONDITION_VARIABLE os_cond;
+typedef void (*os_thread_func)(void * arg);
+
+typedef struct os_thread_start_ctx {
+    os_thread_func fn;
+    void * arg;
+} os_thread_start_ctx;
+
+static inline unsigned __stdcall os_thread_entry(void * p) {
+    os_thread_start_ctx ctx = *(os_thread_start_ctx *)p;
+    free(p);
+    ctx.fn(ctx.arg);
+    return 0;
+}
+
+INLINE bool os_thread_start(os_thread * t, os_thread_func fn, void * arg) {
+    os_thread_start_ctx * ctx = (os_thread_start_ctx *)malloc(sizeof(os_thread_start_ctx));
+    if (!ctx) {
+        return false;
+    }
+    *ctx = (os_thread_start_ctx){fn, arg};
+    *t = (HANDLE)_beginthreadex(NULL, 0, os_thread_entry, ctx, 0, NULL);
+    if (!*t) {
+        free(ctx);
+        return false;
+    }
+    return true;
+}
+
+INLINE void os_thread_join(os_thread t) {
+    WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+}
+
+INLINE void os_mutex_init(os_mutex * m) {
+    InitializeSRWLock(m);
+}
+INLINE void os_mutex_drop(os_mutex * m) {
+    UNUSED(m);
+}
+INLINE void os_mutex_lock(os_mutex * m) {
+    AcquireSRWLockExclusive(m);
+}
+INLINE void os_mutex_unlock(os_mutex * m) {
+    ReleaseSRWLockExclusive(m);
+}
+
+INLINE void os_cond_init(os_cond * c) {
+    InitializeConditionVariable(c);
+}
+INLINE void os_cond_drop(os_cond * c) {
+    UNUSED(c);
+}
+INLINE void os_cond_wait(os_cond * c, os_mutex * m) {
+    SleepConditionVariableSRW(c, m, INFINITE, 0);
+}
+// returns false if it timed out.
+INLINE bool os_cond_timedwait(os_cond * c, os_mutex * m, u64 timeout_ns) {
+    u64 ms = timeout_ns / 1000000;
+    return SleepConditionVariableSRW(c, m, (ms < INFINITE) ? (DWORD)ms : INFINITE - 1, 0) != 0;
+}
+INLINE void os_cond_signal(os_cond * c) {
+    WakeConditionVariable(c);
+}
+INLINE void os_cond_broadcast(os_cond * c) {
+    WakeAllConditionVariable(c);
+}
+
+INLINE u32 os_cpu_count(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? (u32)info.dwNumberOfProcessors : 1;
+}
+
+INLINE u64 os_time_ns(void) {
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (u64)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+}
+
+#else
+    #include <errno.h>
+    #include <pthread.h>
+    #include <stdlib.h>
+    #include <time.h>
+    #include <unistd.h>
+
+typedef pthread_t os_thread;
+typedef pthread_mutex_t os_mutex;
+typedef pthread_cond_t os_cond;
+typedef void (*os_thread_func)(void * arg);
+
+typedef struct os_thread_start_ctx {
+    os_thread_func fn;
+    void * arg;
+} os_thread_start_ctx;
+
+static inline void * os_thread_entry(void * p) {
+    os_thread_start_ctx ctx = *(os_thread_start_ctx *)p;
+    free(p);
+    ctx.fn(ctx.arg);
+    return NULL;
+}
+
+INLINE bool os_thread_start(os_thread * t, os_thread_func fn, void * arg) {
+    os_thread_start_ctx * ctx = (os_thread_start_ctx *)malloc(sizeof(os_thread_start_ctx));
+    if (!ctx) {
+        return false;
+    }
+    *ctx = (os_thread_start_ctx){fn, arg};
+    if (pthread_create(t, NULL, os_thread_entry, ctx)) {
+        free(ctx);
+        return false;
+    }
+    return true;
+}
+
+INLINE void os_thread_join(os_thread t) {
+    pthread_join(t, NULL);
+}
+
+INLINE void os_mutex_init(os_mutex * m) {
+    pthread_mutex_init(m, NULL);
+}
+INLINE void os_mutex_drop(os_mutex * m) {
+    pthread_mutex_destroy(m);
+}
+INLINE void os_mutex_lock(os_mutex * m) {
+    pthread_mutex_lock(m);
+}
+INLINE void os_mutex_unlock(os_mutex * m) {
+    pthread_mutex_unlock(m);
+}
+
+INLINE void os_cond_init(os_cond * c) {
+    pthread_cond_init(c, NULL);
+}
+INLINE void os_cond_drop(os_cond * c) {
+    pthread_cond_destroy(c);
+}
+INLINE void os_cond_wait(os_cond * c, os_mutex * m) {
+    pthread_cond_wait(c, m);
+}
+// returns false if it timed out.
+INLINE bool os_cond_timedwait(os_cond * c, os_mutex * m, u64 timeout_ns) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    u64 ns = (u64)ts.tv_nsec + timeout_ns;
+    ts.tv_sec += (time_t)(ns / 1000000000ull);
+    ts.tv_nsec = (long)(ns % 1000000000ull);
+    return pthread_cond_timedwait(c, m, &ts) != ETIMEDOUT;
+}
+INLINE void os_cond_signal(os_cond * c) {
+    pthread_cond_signal(c);
+}
+INLINE void os_cond_broadcast(os_cond * c) {
+    pthread_cond_broadcast(c);
+}
+
+INLINE u32 os_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (u32)n : 1;
+}
+
+INLINE u64 os_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+#endif
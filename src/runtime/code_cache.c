@@ -0,0 +1,386 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "code_cache.h"
+
+#include "alloc.h"
+#include "lz4.h"
+#include "parser.h"
+#include "stream.h"
+#include "wasm_format.h"
+
+#include <string.h>
+
+LRU_IMPL_FOR_TYPE(code_cache_entry)
+
+// A body in the region follows its block header. size covers the whole block and keeps the
+// next header aligned.
+typedef struct code_block {
+    u32 idx; // LRU_NONE once it's evicted
+    u32 size;
+} code_block;
+
+INLINE size_t block_size(u32 body_size) {
+    return (sizeof(code_block) + body_size + (sizeof(code_block) - 1)) & ~(sizeof(code_block) - 1);
+}
+
+INLINE bool stored_as_is(code_cache_entry * e) {
+    return str_len(e->stored) == e->body_size;
+}
+
+INLINE bool in_region(code_cache * cache, const u8 * p) {
+    return (uptr)p >= (uptr)cache->region && (uptr)p < (uptr)cache->region + cache->region_size;
+}
+
+static void set_body(module * mod, code_cache_entry * e, u32 idx, u8 * body) {
+    e->body = body;
+    func * fn = vec_at_func(&mod->funcs, idx);
+    fn->code = body ? str_from(body + e->code_offset, e->body_size - e->code_offset) : STR_NULL;
+}
+
+static void free_body(code_cache * cache, code_cache_entry * e) {
+    if (in_region(cache, e->body)) {
+        ((code_block *)e->body - 1)->idx = LRU_NONE;
+        cache->region_used -= block_size(e->body_size);
+    } else {
+        array_free(e->body);
+    }
+}
+
+static void evict(module * mod, code_cache * cache, u32 idx) {
+    code_cache_entry * e = &cache->entries[idx];
+    cache->stats.used -= e->body_size;
+    cache->stats.evictions++;
+    free_body(cache, e);
+    set_body(mod, e, idx, NULL);
+    lru_unlink_code_cache_entry(&cache->lru, cache->entries, idx);
+}
+
+static void evict_all(module * mod, code_cache * cache) {
+    while (cache->lru.tail != LRU_NONE) {
+        evict(mod, cache, cache->lru.tail);
+    }
+}
+
+// Slide the resident bodies down over the evicted ones. The interpreters find the code again
+// after every call, so the bodies can move.
+static void compact(module * mod, code_cache * cache) {
+    size_t to = 0;
+    for (size_t from = 0; from < cache->region_end;) {
+        code_block * b = (code_block *)(cache->region + from);
+        size_t size = b->size;
+        if (b->idx != LRU_NONE) {
+            if (to != from) {
+                memmove(cache->region + to, b, size);
+                b = (code_block *)(cache->region + to);
+                set_body(mod, &cache->entries[b->idx], b->idx, (u8 *)(b + 1));
+            }
+            to += size;
+        }
+        from += size;
+    }
+    cache->region_end = to;
+    cache->stats.compactions++;
+}
+
+// the region follows the budget, it's only replaced when nothing is being read from it.
+static r fit_region(module * mod, code_cache * cache) {
+    check_prep(r);
+    if (cache->region_size == cache->stats.budget) {
+        return ok_r;
+    }
+    evict_all(mod, cache);
+    array_free(cache->region);
+    cache->region = NULL;
+    cache->region_size = 0;
+    cache->region_end = 0;
+    cache->region_used = 0;
+    if (cache->stats.budget) {
+        cache->region = array_alloc(u8, cache->stats.budget);
+        if (!cache->region) {
+            return err(e_general, "Failed to allocate the code cache");
+        }
+        cache->region_size = cache->stats.budget;
+    }
+    return ok_r;
+}
+
+// room for a body, evicting the least recently used ones.
+static u8 * alloc_body(module * mod, code_cache * cache, u32 idx) {
+    code_cache_entry * e = &cache->entries[idx];
+    size_t size = block_size(e->body_size);
+    if (size > cache->region_size) {
+        evict_all(mod, cache);
+        return array_alloc(u8, e->body_size);
+    }
+    // one that didn't fit is only kept alone.
+    if (!cache->region_used) {
+        evict_all(mod, cache);
+    }
+    while (cache->region_used + size > cache->region_size) {
+        evict(mod, cache, cache->lru.tail);
+    }
+    if (cache->region_end + size > cache->region_size) {
+        compact(mod, cache);
+    }
+    code_block * b = (code_block *)(cache->region + cache->region_end);
+    *b = (code_block){.idx = idx, .size = (u32)size};
+    cache->region_end += size;
+    cache->region_used += size;
+    return (u8 *)(b + 1);
+}
+
+static r code_cache_new(module * mod) {
+    check_prep(r);
+    code_cache * cache = array_calloc(code_cache, 1);
+    size_t func_count = vec_size_func(&mod->funcs);
+    code_cache_entry * entries = func_count ? array_calloc(code_cache_entry, func_count) : NULL;
+    if (!cache || (func_count && !entries)) {
+        array_free(cache);
+        array_free(entries);
+        return err(e_general, "Failed to allocate the code cache");
+    }
+    for (size_t i = 0; i < func_count; i++) {
+        entries[i].lru = LRU_LINK_INIT;
+    }
+    cache->entries = entries;
+    cache->lru = LRU_LIST_INIT;
+    cache->stats.budget = SILVERFIR_CODE_CACHE_SIZE;
+    mod->code_cache = cache;
+    return ok_r;
+}
+
+// decompress every body once to parse its locals.
+static r parse_bodies(module * mod, u32 max_body_size) {
+    check_prep(r);
+    code_cache * cache = mod->code_cache;
+    u8 * scratch = max_body_size ? array_alloc(u8, max_body_size) : NULL;
+    if (max_body_size && !scratch) {
+        return err(e_general, "Failed to allocate the function body");
+    }
+    for (u32 i = mod->imported_func_count; i < vec_size_func(&mod->funcs); i++) {
+        func * fn = vec_at_func(&mod->funcs, i);
+        code_cache_entry * e = &cache->entries[i];
+        if (stored_as_is(e)) {
+            check(parse_func_body(fn, stream_from(e->stored)), array_free(scratch));
+            e->code_offset = (u32)(fn->code.ptr - e->stored.ptr);
+            continue;
+        }
+        check(lz4_decompress(e->stored, scratch, e->body_size), array_free(scratch));
+        check(parse_func_body(fn, stream_from(str_from(scratch, e->body_size))), array_free(scratch));
+        e->code_offset = (u32)(fn->code.ptr - scratch);
+        fn->code = STR_NULL;
+    }
+    array_free(scratch);
+    return ok_r;
+}
+
+r code_cache_load_section(module * mod, stream st) {
+    assert(mod);
+    check_prep(r);
+
+    if (!str_is_null(mod->code_section)) {
+        return err(e_malformed, "Duplicated code section");
+    }
+    mod->code_section = str_from(st.p, stream_remaining(&st));
+    unwrap(u32, version, stream_read_vu32(&st));
+    if (version != CODE_CACHE_VERSION) {
+        return err(e_malformed, "Unsupported compressed code version");
+    }
+    unwrap(u32, count, stream_read_vu32(&st));
+    if (count + mod->imported_func_count != vec_size_func(&mod->funcs)) {
+        return err(e_malformed, "Function number mismatch between code and function sections");
+    }
+    // it's dropped with the module if anything fails from here on.
+    check(code_cache_new(mod));
+    code_cache_entry * entries = mod->code_cache->entries + mod->imported_func_count;
+    u32 max_body_size = 0;
+    for (u32 i = 0; i < count; i++) {
+        unwrap(u32, body_size, stream_read_vu32(&st));
+        unwrap(u32, stored_size, stream_read_vu32(&st));
+        if (!body_size || !stored_size || stored_size > lz4_compress_bound(body_size)) {
+            return err(e_malformed, "Invalid compressed function size");
+        }
+        entries[i].body_size = body_size;
+        entries[i].stored.len = stored_size;
+        if (body_size > max_body_size && stored_size != body_size) {
+            max_body_size = body_size;
+        }
+    }
+    for (u32 i = 0; i < count; i++) {
+        unwrap(stream, stored, stream_slice(&st, entries[i].stored.len));
+        entries[i].stored = stored.s;
+    }
+    if (stream_remaining(&st)) {
+        return err(e_malformed, "Malformed compressed code section");
+    }
+    return parse_bodies(mod, max_body_size);
+}
+
+r code_cache_set_budget(module * mod, size_t budget) {
+    assert(mod);
+    check_prep(r);
+    if (!mod->code_cache) {
+        return err(e_general, "The module has no compressed code");
+    }
+    mod->code_cache->stats.budget = budget;
+    return ok_r;
+}
+
+void code_cache_drop(module * mod) {
+    assert(mod);
+    if (!mod->code_cache) {
+        return;
+    }
+    code_cache * cache = mod->code_cache;
+    for (size_t i = 0; i < vec_size_func(&mod->funcs); i++) {
+        if (!in_region(cache, cache->entries[i].body)) {
+            array_free(cache->entries[i].body);
+        }
+    }
+    array_free(cache->region);
+    array_free(cache->entries);
+    array_free(mod->code_cache);
+    mod->code_cache = NULL;
+}
+
+r code_cache_acquire(module * mod, func * fn) {
+    assert(mod);
+    assert(mod->code_cache);
+    assert(fn);
+    check_prep(r);
+
+    code_cache * cache = mod->code_cache;
+    u32 idx = module_func_index(mod, fn);
+    code_cache_entry * e = &cache->entries[idx];
+    if (likely(fn->code.ptr)) {
+        // the ones stored as is are not in the list.
+        if (e->body) {
+            cache->stats.hits++;
+            lru_touch_code_cache_entry(&cache->lru, cache->entries, idx);
+        }
+        return ok_r;
+    }
+    check(fit_region(mod, cache));
+    e->body = alloc_body(mod, cache, idx);
+    if (!e->body) {
+        return err(e_general, "Failed to allocate the function body");
+    }
+    check(lz4_decompress(e->stored, e->body, e->body_size), free_body(cache, e), e->body = NULL);
+    set_body(mod, e, idx, e->body);
+    cache->stats.loads++;
+    cache->stats.used += e->body_size;
+    lru_push_front_code_cache_entry(&cache->lru, cache->entries, idx);
+    return ok_r;
+}
+
+code_cache_stats code_cache_get_stats(module * mod) {
+    assert(mod);
+    if (!mod->code_cache) {
+        return (code_cache_stats){0};
+    }
+    return mod->code_cache->stats;
+}
+
+static r write_vu32(vstr * v, u32 val) {
+    check_prep(r);
+    do {
+        u8 b = val & 0x7f;
+        val >>= 7;
+        check(vstr_append_c(v, val ? (b | 0x80) : b));
+    } while (val);
+    return ok_r;
+}
+
+// compress one body, it's kept as is if it doesn't get smaller.
+static r append_body(vstr * index, vstr * bodies, str body) {
+    check_prep(r);
+    size_t cap = lz4_compress_bound(str_len(body));
+    u8 * buf = array_alloc(u8, cap);
+    if (!buf) {
+        return err(e_general, "Failed to allocate the compression buffer");
+    }
+    unwrap(size_t, compressed_size, lz4_compress(body, buf, cap), array_free(buf));
+    str stored = compressed_size < str_len(body) ? str_from(buf, compressed_size) : body;
+    check(write_vu32(index, (u32)str_len(body)), array_free(buf));
+    check(write_vu32(index, (u32)str_len(stored)), array_free(buf));
+    check(vstr_append(bodies, stored), array_free(buf));
+    array_free(buf);
+    return ok_r;
+}
+
+// the payload of the compressed code section from the payload of the code section.
+static r build_payload(vstr * payload, str code_section) {
+    check_prep(r);
+    stream st = stream_from(code_section);
+    unwrap(u32, count, stream_read_vu32(&st));
+    check(write_vu32(payload, CODE_CACHE_VERSION));
+    check(write_vu32(payload, count));
+    // the index goes first, so the bodies are collected separately.
+    vstr bodies = VSTR_NULL;
+    for (u32 i = 0; i < count; i++) {
+        unwrap(u32, body_size, stream_read_vu32(&st), vstr_drop(&bodies));
+        unwrap(stream, body, stream_slice(&st, body_size), vstr_drop(&bodies));
+        check(append_body(payload, &bodies, body.s), vstr_drop(&bodies));
+    }
+    if (stream_remaining(&st)) {
+        vstr_drop(&bodies);
+        return err(e_malformed, "Malformed code section");
+    }
+    check(vstr_append(payload, bodies.s), vstr_drop(&bodies));
+    vstr_drop(&bodies);
+    return ok_r;
+}
+
+static r write_sections(vstr * out, stream st) {
+    check_prep(r);
+    bool found = false;
+    while (stream_remaining(&st)) {
+        const u8 * section_begin = st.p;
+        unwrap(u8, id, stream_read_u8(&st));
+        unwrap(u32, payload_len, stream_read_vu32(&st));
+        unwrap(stream, content, stream_slice(&st, payload_len));
+        if (id != SECTION_code) {
+            check(vstr_append(out, str_from(section_begin, st.p - section_begin)));
+            continue;
+        }
+        found = true;
+        str name = s(CODE_CACHE_SECTION_NAME);
+        vstr payload = VSTR_NULL;
+        check(write_vu32(&payload, (u32)str_len(name)), vstr_drop(&payload));
+        check(vstr_append(&payload, name), vstr_drop(&payload));
+        check(build_payload(&payload, content.s), vstr_drop(&payload));
+        check(vstr_append_c(out, SECTION_custom), vstr_drop(&payload));
+        check(write_vu32(out, (u32)str_len(payload.s)), vstr_drop(&payload));
+        check(vstr_append(out, payload.s), vstr_drop(&payload));
+        vstr_drop(&payload);
+    }
+    if (!found) {
+        return err(e_general, "No code section to compress");
+    }
+    return ok_r;
+}
+
+r_vstr code_cache_compress_module(str bin) {
+    check_prep(r_vstr);
+    stream st = stream_from(bin);
+    // the magic number and the version.
+    unwrap(stream, header, stream_slice(&st, 2 * sizeof(u32)));
+    vstr out = VSTR_NULL;
+    check(vstr_append(&out, header.s), vstr_drop(&out));
+    check(write_sections(&out, st), vstr_drop(&out));
+    return ok(out);
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compressed code.
+// For the binaries stored in flash, the code section can be replaced offline (see test/sf_prep)
+// by a custom section that compresses every function body on its own. The bodies are
+// decompressed into RAM when the functions are called, and the least recently called ones are
+// dropped to stay within a byte budget, except the one being called. The jump tables are
+// relative to the decompressed code so they don't change. A body that doesn't compress is
+// stored as is and runs in place.
+//
+// The bodies are carved out of one region the size of the budget, so the loads don't fragment
+// the heap. The gaps left by the evicted ones are closed by sliding the resident ones down when
+// a new one doesn't fit at the end. A body larger than the whole region gets an allocation of
+// its own, with nothing else resident.
+//
+// The interpreter acquires the code of a function when it enters the function, and again after
+// every call and safe point, because the callee or another green thread can evict or move it.
+// A module with compressed code is changed by the calls and can't be frozen.
+//
+// Section layout, the integers are LEB128:
+//   vu32 version
+//   vu32 function count (imported functions excluded)
+//   for each function: vu32 body size, vu32 stored size
+//   the stored bodies (locals and code) back to back, LZ4 blocks unless both sizes are equal.
+
+#pragma once
+
+#include "lru.h"
+#include "module.h"
+#include "result.h"
+#include "silverfir.h"
+#include "str.h"
+#include "stream.h"
+#include "types.h"
+#include "vstr.h"
+
+#define CODE_CACHE_SECTION_NAME "silverfir.code"
+#define CODE_CACHE_VERSION (1)
+
+typedef struct code_cache_entry {
+    // the neighbours in the LRU list, by function index.
+    lru_link lru;
+    // the body in the binary.
+    str stored;
+    u32 body_size;
+    // where the code starts after the locals.
+    u32 code_offset;
+    // the decompressed body, NULL if it's not resident or it's stored as is.
+    u8 * body;
+} code_cache_entry;
+
+typedef struct code_cache_stats {
+    size_t budget; // in bytes
+    size_t used; // in bytes
+    u64 hits;
+    u64 loads;
+    u64 evictions;
+    u64 compactions;
+} code_cache_stats;
+
+typedef struct code_cache {
+    code_cache_stats stats;
+    // one per function, imported ones included so that they can be indexed directly.
+    code_cache_entry * entries;
+    lru_list lru;
+    // the region the bodies are carved out of, allocated on the first load after the budget
+    // is set. The blocks are back to back up to region_end, region_used counts the resident
+    // ones.
+    u8 * region;
+    size_t region_size;
+    size_t region_end;
+    size_t region_used;
+} code_cache;
+
+// Parse the compressed code section and the locals of the functions. Called by the parser.
+r code_cache_load_section(module * mod, stream st);
+
+// Change the budget in bytes, SILVERFIR_CODE_CACHE_SIZE by default. The region is allocated
+// again on the next load, which drops all the resident bodies.
+r code_cache_set_budget(module * mod, size_t budget);
+
+void code_cache_drop(module * mod);
+
+// Make sure the code of the function is there. It might evict the others.
+r code_cache_acquire(module * mod, func * fn);
+
+code_cache_stats code_cache_get_stats(module * mod);
+
+// Replace the code section of a wasm binary with the compressed one. It fails if there is no
+// code section.
+r_vstr code_cache_compress_module(str bin);
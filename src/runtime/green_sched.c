@@ -0,0 +1,222 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if defined(__APPLE__)
+    // for the ucontext functions, see os_fiber.h. _DARWIN_C_SOURCE keeps MAP_ANONYMOUS.
+    #define _XOPEN_SOURCE 700
+    #define _DARWIN_C_SOURCE
+#endif
+
+#include "green_sched.h"
+
+#include "alloc.h"
+#include "interpreter.h"
+#include "os_thread.h"
+#include "vec_impl.h"
+
+VEC_IMPL_FOR_TYPE(green_thread_ptr)
+
+// The fibers are reused, every round of the loop runs one call.
+static void green_thread_main(void * arg) {
+    green_thread * g = (green_thread *)arg;
+    // this is the first frame on the fiber, so the stack ends about stack_size below it.
+    uptr floor = (uptr)&g - g->sched->stack_size + GREEN_SCHED_STACK_RESERVE;
+    while (true) {
+        thread * t = vm_get_thread(g->vm);
+        t->stack_floor = floor;
+        g->ret = interp_call_in_thread(t, g->f_addr, g->args);
+        t->stack_floor = 0;
+        g->args = (vec_typed_value){0};
+        g->done = true;
+        os_fiber_switch(&g->fiber, &g->sched->main);
+    }
+}
+
+static r green_on_preempt(thread * t) {
+    check_prep(r);
+    green_thread * g = (green_thread *)t->preempt_payload;
+    green_sched * s = g->sched;
+    if (!g->cancelled) {
+        t->budget = s->budget;
+        if (s->slice_ns && (os_time_ns() - s->resumed_at < s->slice_ns)) {
+            return ok_r;
+        }
+        os_fiber_switch(&g->fiber, &s->main);
+        // the scheduler could have run the other vms with their own allocators.
+        alloc_enter(t->alloc);
+    }
+    if (g->cancelled) {
+        return err(e_general, "Green thread cancelled");
+    }
+    return ok_r;
+}
+
+#define GREEN_SCHED_QUEUE_MIN_CAPACITY (16)
+
+static r queue_reserve(green_sched * s, u32 count) {
+    check_prep(r);
+    if (count <= s->capacity) {
+        return ok_r;
+    }
+    u32 capacity = s->capacity ? s->capacity * 2 : GREEN_SCHED_QUEUE_MIN_CAPACITY;
+    green_thread_ptr * queue = array_alloc(green_thread_ptr, capacity);
+    if (!queue) {
+        return err(e_general, "Failed to allocate the run queue");
+    }
+    for (u32 i = 0; i < s->queued; i++) {
+        queue[i] = s->queue[(s->head + i) & (s->capacity - 1)];
+    }
+    array_free(s->queue);
+    s->queue = queue;
+    s->head = 0;
+    s->capacity = capacity;
+    return ok_r;
+}
+
+static void queue_push(green_sched * s, green_thread * g) {
+    assert(s->queued < s->capacity);
+    s->queue[(s->head + s->queued) & (s->capacity - 1)] = g;
+    s->queued++;
+}
+
+static green_thread * queue_pop(green_sched * s) {
+    assert(s->queued);
+    green_thread * g = s->queue[s->head];
+    s->head = (s->head + 1) & (s->capacity - 1);
+    s->queued--;
+    return g;
+}
+
+r green_sched_init(green_sched * s, i32 budget, u32 slice_us, size_t stack_size) {
+    check_prep(r);
+    *s = (green_sched){
+        .budget = budget > 0 ? budget : GREEN_SCHED_DEFAULT_BUDGET,
+        .slice_ns = (u64)slice_us * 1000,
+        .stack_size = stack_size ? stack_size : GREEN_SCHED_DEFAULT_STACK_SIZE,
+    };
+    if (s->stack_size <= GREEN_SCHED_STACK_RESERVE * 2) {
+        return err(e_general, "The fiber stack is too small");
+    }
+    if (!os_fiber_init_main(&s->main)) {
+        return err(e_general, "Failed to set up the scheduler fiber");
+    }
+    return ok_r;
+}
+
+static r_green_thread_ptr green_thread_new(green_sched * s) {
+    check_prep(r_green_thread_ptr);
+    if (vec_size_green_thread_ptr(&s->idle)) {
+        green_thread * g = *vec_back_green_thread_ptr(&s->idle);
+        vec_pop_green_thread_ptr(&s->idle);
+        return ok(g);
+    }
+    // make room for the new one in the queues, so that nothing can fail while running.
+    u32 count = s->thread_count + 1;
+    check(queue_reserve(s, count));
+    check(vec_reserve_green_thread_ptr(&s->idle, count));
+    green_thread * g = array_calloc(green_thread, 1);
+    if (!g) {
+        return err(e_general, "Failed to allocate the green thread");
+    }
+    g->sched = s;
+    if (!os_fiber_create(&g->fiber, s->stack_size, green_thread_main, g)) {
+        os_fiber_drop(&g->fiber);
+        array_free(g);
+        return err(e_general, "Failed to create the fiber");
+    }
+    s->thread_count = count;
+    return ok(g);
+}
+
+r green_sched_spawn(green_sched * s, vm * vm, func_addr f_addr, vec_typed_value args, green_callback cb, void * payload) {
+    assert(s);
+    assert(vm);
+    assert(f_addr);
+    check_prep(r);
+    thread * t = vm_get_thread(vm);
+    if (t->on_preempt) {
+        vec_clear_typed_value(&args);
+        return err(e_general, "The thread of the vm is in use");
+    }
+    unwrap(green_thread_ptr, g, green_thread_new(s), vec_clear_typed_value(&args));
+    g->vm = vm;
+    g->f_addr = f_addr;
+    g->args = args;
+    g->cb = cb;
+    g->payload = payload;
+    g->done = false;
+    g->cancelled = false;
+    t->budget = s->budget;
+    t->on_preempt = green_on_preempt;
+    t->preempt_payload = g;
+    queue_push(s, g);
+    return ok_r;
+}
+
+static void green_thread_finish(green_sched * s, green_thread * g) {
+    thread * t = vm_get_thread(g->vm);
+    t->on_preempt = NULL;
+    t->preempt_payload = NULL;
+    if (g->cb) {
+        g->cb(g->payload, g->ret, &t->results);
+    }
+    g->vm = NULL;
+    g->f_addr = NULL;
+    g->cb = NULL;
+    g->payload = NULL;
+    vec_push_green_thread_ptr(&s->idle, g);
+}
+
+static void green_sched_resume(green_sched * s, green_thread * g) {
+    s->resumed_at = os_time_ns();
+    s->switches++;
+    allocator * prev = alloc_current();
+    os_fiber_switch(&s->main, &g->fiber);
+    alloc_leave(prev);
+    if (g->done) {
+        green_thread_finish(s, g);
+    } else {
+        queue_push(s, g);
+    }
+}
+
+r green_sched_run(green_sched * s) {
+    assert(s);
+    while (s->queued) {
+        green_sched_resume(s, queue_pop(s));
+    }
+    return ok_r;
+}
+
+void green_sched_drop(green_sched * s) {
+    // the cancelled ones unwind at their next safe point, the ones not started yet included.
+    for (u32 i = 0; i < s->queued; i++) {
+        green_thread * g = s->queue[(s->head + i) & (s->capacity - 1)];
+        g->cancelled = true;
+        vm_get_thread(g->vm)->budget = 0;
+    }
+    while (s->queued) {
+        green_sched_resume(s, queue_pop(s));
+    }
+    VEC_FOR_EACH(&s->idle, green_thread_ptr, pg) {
+        os_fiber_drop(&(*pg)->fiber);
+        array_free(*pg);
+    }
+    vec_clear_green_thread_ptr(&s->idle);
+    array_free(s->queue);
+    os_fiber_drop(&s->main);
+    *s = (green_sched){0};
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Green threads.
+// Runs many wasm calls cooperatively on one OS thread. Every green thread runs on its own
+// fiber stack with the thread of its vm, and the scheduler switches between them in user
+// space. The interpreters call back at the safe points (see thread in vm.h) once the budget
+// runs out, and the green thread yields there if its time slice is used up as well. The
+// whole interpreter state, native frames included, stays on the fiber stack until it's
+// resumed.
+// The scheduler and all its green threads belong to the OS thread that created it.
+// A switch is not free: with ucontext it's two system calls for the signal mask each way,
+// which is why the time slice, not the budget, decides when to yield.
+
+#pragma once
+
+#include "os_fiber.h"
+#include "result.h"
+#include "types.h"
+#include "vec.h"
+#include "vm.h"
+
+#define GREEN_SCHED_DEFAULT_BUDGET (10000)
+#define GREEN_SCHED_DEFAULT_SLICE_US (1000)
+// The interpreters keep the wasm stack on the native stack. A call that doesn't fit into the
+// fiber stack fails with an exhaustion error, the same as one over SILVERFIR_STACK_SIZE_LIMIT,
+// and the fibers have a guard page below their stacks for anything else.
+#define GREEN_SCHED_DEFAULT_STACK_SIZE (2 * 1024 * 1024)
+// The part of the fiber stack kept for the native frames: the interpreter's own, the host
+// functions and the switches.
+#define GREEN_SCHED_STACK_RESERVE (64 * 1024)
+
+// called on the scheduler's stack when a green thread finishes. The results are only valid
+// during the callback.
+typedef void (*green_callback)(void * payload, r ret, vec_typed_value * results);
+
+struct green_sched;
+typedef struct green_thread {
+    struct green_sched * sched;
+    os_fiber fiber;
+    // the current call, cleared when it's done so that the fiber can be reused.
+    vm * vm;
+    func_addr f_addr;
+    vec_typed_value args;
+    green_callback cb;
+    void * payload;
+    r ret;
+    bool done;
+    // set when the scheduler is dropped, the call is aborted at the next safe point.
+    bool cancelled;
+} green_thread;
+
+typedef green_thread * green_thread_ptr;
+VEC_DECL_FOR_TYPE(green_thread_ptr)
+RESULT_TYPE_DECL(green_thread_ptr)
+
+typedef struct green_sched {
+    os_fiber main;
+    // the run queue, a ring buffer that always has room for all the green threads.
+    green_thread_ptr * queue;
+    u32 head;
+    u32 queued;
+    u32 capacity;
+    // the finished green threads, kept for their fibers.
+    vec_green_thread_ptr idle;
+    u32 thread_count;
+    i32 budget;
+    u64 slice_ns;
+    size_t stack_size;
+    // the time the running green thread was resumed.
+    u64 resumed_at;
+    u64 switches;
+} green_sched;
+
+// budget is the number of safe points between the clock checks, and slice_us is the time a
+// green thread keeps running before it yields, 0 to yield every time the budget runs out.
+// 0 picks the default for the budget and the stack size, which has to be larger than twice
+// GREEN_SCHED_STACK_RESERVE. The scheduler must not be moved
+// once it's initialized.
+r green_sched_init(green_sched * s, i32 budget, u32 slice_us, size_t stack_size);
+
+// Queue a call of f_addr on the thread of the vm. The args are taken over like
+// interp_call_in_thread. A vm runs only one green thread at a time, and it must not be
+// used in any other way until the callback is called.
+r green_sched_spawn(green_sched * s, vm * vm, func_addr f_addr, vec_typed_value args, green_callback cb, void * payload);
+
+// Run until all the green threads, including the ones spawned in the meantime, are done.
+// It must not be called from a green thread.
+r green_sched_run(green_sched * s);
+
+// Abort the unfinished green threads, their callbacks get an error, then release everything.
+void green_sched_drop(green_sched * s);
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jt_cache.h"
+
+#include "alloc.h"
+#include "validator.h"
+
+LRU_IMPL_FOR_TYPE(jt_cache_entry)
+
+INLINE size_t jt_bytes(func * fn) {
+    size_t bytes = vec_size_jump_table(&fn->jt) * sizeof(jump_table) +
+                   vec_size_jump_table_escape(&fn->jt_escapes) * sizeof(jump_table_escape);
+#if SILVERFIR_STACK_SLOT_32
+    bytes += vec_size_u8(&fn->wide_operands);
+#endif
+    return bytes;
+}
+
+static void release_tables(func * fn) {
+    vec_clear_jump_table(&fn->jt);
+    vec_clear_jump_table_escape(&fn->jt_escapes);
+#if SILVERFIR_STACK_SLOT_32
+    vec_clear_u8(&fn->wide_operands);
+#endif
+}
+
+static void evict(module * mod, jt_cache * cache, u32 idx) {
+    func * fn = vec_at_func(&mod->funcs, idx);
+    cache->stats.used -= jt_bytes(fn);
+    cache->stats.evictions++;
+    release_tables(fn);
+    lru_unlink_jt_cache_entry(&cache->lru, cache->entries, idx);
+    cache->entries[idx].resident = false;
+}
+
+r jt_cache_enable(module * mod, size_t budget) {
+    assert(mod);
+    check_prep(r);
+
+    if (mod->is_static || mod->frozen || mod->side_table_loaded) {
+        return err(e_general, "The jump tables of the module can't be budgeted");
+    }
+    if (mod->jt_cache) {
+        if (mod->jt_cache->validated) {
+            return err(e_general, "The module is already validated");
+        }
+        mod->jt_cache->stats.budget = budget;
+        return ok_r;
+    }
+    jt_cache * cache = array_calloc(jt_cache, 1);
+    size_t func_count = vec_size_func(&mod->funcs);
+    jt_cache_entry * entries = func_count ? array_calloc(jt_cache_entry, func_count) : NULL;
+    if (!cache || (func_count && !entries)) {
+        array_free(cache);
+        array_free(entries);
+        return err(e_general, "Failed to allocate the jump table cache");
+    }
+    for (size_t i = 0; i < func_count; i++) {
+        entries[i].lru = LRU_LINK_INIT;
+    }
+    cache->entries = entries;
+    cache->lru = LRU_LIST_INIT;
+    cache->stats.budget = budget;
+    mod->jt_cache = cache;
+    return ok_r;
+}
+
+void jt_cache_drop(module * mod) {
+    assert(mod);
+    if (!mod->jt_cache) {
+        return;
+    }
+    array_free(mod->jt_cache->entries);
+    array_free(mod->jt_cache);
+    mod->jt_cache = NULL;
+}
+
+r jt_cache_validate(module * mod) {
+    assert(mod);
+    assert(mod->jt_cache);
+    check_prep(r);
+
+    jt_cache * cache = mod->jt_cache;
+    if (cache->validated) {
+        return ok_r;
+    }
+    VEC_FOR_EACH(&mod->funcs, func, fn) {
+        if (fn->linkage & linkage_imported) {
+            continue;
+        }
+        check(validate_func(mod, fn), release_tables(fn));
+        // only the stack size is kept.
+        release_tables(fn);
+    }
+    cache->validated = true;
+    return ok_r;
+}
+
+r jt_cache_acquire(module * mod, func * fn) {
+    assert(mod);
+    assert(mod->jt_cache);
+    assert(fn);
+    check_prep(r);
+
+    jt_cache * cache = mod->jt_cache;
+    u32 idx = module_func_index(mod, fn);
+    jt_cache_entry * e = &cache->entries[idx];
+    if (likely(e->resident)) {
+        cache->stats.hits++;
+        lru_touch_jt_cache_entry(&cache->lru, cache->entries, idx);
+        return ok_r;
+    }
+    // it's validated already, so this only builds the tables again.
+    check(validate_func(mod, fn), release_tables(fn));
+    cache->stats.rebuilds++;
+    cache->stats.used += jt_bytes(fn);
+    e->resident = true;
+    lru_push_front_jt_cache_entry(&cache->lru, cache->entries, idx);
+    while (cache->stats.used > cache->stats.budget && cache->lru.tail != idx) {
+        evict(mod, cache, cache->lru.tail);
+    }
+    return ok_r;
+}
+
+jt_cache_stats jt_cache_get_stats(module * mod) {
+    assert(mod);
+    if (!mod->jt_cache) {
+        return (jt_cache_stats){0};
+    }
+    return mod->jt_cache->stats;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Budgeted jump tables.
+// For the devices that can't keep the jump tables of a whole module in RAM. With a budget,
+// the tables are dropped right after each function is validated, and built again by the
+// validator when the function is called. The tables of the least recently called functions
+// are dropped to stay within the budget, except the one being called, so a single table
+// larger than the budget still works.
+//
+// The interpreter acquires the table of a function when it enters the function and again
+// after every call it makes, because the callee can evict it. A module with a budget is
+// changed by the calls and can't be frozen.
+
+#pragma once
+
+#include "lru.h"
+#include "module.h"
+#include "result.h"
+#include "types.h"
+
+typedef struct jt_cache_entry {
+    // the neighbours in the LRU list, by function index.
+    lru_link lru;
+    bool resident;
+} jt_cache_entry;
+
+typedef struct jt_cache_stats {
+    size_t budget; // in bytes
+    size_t used; // in bytes
+    u64 hits;
+    u64 rebuilds;
+    u64 evictions;
+} jt_cache_stats;
+
+typedef struct jt_cache {
+    jt_cache_stats stats;
+    // one per function, imported ones included so that they can be indexed directly.
+    jt_cache_entry * entries;
+    lru_list lru;
+    bool validated;
+} jt_cache;
+
+// Limit the jump tables of the module to the budget in bytes. It must be called before
+// the module is validated, and can't be used with the frozen or the static modules.
+// A trusted module that loads its side tables doesn't use the budget.
+r jt_cache_enable(module * mod, size_t budget);
+
+void jt_cache_drop(module * mod);
+
+// Validate the functions one at a time, and drop the jump tables. Called by module_validate.
+r jt_cache_validate(module * mod);
+
+// Make sure the jump table of the function is there. It might evict the others.
+r jt_cache_acquire(module * mod, func * fn);
+
+jt_cache_stats jt_cache_get_stats(module * mod);
@@ -0,0 +1,183 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if defined(__linux__)
+    #define _GNU_SOURCE
+#endif
+
+#include "mem_image.h"
+
+#if defined(__linux__)
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+    #define MEM_IMAGE_SUPPORTED 1
+#else
+    #define MEM_IMAGE_SUPPORTED 0
+#endif
+
+#if MEM_IMAGE_SUPPORTED
+
+r_mem_image mem_image_new(str bytes) {
+    check_prep(r_mem_image);
+    int fd = (int)syscall(SYS_memfd_create, "silverfir_mem_image", 0);
+    if (fd < 0) {
+        return err(e_general, "memfd_create failed");
+    }
+    size_t written = 0;
+    while (written < str_len(bytes)) {
+        ssize_t n = write(fd, bytes.ptr + written, str_len(bytes) - written);
+        if (n <= 0) {
+            close(fd);
+            return err(e_general, "Failed to write the memory image");
+        }
+        written += (size_t)n;
+    }
+    // the inode number is unique among the live files, and a mapping keeps the file alive.
+    struct stat st;
+    if (fstat(fd, &st) || !st.st_ino) {
+        close(fd);
+        return err(e_general, "Failed to identify the memory image");
+    }
+    mem_image img = {.fd = fd, .size = str_len(bytes), .id = (u64)st.st_ino};
+    return ok(img);
+}
+
+void mem_image_drop(mem_image * img) {
+    assert(img);
+    if (img->fd >= 0) {
+        close(img->fd);
+    }
+    *img = MEM_IMAGE_NULL;
+}
+
+r mem_image_read(const mem_image * img, u8 * dst) {
+    assert(img);
+    check_prep(r);
+    size_t done = 0;
+    while (done < img->size) {
+        ssize_t n = pread(img->fd, dst + done, img->size - done, (off_t)done);
+        if (n <= 0) {
+            return err(e_general, "Failed to read the memory image");
+        }
+        done += (size_t)n;
+    }
+    return ok_r;
+}
+
+r mem_image_map(const mem_image * img, size_t capacity, vec_u8 * out) {
+    assert(img);
+    assert(out);
+    check_prep(r);
+    if (img->fd < 0) {
+        return err(e_general, "Invalid memory image");
+    }
+    if (!capacity || capacity < img->size) {
+        return err(e_general, "Invalid memory image capacity");
+    }
+    // reserve the whole capacity with zero pages first, then put the image on top of it.
+    void * base = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        return err(e_general, "Failed to reserve the memory");
+    }
+    if (img->size && mmap(base, img->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, img->fd, 0) == MAP_FAILED) {
+        munmap(base, capacity);
+        return err(e_general, "Failed to map the memory image");
+    }
+    *out = (vec_u8){
+        ._data = base,
+        ._size = img->size,
+        ._capacity = capacity,
+        .fixed = true,
+    };
+    return ok_r;
+}
+
+r mem_image_reset(const mem_image * img, vec_u8 * mapped) {
+    assert(img);
+    assert(mapped);
+    check_prep(r);
+    if (vec_size_u8(mapped) && madvise(mapped->_data, vec_size_u8(mapped), MADV_DONTNEED)) {
+        return err(e_general, "Failed to reset the memory image");
+    }
+    mapped->_size = img->size;
+    return ok_r;
+}
+
+void mem_image_unmap(vec_u8 * mapped) {
+    assert(mapped);
+    if (mapped->_data) {
+        munmap(mapped->_data, mapped->_capacity);
+    }
+    *mapped = (vec_u8){0};
+}
+
+r mem_image_reserve(size_t capacity, vec_u8 * out) {
+    assert(out);
+    check_prep(r);
+    if (!capacity) {
+        return err(e_general, "Invalid memory capacity");
+    }
+    void * base = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        return err(e_general, "Failed to reserve the memory");
+    }
+    *out = (vec_u8){
+        ._data = base,
+        ._capacity = capacity,
+        .fixed = true,
+    };
+    return ok_r;
+}
+
+#else
+
+r_mem_image mem_image_new(str bytes) {
+    check_prep(r_mem_image);
+    return err(e_general, "Memory images are not supported");
+}
+
+void mem_image_drop(mem_image * img) {
+    assert(img);
+    *img = MEM_IMAGE_NULL;
+}
+
+r mem_image_read(const mem_image * img, u8 * dst) {
+    check_prep(r);
+    return err(e_general, "Memory images are not supported");
+}
+
+r mem_image_map(const mem_image * img, size_t capacity, vec_u8 * out) {
+    check_prep(r);
+    return err(e_general, "Memory images are not supported");
+}
+
+r mem_image_reset(const mem_image * img, vec_u8 * mapped) {
+    check_prep(r);
+    return err(e_general, "Memory images are not supported");
+}
+
+void mem_image_unmap(vec_u8 * mapped) {
+    assert(0);
+}
+
+r mem_image_reserve(size_t capacity, vec_u8 * out) {
+    check_prep(r);
+    return err(e_general, "Memory images are not supported");
+}
+
+#endif
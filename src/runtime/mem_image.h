@@ -0,0 +1,61 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Copy-on-write memory images for the module instance snapshots.
+// An image is a read-only copy of a linear memory. Mapping it gives a private view, where only
+// the pages that are written get copied, and resetting the view simply drops those pages.
+// Atm it's only implemented on Linux (memfd + MAP_PRIVATE). Elsewhere mem_image_new fails and
+// the callers should fall back to plain copies. The same goes for mem_image_reserve.
+
+#pragma once
+
+#include "result.h"
+#include "str.h"
+#include "types.h"
+#include "vec.h"
+
+typedef struct mem_image {
+    int fd; // -1 if not available
+    size_t size;
+    // identifies the image as long as it or any mapping of it is alive, never zero.
+    u64 id;
+} mem_image;
+RESULT_TYPE_DECL(mem_image)
+
+#define MEM_IMAGE_NULL ((mem_image){.fd = -1})
+
+r_mem_image mem_image_new(str bytes);
+
+void mem_image_drop(mem_image * img);
+
+// Copy the whole image to dst, which must be at least img->size bytes.
+r mem_image_read(const mem_image * img, u8 * dst);
+
+// Map the image into a new region of the address space. capacity is the size reserved for
+// the memory to grow in place. The result is a fixed vector which must be released with
+// mem_image_unmap instead of vec_clear.
+r mem_image_map(const mem_image * img, size_t capacity, vec_u8 * out);
+
+// Drop all the private pages of a mapped region so it has the contents of the image again,
+// and shrink it back to the size of the image.
+r mem_image_reset(const mem_image * img, vec_u8 * mapped);
+
+void mem_image_unmap(vec_u8 * mapped);
+
+// Reserve a region of zero pages without an image, the pages are only backed by memory once
+// they're written. The result is an empty fixed vector with the capacity, released with
+// mem_image_unmap as well.
+r mem_image_reserve(size_t capacity, vec_u8 * out);
@@ -16,14 +16,23 @@
 
 #include "module.h"
 
+#include "code_cache.h"
+#include "jt_cache.h"
 #include "list_impl.h"
 #include "parser.h"
+#include "shared_memory.h"
+#include "side_table.h"
 #include "silverfir.h"
 #include "str.h"
+#include "validator.h"
 #include "vec_impl.h"
 
 VEC_IMPL_FOR_TYPE(type_id)
 VEC_IMPL_FOR_TYPE(jump_table)
+VEC_IMPL_FOR_TYPE(jump_table_escape)
+SVEC_IMPL_FOR_TYPE(local_group)
+VEC_IMPL_FOR_TYPE(link_slot)
+VEC_IMPL_FOR_TYPE(module_ptr)
 
 LIST_IMPL_FOR_TYPE(module)
 
@@ -42,9 +51,16 @@ LIST_IMPL_FOR_TYPE(module)
 
 FOR_EACH_MODULE_MEMBER_VECTOR(MODULE_MEMBER_VEC_TYPE_DECL)
 
+static u32 module_serial_counter;
+
+u32 module_next_serial(void) {
+    return s_atomic_inc32(&module_serial_counter);
+}
+
 r module_init(module * mod, vstr bin, vstr name) {
     assert(mod);
     check_prep(r);
+    mod->serial = module_next_serial();
     mod->wasm_bin = bin;
     check(vec_push_vstr(&mod->names, name));
     check(vec_shrink_to_fit_vstr(&mod->names));
@@ -57,24 +73,53 @@ r module_drop(module * mod) {
     assert(mod);
     check_prep(r);
 
-    if (mod->ref_count) {
+    if (s_atomic_load32(&mod->ref_count)) {
         return err(e_general, "Can't drop the module because it's in use (ref_count > 0)");
     }
 
-    // clean up the inner vectors first.
-    VEC_FOR_EACH(&mod->funcs, func, iter) {
-        vec_clear_type_id(&iter->local_types);
-        vec_clear_jump_table(&iter->jt);
-    }
-    VEC_FOR_EACH(&mod->elements, element, iter) {
-        vec_clear_u32(&iter->v_funcidx);
-        vec_clear_str(&iter->v_expr);
+    jt_cache_drop(mod);
+    code_cache_drop(mod);
+    // no instance is left, so nothing links to the shared memories anymore.
+    VEC_FOR_EACH(&mod->memories, memory, mem) {
+        if (mem->shared) {
+            shared_memory_free(mem->shared);
+            mem->shared = NULL;
+        }
     }
 
-    // clean up the direct members.
+    if (!mod->is_static) {
+        // clean up the inner vectors first.
+        VEC_FOR_EACH(&mod->funcs, func, iter) {
+            svec_clear_local_group(&iter->local_groups);
+#if SILVERFIR_STACK_SLOT_32
+            vec_clear_u32(&iter->local_offsets);
+#endif
+            if (!mod->jt_borrowed) {
+                vec_clear_jump_table(&iter->jt);
+                vec_clear_jump_table_escape(&iter->jt_escapes);
+#if SILVERFIR_STACK_SLOT_32
+                vec_clear_u8(&iter->wide_operands);
+#endif
+            }
+        }
+        VEC_FOR_EACH(&mod->elements, element, iter) {
+            vec_clear_u32(&iter->v_funcidx);
+            vec_clear_str(&iter->v_expr);
+        }
+
+        // clean up the direct members.
 #define MODULE_MEMBER_VEC_CLEAR(type, member) \
     vec_clear_##type(&mod->member);
-    FOR_EACH_MODULE_MEMBER_VECTOR(MODULE_MEMBER_VEC_CLEAR);
+        FOR_EACH_MODULE_MEMBER_VECTOR(MODULE_MEMBER_VEC_CLEAR);
+    }
+
+    str_map_clear(&mod->export_index);
+    link_plan_clear(&mod->link_plan);
+    if (mod->frozen_plan) {
+        link_plan_clear(mod->frozen_plan);
+        array_free(mod->frozen_plan);
+        mod->frozen_plan = NULL;
+    }
 
     // clear the name and wasm binary storage if they're owned.
     VEC_FOR_EACH(&mod->names, vstr, name) {
@@ -86,6 +131,9 @@ r module_drop(module * mod) {
         assert(mod->resource_drop_cb);
         mod->resource_drop_cb(mod->resource_payload);
     }
+    // everything above has been freed into it already.
+    alloc_arena_drop(mod->arena);
+    mod->arena = NULL;
 
     return ok_r;
 }
@@ -99,10 +147,77 @@ bool func_type_eq(func_type a, func_type b) {
     return false;
 }
 
+r module_validate(module * mod) {
+    assert(mod);
+
+    if (mod->side_table_loaded || mod->is_static || mod->frozen) {
+        return ok_r;
+    }
+    // A trusted module can use its precomputed side tables instead. If the tables don't
+    // match the module, it falls back to the validator.
+    if (mod->trusted && !str_is_null(mod->side_table_section) && is_ok(side_table_load(mod))) {
+        jt_cache_drop(mod);
+        return ok_r;
+    }
+    if (mod->jt_cache) {
+        return jt_cache_validate(mod);
+    }
+    return validate_module(mod);
+}
+
+r module_freeze(module * mod) {
+    assert(mod);
+    check_prep(r);
+
+    if (mod->jt_cache) {
+        return err(e_general, "A module with budgeted jump tables can't be frozen");
+    }
+    if (mod->code_cache) {
+        return err(e_general, "A module with compressed code can't be frozen");
+    }
+    check(module_validate(mod));
+    // the vms share the frozen_plan from now on.
+    module_link_plan_reset(mod);
+    mod->frozen = true;
+    return ok_r;
+}
+
+void module_link_plan_reset(module * mod) {
+    assert(mod);
+    // keep the storage for the next plan.
+    vec_popall_str(&mod->link_plan.provider_names);
+    vec_popall_module_ptr(&mod->link_plan.providers);
+    vec_popall_u32(&mod->link_plan.provider_serials);
+    vec_popall_link_slot(&mod->link_plan.slots);
+    mod->link_plan.ready = false;
+}
+
+void link_plan_clear(link_plan * plan) {
+    assert(plan);
+    vec_clear_str(&plan->provider_names);
+    vec_clear_module_ptr(&plan->providers);
+    vec_clear_u32(&plan->provider_serials);
+    vec_clear_link_slot(&plan->slots);
+    plan->ready = false;
+}
+
+export * module_find_export(module * mod, str name, external_kind kind) {
+    assert(mod);
+    uptr idx;
+    if (!str_map_get(&mod->export_index, name, &idx)) {
+        return NULL;
+    }
+    export * exp = vec_at_export(&mod->exports, idx);
+    return exp->external_kind == kind ? exp : NULL;
+}
+
 r module_register_name(module * mod, vstr name) {
     assert(mod);
     check_prep(r);
     assert(vec_size_vstr(&mod->names));
+    if (mod->frozen) {
+        return err(e_general, "Can't change a frozen module");
+    }
     check(vec_push_vstr(&mod->names, name));
     return ok_r;
 }
@@ -20,6 +20,7 @@
 #include "option.h"
 #include "result.h"
 #include "str.h"
+#include "str_map.h"
 #include "trampoline.h"
 #include "types.h"
 #include "vec.h"
@@ -44,34 +45,83 @@ RESULT_TYPE_DECL(func_type)
 
 bool func_type_eq(func_type a, func_type b);
 
+// The types in func_type are checked by the parser and each of them takes exactly one byte.
+INLINE type_id types_at(str types, u32 idx) {
+    u8 u = types.ptr[idx];
+    return (type_id)((u & 0x40) ? ((i8)(u | 0x80)) : u);
+}
+
+// The number of stack slots taken by the values of the types. (see value_slot)
+INLINE u32 types_slot_count(str types) {
+#if SILVERFIR_STACK_SLOT_32
+    u32 count = 0;
+    for (u32 i = 0; i < str_len(types); i++) {
+        count += type_slot_count(types_at(types, i));
+    }
+    return count;
+#else
+    return (u32)str_len(types);
+#endif
+}
+
 typedef struct import_path {
     str module;
     str field;
 } import_path;
 
 #define JUMP_TABLE_IDX_INVALID u16_MAX
+// the target_offset of a slot whose offsets don't fit, see jump_table_escape.
+#define JUMP_TABLE_ESCAPE i16_MIN
 
 // the target_offset points to the instruction address *after* the target, and *before* the immediates.
 // This we if we need to jump into another location, we save some time reading the immediates.
 // However, the stack_offset record the stack state *after* all the push/pops are done since we can't
 // skip any of them.
+// The stack_offset and arity are in slots.
+// A slot is 8 bytes and doesn't keep the pc, the interpreter reaches the slots in the pc order anyway.
+// Almost all the branches fit, and the rest have the target_offset set to JUMP_TABLE_ESCAPE and the
+// stack_offset set to the index of their jump_table_escape.
 typedef struct jump_table {
-    u32 pc; // offset from func->code
-    i32 target_offset; // positive -> forward, negative -> backward (loop)
-    u32 stack_offset; // always backward
+    i16 target_offset; // positive -> forward, negative -> backward (loop)
+    u16 stack_offset; // always backward
     u16 arity;
     u16 next_idx;
 } jump_table;
 VEC_DECL_FOR_TYPE(jump_table)
 
+typedef struct jump_table_escape {
+    i32 target_offset;
+    u32 stack_offset;
+} jump_table_escape;
+VEC_DECL_FOR_TYPE(jump_table_escape)
+
+// The target and the stack offset of a slot.
+INLINE jump_table_escape jump_table_decode(const jump_table * tbl, const jump_table_escape * escapes) {
+    if (likely(tbl->target_offset != JUMP_TABLE_ESCAPE)) {
+        return (jump_table_escape){.target_offset = tbl->target_offset, .stack_offset = tbl->stack_offset};
+    }
+    return escapes[tbl->stack_offset];
+}
+
+// A run of the declared locals with the same type, as they're grouped in the binary. Only the
+// end of each run is kept, so a local is found with a binary search.
+typedef struct local_group {
+    u32 end; // the index past the last local of the run, params included.
+    type_id type;
+} local_group;
+// Most of the functions have only a few runs, so they're kept inside of the func.
+#define LOCAL_GROUP_INLINE_COUNT (4)
+SVEC_DECL_FOR_TYPE(local_group, LOCAL_GROUP_INLINE_COUNT)
+
 typedef struct func {
     func_type fn_type;
     u32 linkage;
     u32 local_count; // including the parameters.
-    vec_type_id local_types; // Doesn't include params.
+    svec_local_group local_groups; // Doesn't include params.
     str code;
     import_path path;
     vec_jump_table jt;
+    vec_jump_table_escape jt_escapes;
     // the maximum stack usage of the function. Locals NOT included. Filled by the validator.
     // it also contains the local size of the outgoing calls so that the callee doesn't have
     // to copy the args to locals and simply reuse the entire local var space.
@@ -79,22 +129,105 @@ typedef struct func {
     // for host functions
     trampoline tr;
     void * host_func;
+#if SILVERFIR_STACK_SLOT_32
+    // the layout of the locals in slots, filled by the parser. The host functions don't have it.
+    u32 param_slots;
+    u32 result_slots;
+    u32 local_slots; // including the parameters.
+    // the slot offset of each local and then the end, so that the width of a local is the distance
+    // to the next one. Empty if every local takes exactly one slot.
+    vec_u32 local_offsets;
+    // a bit per byte of the code, set after the opcode of every drop and untyped select whose
+    // operand takes two slots, which they can't tell by themselves. Empty if there's none.
+    // Filled by the validator.
+    vec_u8 wide_operands;
+#endif
 } func;
 VEC_DECL_FOR_TYPE(func)
 
+#if SILVERFIR_STACK_SLOT_32
+// Whether the operand of the drop or the untyped select is two slots wide, see func.
+INLINE bool func_wide_operand(const u8 * wide_operands, u32 offset) {
+    return wide_operands && ((wide_operands[offset >> 3] >> (offset & 7)) & 1);
+}
+#endif
+
+// The type of a declared local, the index counts the params too.
+INLINE type_id func_local_type(func * fn, u32 idx) {
+    assert(idx >= fn->fn_type.param_count && idx < fn->local_count);
+    const local_group * groups = svec_data_local_group(&fn->local_groups);
+    size_t lo = 0;
+    size_t hi = svec_size_local_group(&fn->local_groups) - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (groups[mid].end <= idx) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return groups[lo].type;
+}
+
+// The stack sizes of a function in slots, which are the counts unless SILVERFIR_STACK_SLOT_32 is on.
+INLINE u32 func_param_slots(const func * fn) {
+#if SILVERFIR_STACK_SLOT_32
+    return fn->tr ? types_slot_count(fn->fn_type.params) : fn->param_slots;
+#else
+    return fn->fn_type.param_count;
+#endif
+}
+
+INLINE u32 func_result_slots(const func * fn) {
+#if SILVERFIR_STACK_SLOT_32
+    return fn->tr ? types_slot_count(fn->fn_type.results) : fn->result_slots;
+#else
+    return fn->fn_type.result_count;
+#endif
+}
+
+INLINE u32 func_local_slots(const func * fn) {
+#if SILVERFIR_STACK_SLOT_32
+    return fn->tr ? types_slot_count(fn->fn_type.params) : fn->local_slots;
+#else
+    return fn->local_count;
+#endif
+}
+
 typedef struct limits {
-    u32 min;
-    u32 max;
+    u64 min;
+    u64 max;
+    bool shared;     // memories only
+    bool is64;       // memories only, indexed with i64 (memory64)
+    bool byte_pages; // memories only, the page size is 1 instead of 64KiB (custom-page-sizes)
 } limits;
 RESULT_TYPE_DECL(limits)
 
+struct shared_memory;
 typedef struct memory {
     limits lim;
     u32 linkage;
     import_path path;
+    // A shared memory defined by the module is created by the first instance and then used by
+    // all the instances of the module, in any vm. It's owned by the module and is only
+    // accessed with the s_atomic_*_ptr functions. (see shared_memory.h)
+    struct shared_memory * shared;
 } memory;
 VEC_DECL_FOR_TYPE(memory)
 
+// No memory can be this large as the address spaces are 48-bit at most, so the interpreters clamp
+// the 64-bit indexes to it to keep the effective addresses from overflowing.
+#define MEMORY64_SIZE_LIMIT (1ull << 48)
+
+INLINE bool memory_is64(const memory * mem) {
+    return SILVERFIR_ENABLE_MEMORY64 && mem->lim.is64;
+}
+
+// log2 of the page size, the limits and memory.size/grow are all in pages of this size.
+INLINE u32 memory_page_shift(const memory * mem) {
+    return (SILVERFIR_ENABLE_CUSTOM_PAGE_SIZES && mem->lim.byte_pages) ? 0 : WASM_PAGE_SIZE_LOG2;
+}
+
 typedef struct table {
     type_id valtype;
     limits lim;
@@ -142,10 +275,43 @@ VEC_DECL_FOR_TYPE(data)
 // called on module dtor.
 typedef void (*resource_drop_callback)(void *);
 
+// Link plan.
+// The imports of a module resolved against a set of provider modules, so that instantiating
+// the module again with the same providers only needs to look up each provider once and then
+// copies the addresses by index. The static checks (signatures, global mutability, etc.) are
+// done when the plan is built.
+typedef struct link_slot {
+    external_kind kind;
+    u32 idx; // index of the import in the funcs/globals/memories/tables of the module
+    u32 provider; // index of the provider_names
+    u32 external_idx; // index in the provider
+} link_slot;
+VEC_DECL_FOR_TYPE(link_slot)
+RESULT_TYPE_DECL(link_slot)
+
+struct module;
+typedef struct module * module_ptr;
+VEC_DECL_FOR_TYPE(module_ptr)
+
+typedef struct link_plan {
+    bool ready;
+    // the distinct module names of the imports, and the modules they resolved to. The serials
+    // tell a new module at the same address from the one the plan was built against.
+    vec_str provider_names;
+    vec_module_ptr providers;
+    vec_u32 provider_serials;
+    // one slot per import, grouped by provider.
+    vec_link_slot slots;
+} link_plan;
+
 typedef struct module {
     vec_vstr names;
     vstr wasm_bin;
+    // the number of module instances and snapshots using it, only accessed with the
+    // s_atomic_* functions.
     u32 ref_count;
+    // different for every module initialized, see module_next_serial().
+    u32 serial;
     u32 format_version;
     vec_func_type func_types;
     u32 imported_func_count;
@@ -157,12 +323,43 @@ typedef struct module {
     u32 imported_global_count;
     vec_global globals;
     vec_export exports;
+    // export name -> index of the exports.
+    str_map export_index;
     option_u32 start_funcidx;
     vec_element elements;
     option_u32 data_count;
     vec_data data;
     void * resource_payload;
     resource_drop_callback resource_drop_cb;
+    // the payload of the code section, or the compressed one, used to check against the side
+    // tables.
+    str code_section;
+    // precomputed side tables (see side_table.h), only used by trusted modules.
+    str side_table_section;
+    // Set it if the binary comes from a trusted source. A trusted module with side tables
+    // isn't validated on instantiation.
+    bool trusted;
+    bool side_table_loaded;
+    // the jump tables are pointing into the wasm binary and are not owned by the functions.
+    bool jt_borrowed;
+    // a host module descriptor generated at build time (see host_modules.h). The vectors
+    // except the names point to static storage, and there is nothing to validate.
+    bool is_static;
+    // the imports resolved by the last instantiation, not used by the frozen modules.
+    link_plan link_plan;
+    // The plan of a frozen module, published by the first vm that links it and never changed
+    // afterwards. The vms with other providers link by a plan of their own.
+    link_plan * frozen_plan;
+    // Validated and never written again, except for the ref_count and the frozen_plan once.
+    // A frozen module can be instantiated by any number of vms on different threads at the
+    // same time.
+    bool frozen;
+    // the budgeted jump tables, see jt_cache.h. NULL if all the tables are kept.
+    struct jt_cache * jt_cache;
+    // the decompressed function bodies, see code_cache.h. NULL if the code isn't compressed.
+    struct code_cache * code_cache;
+    // the arena the module is parsed into (see runtime.h), dropped with the module.
+    allocator * arena;
 } module;
 LIST_DECL_FOR_TYPE(module)
 RESULT_TYPE_DECL(module)
@@ -176,3 +373,28 @@ r module_register_name(module * mod, vstr name);
 // release the internal resources
 r module_drop(module * mod);
 
+// Validate the module, or load the side tables if it's trusted. Nothing to do for the
+// static and the frozen modules.
+r module_validate(module * mod);
+
+// Validate the module and make it read-only so that it can be shared across threads.
+// After this, the module must not be changed (e.g. registering more names) until it's dropped.
+r module_freeze(module * mod);
+
+// forget the link plan, e.g. when one of the providers is going away.
+void module_link_plan_reset(module * mod);
+
+// release the storage of a plan.
+void link_plan_clear(link_plan * plan);
+
+// A new serial for a module, the host modules made from the static descriptors need one too.
+u32 module_next_serial(void);
+
+// The index of a function in the module, imported ones included.
+INLINE u32 module_func_index(module * mod, func * fn) {
+    return (u32)(fn - vec_at_func(&mod->funcs, 0));
+}
+
+// find an export by its name and kind, NULL if not found.
+export * module_find_export(module * mod, str name, external_kind kind);
+
@@ -16,7 +16,9 @@
 
 #include "parser.h"
 
+#include "code_cache.h"
 #include "opcode.h"
+#include "side_table.h"
 #include "silverfir.h"
 #include "types.h"
 #include "utf8.h"
@@ -51,23 +53,72 @@ r_vec_type_id parse_types(u32 count, str types) {
     return ok(v);
 }
 
-static r_limits parse_limits(stream * st, u32 max_cap) {
+static r_u64 read_limit(stream * st, bool is64) {
+    check_prep(r_u64);
+    if (is64) {
+        return stream_read_vu64(st);
+    }
+    unwrap(u32, val, stream_read_vu32(st));
+    return ok((u64)val);
+}
+
+// The shared flag (0x2), the 64-bit flag (0x4) and the page size flag (0x8) are only allowed for
+// the memories, and a shared memory must have a max. The limits of a 64-bit memory are u64 and
+// capped by WASM_MEM64_MAX_PAGES instead of max_cap. A memory with 1-byte pages can have up to
+// 2^32 - 1 pages, or any u64 if it's 64-bit, so that its size in bytes still fits the index type.
+static r_limits parse_limits(stream * st, u32 max_cap, bool is_memory) {
     check_prep(r_limits);
     assert(max_cap);
 
     unwrap(u8, flag, stream_read_u8(st));
-    if ((flag != 0x0) && (flag != 0x1)) {
+    if ((flag > 0xf) || ((flag & 0xe) && !is_memory)) {
         return err(e_malformed, "Invalid limits");
     }
-    unwrap(u32, min, stream_read_vu32(st));
-    u32 max = max_cap;
-    if (flag == 0x1) {
-        unwrap(u32, m, stream_read_vu32(st));
-        if (m <= max_cap) {
-            max = m;
-        } else {
-            return err(e_invalid, "Invalid limits max");
-        }
+    bool shared = flag & 0x2;
+    if (shared) {
+#if !SILVERFIR_ENABLE_THREADS
+        return err(e_invalid, "Shared memories are disabled");
+#endif
+        if (!(flag & 0x1)) {
+            return err(e_invalid, "shared memory must have maximum");
+        }
+    }
+    bool is64 = flag & 0x4;
+    if (is64) {
+#if !SILVERFIR_ENABLE_MEMORY64
+        return err(e_invalid, "64-bit memories are disabled");
+#endif
+        if (shared) {
+            // the waiters are keyed by 32-bit addresses.
+            return err(e_invalid, "Shared 64-bit memories are not supported");
+        }
+    }
+    unwrap(u64, min, read_limit(st, is64));
+    u64 max = 0;
+    if (flag & 0x1) {
+        unwrap(u64, m, read_limit(st, is64));
+        max = m;
+    }
+    bool byte_pages = false;
+    if (flag & 0x8) {
+#if !SILVERFIR_ENABLE_CUSTOM_PAGE_SIZES
+        return err(e_invalid, "Custom page sizes are disabled");
+#endif
+        // log2 of the page size, only 1 byte and the default 64KiB are allowed.
+        unwrap(u32, page_size_log2, stream_read_vu32(st));
+        if ((page_size_log2 != 0) && (page_size_log2 != WASM_PAGE_SIZE_LOG2)) {
+            return err(e_invalid, "Invalid custom page size");
+        }
+        byte_pages = !page_size_log2;
+    }
+    u64 cap = is64 ? WASM_MEM64_MAX_PAGES : max_cap;
+    if (byte_pages) {
+        cap = is64 ? u64_MAX : u32_MAX;
+    }
+    if (!(flag & 0x1)) {
+        max = cap;
+    } else if (max > cap) {
+        return err(e_invalid, "Invalid limits max");
     }
     if (min > max) {
         return err(e_invalid, "Invalid limits min");
@@ -75,6 +126,9 @@ static r_limits parse_limits(stream * st, u32 max_cap) {
     limits lim = {
         .min = min,
         .max = max,
+        .shared = shared,
+        .is64 = is64,
+        .byte_pages = byte_pages,
     };
     return ok(lim);
 }
@@ -114,6 +168,14 @@ static r_str parse_const_expr(stream * st) {
                 unwrap_drop(u32, stream_read_vu32(&st_copy));
                 continue;
             }
+            case op_prefix_fd: {
+                // v128.const, skip the immediate because it can contain anything including op_end.
+                unwrap(u32, opcode_fd, stream_read_vu32(&st_copy));
+                if (opcode_fd == op_v128_const) {
+                    check(stream_seek(&st_copy, 16));
+                }
+                continue;
+            }
             case op_end: {
                 goto end;
             }
@@ -150,7 +212,58 @@ static r_str parse_name(stream * st) {
     return ok(name.s);
 }
 
+#if SILVERFIR_STACK_SLOT_32
+// Lay out the params and the locals in slots. The side tables don't have it, so it can't be left
+// to the validator.
+static r layout_func_slots(func * fn) {
+    check_prep(r);
+    fn->param_slots = types_slot_count(fn->fn_type.params);
+    fn->result_slots = types_slot_count(fn->fn_type.results);
+    fn->local_slots = fn->param_slots;
+    u32 group_begin = fn->fn_type.param_count;
+    SVEC_FOR_EACH(&fn->local_groups, local_group, g) {
+        fn->local_slots += (g->end - group_begin) * type_slot_count(g->type);
+        group_begin = g->end;
+    }
+    vec_clear_u32(&fn->local_offsets);
+    // every local takes one slot, the index is the offset.
+    if (fn->local_slots == fn->local_count) {
+        return ok_r;
+    }
+    check(vec_reserve_u32(&fn->local_offsets, fn->local_count + 1));
+    u32 offset = 0;
+    stream st = stream_from(fn->fn_type.params);
+    for (u32 i = 0; i < fn->fn_type.param_count; i++) {
+        unwrap(i8, t, stream_read_vi7(&st));
+        check(vec_push_u32(&fn->local_offsets, offset));
+        offset += type_slot_count((type_id)t);
+    }
+    group_begin = fn->fn_type.param_count;
+    SVEC_FOR_EACH(&fn->local_groups, local_group, g) {
+        for (u32 i = group_begin; i < g->end; i++) {
+            check(vec_push_u32(&fn->local_offsets, offset));
+            offset += type_slot_count(g->type);
+        }
+        group_begin = g->end;
+    }
+    check(vec_push_u32(&fn->local_offsets, offset));
+    vec_set_fixed(&fn->local_offsets, true);
+    return ok_r;
+}
+#endif
+
 r parse_section_custom(module * mod, stream st) {
+    check_prep(r);
+    unwrap(str, name, parse_name(&st));
+    // Only the side tables and the compressed code are recognized. If there're more than one
+    // side tables, the first one wins.
+    if (!str_is_null(name) && str_eq(name, s(SIDE_TABLE_SECTION_NAME)) && str_is_null(mod->side_table_section)) {
+        if (stream_remaining(&st)) {
+            mod->side_table_section = str_from(st.p, stream_remaining(&st));
+        }
+    } else if (!str_is_null(name) && str_eq(name, s(CODE_CACHE_SECTION_NAME))) {
+        check(code_cache_load_section(mod, st));
+    }
     return ok_r;
 }
 
@@ -233,6 +346,9 @@ r parse_section_import(module * mod, stream st) {
                     .linkage = linkage_imported,
                     .path = (import_path){.module = module_name, .field = field_name},
                 };
+#if SILVERFIR_STACK_SLOT_32
+                check(layout_func_slots(&func));
+#endif
                 check(vec_push_func(&mod->funcs, func));
                 mod->imported_func_count++;
                 break;
@@ -242,7 +358,7 @@ r parse_section_import(module * mod, stream st) {
                 if (!is_ref(valtype)) {
                     return err(e_invalid, "Invalid ref in the imported table");
                 }
-                unwrap(limits, lim, parse_limits(&st, u32_MAX));
+                unwrap(limits, lim, parse_limits(&st, u32_MAX, false));
                 table table = {
                     .valtype = valtype,
                     .lim = lim,
@@ -254,7 +370,7 @@ r parse_section_import(module * mod, stream st) {
                 break;
             }
             case EXTERNAL_KIND_Memory: {
-                unwrap(limits, lim, parse_limits(&st, WASM_MEM_MAX_PAGES));
+                unwrap(limits, lim, parse_limits(&st, WASM_MEM_MAX_PAGES, true));
                 memory mem = {
                     .lim = lim,
                     .linkage = linkage_imported,
@@ -313,6 +429,9 @@ r parse_section_function(module * mod, stream st) {
             .linkage = linkage_none,
             .local_count = fn_type.param_count,
         };
+#if SILVERFIR_STACK_SLOT_32
+        check(layout_func_slots(&func));
+#endif
         check(vec_push_func(&mod->funcs, func));
     }
     if (stream_remaining(&st)) {
@@ -333,7 +452,7 @@ r parse_section_table(module * mod, stream st) {
         if (!is_ref(valtype)) {
             return err(e_invalid, "Invalid ref in the table section");
         }
-        unwrap(limits, lim, parse_limits(&st, u32_MAX));
+        unwrap(limits, lim, parse_limits(&st, u32_MAX, false));
         table tab = {
             .valtype = valtype,
             .lim = lim,
@@ -355,7 +474,7 @@ r parse_section_memory(module * mod, stream st) {
     vec_set_fixed(&mod->memories, true);
 
     for (u32 i = 0; i < count; i++) {
-        unwrap(limits, lim, parse_limits(&st, WASM_MEM_MAX_PAGES));
+        unwrap(limits, lim, parse_limits(&st, WASM_MEM_MAX_PAGES, true));
         memory mem = {
             .lim = lim,
             .linkage = linkage_none,
@@ -444,7 +563,11 @@ r parse_section_export(module * mod, stream st) {
                 break;
             }
         }
-        // TODO: check if the exported names are unique.
+        uptr dup_idx;
+        if (str_map_get(&mod->export_index, name, &dup_idx)) {
+            return err(e_invalid, "duplicate export name");
+        }
+        check(str_map_put(&mod->export_index, name, i));
         export exp = {
             .name = name,
             .external_kind = external_kind,
@@ -574,8 +697,72 @@ r parse_section_element(module * mod, stream st) {
     return ok_r;
 }
 
+r parse_func_body(func * fn, stream code) {
+    check_prep(r);
+    unwrap(u32, local_group_count, stream_read_vu32(&code));
+
+    // in order to pass the spec test we need to calculate the total local numbers to
+    // make sure it doesn't exceed 2^32-1. The params are counted too, so that the index of
+    // every local fits in a u32.
+    stream code_copy = code;
+    u64 total_locals = fn->local_count;
+    for (u32 j = 0; j < local_group_count; j++) {
+        unwrap(u32, local_count, stream_read_vu32(&code_copy));
+        unwrap_drop(i8, stream_read_vi7(&code_copy));
+        total_locals += local_count;
+        // parser should allow no more than u32_MAX number of locals because that's
+        // valid binary format. However, the runtime may still limit the local to a
+        // much smaller number due to the resource limit. And in that case a different
+        // error (assert_exhaustion) will be raised instead.
+        if (total_locals > u32_MAX) {
+            return err(e_malformed, "Too many locals");
+        }
+    }
+
+    // now we do the job, the groups are kept as they are except the empty ones, and the
+    // neighbours of the same type are merged.
+    check(svec_reserve_local_group(&fn->local_groups, local_group_count));
+    for (u32 j = 0; j < local_group_count; j++) {
+        unwrap(u32, local_count, stream_read_vu32(&code));
+        unwrap(i8, valtype, stream_read_vi7(&code));
+        if (!is_value_type(valtype)) {
+            return err(e_invalid, "Invalid value type");
+        }
+        if (!local_count) {
+            continue;
+        }
+        fn->local_count += local_count;
+        size_t group_count = svec_size_local_group(&fn->local_groups);
+        local_group * last = group_count ? svec_at_local_group(&fn->local_groups, group_count - 1) : NULL;
+        if (last && last->type == valtype) {
+            last->end = fn->local_count;
+        } else {
+            check(svec_push_local_group(&fn->local_groups, (local_group){.end = fn->local_count, .type = valtype}));
+        }
+    }
+    // now, the sub stream should contain the code only.
+    if (!stream_remaining(&code)) {
+        return err(e_invalid, "Function body is empty");
+    }
+    // TODO: move this to an str API
+    fn->code = (str){
+        .ptr = code.p,
+        .len = code.s.ptr + code.s.len - code.p,
+    };
+    check(svec_shrink_to_fit_local_group(&fn->local_groups));
+    svec_set_fixed(&fn->local_groups, true);
+#if SILVERFIR_STACK_SLOT_32
+    check(layout_func_slots(fn));
+#endif
+    return ok_r;
+}
+
 r parse_section_code(module * mod, stream st) {
     check_prep(r);
+    if (!str_is_null(mod->code_section)) {
+        return err(e_malformed, "Duplicated code section");
+    }
+    mod->code_section = st.s;
 
     unwrap(u32, count, stream_read_vu32(&st));
     if (count + mod->imported_func_count != vec_size_func(&mod->funcs)) {
@@ -590,48 +777,7 @@ r parse_section_code(module * mod, stream st) {
         unwrap(stream, code, stream_slice(&st, code_size));
         // we create a slice of the main stream so that we can leave the main "st"
         // and parse the copy.
-        unwrap(u32, local_group_count, stream_read_vu32(&code));
-
-        // in order to pass the spec test we need to calculate the total local numbers to
-        // make sure it doesn't exceed 2^32-1.
-        stream code_copy = code;
-        u64 total_locals = 0;
-        for (u32 j = 0; j < local_group_count; j++) {
-            unwrap(u32, local_count, stream_read_vu32(&code_copy));
-            unwrap_drop(i8, stream_read_vi7(&code_copy));
-            total_locals += local_count;
-            // parser should allow no more than u32_MAX number of locals because that's
-            // valid binary format. However, the runtime may still limit the local to a
-            // much smaller number due to the resource limit. And in that case a different
-            // error (assert_exhaustion) will be raised instead.
-            if (total_locals > u32_MAX) {
-                return err(e_malformed, "Too many locals");
-            }
-        }
-
-        // now we do the job
-        for (u32 j = 0; j < local_group_count; j++) {
-            unwrap(u32, local_count, stream_read_vu32(&code));
-            unwrap(i8, valtype, stream_read_vi7(&code));
-            if (!is_value_type(valtype)) {
-                return err(e_invalid, "Invalid value type");
-            }
-            for (u32 k = 0; k < local_count; k++) {
-                check(vec_push_type_id(&fn->local_types, valtype));
-                fn->local_count++;
-            }
-        }
-        // now, the sub stream should contain the code only.
-        if (!stream_remaining(&code)) {
-            return err(e_invalid, "Function body is empty");
-        }
-        // TODO: move this to an str API
-        fn->code = (str){
-            .ptr = code.p,
-            .len = code.s.ptr + code.s.len - code.p,
-        };
-        check(vec_shrink_to_fit_type_id(&fn->local_types));
-        vec_set_fixed(&fn->local_types, true);
+        check(parse_func_body(fn, code));
     }
     if (stream_remaining(&st)) {
         return err(e_malformed, "Malformed code section");
@@ -26,3 +26,6 @@ r parse_module(module * mod);
 
 // helper function to parse encoded types str into a vector
 r_vec_type_id parse_types(u32 count, str types);
+
+// Parse the locals of a function body, and point the code of the function to the rest.
+r parse_func_body(func * fn, stream code);
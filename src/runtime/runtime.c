@@ -30,36 +30,61 @@ r runtime_drop(runtime * rt) {
     }
 
     LIST_FOR_EACH(&rt->modules, module, iter) {
-        assert(!iter->ref_count);
+        assert(!s_atomic_load32(&iter->ref_count));
         check(module_drop(iter));
     }
 
     list_clear_vm(&rt->vms);
     list_clear_module(&rt->modules);
+    str_map_clear(&rt->module_index);
     return ok_r;
 }
 
-r runtime_module_add_mod(runtime * rt, module mod) {
-    assert(rt);
-    assert(!mod.ref_count);
+static void runtime_module_unindex(runtime * rt, module * mod) {
+    VEC_FOR_EACH(&mod->names, vstr, n) {
+        if (runtime_module_find(rt, n->s) == mod) {
+            str_map_remove(&rt->module_index, n->s);
+        }
+    }
+}
+
+static r runtime_module_index(runtime * rt, module * mod) {
+    check_prep(r);
+    VEC_FOR_EACH(&mod->names, vstr, n) {
+        check(str_map_put(&rt->module_index, n->s, (uptr)mod), runtime_module_unindex(rt, mod));
+    }
+    return ok_r;
+}
+
+static r runtime_module_add_mod_in(runtime * rt, module mod) {
     check_prep(r);
 
     assert(vec_size_vstr(&mod.names));
-    assert(!vstr_is_null(mod.wasm_bin));
+    assert(mod.is_static || !vstr_is_null(mod.wasm_bin));
 
     // check if the name has conflicts.
-    LIST_FOR_EACH(&rt->modules, module, m) {
-        VEC_FOR_EACH(&m->names, vstr, n1) {
-            VEC_FOR_EACH(&mod.names, vstr, n2) {
-                if (str_eq(n1->s, n2->s)) {
-                    return err(e_general, "Module name conflict");
-                }
-            }
+    VEC_FOR_EACH(&mod.names, vstr, n) {
+        if (runtime_module_find(rt, n->s)) {
+            return err(e_general, "Module name conflict");
         }
     }
 
     // at this time, the ref_count is still zero, until it gets instantiated.
-    return list_push_module(&rt->modules, mod);
+    check(list_push_module(&rt->modules, mod));
+    module * m = list_back_module(&rt->modules);
+    assert(m);
+    check(runtime_module_index(rt, m), list_erase_module(&rt->modules, m));
+    return ok_r;
+}
+
+r runtime_module_add_mod(runtime * rt, module mod) {
+    assert(rt);
+    assert(!mod.ref_count);
+
+    allocator * prev = alloc_enter(rt->alloc);
+    r ret = runtime_module_add_mod_in(rt, mod);
+    alloc_leave(prev);
+    return ret;
 }
 
 r runtime_module_drop(runtime * rt, module * mod) {
@@ -69,7 +94,21 @@ r runtime_module_drop(runtime * rt, module * mod) {
 
     LIST_FOR_EACH(&rt->modules, module, m) {
         if (m == mod) {
-            check(module_drop(m));
+            // the plans must not match a new module allocated at the same address.
+            LIST_FOR_EACH(&rt->modules, module, other) {
+                VEC_FOR_EACH(&other->link_plan.providers, module_ptr, provider) {
+                    if (*provider == mod) {
+                        module_link_plan_reset(other);
+                        break;
+                    }
+                }
+            }
+            // the names are gone after the drop, so unindex first.
+            runtime_module_unindex(rt, m);
+            check(module_drop(m), {
+                r ret = runtime_module_index(rt, m);
+                UNUSED(ret);
+            });
             list_erase_module(&rt->modules, m);
             return ok_r;
         }
@@ -77,16 +116,27 @@ r runtime_module_drop(runtime * rt, module * mod) {
     return err(e_general, "The module isn't owned by the runtime");
 }
 
-r runtime_module_add(runtime * rt, vstr bin, vstr name) {
+static r runtime_module_add_in(runtime * rt, vstr bin, vstr name) {
     check_prep(r);
 
     module m = {0};
-    check(module_init(&m, bin, name), {
+    if (rt->module_arena) {
+        m.arena = alloc_arena_new(SILVERFIR_ARENA_CHUNK_SIZE);
+        if (!m.arena) {
+            vstr_drop(&bin);
+            vstr_drop(&name);
+            return err(e_general, "Failed to allocate the module arena");
+        }
+    }
+    allocator * prev = alloc_enter(m.arena);
+    r ret = module_init(&m, bin, name);
+    alloc_leave(prev);
+    check(ret, {
         r ret = module_drop(&m);
         UNUSED(ret);
         assert(is_ok(ret));
     });
-    check(runtime_module_add_mod(rt, m), {
+    check(runtime_module_add_mod_in(rt, m), {
         r ret = module_drop(&m);
         UNUSED(ret);
         assert(is_ok(ret));
@@ -94,25 +144,64 @@ r runtime_module_add(runtime * rt, vstr bin, vstr name) {
     return ok_r;
 }
 
+r runtime_module_add(runtime * rt, vstr bin, vstr name) {
+    assert(rt);
+
+    allocator * prev = alloc_enter(rt->alloc);
+    r ret = runtime_module_add_in(rt, bin, name);
+    alloc_leave(prev);
+    return ret;
+}
+
 module * runtime_module_find(runtime * rt, str name) {
     assert(rt);
 
-    LIST_FOR_EACH(&rt->modules, module, mod) {
-        VEC_FOR_EACH(&mod->names, vstr, n) {
-            if (str_eq(n->s, name)) {
-                return mod;
-            }
+    uptr mod;
+    if (!str_map_get(&rt->module_index, name, &mod)) {
+        return NULL;
+    }
+    return (module *)mod;
+}
+
+static r runtime_module_register_name_in(runtime * rt, module * mod, vstr name) {
+    check_prep(r);
+
+    if (runtime_module_find(rt, name.s)) {
+        return err(e_general, "Module name conflict");
+    }
+    check(module_register_name(mod, name));
+    str new_name = vec_at_vstr(&mod->names, vec_size_vstr(&mod->names) - 1)->s;
+    check(str_map_put(&rt->module_index, new_name, (uptr)mod));
+    // the instances are indexed by names too.
+    str primary_name = vec_at_vstr(&mod->names, 0)->s;
+    LIST_FOR_EACH(&rt->vms, vm, v) {
+        module_inst * inst = vm_find_module_inst(v, primary_name);
+        if (inst && (inst->mod == mod)) {
+            check(str_map_put(&v->instance_index, new_name, (uptr)inst));
         }
     }
-    return NULL;
+    return ok_r;
+}
+
+r runtime_module_register_name(runtime * rt, module * mod, vstr name) {
+    assert(rt);
+    assert(mod);
+
+    allocator * prev = alloc_enter(rt->alloc);
+    r ret = runtime_module_register_name_in(rt, mod, name);
+    alloc_leave(prev);
+    return ret;
 }
 
 r_vm_ptr runtime_vm_new(runtime * rt) {
     assert(rt);
     check_prep(r_vm_ptr);
 
-    vm v = {.rt = rt};
-    check(list_push_vm(&rt->vms, v));
+    vm v = {.rt = rt, .thread.alloc = rt->alloc};
+    allocator * prev = alloc_enter(rt->alloc);
+    r ret = list_push_vm(&rt->vms, v);
+    alloc_leave(prev);
+    check(ret);
 
     vm * pv = list_back_vm(&rt->vms);
     assert(pv);
@@ -26,9 +26,18 @@
 //              thread -> { frame stack : frame,frame,frame...
 //                          value stack : args, locals, args, locals, ...}
 
+// Everything of a runtime is allocated with its allocator (see alloc.h), which is given on
+// creation, e.g. runtime rt = {.alloc = &fixed.base};
 typedef struct runtime {
     list_module modules;
+    // module name -> module
+    str_map module_index;
     list_vm vms;
+    // NULL for the current one of the thread.
+    allocator * alloc;
+    // Parse each module into an arena of its own, which takes chunks from alloc and is freed
+    // as a whole when the module is dropped. The validation and the instances still use alloc.
+    bool module_arena;
 } runtime;
 
 // delete all vm and modules and clear the runtime.
@@ -46,6 +55,10 @@ r runtime_module_drop(runtime * rt, module * mod);
 // find a module by name
 module * runtime_module_find(runtime * rt, str name);
 
+// Give a runtime owned module another name. Unlike module_register_name, it also updates
+// the indexes, so the module and its instances can be found by the new name right away.
+r runtime_module_register_name(runtime * rt, module * mod, vstr name);
+
 // create an empty vm from the main module.
 r_vm_ptr runtime_vm_new(runtime * rt);
 
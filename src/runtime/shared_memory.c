@@ -0,0 +1,285 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if defined(__linux__)
+    #define _GNU_SOURCE
+#endif
+
+#include "shared_memory.h"
+
+#include "alloc.h"
+#include "mem_image.h"
+#include "silverfir.h"
+#include "wasm_format.h"
+
+#if SILVERFIR_ENABLE_THREADS
+    #include <stdatomic.h>
+#endif
+#if defined(__linux__)
+    #include <linux/futex.h>
+    #include <sys/syscall.h>
+    #include <time.h>
+    #include <unistd.h>
+#endif
+
+// The pages of a reservation are zero until they're written, so it's resized in place.
+static r shared_memory_reserve(shared_memory * sm, u64 capacity, size_t size) {
+    check_prep(r);
+    vec_u8 * mdata = &sm->inst.mdata;
+    if (is_ok(mem_image_reserve((size_t)capacity, mdata))) {
+        sm->inst.mapped = true;
+        mdata->_size = size;
+        return ok_r;
+    }
+    if (capacity > SILVERFIR_SHARED_MEMORY_HEAP_MAX) {
+        return err(e_general, "Shared memory is too large to be allocated upfront");
+    }
+    check(vec_reserve_u8(mdata, (size_t)capacity));
+    check(vec_resize_u8(mdata, size), vec_clear_u8(mdata));
+    vec_set_fixed(mdata, true);
+    return ok_r;
+}
+
+static void shared_memory_release(shared_memory * sm) {
+    if (sm->inst.mapped) {
+        mem_image_unmap(&sm->inst.mdata);
+        sm->inst.mapped = false;
+    } else {
+        vec_clear_u8(&sm->inst.mdata);
+    }
+}
+
+static r_shared_memory_ptr shared_memory_new(memory * mem) {
+    check_prep(r_shared_memory_ptr);
+
+    u32 shift = memory_page_shift(mem);
+    u64 capacity = mem->lim.max << shift;
+    if (capacity > SIZE_MAX) {
+        return err(e_general, "Shared memory is too large");
+    }
+    shared_memory * sm = array_calloc(shared_memory, 1);
+    if (!sm) {
+        return err(e_general, "Failed to allocate the shared memory");
+    }
+    sm->inst.mem = mem;
+    sm->inst.shared = sm;
+    // the data must not move once it's shared.
+    check(shared_memory_reserve(sm, capacity, (size_t)(mem->lim.min << shift)), array_free(sm));
+    os_mutex_init(&sm->grow_lock);
+    for (u32 i = 0; i < SHARED_MEMORY_WAIT_BUCKETS; i++) {
+        os_mutex_init(&sm->buckets[i].lock);
+    }
+    return ok(sm);
+}
+
+r_shared_memory_ptr shared_memory_get(memory * mem) {
+    assert(mem);
+    assert(mem->lim.shared);
+    check_prep(r_shared_memory_ptr);
+
+    shared_memory * sm = s_atomic_load_ptr(&mem->shared);
+    if (sm) {
+        return ok(sm);
+    }
+    unwrap(shared_memory_ptr, created, shared_memory_new(mem));
+    if (!s_atomic_cas_ptr(&mem->shared, NULL, created)) {
+        // another instance got there first.
+        shared_memory_free(created);
+        created = s_atomic_load_ptr(&mem->shared);
+    }
+    return ok(created);
+}
+
+void shared_memory_free(shared_memory * sm) {
+    if (!sm) {
+        return;
+    }
+    for (u32 i = 0; i < SHARED_MEMORY_WAIT_BUCKETS; i++) {
+        assert(!sm->buckets[i].head);
+        os_mutex_drop(&sm->buckets[i].lock);
+    }
+    os_mutex_drop(&sm->grow_lock);
+    shared_memory_release(sm);
+    array_free(sm);
+}
+
+i32 shared_memory_grow(shared_memory * sm, u32 delta) {
+    assert(sm);
+    i32 prev_pages = -1;
+    os_mutex_lock(&sm->grow_lock);
+    vec_u8 * mdata = &sm->inst.mdata;
+    u32 shift = memory_page_shift(sm->inst.mem);
+    u32 pages = (u32)(vec_size_u8(mdata) >> shift);
+    if ((u64)pages + delta <= sm->inst.mem->lim.max) {
+        // always within the reserved capacity.
+        size_t size = (size_t)(((u64)pages + delta) << shift);
+        if (sm->inst.mapped) {
+            mdata->_size = size;
+            prev_pages = (i32)pages;
+        } else if (is_ok(vec_resize_u8(mdata, size))) {
+            prev_pages = (i32)pages;
+        }
+    }
+    os_mutex_unlock(&sm->grow_lock);
+    return prev_pages;
+}
+
+#if SILVERFIR_ENABLE_THREADS
+
+INLINE shared_wait_bucket * bucket_of(shared_memory * sm, u32 addr) {
+    return &sm->buckets[(addr >> 2) % SHARED_MEMORY_WAIT_BUCKETS];
+}
+
+INLINE bool waiter_woken(shared_waiter * w) {
+    return atomic_load_explicit((_Atomic u32 *)&w->woken, memory_order_acquire);
+}
+
+static void bucket_remove(shared_wait_bucket * b, shared_waiter * w) {
+    shared_waiter * prev = NULL;
+    for (shared_waiter * it = b->head; it; prev = it, it = it->next) {
+        if (it != w) {
+            continue;
+        }
+        if (prev) {
+            prev->next = it->next;
+        } else {
+            b->head = it->next;
+        }
+        if (b->tail == it) {
+            b->tail = prev;
+        }
+        return;
+    }
+}
+
+#if defined(__linux__)
+static void futex_wait(u32 * word, i64 timeout_ns) {
+    struct timespec ts;
+    struct timespec * pts = NULL;
+    if (timeout_ns >= 0) {
+        ts.tv_sec = (time_t)(timeout_ns / 1000000000);
+        ts.tv_nsec = (long)(timeout_ns % 1000000000);
+        pts = &ts;
+    }
+    // returns right away if the word is not zero anymore.
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, 0, pts, NULL, 0);
+}
+
+static void futex_wake(u32 * word) {
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+#endif
+
+shared_wait_result shared_memory_wait(shared_memory * sm, u32 addr, u64 expected, bool is64, i64 timeout_ns) {
+    assert(sm);
+    shared_wait_bucket * b = bucket_of(sm, addr);
+    u8 * p = vec_at_u8(&sm->inst.mdata, addr);
+
+    // compared under the bucket lock, so a notify after the change can't be missed.
+    os_mutex_lock(&b->lock);
+    u64 val = is64 ? atomic_load((_Atomic u64 *)p) : atomic_load((_Atomic u32 *)p);
+    if (val != expected) {
+        os_mutex_unlock(&b->lock);
+        return shared_wait_not_equal;
+    }
+    shared_waiter w = {.addr = addr};
+    if (b->tail) {
+        b->tail->next = &w;
+    } else {
+        b->head = &w;
+    }
+    b->tail = &w;
+
+    u64 deadline = (timeout_ns >= 0) ? os_time_ns() + (u64)timeout_ns : 0;
+#if defined(__linux__)
+    os_mutex_unlock(&b->lock);
+    while (!waiter_woken(&w)) {
+        i64 remaining = -1;
+        if (timeout_ns >= 0) {
+            u64 now = os_time_ns();
+            if (now >= deadline) {
+                break;
+            }
+            remaining = (i64)(deadline - now);
+        }
+        futex_wait(&w.woken, remaining);
+    }
+    // the notifier may still be touching the waiter until it unlocks.
+    os_mutex_lock(&b->lock);
+#else
+    os_cond_init(&w.cond);
+    while (!waiter_woken(&w)) {
+        if (timeout_ns < 0) {
+            os_cond_wait(&w.cond, &b->lock);
+            continue;
+        }
+        u64 now = os_time_ns();
+        if (now >= deadline) {
+            break;
+        }
+        os_cond_timedwait(&w.cond, &b->lock, deadline - now);
+    }
+#endif
+    // a woken waiter is already removed by the notifier.
+    shared_wait_result result = shared_wait_ok;
+    if (!waiter_woken(&w)) {
+        bucket_remove(b, &w);
+        result = shared_wait_timed_out;
+    }
+    os_mutex_unlock(&b->lock);
+#if !defined(__linux__)
+    os_cond_drop(&w.cond);
+#endif
+    return result;
+}
+
+u32 shared_memory_notify(shared_memory * sm, u32 addr, u32 count) {
+    assert(sm);
+    shared_wait_bucket * b = bucket_of(sm, addr);
+    u32 woken = 0;
+
+    os_mutex_lock(&b->lock);
+    shared_waiter * prev = NULL;
+    shared_waiter * it = b->head;
+    while (it && (woken < count)) {
+        shared_waiter * next = it->next;
+        if (it->addr != addr) {
+            prev = it;
+            it = next;
+            continue;
+        }
+        if (prev) {
+            prev->next = next;
+        } else {
+            b->head = next;
+        }
+        if (b->tail == it) {
+            b->tail = prev;
+        }
+        atomic_store_explicit((_Atomic u32 *)&it->woken, 1, memory_order_release);
+#if defined(__linux__)
+        futex_wake(&it->woken);
+#else
+        os_cond_signal(&it->cond);
+#endif
+        woken++;
+        it = next;
+    }
+    os_mutex_unlock(&b->lock);
+    return woken;
+}
+
+#endif // SILVERFIR_ENABLE_THREADS
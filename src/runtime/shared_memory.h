@@ -0,0 +1,87 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Shared memories (the threads proposal).
+// A shared memory defined by a module is created by the first instance of the module and
+// then linked by all its instances, in any vm on any thread, until the module is dropped. The
+// memories importing it are linked to the same memory as usual. The address space is reserved
+// up to the max upfront so it never moves, and the other threads can keep accessing it while
+// it grows. Only the pages written take memory (see SILVERFIR_SHARED_MEMORY_HEAP_MAX for where
+// it can't be reserved).
+//
+// Waiters sleep on a word of their own, with a futex on Linux or with a condition variable
+// elsewhere. They are kept in buckets by address, in the order they came in, and a notify
+// wakes the first ones waiting on the address.
+
+#pragma once
+
+#include "module.h"
+#include "os_thread.h"
+#include "result.h"
+#include "types.h"
+#include "vm.h"
+
+#define SHARED_MEMORY_WAIT_BUCKETS (16)
+
+typedef struct shared_waiter {
+    struct shared_waiter * next;
+    u32 addr;
+    // set by the notifier, only accessed atomically.
+    u32 woken;
+#if !defined(__linux__)
+    os_cond cond;
+#endif
+} shared_waiter;
+
+typedef struct shared_wait_bucket {
+    os_mutex lock;
+    shared_waiter * head;
+    shared_waiter * tail;
+} shared_wait_bucket;
+
+typedef struct shared_memory {
+    memory_inst inst;
+    // serializes the grows, the accesses don't take it.
+    os_mutex grow_lock;
+    shared_wait_bucket buckets[SHARED_MEMORY_WAIT_BUCKETS];
+} shared_memory;
+
+typedef shared_memory * shared_memory_ptr;
+RESULT_TYPE_DECL(shared_memory_ptr)
+
+// the results of shared_memory_wait, same as memory.atomic.wait.
+typedef enum shared_wait_result {
+    shared_wait_ok = 0,
+    shared_wait_not_equal = 1,
+    shared_wait_timed_out = 2,
+} shared_wait_result;
+
+// Get the shared memory of a shared memory defined by a module, create it on the first call.
+// It's safe to be called by several threads at the same time.
+r_shared_memory_ptr shared_memory_get(memory * mem);
+
+// called by module_drop.
+void shared_memory_free(shared_memory * sm);
+
+// grow by delta pages, returns the previous size in pages or -1 if it can't grow.
+i32 shared_memory_grow(shared_memory * sm, u32 delta);
+
+// Sleep if the 4 or 8 bytes at addr are equal to expected, until notified or timed out. A negative
+// timeout waits forever. addr must be in bounds and aligned.
+shared_wait_result shared_memory_wait(shared_memory * sm, u32 addr, u64 expected, bool is64, i64 timeout_ns);
+
+// wake up to count waiters of addr, returns the number woken.
+u32 shared_memory_notify(shared_memory * sm, u32 addr, u32 count);
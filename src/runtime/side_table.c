@@ -0,0 +1,354 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "side_table.h"
+
+#include "compiler.h"
+#include "stream.h"
+#include "vec.h"
+#include "wasm_format.h"
+
+// the jump tables are stored as-is, so the layout must not have any padding.
+#define JUMP_TABLE_ENCODED_SIZE (8)
+STATIC_ASSERT(sizeof(jump_table) == JUMP_TABLE_ENCODED_SIZE, jump_table_size);
+#define JUMP_TABLE_ESCAPE_ENCODED_SIZE (8)
+STATIC_ASSERT(sizeof(jump_table_escape) == JUMP_TABLE_ESCAPE_ENCODED_SIZE, jump_table_escape_size);
+#if SILVERFIR_STACK_SLOT_32
+    #define FUNC_HEADER_SIZE (5 * sizeof(u32))
+#else
+    #define FUNC_HEADER_SIZE (4 * sizeof(u32))
+#endif
+#define SIDE_TABLE_ALIGN (4)
+
+#if SILVERFIR_STACK_SLOT_32
+// the bitmap is padded so that the next function stays aligned.
+INLINE size_t wide_operands_padded(u32 size) {
+    return ((size_t)size + SIDE_TABLE_ALIGN - 1) & ~(size_t)(SIDE_TABLE_ALIGN - 1);
+}
+#endif
+
+u32 side_table_checksum(str s) {
+    return str_hash(s);
+}
+
+INLINE u32 read_u32(const u8 * p) {
+    return (u32)p[0] | ((u32)p[1] << 8) | ((u32)p[2] << 16) | ((u32)p[3] << 24);
+}
+
+INLINE u16 read_u16(const u8 * p) {
+    return (u16)(p[0] | (p[1] << 8));
+}
+
+static r write_u32(vec_u8 * v, u32 val) {
+    check_prep(r);
+    for (u32 i = 0; i < sizeof(u32); i++) {
+        check(vec_push_u8(v, (u8)(val >> (i * 8))));
+    }
+    return ok_r;
+}
+
+static r write_u16(vec_u8 * v, u16 val) {
+    check_prep(r);
+    check(vec_push_u8(v, (u8)val));
+    check(vec_push_u8(v, (u8)(val >> 8)));
+    return ok_r;
+}
+
+// always takes 5 bytes so that it can be patched later.
+static void patch_vu32_padded(u8 * p, u32 val) {
+    for (u32 i = 0; i < 4; i++) {
+        p[i] = (u8)((val & 0x7f) | 0x80);
+        val >>= 7;
+    }
+    p[4] = (u8)(val & 0x7f);
+}
+
+static r write_section(vec_u8 * v, module * mod, size_t base_offset) {
+    check_prep(r);
+    str name = s(SIDE_TABLE_SECTION_NAME);
+    assert(str_len(name) < 0x80);
+
+    check(vec_push_u8(v, SECTION_custom));
+    // the payload size, patched in the end.
+    size_t size_offset = vec_size_u8(v);
+    check(vec_resize_u8(v, size_offset + 5));
+    size_t payload_offset = vec_size_u8(v);
+    check(vec_push_u8(v, (u8)str_len(name)));
+    for (size_t i = 0; i < str_len(name); i++) {
+        check(vec_push_u8(v, name.ptr[i]));
+    }
+    u8 pad_len = (u8)((SIDE_TABLE_ALIGN - ((base_offset + vec_size_u8(v) + 1) % SIDE_TABLE_ALIGN)) % SIDE_TABLE_ALIGN);
+    check(vec_push_u8(v, pad_len));
+    for (u8 i = 0; i < pad_len; i++) {
+        check(vec_push_u8(v, 0));
+    }
+
+    check(write_u32(v, SIDE_TABLE_VERSION));
+    check(write_u32(v, side_table_checksum(mod->code_section)));
+    check(write_u32(v, (u32)(vec_size_func(&mod->funcs) - mod->imported_func_count)));
+    VEC_FOR_EACH(&mod->funcs, func, fn) {
+        if (fn->linkage & linkage_imported) {
+            continue;
+        }
+        check(write_u32(v, fn->local_count));
+        check(write_u32(v, fn->stack_size_max));
+        check(write_u32(v, (u32)vec_size_jump_table(&fn->jt)));
+        check(write_u32(v, (u32)vec_size_jump_table_escape(&fn->jt_escapes)));
+#if SILVERFIR_STACK_SLOT_32
+        u32 wide_size = (u32)vec_size_u8(&fn->wide_operands);
+        check(write_u32(v, wide_size));
+#endif
+        VEC_FOR_EACH(&fn->jt, jump_table, slot) {
+            check(write_u16(v, (u16)slot->target_offset));
+            check(write_u16(v, slot->stack_offset));
+            check(write_u16(v, slot->arity));
+            check(write_u16(v, slot->next_idx));
+        }
+        VEC_FOR_EACH(&fn->jt_escapes, jump_table_escape, escape) {
+            check(write_u32(v, (u32)escape->target_offset));
+            check(write_u32(v, escape->stack_offset));
+        }
+#if SILVERFIR_STACK_SLOT_32
+        for (u32 i = 0; i < wide_size; i++) {
+            check(vec_push_u8(v, *vec_at_u8(&fn->wide_operands, i)));
+        }
+        check(vec_resize_u8(v, vec_size_u8(v) + wide_operands_padded(wide_size) - wide_size));
+#endif
+    }
+    patch_vu32_padded(vec_at_u8(v, size_offset), (u32)(vec_size_u8(v) - payload_offset));
+    return ok_r;
+}
+
+r_vstr side_table_section_build(module * mod, size_t base_offset) {
+    assert(mod);
+    check_prep(r_vstr);
+
+    vec_u8 v = {0};
+    check(write_section(&v, mod, base_offset), vec_clear_u8(&v));
+    vstr section = {.s = s_pl(v._data, vec_size_u8(&v)), .v = v};
+    return ok(section);
+}
+
+// Walk through the tables and make sure it matches the module, without changing anything.
+static r side_table_verify(module * mod, stream st) {
+    check_prep(r);
+    unwrap(u32, version, stream_read_u32(&st));
+    if (version != SIDE_TABLE_VERSION) {
+        return err(e_general, "Side table version mismatch");
+    }
+    unwrap(u32, checksum, stream_read_u32(&st));
+    if (checksum != side_table_checksum(mod->code_section)) {
+        return err(e_general, "Side table checksum mismatch");
+    }
+    unwrap(u32, func_count, stream_read_u32(&st));
+    if (func_count != vec_size_func(&mod->funcs) - mod->imported_func_count) {
+        return err(e_general, "Side table function count mismatch");
+    }
+    VEC_FOR_EACH(&mod->funcs, func, fn) {
+        if (fn->linkage & linkage_imported) {
+            continue;
+        }
+        unwrap(u32, local_count, stream_read_u32(&st));
+        if (local_count != fn->local_count) {
+            return err(e_general, "Side table local count mismatch");
+        }
+        unwrap_drop(u32, stream_read_u32(&st));
+        unwrap(u32, jt_size, stream_read_u32(&st));
+        if (jt_size >= JUMP_TABLE_IDX_INVALID) {
+            return err(e_general, "Side table jump table is too large");
+        }
+        unwrap(u32, escape_count, stream_read_u32(&st));
+        if (escape_count > u16_MAX + 1) {
+            return err(e_general, "Side table has too many escapes");
+        }
+#if SILVERFIR_STACK_SLOT_32
+        unwrap(u32, wide_size, stream_read_u32(&st));
+        if (wide_size && wide_size != (str_len(fn->code) + 7) / 8) {
+            return err(e_general, "Side table operand widths mismatch");
+        }
+#endif
+        if (jt_size) {
+            check(stream_seek(&st, (i64)jt_size * JUMP_TABLE_ENCODED_SIZE));
+        }
+        if (escape_count) {
+            check(stream_seek(&st, (i64)escape_count * JUMP_TABLE_ESCAPE_ENCODED_SIZE));
+        }
+#if SILVERFIR_STACK_SLOT_32
+        if (wide_size) {
+            check(stream_seek(&st, (i64)wide_operands_padded(wide_size)));
+        }
+#endif
+    }
+    if (stream_remaining(&st)) {
+        return err(e_general, "Malformed side table");
+    }
+    return ok_r;
+}
+
+r side_table_load(module * mod) {
+    assert(mod);
+    check_prep(r);
+
+    if (str_is_null(mod->side_table_section)) {
+        return err(e_general, "Side table not found");
+    }
+    stream st = stream_from(mod->side_table_section);
+    unwrap(u8, pad_len, stream_read_u8(&st));
+    if (pad_len) {
+        check(stream_seek(&st, pad_len));
+    }
+    check(side_table_verify(mod, st));
+
+    // It's verified so the unchecked readers are safe from here on.
+    // The tables can be used in place only if the layout in memory is the same.
+    bool borrow = is_little_endian() && !((uptr)st.p % SIDE_TABLE_ALIGN);
+    // decode everything first so that nothing is changed on failure.
+    vec_jump_table * copies = NULL;
+    vec_jump_table_escape * escape_copies = NULL;
+#if SILVERFIR_STACK_SLOT_32
+    vec_u8 * wide_copies = NULL;
+#endif
+    size_t func_count = vec_size_func(&mod->funcs) - mod->imported_func_count;
+    if (!borrow && func_count) {
+        copies = array_calloc(vec_jump_table, func_count);
+        escape_copies = array_calloc(vec_jump_table_escape, func_count);
+        bool failed = !copies || !escape_copies;
+#if SILVERFIR_STACK_SLOT_32
+        wide_copies = array_calloc(vec_u8, func_count);
+        failed = failed || !wide_copies;
+#endif
+        if (failed) {
+            array_free(copies);
+            array_free(escape_copies);
+#if SILVERFIR_STACK_SLOT_32
+            array_free(wide_copies);
+#endif
+            return err(e_general, "Failed to allocate the jump tables");
+        }
+    }
+    const u8 * p = st.p + 3 * sizeof(u32);
+    const u8 * tables_begin = p;
+    for (size_t i = 0; i < func_count && !borrow; i++) {
+        u32 jt_size = read_u32(p + 2 * sizeof(u32));
+        u32 escape_count = read_u32(p + 3 * sizeof(u32));
+#if SILVERFIR_STACK_SLOT_32
+        u32 wide_size = read_u32(p + 4 * sizeof(u32));
+#endif
+        p += FUNC_HEADER_SIZE;
+        r ret = vec_reserve_jump_table(&copies[i], jt_size ? jt_size : 1);
+        for (u32 j = 0; j < jt_size && is_ok(ret); j++, p += JUMP_TABLE_ENCODED_SIZE) {
+            ret = vec_push_jump_table(&copies[i], (jump_table){
+                                                      .target_offset = (i16)read_u16(p),
+                                                      .stack_offset = read_u16(p + 2),
+                                                      .arity = read_u16(p + 4),
+                                                      .next_idx = read_u16(p + 6),
+                                                  });
+        }
+        for (u32 j = 0; j < escape_count && is_ok(ret); j++, p += JUMP_TABLE_ESCAPE_ENCODED_SIZE) {
+            ret = vec_push_jump_table_escape(&escape_copies[i], (jump_table_escape){
+                                                                    .target_offset = (i32)read_u32(p),
+                                                                    .stack_offset = read_u32(p + 4),
+                                                                });
+        }
+#if SILVERFIR_STACK_SLOT_32
+        for (u32 j = 0; j < wide_size && is_ok(ret); j++) {
+            ret = vec_push_u8(&wide_copies[i], p[j]);
+        }
+        p += wide_operands_padded(wide_size);
+#endif
+        if (!is_ok(ret)) {
+            for (size_t k = 0; k <= i; k++) {
+                vec_clear_jump_table(&copies[k]);
+                vec_clear_jump_table_escape(&escape_copies[k]);
+#if SILVERFIR_STACK_SLOT_32
+                vec_clear_u8(&wide_copies[k]);
+#endif
+            }
+            array_free(copies);
+            array_free(escape_copies);
+#if SILVERFIR_STACK_SLOT_32
+            array_free(wide_copies);
+#endif
+            return ret;
+        }
+    }
+
+    // apply
+    p = tables_begin;
+    size_t i = 0;
+    VEC_FOR_EACH(&mod->funcs, func, fn) {
+        if (fn->linkage & linkage_imported) {
+            continue;
+        }
+        if (!mod->jt_borrowed) {
+            vec_clear_jump_table(&fn->jt);
+            vec_clear_jump_table_escape(&fn->jt_escapes);
+#if SILVERFIR_STACK_SLOT_32
+            vec_clear_u8(&fn->wide_operands);
+#endif
+        }
+        fn->stack_size_max = read_u32(p + sizeof(u32));
+        u32 jt_size = read_u32(p + 2 * sizeof(u32));
+        u32 escape_count = read_u32(p + 3 * sizeof(u32));
+#if SILVERFIR_STACK_SLOT_32
+        u32 wide_size = read_u32(p + 4 * sizeof(u32));
+#endif
+        p += FUNC_HEADER_SIZE;
+        size_t tables_size = (size_t)jt_size * JUMP_TABLE_ENCODED_SIZE + (size_t)escape_count * JUMP_TABLE_ESCAPE_ENCODED_SIZE;
+        if (borrow) {
+            fn->jt = (vec_jump_table){
+                ._size = jt_size,
+                ._capacity = jt_size,
+                ._data = jt_size ? (jump_table *)p : NULL,
+                .fixed = true,
+            };
+            const u8 * escapes = p + (size_t)jt_size * JUMP_TABLE_ENCODED_SIZE;
+            fn->jt_escapes = (vec_jump_table_escape){
+                ._size = escape_count,
+                ._capacity = escape_count,
+                ._data = escape_count ? (jump_table_escape *)escapes : NULL,
+                .fixed = true,
+            };
+#if SILVERFIR_STACK_SLOT_32
+            fn->wide_operands = (vec_u8){
+                ._size = wide_size,
+                ._capacity = wide_size,
+                ._data = wide_size ? (u8 *)(p + tables_size) : NULL,
+                .fixed = true,
+            };
+#endif
+        } else {
+            fn->jt = copies[i];
+            fn->jt_escapes = escape_copies[i];
+#if SILVERFIR_STACK_SLOT_32
+            fn->wide_operands = wide_copies[i];
+#endif
+        }
+        p += tables_size;
+#if SILVERFIR_STACK_SLOT_32
+        p += wide_operands_padded(wide_size);
+#endif
+        i++;
+    }
+    array_free(copies);
+    array_free(escape_copies);
+#if SILVERFIR_STACK_SLOT_32
+    array_free(wide_copies);
+#endif
+    mod->jt_borrowed = borrow;
+    mod->side_table_loaded = true;
+    return ok_r;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Precomputed side tables.
+// The validator produces a jump table and the max stack size for every function. For the
+// binaries stored in flash, those tables can be generated offline (see test/sf_prep) and
+// appended to the binary as a custom section, so that a trusted module can skip the
+// validation and use the tables in place without copying them into RAM.
+//
+// Section layout, all integers are little-endian:
+//   u8 pad_len, pad_len zero bytes. (aligns the rest to 4 bytes from the start of the binary)
+//   u32 version
+//   u32 checksum of the code section payload
+//   u32 function count (imported functions excluded)
+//   for each function:
+//     u32 local_count
+//     u32 stack_size_max
+//     u32 jump table size
+//     u32 escape count
+//     u32 operand width bitmap size (SILVERFIR_STACK_SLOT_32 only)
+//     jump_table[size] (i16 target_offset, u16 stack_offset, u16 arity, u16 next_idx)
+//     jump_table_escape[count] (i32 target_offset, u32 stack_offset)
+//     u8[bitmap size] padded to 4 bytes (SILVERFIR_STACK_SLOT_32 only, see func.wide_operands)
+
+#pragma once
+
+#include "module.h"
+#include "result.h"
+#include "silverfir.h"
+#include "str.h"
+#include "types.h"
+#include "vstr.h"
+
+#define SIDE_TABLE_SECTION_NAME "silverfir.side_table"
+// The stack sizes are in slots, so the tables for the 32-bit slots are not interchangeable.
+#if SILVERFIR_STACK_SLOT_32
+    #define SIDE_TABLE_VERSION (0x10003)
+#else
+    #define SIDE_TABLE_VERSION (2)
+#endif
+
+u32 side_table_checksum(str s);
+
+// Build the whole custom section (id and size included) from a validated module.
+// base_offset is where the section is going to be placed in the binary, which is used
+// to align the tables.
+r_vstr side_table_section_build(module * mod, size_t base_offset);
+
+// Load the side tables from the custom section instead of validating the functions.
+// The jump tables point into the binary directly if it's properly aligned.
+// Nothing is changed if it fails.
+r side_table_load(module * mod);
@@ -0,0 +1,423 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stack_depth.h"
+
+#include "alloc.h"
+#include "op_decoder.h"
+#include "opcode.h"
+#include "stream.h"
+#include "vec_impl.h"
+
+#include <string.h>
+
+VEC_IMPL_FOR_TYPE(stack_depth)
+
+// A call in the graph. The target of an indirect call is its type index until it's expanded
+// to the functions of the type.
+typedef struct call_edge {
+    u32 target;
+    u32 table; // the table of an indirect call
+    bool tail;
+    bool indirect;
+} call_edge;
+VEC_DECL_FOR_TYPE(call_edge)
+VEC_IMPL_FOR_TYPE(call_edge)
+
+typedef struct call_node {
+    // the calls of the function in the edges.
+    u32 edge_begin;
+    u32 edge_end;
+    // Tarjan's strongly connected components, 0 if not visited yet.
+    u32 index;
+    u32 lowlink;
+    u32 scc;
+    u32 cursor; // the next edge to visit
+    bool on_stack;
+    // the deepest of the calls, not including the function itself. A tail call adds the callee's
+    // calls only, because it runs in this frame.
+    size_t native_bytes;
+    size_t value_slots;
+    u32 frames;
+    bool recursive;
+    bool calls_import;
+    bool calls_unknown;
+} call_node;
+
+typedef struct stack_depth_context {
+    module * mod;
+    size_t frame_size;
+    call_node * nodes;
+    vec_call_edge edges;
+    // the functions that can be put into a table by the module.
+    u8 * in_table;
+    // the tables that can hold a function from outside of the module.
+    u8 * table_unknown;
+    // Tarjan's stack, and the path being visited.
+    vec_u32 scc_stack;
+    vec_u32 path;
+    u32 next_index;
+    u32 scc_count;
+} stack_depth_context;
+
+INLINE size_t max_size(size_t a, size_t b) {
+    return a > b ? a : b;
+}
+
+static r on_call(void * payload, stream imm, u32 funcidx) {
+    stack_depth_context * ctx = (stack_depth_context *)payload;
+    return vec_push_call_edge(&ctx->edges, (call_edge){.target = funcidx});
+}
+
+static r on_return_call(void * payload, stream imm, u32 funcidx) {
+    stack_depth_context * ctx = (stack_depth_context *)payload;
+    return vec_push_call_edge(&ctx->edges, (call_edge){.target = funcidx, .tail = true});
+}
+
+static r on_call_indirect(void * payload, stream imm, u32 typeidx, u32 tableidx) {
+    stack_depth_context * ctx = (stack_depth_context *)payload;
+    return vec_push_call_edge(&ctx->edges, (call_edge){.target = typeidx, .table = tableidx, .indirect = true});
+}
+
+static r on_return_call_indirect(void * payload, stream imm, u32 typeidx, u32 tableidx) {
+    stack_depth_context * ctx = (stack_depth_context *)payload;
+    return vec_push_call_edge(&ctx->edges, (call_edge){.target = typeidx, .table = tableidx, .tail = true, .indirect = true});
+}
+
+// The value written by these can be a param, a global or a result of an import, so it can be
+// any function.
+static r on_table_write(void * payload, stream imm, u32 tableidx) {
+    stack_depth_context * ctx = (stack_depth_context *)payload;
+    ctx->table_unknown[tableidx] = 1;
+    return ok_r;
+}
+
+static r on_table_copy(void * payload, stream imm, u32 dst, u32 src) {
+    return on_table_write(payload, imm, dst);
+}
+
+static r on_ref_func(void * payload, stream imm, u32 funcidx) {
+    stack_depth_context * ctx = (stack_depth_context *)payload;
+    ctx->in_table[funcidx] = 1;
+    return ok_r;
+}
+
+static const op_decoder_callbacks stack_depth_callbacks = {
+    .on_call = on_call,
+    .on_call_indirect = on_call_indirect,
+    .on_return_call = on_return_call,
+    .on_return_call_indirect = on_return_call_indirect,
+    .on_ref_func = on_ref_func,
+    .on_table_set = on_table_write,
+    .on_table_grow = on_table_write,
+    .on_table_fill = on_table_write,
+    .on_table_copy = on_table_copy,
+};
+
+// The const exprs are validated, so a ref.func is always the first instruction.
+static void mark_ref_func_expr(stack_depth_context * ctx, str expr) {
+    stream st = stream_from(expr);
+    r_u8 opcode = stream_read_u8(&st);
+    if (!is_ok(opcode) || (opcode.value != op_ref_func)) {
+        return;
+    }
+    r_u32 funcidx = stream_read_vu32(&st);
+    if (is_ok(funcidx) && (funcidx.value < vec_size_func(&ctx->mod->funcs))) {
+        ctx->in_table[funcidx.value] = 1;
+    }
+}
+
+static void mark_table_funcs(stack_depth_context * ctx) {
+    module * mod = ctx->mod;
+    // the host or another module can put any function into an imported or exported table.
+    for (u32 i = 0; i < vec_size_table(&mod->tables); i++) {
+        if (vec_at_table(&mod->tables, i)->linkage & (linkage_imported | linkage_exported)) {
+            ctx->table_unknown[i] = 1;
+        }
+    }
+    VEC_FOR_EACH(&mod->elements, element, elem) {
+        VEC_FOR_EACH(&elem->v_funcidx, u32, funcidx) {
+            ctx->in_table[*funcidx] = 1;
+        }
+        VEC_FOR_EACH(&elem->v_expr, str, expr) {
+            mark_ref_func_expr(ctx, *expr);
+        }
+    }
+    VEC_FOR_EACH(&mod->globals, global, g) {
+        if (!(g->linkage & linkage_imported)) {
+            mark_ref_func_expr(ctx, g->expr);
+        }
+    }
+}
+
+// Decode the calls of all the functions, the indirect ones are not expanded yet.
+static r collect_calls(stack_depth_context * ctx) {
+    check_prep(r);
+    module * mod = ctx->mod;
+    for (u32 i = 0; i < vec_size_func(&mod->funcs); i++) {
+        func * fn = vec_at_func(&mod->funcs, i);
+        call_node * node = &ctx->nodes[i];
+        node->edge_begin = (u32)vec_size_call_edge(&ctx->edges);
+        if (!(fn->linkage & linkage_imported)) {
+            check(decode_function(mod, fn, &stack_depth_callbacks, ctx));
+        }
+        node->edge_end = (u32)vec_size_call_edge(&ctx->edges);
+    }
+    return ok_r;
+}
+
+// Replace each indirect call with the calls to the functions of the same type in the tables.
+// A type is expanded only once for a function.
+static r expand_indirect_calls(stack_depth_context * ctx) {
+    check_prep(r);
+    module * mod = ctx->mod;
+    size_t func_count = vec_size_func(&mod->funcs);
+    size_t type_count = vec_size_func_type(&mod->func_types);
+    vec_call_edge edges = {0};
+    // the last function (+1) that expanded the type, for the calls and the tail calls.
+    u32 * expanded = array_calloc(u32, type_count * 2);
+    if (type_count && !expanded) {
+        return err(e_general, "Failed to allocate the stack depth analysis");
+    }
+    r ret = ok_r;
+    for (u32 i = 0; i < func_count && is_ok(ret); i++) {
+        call_node * node = &ctx->nodes[i];
+        u32 edge_begin = (u32)vec_size_call_edge(&edges);
+        for (u32 j = node->edge_begin; j < node->edge_end && is_ok(ret); j++) {
+            call_edge e = *vec_at_call_edge(&ctx->edges, j);
+            if (!e.indirect) {
+                ret = vec_push_call_edge(&edges, e);
+                continue;
+            }
+            node->calls_unknown |= ctx->table_unknown[e.table];
+            u32 * stamp = &expanded[e.target * 2 + e.tail];
+            if (*stamp == i + 1) {
+                continue;
+            }
+            *stamp = i + 1;
+            func_type type = *vec_at_func_type(&mod->func_types, e.target);
+            for (u32 k = 0; k < func_count && is_ok(ret); k++) {
+                if (ctx->in_table[k] && func_type_eq(vec_at_func(&mod->funcs, k)->fn_type, type)) {
+                    ret = vec_push_call_edge(&edges, (call_edge){.target = k, .tail = e.tail, .indirect = true});
+                }
+            }
+        }
+        node->edge_begin = edge_begin;
+        node->edge_end = (u32)vec_size_call_edge(&edges);
+    }
+    array_free(expanded);
+    vec_clear_call_edge(&ctx->edges);
+    ctx->edges = edges;
+    return ret;
+}
+
+// The stack taken by a call to the function, in the caller's frame for the value stack.
+INLINE size_t native_bytes_of(stack_depth_context * ctx, func * fn, call_node * node) {
+    return ctx->frame_size + (size_t)fn->stack_size_max * sizeof(value_slot) + node->native_bytes;
+}
+
+INLINE size_t value_slots_of(func * fn, call_node * node) {
+    return (size_t)fn->stack_size_max + node->value_slots;
+}
+
+// All the callees out of the component are done, because Tarjan's algorithm finds the
+// components in the reverse topological order.
+static void finish_scc(stack_depth_context * ctx, const u32 * members, size_t count) {
+    module * mod = ctx->mod;
+    u32 id = ++ctx->scc_count;
+    for (size_t i = 0; i < count; i++) {
+        ctx->nodes[members[i]].scc = id;
+    }
+    bool cycle = false;
+    bool recursive = false;
+    for (size_t i = 0; i < count; i++) {
+        call_node * node = &ctx->nodes[members[i]];
+        for (u32 j = node->edge_begin; j < node->edge_end; j++) {
+            call_edge * e = vec_at_call_edge(&ctx->edges, j);
+            func * callee_fn = vec_at_func(&mod->funcs, e->target);
+            call_node * callee = &ctx->nodes[e->target];
+            if (callee_fn->linkage & linkage_imported) {
+                node->calls_import = true;
+                continue;
+            }
+            if (callee->scc == id) {
+                cycle = true;
+                recursive |= !e->tail;
+                continue;
+            }
+            node->recursive |= callee->recursive;
+            node->calls_import |= callee->calls_import;
+            node->calls_unknown |= callee->calls_unknown;
+            size_t value_slots = value_slots_of(callee_fn, callee);
+            // the locals are put somewhere else, instead of the caller's operand stack.
+            if (e->tail || e->indirect) {
+                value_slots += func_local_slots(callee_fn);
+            }
+            node->value_slots = max_size(node->value_slots, value_slots);
+            if (e->tail) {
+                node->native_bytes = max_size(node->native_bytes, callee->native_bytes);
+                node->frames = node->frames > callee->frames ? node->frames : callee->frames;
+            } else {
+                node->native_bytes = max_size(node->native_bytes, native_bytes_of(ctx, callee_fn, callee));
+                node->frames = node->frames > callee->frames + 1 ? node->frames : callee->frames + 1;
+            }
+        }
+    }
+    if (!cycle) {
+        return;
+    }
+    // Any of them can get to the others, so they all take the worst of the component. It's
+    // entered with a tail call in the worst case, where the locals are not in the caller's frame.
+    call_node worst = {.recursive = recursive};
+    for (size_t i = 0; i < count; i++) {
+        call_node * node = &ctx->nodes[members[i]];
+        func * fn = vec_at_func(&mod->funcs, members[i]);
+        worst.native_bytes = max_size(worst.native_bytes, node->native_bytes);
+        worst.value_slots = max_size(worst.value_slots, func_local_slots(fn) + value_slots_of(fn, node));
+        worst.frames = worst.frames > node->frames ? worst.frames : node->frames;
+        worst.recursive |= node->recursive;
+        worst.calls_import |= node->calls_import;
+        worst.calls_unknown |= node->calls_unknown;
+    }
+    for (size_t i = 0; i < count; i++) {
+        call_node * node = &ctx->nodes[members[i]];
+        node->native_bytes = worst.native_bytes;
+        node->value_slots = worst.value_slots;
+        node->frames = worst.frames;
+        node->recursive = worst.recursive;
+        node->calls_import = worst.calls_import;
+        node->calls_unknown = worst.calls_unknown;
+    }
+}
+
+static r visit(stack_depth_context * ctx, u32 idx) {
+    check_prep(r);
+    call_node * node = &ctx->nodes[idx];
+    node->index = node->lowlink = ++ctx->next_index;
+    node->cursor = node->edge_begin;
+    node->on_stack = true;
+    check(vec_push_u32(&ctx->scc_stack, idx));
+    check(vec_push_u32(&ctx->path, idx));
+    return ok_r;
+}
+
+// Tarjan's algorithm without recursion, the path keeps the functions being visited.
+static r find_sccs(stack_depth_context * ctx, u32 root) {
+    check_prep(r);
+    module * mod = ctx->mod;
+    check(visit(ctx, root));
+    while (vec_size_u32(&ctx->path)) {
+        u32 idx = *vec_back_u32(&ctx->path);
+        call_node * node = &ctx->nodes[idx];
+        if (node->cursor < node->edge_end) {
+            u32 target = vec_at_call_edge(&ctx->edges, node->cursor++)->target;
+            call_node * callee = &ctx->nodes[target];
+            if (vec_at_func(&mod->funcs, target)->linkage & linkage_imported) {
+                continue;
+            }
+            if (!callee->index) {
+                check(visit(ctx, target));
+            } else if (callee->on_stack && (callee->index < node->lowlink)) {
+                node->lowlink = callee->index;
+            }
+            continue;
+        }
+        vec_pop_u32(&ctx->path);
+        if (vec_size_u32(&ctx->path)) {
+            call_node * caller = &ctx->nodes[*vec_back_u32(&ctx->path)];
+            if (node->lowlink < caller->lowlink) {
+                caller->lowlink = node->lowlink;
+            }
+        }
+        if (node->lowlink == node->index) {
+            size_t begin = vec_size_u32(&ctx->scc_stack);
+            do {
+                begin--;
+                ctx->nodes[*vec_at_u32(&ctx->scc_stack, begin)].on_stack = false;
+            } while (*vec_at_u32(&ctx->scc_stack, begin) != idx);
+            size_t count = vec_size_u32(&ctx->scc_stack) - begin;
+            finish_scc(ctx, vec_at_u32(&ctx->scc_stack, begin), count);
+            vec_resize_smaller_unchecked(&ctx->scc_stack, begin);
+        }
+    }
+    return ok_r;
+}
+
+static r analyze(stack_depth_context * ctx, vec_stack_depth * report) {
+    check_prep(r);
+    module * mod = ctx->mod;
+    size_t func_count = vec_size_func(&mod->funcs);
+    check(collect_calls(ctx));
+    mark_table_funcs(ctx);
+    check(expand_indirect_calls(ctx));
+    for (u32 i = 0; i < func_count; i++) {
+        if (!ctx->nodes[i].index && !(vec_at_func(&mod->funcs, i)->linkage & linkage_imported)) {
+            check(find_sccs(ctx, i));
+        }
+    }
+
+    VEC_FOR_EACH(&mod->exports, export, exp) {
+        if (exp->external_kind != EXTERNAL_KIND_Function) {
+            continue;
+        }
+        func * fn = vec_at_func(&mod->funcs, exp->external_idx);
+        stack_depth depth = {.name = exp->name, .funcidx = exp->external_idx};
+        if (fn->linkage & linkage_imported) {
+            depth.calls_import = true;
+        } else {
+            call_node * node = &ctx->nodes[exp->external_idx];
+            // the args and the locals of the entry are allocated by the caller.
+            size_t entry_slots = max_size(func_local_slots(fn), func_result_slots(fn));
+            depth.value_bytes = (entry_slots + value_slots_of(fn, node)) * sizeof(value_slot);
+            depth.native_bytes = entry_slots * sizeof(value_slot) + native_bytes_of(ctx, fn, node);
+            depth.frames = node->frames + 1;
+            depth.recursive = node->recursive;
+            depth.calls_import = node->calls_import;
+            depth.calls_unknown = node->calls_unknown;
+        }
+        check(vec_push_stack_depth(report, depth));
+    }
+    return ok_r;
+}
+
+r stack_depth_analyze(module * mod, size_t frame_size, vec_stack_depth * report) {
+    assert(mod);
+    assert(report);
+    check_prep(r);
+
+    size_t func_count = vec_size_func(&mod->funcs);
+    size_t table_count = vec_size_table(&mod->tables);
+    stack_depth_context ctx = {
+        .mod = mod,
+        .frame_size = frame_size,
+        .nodes = array_calloc(call_node, func_count),
+        .in_table = array_calloc(u8, func_count),
+        .table_unknown = array_calloc(u8, table_count),
+    };
+    r ret;
+    if ((func_count && (!ctx.nodes || !ctx.in_table)) || (table_count && !ctx.table_unknown)) {
+        ret = err(e_general, "Failed to allocate the stack depth analysis");
+    } else {
+        ret = analyze(&ctx, report);
+    }
+    array_free(ctx.nodes);
+    array_free(ctx.in_table);
+    array_free(ctx.table_unknown);
+    vec_clear_call_edge(&ctx.edges);
+    vec_clear_u32(&ctx.scc_stack);
+    vec_clear_u32(&ctx.path);
+    return ret;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Worst-case stack depth of the exported functions.
+// The interpreters recurse on the native stack, one frame per wasm call, and each frame allocas
+// the operand stack of its function (stack_size_max slots). The locals of a callee are in the
+// operand stack of the caller, except that call_indirect puts them on the heap, and a tail call
+// runs in the frame of the caller. So the deepest call chain is bounded by the static call graph
+// and the stack sizes found by the validator. The calls in the graph are:
+//   call and return_call, to the function.
+//   call_indirect and return_call_indirect, conservatively to every function of the same type
+//   that the module itself can put into a table: the ones in the element segments, and the ones
+//   taken by ref.func. If the table is imported or exported, the host or another module can put
+//   any function into it. And table.set, table.grow, table.fill and table.copy can write a param,
+//   a global or a result of an import into it. Either way the callee is unknown and there's no
+//   bound. It's flagged.
+// A recursion (a cycle with any non-tail call) has no bound. It's flagged, and the numbers only
+// cover a single pass through the cycle. The stack used by the imported functions isn't counted
+// either, they're flagged as well.
+
+#pragma once
+
+#include "module.h"
+#include "result.h"
+#include "str.h"
+#include "types.h"
+#include "vec.h"
+
+typedef struct stack_depth {
+    str name; // of the export
+    u32 funcidx;
+    // the locals and the operand stacks of the deepest chain, including the args of the entry.
+    size_t value_bytes;
+    // the interpreter frames and their operand stacks of the deepest chain, including the args
+    // of the entry. The locals on the heap are not counted.
+    size_t native_bytes;
+    // the deepest chain in frames, see SILVERFIR_STACK_FRAME_LIMIT.
+    u32 frames;
+    bool recursive;
+    bool calls_import;
+    // through call_indirect on an imported or exported table, or one written by the code.
+    bool calls_unknown;
+} stack_depth;
+VEC_DECL_FOR_TYPE(stack_depth)
+
+// Find the worst case for each exported function. The module must be validated, or have its
+// side tables loaded.
+// frame_size is the native frame of one interpreter call except its operand stack, which depends
+// on the compiler, e.g. -fstack-usage tells the one of in_place_dt_call.
+r stack_depth_analyze(module * mod, size_t frame_size, vec_stack_depth * report);
@@ -21,57 +21,84 @@
 #include "opcode.h"
 #include "parser.h"
 #include "result.h"
+#include "silverfir.h"
 #include "stream.h"
 #include "vec_impl.h"
 
 #define LOGI(fmt, ...) LOG_INFO(log_channel_validator, fmt, ##__VA_ARGS__)
 #define LOGW(fmt, ...) LOG_WARNING(log_channel_validator, fmt, ##__VA_ARGS__)
 
-VEC_DECL_FOR_TYPE(ctrl_frame)
-VEC_IMPL_FOR_TYPE(ctrl_frame)
+// The stacks of a shallow function fit in the context, so validating it alone (e.g. when the
+// jump table cache takes it back) doesn't have to allocate them.
+#define VALIDATOR_INLINE_VALS (32)
+#define VALIDATOR_INLINE_FRAMES (8)
+SVEC_DECL_FOR_TYPE(type_id, VALIDATOR_INLINE_VALS)
+SVEC_IMPL_FOR_TYPE(type_id)
+SVEC_DECL_FOR_TYPE(ctrl_frame, VALIDATOR_INLINE_FRAMES)
+SVEC_IMPL_FOR_TYPE(ctrl_frame)
 
+#define JT_SLOT_NONE u32_MAX
+
+// All the vectors are only reset between functions (never released) so that once they're
+// big enough, validating more functions or blocks won't allocate anymore.
 typedef struct validator_context {
-    vec_type_id locals;
-    vec_type_id val_stack;
-    vec_ctrl_frame ctrl_stack;
+    svec_type_id val_stack;
+    svec_ctrl_frame ctrl_stack;
+    // jt_links[i] is the next pending slot of the same frame as the jump table slot i.
+    vec_u32 jt_links;
+    // jt_pcs[i] is the pc of the jump table slot i, the slots don't keep it.
+    vec_u32 jt_pcs;
+    // used by br_table to keep the popped values.
+    svec_type_id scratch;
+    // the height of val_stack in slots, the stack sizes in the jump table are all in slots.
+    u32 slot_height;
     u32 stack_size_max;
     module * mod;
     func * f;
 } validator_context;
 
+// The types in func_type are already checked by the parser and each of them takes
+// exactly one byte, so it's safe to access them directly.
+INLINE type_id type_at(str types, u32 idx) {
+    assert(idx < str_len(types));
+    u8 u = types.ptr[idx];
+    return (type_id)((u & 0x40) ? ((i8)(u | 0x80)) : u);
+}
+
 static r push_val(type_id type, validator_context * ctx) {
     assert(ctx);
     check_prep(r);
-    check(vec_push_type_id(&ctx->val_stack, type));
-    if (vec_size_type_id(&ctx->val_stack) > ctx->stack_size_max) {
-        ctx->stack_size_max = (u32)vec_size_type_id(&ctx->val_stack);
+    check(svec_push_type_id(&ctx->val_stack, type));
+    ctx->slot_height += type_slot_count(type);
+    if (ctx->slot_height > ctx->stack_size_max) {
+        ctx->stack_size_max = ctx->slot_height;
     }
     return ok_r;
 }
 
-static r push_vals(vec_type_id * vals, validator_context * ctx) {
-    assert(vals);
+static r push_vals(u32 count, str types, validator_context * ctx) {
     assert(ctx);
     check_prep(r);
-    VEC_FOR_EACH(vals, type_id, v) {
-        check(push_val(*v, ctx));
+    for (u32 i = 0; i < count; i++) {
+        check(push_val(type_at(types, i), ctx));
     }
     return ok_r;
 }
 
 static r_type_id pop_val(validator_context * ctx) {
     assert(ctx);
-    ctrl_frame * frame = vec_back_ctrl_frame(&ctx->ctrl_stack);
+    ctrl_frame * frame = svec_back_ctrl_frame(&ctx->ctrl_stack);
     check_prep(r_type_id);
     // stack-polymorphic
-    if (frame->unreachable && (frame->height == vec_size_type_id(&ctx->val_stack))) {
+    if (frame->unreachable && (frame->height == svec_size_type_id(&ctx->val_stack))) {
         return ok(TYPE_ID_unknown);
     }
-    if (frame->height == vec_size_type_id(&ctx->val_stack)) {
+    if (frame->height == svec_size_type_id(&ctx->val_stack)) {
         return err(e_invalid, "Stack underrun");
     }
-    type_id real_type = *vec_back_type_id(&ctx->val_stack);
-    vec_pop_type_id(&ctx->val_stack);
+    type_id real_type = *svec_back_type_id(&ctx->val_stack);
+    svec_pop_type_id(&ctx->val_stack);
+    ctx->slot_height -= type_slot_count(real_type);
     return ok(real_type);
 }
 
@@ -88,30 +115,13 @@ static r_type_id pop_val_expect(type_id expected_type, validator_context * ctx)
     return ok(actual);
 }
 
-static r_vec_type_id pop_vals_to_vec(vec_type_id * vals, validator_context * ctx) {
-    assert(vals);
-    assert(ctx);
-    check_prep(r_vec_type_id);
-
-    vec_type_id popped_vals = {0};
-    VEC_FOR_EACH_REVERSE(vals, type_id, v) {
-        unwrap(type_id, t, pop_val_expect(*v, ctx), {
-            vec_clear_type_id(&popped_vals);
-        });
-        check(vec_push_type_id(&popped_vals, t), {
-            vec_clear_type_id(&popped_vals);
-        });
-    }
-    return ok(popped_vals);
-}
-
 // pop vals and then drop it.
-static r pop_vals(vec_type_id * vals, validator_context * ctx) {
-    assert(vals);
+static r pop_vals(u32 count, str types, validator_context * ctx) {
     assert(ctx);
     check_prep(r);
-    unwrap(vec_type_id, popped_vals, pop_vals_to_vec(vals, ctx));
-    vec_clear_type_id(&popped_vals);
+    for (u32 i = count; i > 0; i--) {
+        unwrap_drop(type_id, pop_val_expect(type_at(types, i - 1), ctx));
+    }
     return ok_r;
 }
 
@@ -119,69 +129,151 @@ static r push_ctrl(blocktype bt, func_type ftype, validator_context * ctx) {
     assert(ctx);
     check_prep(r);
 
-    check(vec_push_ctrl_frame(&ctx->ctrl_stack, (ctrl_frame){0}));
-    ctrl_frame * frame = vec_back_ctrl_frame(&ctx->ctrl_stack);
+    check(svec_push_ctrl_frame(&ctx->ctrl_stack, (ctrl_frame){0}));
+    ctrl_frame * frame = svec_back_ctrl_frame(&ctx->ctrl_stack);
     frame->type = bt;
     frame->ftype = ftype;
-    frame->height = vec_size_type_id(&ctx->val_stack);
+    frame->height = svec_size_type_id(&ctx->val_stack);
+    frame->slot_height = ctx->slot_height;
     frame->unreachable = false;
-    unwrap(vec_type_id, params, parse_types(ftype.param_count, ftype.params));
-    frame->start_types = params;
-    unwrap(vec_type_id, results, parse_types(ftype.result_count, ftype.results));
-    frame->end_types = results;
-    check(push_vals(&frame->start_types, ctx));
+    frame->pending_jt_head = JT_SLOT_NONE;
+    frame->if_jt_slot = JT_SLOT_NONE;
+    frame->loop_jt_slot = JT_SLOT_NONE;
+    check(push_vals(ftype.param_count, ftype.params, ctx));
     return ok_r;
 }
 
-// be sure to release the ctrl frame after the pop
 static r_ctrl_frame pop_ctrl(validator_context * ctx) {
     assert(ctx);
     check_prep(r_ctrl_frame);
 
-    if (!vec_size_ctrl_frame(&ctx->ctrl_stack)) {
+    if (!svec_size_ctrl_frame(&ctx->ctrl_stack)) {
         return err(e_invalid, "Control stack underrun");
     }
-    ctrl_frame top_frame = *vec_back_ctrl_frame(&ctx->ctrl_stack);
-    check(pop_vals(&top_frame.end_types, ctx));
-    vec_pop_ctrl_frame(&ctx->ctrl_stack);
+    ctrl_frame top_frame = *svec_back_ctrl_frame(&ctx->ctrl_stack);
+    check(pop_vals(top_frame.ftype.result_count, top_frame.ftype.results, ctx));
+    svec_pop_ctrl_frame(&ctx->ctrl_stack);
     return ok(top_frame);
 }
 
-void release_ctrl_frame(ctrl_frame * frame) {
-    vec_clear_type_id(&frame->start_types);
-    vec_clear_type_id(&frame->end_types);
-    vec_clear_u32(&frame->pending_jt_slots);
+static u32 label_count(ctrl_frame * frame) {
+    return frame->type == bt_loop ? frame->ftype.param_count : frame->ftype.result_count;
 }
 
-vec_type_id * label_types(ctrl_frame * frame) {
-    if (frame->type == bt_loop) {
-        return &frame->start_types;
-    } else {
-        return &frame->end_types;
-    }
+static str label_types(ctrl_frame * frame) {
+    return frame->type == bt_loop ? frame->ftype.params : frame->ftype.results;
+}
+
+static u32 label_slots(ctrl_frame * frame) {
+    return types_slot_count(label_types(frame));
 }
 
 static r unreachable(validator_context * ctx) {
     assert(ctx);
     check_prep(r);
 
-    ctrl_frame * frame = vec_back_ctrl_frame(&ctx->ctrl_stack);
+    ctrl_frame * frame = svec_back_ctrl_frame(&ctx->ctrl_stack);
 
-    if (vec_size_type_id(&ctx->val_stack) < frame->height) {
+    if (svec_size_type_id(&ctx->val_stack) < frame->height) {
         return err(e_invalid, "Stack underrun");
     }
-    check(vec_resize_type_id(&ctx->val_stack, frame->height));
+    check(svec_resize_type_id(&ctx->val_stack, frame->height));
+    ctx->slot_height = frame->slot_height;
     frame->unreachable = true;
     return ok_r;
 }
 
-static void validator_context_drop(validator_context * ctx) {
-    VEC_FOR_EACH(&ctx->ctrl_stack, ctrl_frame, fr) {
-        release_ctrl_frame(fr);
+// Set the offsets of a slot, and move them to an escape if they don't fit in the slot.
+static r set_slot_offsets(validator_context * ctx, u32 slot_idx, i32 target_offset, u32 stack_offset) {
+    check_prep(r);
+    jump_table * record = vec_at_jump_table(&ctx->f->jt, slot_idx);
+    if (record->target_offset == JUMP_TABLE_ESCAPE) {
+        *vec_at_jump_table_escape(&ctx->f->jt_escapes, record->stack_offset) = (jump_table_escape){
+            .target_offset = target_offset,
+            .stack_offset = stack_offset,
+        };
+        return ok_r;
+    }
+    if (target_offset > i16_MIN && target_offset <= i16_MAX && stack_offset <= u16_MAX) {
+        record->target_offset = (i16)target_offset;
+        record->stack_offset = (u16)stack_offset;
+        return ok_r;
+    }
+    vec_jump_table_escape * escapes = &ctx->f->jt_escapes;
+    size_t escape_idx = vec_size_jump_table_escape(escapes);
+    if (escape_idx > u16_MAX) {
+        return err(e_exhaustion, "Too many jump table escapes");
+    }
+    check(vec_push_jump_table_escape(escapes, (jump_table_escape){
+                                                  .target_offset = target_offset,
+                                                  .stack_offset = stack_offset,
+                                              }));
+    record->target_offset = JUMP_TABLE_ESCAPE;
+    record->stack_offset = (u16)escape_idx;
+    return ok_r;
+}
+
+// Append a slot to the jump table. The next_idx is limited to u16, so is the jump table.
+static r_u32 push_jt_slot(validator_context * ctx, u32 pc, u32 stack_offset, u16 arity) {
+    check_prep(r_u32);
+    vec_jump_table * jt = &ctx->f->jt;
+    size_t idx = vec_size_jump_table(jt);
+    if (idx >= JUMP_TABLE_IDX_INVALID) {
+        return err(e_exhaustion, "Too many jump table slots");
+    }
+    check(vec_push_jump_table(jt, (jump_table){
+                                      .arity = arity,
+                                      .next_idx = JUMP_TABLE_IDX_INVALID,
+                                  }));
+    check(vec_push_u32(&ctx->jt_links, JT_SLOT_NONE));
+    check(vec_push_u32(&ctx->jt_pcs, pc));
+    check(set_slot_offsets(ctx, (u32)idx, 0, stack_offset));
+    return ok((u32)idx);
+}
+
+static void add_pending_slot(validator_context * ctx, ctrl_frame * frame, u32 slot_idx) {
+    *vec_at_u32(&ctx->jt_links, slot_idx) = frame->pending_jt_head;
+    frame->pending_jt_head = slot_idx;
+}
+
+// The jump table is sorted by pc, so the first slot after the branch target is either
+// the slot that will be pushed next (forward) or the first slot of the loop (backward).
+// A next_idx that ends up equal to the jump table size is invalidated at the end.
+static r patch_slot(validator_context * ctx, u32 slot_idx, u32 target_pc, u32 next_idx) {
+    check_prep(r);
+    jump_table * record = vec_at_jump_table(&ctx->f->jt, slot_idx);
+    record->next_idx = (u16)next_idx;
+    jump_table_escape offsets = jump_table_decode(record, ctx->f->jt_escapes._data);
+    i32 target_offset = (i32)(target_pc - *vec_at_u32(&ctx->jt_pcs, slot_idx));
+    check(set_slot_offsets(ctx, slot_idx, target_offset, offsets.stack_offset));
+    return ok_r;
+}
+
+static r patch_pending_slots(validator_context * ctx, u32 head, u32 target_pc, u32 next_idx) {
+    check_prep(r);
+    for (u32 slot_idx = head; slot_idx != JT_SLOT_NONE; slot_idx = *vec_at_u32(&ctx->jt_links, slot_idx)) {
+        check(patch_slot(ctx, slot_idx, target_pc, next_idx));
     }
-    vec_clear_ctrl_frame(&ctx->ctrl_stack);
-    vec_clear_type_id(&ctx->val_stack);
-    vec_clear_type_id(&ctx->locals);
+    return ok_r;
+}
+
+static void validator_context_reset(validator_context * ctx, func * f) {
+    svec_popall_type_id(&ctx->val_stack);
+    svec_popall_ctrl_frame(&ctx->ctrl_stack);
+    vec_popall_u32(&ctx->jt_links);
+    vec_popall_u32(&ctx->jt_pcs);
+    svec_popall_type_id(&ctx->scratch);
+    ctx->slot_height = 0;
+    ctx->stack_size_max = 0;
+    ctx->f = f;
+}
+
+static void validator_context_drop(validator_context * ctx) {
+    svec_clear_ctrl_frame(&ctx->ctrl_stack);
+    svec_clear_type_id(&ctx->val_stack);
+    vec_clear_u32(&ctx->jt_links);
+    vec_clear_u32(&ctx->jt_pcs);
+    svec_clear_type_id(&ctx->scratch);
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -192,29 +284,22 @@ static r validator_on_decode_begin(void * payload) {
     func * f = ctx->f;
     LOGI("%s", "validator begin");
 
-    assert(!vec_size_type_id(&ctx->val_stack));
-    vec_type_id * locals = &ctx->locals;
+    assert(!svec_size_type_id(&ctx->val_stack));
 
-    // prepare the locals vector.
+    // the function could be validated again (e.g. instantiated by another vm), so start over.
+    vec_popall_jump_table(&f->jt);
+    vec_popall_jump_table_escape(&f->jt_escapes);
+#if SILVERFIR_STACK_SLOT_32
+    vec_popall_u8(&f->wide_operands);
+#endif
     assert(f->fn_type.param_count <= f->local_count);
-    check(vec_reserve_type_id(locals, f->local_count));
-    unwrap(vec_type_id, func_params, parse_types(f->fn_type.param_count, f->fn_type.params));
-    VEC_FOR_EACH(&func_params, type_id, param) {
-        check(vec_push_type_id(locals, *param), {
-            vec_clear_type_id(&func_params);
-        });
-    }
-    vec_clear_type_id(&func_params);
-    VEC_FOR_EACH(&f->local_types, type_id, local) {
-        check(vec_push_type_id(locals, *local));
-    }
-    assert(vec_size_type_id(locals) == f->local_count);
 
     // push the first frame
-    assert(!vec_size_ctrl_frame(&ctx->ctrl_stack));
+    assert(!svec_size_ctrl_frame(&ctx->ctrl_stack));
     check(push_ctrl(bt_func, f->fn_type, ctx));
     // we need to clear the pushed vals because the params of the 1st frame is in the local
-    vec_clear_type_id(&ctx->val_stack);
+    svec_popall_type_id(&ctx->val_stack);
+    ctx->slot_height = 0;
     return ok_r;
 }
 
@@ -224,9 +309,9 @@ static r validator_on_opcode(void * payload, wasm_opcode opcode, stream imm) {
     module * mod = ctx->mod;
     const char * op_name = get_op_name(opcode);
     u32 local_count = ctx->f->local_count;
-    u32 stack_height = (u32)vec_size_type_id(&ctx->val_stack);
+    u32 stack_height = (u32)svec_size_type_id(&ctx->val_stack);
     u32 op_offset = (u32)(imm.p - mod->wasm_bin.s.ptr - 1);
-    u32 ctrl_frames = (u32)vec_size_ctrl_frame(&ctx->ctrl_stack) - 1;
+    u32 ctrl_frames = (u32)svec_size_ctrl_frame(&ctx->ctrl_stack) - 1;
     if (ctrl_frames && (opcode == op_end || opcode == op_else)) {
         ctrl_frames--;
     }
@@ -244,35 +329,27 @@ static r validator_on_unreachable(void * payload, wasm_opcode opcode, stream imm
 static r validator_on_block(void * payload, wasm_opcode opcode, stream imm, func_type type) {
     check_prep(r);
     validator_context * ctx = (validator_context *)payload;
-    vec_jump_table * jt = &ctx->f->jt;
 
     if (opcode == op_if) {
         unwrap_drop(type_id, pop_val_expect(TYPE_ID_i32, ctx));
     }
-    unwrap(vec_type_id, param_types, parse_types(type.param_count, type.params));
-    check(pop_vals(&param_types, ctx), {
-        vec_clear_type_id(&param_types);
-    });
-    vec_clear_type_id(&param_types);
+    check(pop_vals(type.param_count, type.params, ctx));
     blocktype bt = (opcode == op_block ? bt_block : (opcode == op_loop ? bt_loop : bt_if));
     check(push_ctrl(bt, type, ctx));
+    ctrl_frame * frame = svec_back_ctrl_frame(&ctx->ctrl_stack);
     // update the jump table
     u32 pc_offset = (u32)(imm.p - imm.s.ptr);
     // The pc_offset target for loop is pointing at the instruction next to the loop because
     // all the block instructions are just nop
     if (opcode == op_loop) {
         pc_offset += 1;
-        vec_back_ctrl_frame(&ctx->ctrl_stack)->pc = pc_offset;
+        frame->pc = pc_offset;
+        frame->loop_jt_slot = (u32)vec_size_jump_table(&ctx->f->jt);
     }
     // the "if" block needs a jump table slot.
     if (opcode == op_if) {
-        check(vec_push_jump_table(jt, (jump_table){
-                                          .pc = pc_offset,
-                                          .stack_offset = 0,
-                                          .arity = 0,
-                                          .next_idx = JUMP_TABLE_IDX_INVALID,
-                                      }));
-        check(vec_push_u32(&vec_back_ctrl_frame(&ctx->ctrl_stack)->pending_jt_slots, (u32)(vec_size_jump_table(jt) - 1)));
+        unwrap(u32, idx, push_jt_slot(ctx, pc_offset, 0, 0));
+        frame->if_jt_slot = idx;
     }
     return ok_r;
 }
@@ -280,55 +357,33 @@ static r validator_on_block(void * payload, wasm_opcode opcode, stream imm, func
 static r validator_on_else(void * payload, wasm_opcode opcode, stream imm) {
     check_prep(r);
     validator_context * ctx = (validator_context *)payload;
-    ctrl_frame * current_frame = vec_back_ctrl_frame(&ctx->ctrl_stack);
-    vec_jump_table * jt = &ctx->f->jt;
+    ctrl_frame * current_frame = svec_back_ctrl_frame(&ctx->ctrl_stack);
 
     if (current_frame->type != bt_if) {
         return err(e_invalid, "if/else mismatch");
     }
-    // the ctrl_frame is ripped out of the stack, so it has to be
-    // released because it owns two vectors.
     unwrap(ctrl_frame, cf, pop_ctrl(ctx));
-    check(push_ctrl(bt_else, cf.ftype, ctx), {
-        release_ctrl_frame(&cf);
-    });
-    // move the pending jt slots except the first one to the else block
+    check(push_ctrl(bt_else, cf.ftype, ctx));
+    // move the pending jt slots to the else block.
     // the if slot's jump target is the else block, and all other br always point to the end
     // and if there's no else block, the "if" block will be just like a normal br that points
     // to the end
-    ctrl_frame * else_frame = vec_back_ctrl_frame(&ctx->ctrl_stack);
+    ctrl_frame * else_frame = svec_back_ctrl_frame(&ctx->ctrl_stack);
+    else_frame->pending_jt_head = cf.pending_jt_head;
     u32 pc_offset = (u32)(imm.p - imm.s.ptr);
-    for (u32 i = 0; i < vec_size_u32(&cf.pending_jt_slots); i++) {
-        u32 slot_idx = *vec_at_u32(&cf.pending_jt_slots, i);
-        if (i == 0) {
-            jump_table * record = vec_at_jump_table(jt, slot_idx);
-            record->target_offset = pc_offset - record->pc;
-            continue;
-        }
-        check(vec_push_u32(&else_frame->pending_jt_slots, slot_idx), {
-            release_ctrl_frame(&cf);
-        });
-    }
     // push the else itself. else is like a "br 0". When we run into an else, we jump out of the frame
-    u16 arity = (u16)vec_size_type_id(label_types(else_frame));
-    check(vec_push_jump_table(jt, (jump_table){
-                                      .pc = pc_offset,
-                                      .stack_offset = (u32)(vec_size_type_id(&ctx->val_stack) - arity - else_frame->height),
-                                      .arity = arity,
-                                      .next_idx = JUMP_TABLE_IDX_INVALID,
-                                  }),
-          release_ctrl_frame(&cf));
-    u32 idx = (u32)vec_size_jump_table(jt) - 1;
-    check(vec_push_u32(&else_frame->pending_jt_slots, idx));
-    //done.
-    release_ctrl_frame(&cf);
+    u16 arity = (u16)label_slots(else_frame);
+    unwrap(u32, idx, push_jt_slot(ctx, pc_offset, ctx->slot_height - arity - else_frame->slot_height, arity));
+    add_pending_slot(ctx, else_frame, idx);
+    // the else slot has the same pc as the target, so the if slot's next slot is the one after it.
+    assert(cf.if_jt_slot != JT_SLOT_NONE);
+    check(patch_slot(ctx, cf.if_jt_slot, pc_offset, idx + 1));
     return ok_r;
 }
 
 static r validator_on_end(void * payload, wasm_opcode opcode, stream imm) {
     check_prep(r);
     validator_context * ctx = (validator_context *)payload;
-    vec_jump_table * jt = &ctx->f->jt;
 
     // Notice that the cf.type could be bt_func, so when we pop the last frame
     // we're actually checking the return values. So no need to double check on
@@ -337,58 +392,46 @@ static r validator_on_end(void * payload, wasm_opcode opcode, stream imm) {
 
     // update the pending jump slots with the correct PC offset
     if (cf.type == bt_loop) {
-        VEC_FOR_EACH(&cf.pending_jt_slots, u32, slot_idx) {
-            jump_table * record = vec_at_jump_table(jt, *slot_idx);
-            record->target_offset = cf.pc - record->pc;
-        }
+        check(patch_pending_slots(ctx, cf.pending_jt_head, cf.pc, cf.loop_jt_slot));
     } else {
-        VEC_FOR_EACH(&cf.pending_jt_slots, u32, slot_idx) {
-            jump_table * record = vec_at_jump_table(jt, *slot_idx);
-            u32 pc_offset = (u32)(imm.p - imm.s.ptr);
-            record->target_offset = pc_offset - record->pc;
-            if (cf.type == bt_func) {
-                // a tiny optimization for the br that jumps out of a function.
-                // when it happens the branch target will be pointing to the last end.
-                record->target_offset--;
-            }
+        u32 pc_offset = (u32)(imm.p - imm.s.ptr);
+        if (cf.type == bt_func) {
+            // a tiny optimization for the br that jumps out of a function.
+            // when it happens the branch target will be pointing to the last end.
+            pc_offset--;
+        }
+        u32 next_idx = (u32)vec_size_jump_table(&ctx->f->jt);
+        check(patch_pending_slots(ctx, cf.pending_jt_head, pc_offset, next_idx));
+        if (cf.if_jt_slot != JT_SLOT_NONE) {
+            check(patch_slot(ctx, cf.if_jt_slot, pc_offset, next_idx));
         }
     }
     // done
-    check(push_vals(&cf.end_types, ctx), {
-        release_ctrl_frame(&cf);
-    });
-    release_ctrl_frame(&cf);
+    check(push_vals(cf.ftype.result_count, cf.ftype.results, ctx));
     return ok_r;
 }
 
 static r validator_on_br_or_if(void * payload, wasm_opcode opcode, stream imm, u8 lth) {
     check_prep(r);
     validator_context * ctx = (validator_context *)payload;
-    vec_jump_table * jt = &ctx->f->jt;
 
-    if (lth >= vec_size_ctrl_frame(&ctx->ctrl_stack)) {
+    if (lth >= svec_size_ctrl_frame(&ctx->ctrl_stack)) {
         return err(e_invalid, "invalid br n");
     }
     if (opcode == op_br_if) {
         unwrap_drop(type_id, pop_val_expect(TYPE_ID_i32, ctx));
     }
-    ctrl_frame * target_frame = vec_at_ctrl_frame(&ctx->ctrl_stack, vec_size_ctrl_frame(&ctx->ctrl_stack) - lth - 1);
+    ctrl_frame * target_frame = svec_at_ctrl_frame(&ctx->ctrl_stack, svec_size_ctrl_frame(&ctx->ctrl_stack) - lth - 1);
     // update the jump table
-    u16 arity = (u16)vec_size_type_id(label_types(target_frame));
-    check(vec_push_jump_table(jt, (jump_table){
-                                      .pc = (u32)(imm.p - imm.s.ptr),
-                                      .stack_offset = (u32)(vec_size_type_id(&ctx->val_stack) - arity - target_frame->height),
-                                      .arity = arity,
-                                      .next_idx = JUMP_TABLE_IDX_INVALID,
-                                  }));
-    u32 idx = (u32)(vec_size_jump_table(jt) - 1);
-    check(vec_push_u32(&target_frame->pending_jt_slots, idx));
+    u16 arity = (u16)label_slots(target_frame);
+    unwrap(u32, idx, push_jt_slot(ctx, (u32)(imm.p - imm.s.ptr), ctx->slot_height - arity - target_frame->slot_height, arity));
+    add_pending_slot(ctx, target_frame, idx);
     // done.
-    check(pop_vals(label_types(target_frame), ctx));
+    check(pop_vals(label_count(target_frame), label_types(target_frame), ctx));
     if (opcode == op_br) {
         check(unreachable(ctx));
     } else {
-        check(push_vals(label_types(target_frame), ctx));
+        check(push_vals(label_count(target_frame), label_types(target_frame), ctx));
     }
     return ok_r;
 }
@@ -396,52 +439,51 @@ static r validator_on_br_or_if(void * payload, wasm_opcode opcode, stream imm, u
 static r validator_on_br_table(void * payload, wasm_opcode opcode, stream imm) {
     check_prep(r);
     validator_context * ctx = (validator_context *)payload;
-    vec_jump_table * jt = &ctx->f->jt;
 
     unwrap_drop(type_id, pop_val_expect(TYPE_ID_i32, ctx));
     unwrap(u32, table_len, stream_read_vu32(&imm));
     // we need to find out the arity, which depends on the last table item, so we
     // there has to be two passes.
-    size_t arity = 0;
+    u32 arity = 0;
     stream pc_copy = imm;
     ctrl_frame * m_frame = NULL;
     for (u32 i = 0; i < (table_len + 1); i++) {
         unwrap(u32, l, stream_read_vu32(&pc_copy));
-        if (l >= vec_size_ctrl_frame(&ctx->ctrl_stack)) {
+        if (l >= svec_size_ctrl_frame(&ctx->ctrl_stack)) {
             return err(e_invalid, "invalid br table n");
         }
         if (i == table_len) {
-            m_frame = vec_at_ctrl_frame(&ctx->ctrl_stack, vec_size_ctrl_frame(&ctx->ctrl_stack) - l - 1);
-            arity = vec_size_type_id(label_types(m_frame));
+            m_frame = svec_at_ctrl_frame(&ctx->ctrl_stack, svec_size_ctrl_frame(&ctx->ctrl_stack) - l - 1);
+            arity = label_count(m_frame);
         }
     }
     assert(m_frame);
     // second pass, check each frame's arity
+    svec_type_id * popped = &ctx->scratch;
     for (u32 j = 0; j < table_len + 1; j++) {
         unwrap(u32, l, stream_read_vu32(&imm));
-        ctrl_frame * target_frame = vec_at_ctrl_frame(&ctx->ctrl_stack, vec_size_ctrl_frame(&ctx->ctrl_stack) - l - 1);
-        if (arity != vec_size_type_id(label_types(target_frame))) {
+        ctrl_frame * target_frame = svec_at_ctrl_frame(&ctx->ctrl_stack, svec_size_ctrl_frame(&ctx->ctrl_stack) - l - 1);
+        if (arity != label_count(target_frame)) {
             return err(e_invalid, "br table arity mismatch");
         }
         // update the jump table
         // br_table is an exception where the pc offset points to the end of the instruction. This way we can
         // simply reuse the code between all br handlers.
-        check(vec_push_jump_table(jt, (jump_table){
-                                          .pc = (u32)(pc_copy.p - pc_copy.s.ptr),
-                                          .stack_offset = (u32)(vec_size_type_id(&ctx->val_stack) - arity - target_frame->height),
-                                          .arity = (u16)arity,
-                                          .next_idx = JUMP_TABLE_IDX_INVALID,
-                                      }));
-        check(vec_push_u32(&target_frame->pending_jt_slots, (u32)(vec_size_jump_table(jt) - 1)));
+        u16 arity_slots = (u16)label_slots(target_frame);
+        unwrap(u32, idx, push_jt_slot(ctx, (u32)(pc_copy.p - pc_copy.s.ptr), ctx->slot_height - arity_slots - target_frame->slot_height, arity_slots));
+        add_pending_slot(ctx, target_frame, idx);
         // done.
-        unwrap(vec_type_id, popped, pop_vals_to_vec(label_types(target_frame), ctx));
-        VEC_REVERSE(&popped);
-        check(push_vals(&popped, ctx), {
-            vec_clear_type_id(&popped);
-        });
-        vec_clear_type_id(&popped);
-    }
-    check(pop_vals(label_types(m_frame), ctx));
+        str types = label_types(target_frame);
+        svec_popall_type_id(popped);
+        for (u32 i = arity; i > 0; i--) {
+            unwrap(type_id, t, pop_val_expect(type_at(types, i - 1), ctx));
+            check(svec_push_type_id(popped, t));
+        }
+        for (size_t i = svec_size_type_id(popped); i > 0; i--) {
+            check(push_val(*svec_at_type_id(popped, i - 1), ctx));
+        }
+    }
+    check(pop_vals(arity, label_types(m_frame), ctx));
     check(unreachable(ctx));
     return ok_r;
 }
@@ -449,8 +491,8 @@ static r validator_on_br_table(void * payload, wasm_opcode opcode, stream imm) {
 static r validator_on_return(void * payload, wasm_opcode opcode, stream imm) {
     check_prep(r);
     validator_context * ctx = (validator_context *)payload;
-    ctrl_frame * target_frame = vec_at_ctrl_frame(&ctx->ctrl_stack, 0);
-    check(pop_vals(label_types(target_frame), ctx));
+    ctrl_frame * target_frame = svec_at_ctrl_frame(&ctx->ctrl_stack, 0);
+    check(pop_vals(label_count(target_frame), label_types(target_frame), ctx));
     check(unreachable(ctx));
     return ok_r;
 }
@@ -464,22 +506,14 @@ static r validator_on_call(void * payload, stream imm, u32 func_idx) {
     }
     func * fn = vec_at_func(&mod->funcs, func_idx);
     // pop params
-    unwrap(vec_type_id, param_types, parse_types(fn->fn_type.param_count, fn->fn_type.params));
-    check(pop_vals(&param_types, ctx), {
-        vec_clear_type_id(&param_types);
-    });
-    vec_clear_type_id(&param_types);
+    check(pop_vals(fn->fn_type.param_count, fn->fn_type.params, ctx));
     // calculate the potential maximum stack size with the callee's locals
-    u32 required_size = (u32)(vec_size_type_id(&ctx->val_stack) + fn->local_count);
+    u32 required_size = ctx->slot_height + func_local_slots(fn);
     if (required_size > ctx->stack_size_max) {
         ctx->stack_size_max = required_size;
     }
     // push results
-    unwrap(vec_type_id, result_types, parse_types(fn->fn_type.result_count, fn->fn_type.results));
-    check(push_vals(&result_types, ctx), {
-        vec_clear_type_id(&result_types);
-    });
-    vec_clear_type_id(&result_types);
+    check(push_vals(fn->fn_type.result_count, fn->fn_type.results, ctx));
     return ok_r;
 }
 
@@ -496,11 +530,7 @@ static r validator_on_call_indirect(void * payload, stream imm, u32 type_idx, u3
     }
     func_type * ft = vec_at_func_type(&mod->func_types, type_idx);
     // pop params
-    unwrap(vec_type_id, param_types, parse_types(ft->param_count, ft->params));
-    check(pop_vals(&param_types, ctx), {
-        vec_clear_type_id(&param_types);
-    });
-    vec_clear_type_id(&param_types);
+    check(pop_vals(ft->param_count, ft->params, ctx));
 
     // Caution, we can't potential maximum stack size here because we don't know
     // the callee's local counts. So, in order to make sure the stack is enough,
@@ -508,18 +538,81 @@ static r validator_on_call_indirect(void * payload, stream imm, u32 type_idx, u3
     // call_indirect implementation for more information.
 
     // push results
-    unwrap(vec_type_id, result_types, parse_types(ft->result_count, ft->results));
-    check(push_vals(&result_types, ctx), {
-        vec_clear_type_id(&result_types);
-    });
-    vec_clear_type_id(&result_types);
+    check(push_vals(ft->result_count, ft->results, ctx));
+    return ok_r;
+}
+
+// The callee's results become the caller's, so they have to match exactly.
+static r validate_tail_call(validator_context * ctx, func_type ft) {
+    check_prep(r);
+    if ((ft.result_count != ctx->f->fn_type.result_count) || !str_eq(ft.results, ctx->f->fn_type.results)) {
+        return err(e_invalid, "type mismatch");
+    }
+    // pop params
+    check(pop_vals(ft.param_count, ft.params, ctx));
+    // host callees are called on top of this frame and leave the results there.
+    u32 param_slots = types_slot_count(ft.params);
+    u32 result_slots = types_slot_count(ft.results);
+    u32 required_size = ctx->slot_height + (param_slots > result_slots ? param_slots : result_slots);
+    if (required_size > ctx->stack_size_max) {
+        ctx->stack_size_max = required_size;
+    }
+    check(unreachable(ctx));
+    return ok_r;
+}
+
+static r validator_on_return_call(void * payload, stream imm, u32 func_idx) {
+    check_prep(r);
+    validator_context * ctx = (validator_context *)payload;
+    module * mod = ctx->mod;
+    if (func_idx >= vec_size_func(&mod->funcs)) {
+        return err(e_invalid, "Invalid function index");
+    }
+    check(validate_tail_call(ctx, vec_at_func(&mod->funcs, func_idx)->fn_type));
+    return ok_r;
+}
+
+static r validator_on_return_call_indirect(void * payload, stream imm, u32 type_idx, u32 table_idx) {
+    check_prep(r);
+    validator_context * ctx = (validator_context *)payload;
+    module * mod = ctx->mod;
+    unwrap_drop(type_id, pop_val_expect(TYPE_ID_i32, ctx));
+    if (table_idx >= vec_size_table(&mod->tables)) {
+        return err(e_invalid, "Invalid table index");
+    }
+    if (type_idx >= vec_size_func_type(&mod->func_types)) {
+        return err(e_invalid, "Invalid type index");
+    }
+    check(validate_tail_call(ctx, *vec_at_func_type(&mod->func_types, type_idx)));
+    return ok_r;
+}
+
+// drop and the untyped select don't tell the interpreter how many slots the operand takes, so the
+// wide ones are marked by their pc (see func).
+static r mark_operand_width(validator_context * ctx, stream imm, type_id type) {
+#if SILVERFIR_STACK_SLOT_32
+    check_prep(r);
+    if (type_slot_count(type) == 2) {
+        vec_u8 * bits = &ctx->f->wide_operands;
+        if (!vec_size_u8(bits)) {
+            check(vec_resize_u8(bits, (str_len(ctx->f->code) + 7) / 8));
+        }
+        u32 offset = (u32)(imm.p - imm.s.ptr);
+        *vec_at_u8(bits, offset >> 3) |= (u8)(1u << (offset & 7));
+    }
+#else
+    UNUSED(ctx);
+    UNUSED(imm);
+    UNUSED(type);
+#endif
     return ok_r;
 }
 
 static r validator_on_drop(void * payload, wasm_opcode opcode, stream imm) {
     check_prep(r);
     validator_context * ctx = (validator_context *)payload;
-    unwrap_drop(type_id, pop_val(ctx));
+    unwrap(type_id, t, pop_val(ctx));
+    check(mark_operand_width(ctx, imm, t));
     return ok_r;
 }
 
@@ -536,6 +629,7 @@ static r validator_on_select(void * payload, wasm_opcode opcode, stream imm) {
         return err(e_invalid, "select operand type mismatch");
     }
     check(push_val(t1 == TYPE_ID_unknown ? t2 : t1, ctx));
+    check(mark_operand_width(ctx, imm, t1 == TYPE_ID_unknown ? t2 : t1));
     return ok_r;
 }
 
@@ -549,14 +643,22 @@ static r validator_on_select_t(void * payload, wasm_opcode opcode, stream imm, t
     return ok_r;
 }
 
+// the params first, then the declared locals.
+static r_type_id local_type_at(func * f, u32 local_idx) {
+    check_prep(r_type_id);
+    if (local_idx >= f->local_count) {
+        return err(e_invalid, "Invalid local index");
+    }
+    if (local_idx < f->fn_type.param_count) {
+        return ok(type_at(f->fn_type.params, local_idx));
+    }
+    return ok(func_local_type(f, local_idx));
+}
+
 static r validator_on_local_get(void * payload, stream imm, u32 local_idx) {
     check_prep(r);
     validator_context * ctx = (validator_context *)payload;
-    vec_type_id * locals = &ctx->locals;
-    if (local_idx >= vec_size_type_id(locals)) {
-        return err(e_invalid, "Invalid local index");
-    }
-    type_id local_type = *vec_at_type_id(locals, local_idx);
+    unwrap(type_id, local_type, local_type_at(ctx->f, local_idx));
     check(push_val(local_type, ctx));
     return ok_r;
 }
@@ -564,11 +666,7 @@ static r validator_on_local_get(void * payload, stream imm, u32 local_idx) {
 static r validator_on_local_set(void * payload, stream imm, u32 local_idx) {
     check_prep(r);
     validator_context * ctx = (validator_context *)payload;
-    vec_type_id * locals = &ctx->locals;
-    if (local_idx >= vec_size_type_id(locals)) {
-        return err(e_invalid, "Invalid local index");
-    }
-    type_id local_type = *vec_at_type_id(locals, local_idx);
+    unwrap(type_id, local_type, local_type_at(ctx->f, local_idx));
     unwrap_drop(type_id, pop_val_expect(local_type, ctx));
     return ok_r;
 }
@@ -576,11 +674,7 @@ static r validator_on_local_set(void * payload, stream imm, u32 local_idx) {
 static r validator_on_local_tee(void * payload, stream imm, u32 local_idx) {
     check_prep(r);
     validator_context * ctx = (validator_context *)payload;
-    vec_type_id * locals = &ctx->locals;
-    if (local_idx >= vec_size_type_id(locals)) {
-        return err(e_invalid, "Invalid local index");
-    }
-    type_id local_type = *vec_at_type_id(locals, local_idx);
+    unwrap(type_id, local_type, local_type_at(ctx->f, local_idx));
     unwrap_drop(type_id, pop_val_expect(local_type, ctx));
     check(push_val(local_type, ctx));
     return ok_r;
@@ -636,20 +730,29 @@ static r validator_on_table_set(void * payload, stream imm, u32 table_idx) {
     return ok_r;
 }
 
-static r validator_on_memory_load_store(void * payload, wasm_opcode opcode, stream imm, u8 align, u32 offset) {
+// The type of the addresses into mem0, i64 for 64-bit memories.
+static type_id mem0_index_type(module * mod) {
+    if (vec_size_memory(&mod->memories) && memory_is64(vec_at_memory(&mod->memories, 0))) {
+        return TYPE_ID_i64;
+    }
+    return TYPE_ID_i32;
+}
+
+static r validator_on_memory_load_store(void * payload, wasm_opcode opcode, stream imm, u8 align, u64 offset) {
     check_prep(r);
     validator_context * ctx = (validator_context *)payload;
     module * mod = ctx->mod;
     if (!vec_size_memory(&mod->memories)) {
         return err(e_invalid, "mem0 not found");
     }
+    type_id index_type = mem0_index_type(mod);
     // TODO: check the offset against the limits
 #define MEM_LOAD(dst_type)                                      \
     {                                                           \
         if (align > sizeof(dst_type)) {                         \
             return err(e_invalid, "Invalid alignment");         \
         }                                                       \
-        unwrap_drop(type_id, pop_val_expect(TYPE_ID_i32, ctx)); \
+        unwrap_drop(type_id, pop_val_expect(index_type, ctx));  \
         check(push_val(TYPE_ID_##dst_type, ctx));               \
         break;                                                  \
     }
@@ -660,7 +763,7 @@ static r validator_on_memory_load_store(void * payload, wasm_opcode opcode, stre
             return err(e_invalid, "Invalid alignment");                \
         }                                                              \
         unwrap_drop(type_id, pop_val_expect(TYPE_ID_##src_type, ctx)); \
-        unwrap_drop(type_id, pop_val_expect(TYPE_ID_i32, ctx));        \
+        unwrap_drop(type_id, pop_val_expect(index_type, ctx));         \
         break;                                                         \
     }
 
@@ -706,15 +809,16 @@ static r validator_on_memory_load_store(void * payload, wasm_opcode opcode, stre
 static r validator_on_memory_size(void * payload, wasm_opcode opcode, stream imm) {
     check_prep(r);
     validator_context * ctx = (validator_context *)payload;
-    check(push_val(TYPE_ID_i32, ctx));
+    check(push_val(mem0_index_type(ctx->mod), ctx));
     return ok_r;
 }
 
 static r validator_on_memory_grow(void * payload, wasm_opcode opcode, stream imm) {
     check_prep(r);
     validator_context * ctx = (validator_context *)payload;
-    unwrap_drop(type_id, pop_val_expect(TYPE_ID_i32, ctx));
-    check(push_val(TYPE_ID_i32, ctx));
+    type_id index_type = mem0_index_type(ctx->mod);
+    unwrap_drop(type_id, pop_val_expect(index_type, ctx));
+    check(push_val(index_type, ctx));
     return ok_r;
 }
 
@@ -1071,9 +1175,9 @@ static r validator_on_opcode_fc(void * payload, wasm_opcode_fc opcode, stream im
     module * mod = ctx->mod;
     const char * op_name = get_op_fc_name(opcode);
     u32 local_count = ctx->f->local_count;
-    u32 stack_height = (u32)vec_size_type_id(&ctx->val_stack);
+    u32 stack_height = (u32)svec_size_type_id(&ctx->val_stack);
     u32 op_offset = (u32)(imm.p - mod->wasm_bin.s.ptr - 1);
-    u32 ctrl_frames = (u32)vec_size_ctrl_frame(&ctx->ctrl_stack) - 1;
+    u32 ctrl_frames = (u32)svec_size_ctrl_frame(&ctx->ctrl_stack) - 1;
     LOGI("%08x locals:%-3u stack:%-3u |%*s%s", op_offset, local_count, stack_height, ctrl_frames * 2, "", op_name);
 #endif // LOG_INFO_ENABLED
     return ok_r;
@@ -1111,9 +1215,10 @@ static r validator_on_memory_init(void * payload, stream imm, u32 data_idx) {
     if (!vec_size_memory(&mod->memories)) {
         return err(e_invalid, "mem0 not found");
     }
+    // the source offset and the size index into the data segment.
     unwrap_drop(type_id, pop_val_expect(TYPE_ID_i32, ctx));
     unwrap_drop(type_id, pop_val_expect(TYPE_ID_i32, ctx));
-    unwrap_drop(type_id, pop_val_expect(TYPE_ID_i32, ctx));
+    unwrap_drop(type_id, pop_val_expect(mem0_index_type(mod), ctx));
     return ok_r;
 }
 
@@ -1124,14 +1229,26 @@ static r validator_on_memory_copy(void * payload, wasm_opcode_fc opcode, stream
     if (!vec_size_memory(&mod->memories)) {
         return err(e_invalid, "mem0 not found");
     }
-    unwrap_drop(type_id, pop_val_expect(TYPE_ID_i32, ctx));
-    unwrap_drop(type_id, pop_val_expect(TYPE_ID_i32, ctx));
-    unwrap_drop(type_id, pop_val_expect(TYPE_ID_i32, ctx));
+    type_id index_type = mem0_index_type(mod);
+    unwrap_drop(type_id, pop_val_expect(index_type, ctx));
+    unwrap_drop(type_id, pop_val_expect(index_type, ctx));
+    unwrap_drop(type_id, pop_val_expect(index_type, ctx));
     return ok_r;
 }
 
-// same impl
-#define validator_on_memory_fill validator_on_memory_copy
+static r validator_on_memory_fill(void * payload, wasm_opcode_fc opcode, stream imm) {
+    check_prep(r);
+    validator_context * ctx = (validator_context *)payload;
+    module * mod = ctx->mod;
+    if (!vec_size_memory(&mod->memories)) {
+        return err(e_invalid, "mem0 not found");
+    }
+    type_id index_type = mem0_index_type(mod);
+    unwrap_drop(type_id, pop_val_expect(index_type, ctx));
+    unwrap_drop(type_id, pop_val_expect(TYPE_ID_i32, ctx));
+    unwrap_drop(type_id, pop_val_expect(index_type, ctx));
+    return ok_r;
+}
 
 static r validator_on_data_drop(void * payload, stream imm, u32 data_idx) {
     check_prep(r);
@@ -1233,8 +1350,554 @@ static r validator_on_table_fill(void * payload, stream imm, u32 table_idx) {
 }
 
 static r validator_on_opcode_fd(void * payload, wasm_opcode_fd opcode, stream imm) {
+#if !SILVERFIR_ENABLE_SIMD
+    check_prep(r);
+    return err(e_invalid, "SIMD instructions are disabled");
+#else
+#ifdef LOG_INFO_ENABLED
+    validator_context * ctx = (validator_context *)payload;
+    module * mod = ctx->mod;
+    const char * op_name = get_op_fd_name(opcode);
+    u32 local_count = ctx->f->local_count;
+    u32 stack_height = (u32)svec_size_type_id(&ctx->val_stack);
+    u32 op_offset = (u32)(imm.p - mod->wasm_bin.s.ptr - 1);
+    u32 ctrl_frames = (u32)svec_size_ctrl_frame(&ctx->ctrl_stack) - 1;
+    LOGI("%08x locals:%-3u stack:%-3u |%*s%s", op_offset, local_count, stack_height, ctrl_frames * 2, "", op_name);
+#endif // LOG_INFO_ENABLED
+    return ok_r;
+#endif
+}
+
+#if SILVERFIR_ENABLE_SIMD
+
+static r validator_on_simd_memory(void * payload, wasm_opcode_fd opcode, stream imm, u8 align, u64 offset) {
+    check_prep(r);
+    validator_context * ctx = (validator_context *)payload;
+    module * mod = ctx->mod;
+    if (!vec_size_memory(&mod->memories)) {
+        return err(e_invalid, "mem0 not found");
+    }
+    // the alignment must not be larger than the number of bytes accessed.
+    u8 max_align;
+    switch (opcode) {
+        case op_v128_load:
+        case op_v128_store:
+            max_align = 4;
+            break;
+        case op_v128_load8_splat:
+            max_align = 0;
+            break;
+        case op_v128_load16_splat:
+            max_align = 1;
+            break;
+        case op_v128_load32_splat:
+        case op_v128_load32_zero:
+            max_align = 2;
+            break;
+        default: // the extending loads, load64_splat and load64_zero
+            max_align = 3;
+            break;
+    }
+    if (align > max_align) {
+        return err(e_invalid, "Invalid alignment");
+    }
+    if (opcode == op_v128_store) {
+        unwrap_drop(type_id, pop_val_expect(TYPE_ID_v128, ctx));
+        unwrap_drop(type_id, pop_val_expect(mem0_index_type(mod), ctx));
+    } else {
+        unwrap_drop(type_id, pop_val_expect(mem0_index_type(mod), ctx));
+        check(push_val(TYPE_ID_v128, ctx));
+    }
+    return ok_r;
+}
+
+static r validator_on_simd_memory_lane(void * payload, wasm_opcode_fd opcode, stream imm, u8 align, u64 offset, u8 lane) {
+    check_prep(r);
+    validator_context * ctx = (validator_context *)payload;
+    module * mod = ctx->mod;
+    if (!vec_size_memory(&mod->memories)) {
+        return err(e_invalid, "mem0 not found");
+    }
+    // load8_lane ... load64_lane and then store8_lane ... store64_lane
+    bool is_load = opcode <= op_v128_load64_lane;
+    u8 log2_size = (u8)((opcode - op_v128_load8_lane) % 4);
+    if (align > log2_size) {
+        return err(e_invalid, "Invalid alignment");
+    }
+    if (lane >= (16 >> log2_size)) {
+        return err(e_invalid, "Invalid lane index");
+    }
+    unwrap_drop(type_id, pop_val_expect(TYPE_ID_v128, ctx));
+    unwrap_drop(type_id, pop_val_expect(mem0_index_type(mod), ctx));
+    if (is_load) {
+        check(push_val(TYPE_ID_v128, ctx));
+    }
+    return ok_r;
+}
+
+static r validator_on_v128_const(void * payload, wasm_opcode_fd opcode, stream imm, const u8 * bytes) {
     check_prep(r);
-    return err(e_invalid, "prefix_fd opcodes is not supported yet");
+    validator_context * ctx = (validator_context *)payload;
+    check(push_val(TYPE_ID_v128, ctx));
+    return ok_r;
+}
+
+static r validator_on_i8x16_shuffle(void * payload, wasm_opcode_fd opcode, stream imm, const u8 * bytes) {
+    check_prep(r);
+    validator_context * ctx = (validator_context *)payload;
+    for (u32 i = 0; i < 16; i++) {
+        if (bytes[i] >= 32) {
+            return err(e_invalid, "Invalid lane index");
+        }
+    }
+    unwrap_drop(type_id, pop_val_expect(TYPE_ID_v128, ctx));
+    unwrap_drop(type_id, pop_val_expect(TYPE_ID_v128, ctx));
+    check(push_val(TYPE_ID_v128, ctx));
+    return ok_r;
+}
+
+static r validator_on_simd_lane(void * payload, wasm_opcode_fd opcode, stream imm, u8 lane) {
+    check_prep(r);
+    validator_context * ctx = (validator_context *)payload;
+    u8 lanes;
+    type_id scalar;
+    bool replace;
+    switch (opcode) {
+        case op_i8x16_extract_lane_s:
+        case op_i8x16_extract_lane_u:
+        case op_i8x16_replace_lane:
+            lanes = 16, scalar = TYPE_ID_i32, replace = (opcode == op_i8x16_replace_lane);
+            break;
+        case op_i16x8_extract_lane_s:
+        case op_i16x8_extract_lane_u:
+        case op_i16x8_replace_lane:
+            lanes = 8, scalar = TYPE_ID_i32, replace = (opcode == op_i16x8_replace_lane);
+            break;
+        case op_i32x4_extract_lane:
+        case op_i32x4_replace_lane:
+            lanes = 4, scalar = TYPE_ID_i32, replace = (opcode == op_i32x4_replace_lane);
+            break;
+        case op_i64x2_extract_lane:
+        case op_i64x2_replace_lane:
+            lanes = 2, scalar = TYPE_ID_i64, replace = (opcode == op_i64x2_replace_lane);
+            break;
+        case op_f32x4_extract_lane:
+        case op_f32x4_replace_lane:
+            lanes = 4, scalar = TYPE_ID_f32, replace = (opcode == op_f32x4_replace_lane);
+            break;
+        default: // f64x2
+            lanes = 2, scalar = TYPE_ID_f64, replace = (opcode == op_f64x2_replace_lane);
+            break;
+    }
+    if (lane >= lanes) {
+        return err(e_invalid, "Invalid lane index");
+    }
+    if (replace) {
+        unwrap_drop(type_id, pop_val_expect(scalar, ctx));
+        unwrap_drop(type_id, pop_val_expect(TYPE_ID_v128, ctx));
+        check(push_val(TYPE_ID_v128, ctx));
+    } else {
+        unwrap_drop(type_id, pop_val_expect(TYPE_ID_v128, ctx));
+        check(push_val(scalar, ctx));
+    }
+    return ok_r;
+}
+
+// all the instructions without immediates.
+static r validator_on_simd(void * payload, wasm_opcode_fd opcode, stream imm) {
+    switch (opcode) {
+        case op_i8x16_splat:
+        case op_i16x8_splat:
+        case op_i32x4_splat:
+            POP1_PUSH(i32, v128);
+        case op_i64x2_splat:
+            POP1_PUSH(i64, v128);
+        case op_f32x4_splat:
+            POP1_PUSH(f32, v128);
+        case op_f64x2_splat:
+            POP1_PUSH(f64, v128);
+        case op_v128_any_true:
+        case op_i8x16_all_true:
+        case op_i8x16_bitmask:
+        case op_i16x8_all_true:
+        case op_i16x8_bitmask:
+        case op_i32x4_all_true:
+        case op_i32x4_bitmask:
+        case op_i64x2_all_true:
+        case op_i64x2_bitmask:
+            POP1_PUSH(v128, i32);
+        case op_i8x16_shl:
+        case op_i8x16_shr_s:
+        case op_i8x16_shr_u:
+        case op_i16x8_shl:
+        case op_i16x8_shr_s:
+        case op_i16x8_shr_u:
+        case op_i32x4_shl:
+        case op_i32x4_shr_s:
+        case op_i32x4_shr_u:
+        case op_i64x2_shl:
+        case op_i64x2_shr_s:
+        case op_i64x2_shr_u: {
+            check_prep(r);
+            validator_context * ctx = (validator_context *)payload;
+            unwrap_drop(type_id, pop_val_expect(TYPE_ID_i32, ctx));
+            unwrap_drop(type_id, pop_val_expect(TYPE_ID_v128, ctx));
+            check(push_val(TYPE_ID_v128, ctx));
+            return ok_r;
+        }
+        case op_v128_bitselect: {
+            check_prep(r);
+            validator_context * ctx = (validator_context *)payload;
+            unwrap_drop(type_id, pop_val_expect(TYPE_ID_v128, ctx));
+            unwrap_drop(type_id, pop_val_expect(TYPE_ID_v128, ctx));
+            unwrap_drop(type_id, pop_val_expect(TYPE_ID_v128, ctx));
+            check(push_val(TYPE_ID_v128, ctx));
+            return ok_r;
+        }
+        // unary
+        case op_v128_not:
+        case op_f32x4_demote_f64x2_zero:
+        case op_f64x2_promote_low_f32x4:
+        case op_i8x16_abs:
+        case op_i8x16_neg:
+        case op_i8x16_popcnt:
+        case op_f32x4_ceil:
+        case op_f32x4_floor:
+        case op_f32x4_trunc:
+        case op_f32x4_nearest:
+        case op_f64x2_ceil:
+        case op_f64x2_floor:
+        case op_f64x2_trunc:
+        case op_f64x2_nearest:
+        case op_i16x8_extadd_pairwise_i8x16_s:
+        case op_i16x8_extadd_pairwise_i8x16_u:
+        case op_i32x4_extadd_pairwise_i16x8_s:
+        case op_i32x4_extadd_pairwise_i16x8_u:
+        case op_i16x8_abs:
+        case op_i16x8_neg:
+        case op_i16x8_extend_low_i8x16_s:
+        case op_i16x8_extend_high_i8x16_s:
+        case op_i16x8_extend_low_i8x16_u:
+        case op_i16x8_extend_high_i8x16_u:
+        case op_i32x4_abs:
+        case op_i32x4_neg:
+        case op_i32x4_extend_low_i16x8_s:
+        case op_i32x4_extend_high_i16x8_s:
+        case op_i32x4_extend_low_i16x8_u:
+        case op_i32x4_extend_high_i16x8_u:
+        case op_i64x2_abs:
+        case op_i64x2_neg:
+        case op_i64x2_extend_low_i32x4_s:
+        case op_i64x2_extend_high_i32x4_s:
+        case op_i64x2_extend_low_i32x4_u:
+        case op_i64x2_extend_high_i32x4_u:
+        case op_f32x4_abs:
+        case op_f32x4_neg:
+        case op_f32x4_sqrt:
+        case op_f64x2_abs:
+        case op_f64x2_neg:
+        case op_f64x2_sqrt:
+        case op_i32x4_trunc_sat_f32x4_s:
+        case op_i32x4_trunc_sat_f32x4_u:
+        case op_f32x4_convert_i32x4_s:
+        case op_f32x4_convert_i32x4_u:
+        case op_i32x4_trunc_sat_f64x2_s_zero:
+        case op_i32x4_trunc_sat_f64x2_u_zero:
+        case op_f64x2_convert_low_i32x4_s:
+        case op_f64x2_convert_low_i32x4_u:
+            POP1_PUSH(v128, v128);
+        // binary
+        case op_i8x16_swizzle:
+        case op_i8x16_eq:
+        case op_i8x16_ne:
+        case op_i8x16_lt_s:
+        case op_i8x16_lt_u:
+        case op_i8x16_gt_s:
+        case op_i8x16_gt_u:
+        case op_i8x16_le_s:
+        case op_i8x16_le_u:
+        case op_i8x16_ge_s:
+        case op_i8x16_ge_u:
+        case op_i16x8_eq:
+        case op_i16x8_ne:
+        case op_i16x8_lt_s:
+        case op_i16x8_lt_u:
+        case op_i16x8_gt_s:
+        case op_i16x8_gt_u:
+        case op_i16x8_le_s:
+        case op_i16x8_le_u:
+        case op_i16x8_ge_s:
+        case op_i16x8_ge_u:
+        case op_i32x4_eq:
+        case op_i32x4_ne:
+        case op_i32x4_lt_s:
+        case op_i32x4_lt_u:
+        case op_i32x4_gt_s:
+        case op_i32x4_gt_u:
+        case op_i32x4_le_s:
+        case op_i32x4_le_u:
+        case op_i32x4_ge_s:
+        case op_i32x4_ge_u:
+        case op_f32x4_eq:
+        case op_f32x4_ne:
+        case op_f32x4_lt:
+        case op_f32x4_gt:
+        case op_f32x4_le:
+        case op_f32x4_ge:
+        case op_f64x2_eq:
+        case op_f64x2_ne:
+        case op_f64x2_lt:
+        case op_f64x2_gt:
+        case op_f64x2_le:
+        case op_f64x2_ge:
+        case op_v128_and:
+        case op_v128_andnot:
+        case op_v128_or:
+        case op_v128_xor:
+        case op_i8x16_narrow_i16x8_s:
+        case op_i8x16_narrow_i16x8_u:
+        case op_i8x16_add:
+        case op_i8x16_add_sat_s:
+        case op_i8x16_add_sat_u:
+        case op_i8x16_sub:
+        case op_i8x16_sub_sat_s:
+        case op_i8x16_sub_sat_u:
+        case op_i8x16_min_s:
+        case op_i8x16_min_u:
+        case op_i8x16_max_s:
+        case op_i8x16_max_u:
+        case op_i8x16_avgr_u:
+        case op_i16x8_q15mulr_sat_s:
+        case op_i16x8_narrow_i32x4_s:
+        case op_i16x8_narrow_i32x4_u:
+        case op_i16x8_add:
+        case op_i16x8_add_sat_s:
+        case op_i16x8_add_sat_u:
+        case op_i16x8_sub:
+        case op_i16x8_sub_sat_s:
+        case op_i16x8_sub_sat_u:
+        case op_i16x8_mul:
+        case op_i16x8_min_s:
+        case op_i16x8_min_u:
+        case op_i16x8_max_s:
+        case op_i16x8_max_u:
+        case op_i16x8_avgr_u:
+        case op_i16x8_extmul_low_i8x16_s:
+        case op_i16x8_extmul_high_i8x16_s:
+        case op_i16x8_extmul_low_i8x16_u:
+        case op_i16x8_extmul_high_i8x16_u:
+        case op_i32x4_add:
+        case op_i32x4_sub:
+        case op_i32x4_mul:
+        case op_i32x4_min_s:
+        case op_i32x4_min_u:
+        case op_i32x4_max_s:
+        case op_i32x4_max_u:
+        case op_i32x4_dot_i16x8_s:
+        case op_i32x4_extmul_low_i16x8_s:
+        case op_i32x4_extmul_high_i16x8_s:
+        case op_i32x4_extmul_low_i16x8_u:
+        case op_i32x4_extmul_high_i16x8_u:
+        case op_i64x2_add:
+        case op_i64x2_sub:
+        case op_i64x2_mul:
+        case op_i64x2_eq:
+        case op_i64x2_ne:
+        case op_i64x2_lt_s:
+        case op_i64x2_gt_s:
+        case op_i64x2_le_s:
+        case op_i64x2_ge_s:
+        case op_i64x2_extmul_low_i32x4_s:
+        case op_i64x2_extmul_high_i32x4_s:
+        case op_i64x2_extmul_low_i32x4_u:
+        case op_i64x2_extmul_high_i32x4_u:
+        case op_f32x4_add:
+        case op_f32x4_sub:
+        case op_f32x4_mul:
+        case op_f32x4_div:
+        case op_f32x4_min:
+        case op_f32x4_max:
+        case op_f32x4_pmin:
+        case op_f32x4_pmax:
+        case op_f64x2_add:
+        case op_f64x2_sub:
+        case op_f64x2_mul:
+        case op_f64x2_div:
+        case op_f64x2_min:
+        case op_f64x2_max:
+        case op_f64x2_pmin:
+        case op_f64x2_pmax:
+            POP2_PUSH(v128, v128);
+        default: {
+            check_prep(r);
+            return err(e_malformed, "Invalid opcode");
+        }
+    }
+}
+
+#endif // SILVERFIR_ENABLE_SIMD
+
+static r validator_on_opcode_fe(void * payload, wasm_opcode_fe opcode, stream imm) {
+#ifdef LOG_INFO_ENABLED
+    validator_context * ctx = (validator_context *)payload;
+    module * mod = ctx->mod;
+    const char * op_name = get_op_fe_name(opcode);
+    u32 local_count = ctx->f->local_count;
+    u32 stack_height = (u32)svec_size_type_id(&ctx->val_stack);
+    u32 op_offset = (u32)(imm.p - mod->wasm_bin.s.ptr - 1);
+    u32 ctrl_frames = (u32)svec_size_ctrl_frame(&ctx->ctrl_stack) - 1;
+    LOGI("%08x locals:%-3u stack:%-3u |%*s%s", op_offset, local_count, stack_height, ctrl_frames * 2, "", op_name);
+#endif // LOG_INFO_ENABLED
+    return ok_r;
+}
+
+static r validator_on_atomic_memory(void * payload, wasm_opcode_fe opcode, stream imm, u8 align, u64 offset) {
+    check_prep(r);
+    validator_context * ctx = (validator_context *)payload;
+    module * mod = ctx->mod;
+#if !SILVERFIR_ENABLE_THREADS
+    return err(e_invalid, "Atomic instructions are disabled");
+#endif
+    if (!vec_size_memory(&mod->memories)) {
+        return err(e_invalid, "mem0 not found");
+    }
+    type_id index_type = mem0_index_type(mod);
+    // unlike the regular loads and stores, atomic accesses must be naturally aligned.
+#define ATOMIC_ALIGN(log2_size)                                   \
+    if (align != (log2_size)) {                                   \
+        return err(e_invalid, "Invalid atomic alignment");        \
+    }
+#define ATOMIC_LOAD(type, log2_size)                            \
+    {                                                           \
+        ATOMIC_ALIGN(log2_size);                                \
+        unwrap_drop(type_id, pop_val_expect(index_type, ctx));  \
+        check(push_val(TYPE_ID_##type, ctx));                   \
+        break;                                                  \
+    }
+#define ATOMIC_STORE(type, log2_size)                            \
+    {                                                            \
+        ATOMIC_ALIGN(log2_size);                                 \
+        unwrap_drop(type_id, pop_val_expect(TYPE_ID_##type, ctx)); \
+        unwrap_drop(type_id, pop_val_expect(index_type, ctx));   \
+        break;                                                   \
+    }
+#define ATOMIC_RMW(type, log2_size)                              \
+    {                                                            \
+        ATOMIC_ALIGN(log2_size);                                 \
+        unwrap_drop(type_id, pop_val_expect(TYPE_ID_##type, ctx)); \
+        unwrap_drop(type_id, pop_val_expect(index_type, ctx));   \
+        check(push_val(TYPE_ID_##type, ctx));                    \
+        break;                                                   \
+    }
+#define ATOMIC_CMPXCHG(type, log2_size)                          \
+    {                                                            \
+        ATOMIC_ALIGN(log2_size);                                 \
+        unwrap_drop(type_id, pop_val_expect(TYPE_ID_##type, ctx)); \
+        unwrap_drop(type_id, pop_val_expect(TYPE_ID_##type, ctx)); \
+        unwrap_drop(type_id, pop_val_expect(index_type, ctx));   \
+        check(push_val(TYPE_ID_##type, ctx));                    \
+        break;                                                   \
+    }
+#define ATOMIC_RMW_GROUP(name)                  \
+    case op_i32_atomic_rmw_##name:              \
+        ATOMIC_RMW(i32, 2);                     \
+    case op_i64_atomic_rmw_##name:              \
+        ATOMIC_RMW(i64, 3);                     \
+    case op_i32_atomic_rmw8_##name##_u:         \
+        ATOMIC_RMW(i32, 0);                     \
+    case op_i32_atomic_rmw16_##name##_u:        \
+        ATOMIC_RMW(i32, 1);                     \
+    case op_i64_atomic_rmw8_##name##_u:         \
+        ATOMIC_RMW(i64, 0);                     \
+    case op_i64_atomic_rmw16_##name##_u:        \
+        ATOMIC_RMW(i64, 1);                     \
+    case op_i64_atomic_rmw32_##name##_u:        \
+        ATOMIC_RMW(i64, 2);
+
+    switch (opcode) {
+        case op_memory_atomic_notify:
+            ATOMIC_RMW(i32, 2);
+        case op_memory_atomic_wait32:
+            ATOMIC_ALIGN(2);
+            unwrap_drop(type_id, pop_val_expect(TYPE_ID_i64, ctx));
+            unwrap_drop(type_id, pop_val_expect(TYPE_ID_i32, ctx));
+            unwrap_drop(type_id, pop_val_expect(index_type, ctx));
+            check(push_val(TYPE_ID_i32, ctx));
+            break;
+        case op_memory_atomic_wait64:
+            ATOMIC_ALIGN(3);
+            unwrap_drop(type_id, pop_val_expect(TYPE_ID_i64, ctx));
+            unwrap_drop(type_id, pop_val_expect(TYPE_ID_i64, ctx));
+            unwrap_drop(type_id, pop_val_expect(index_type, ctx));
+            check(push_val(TYPE_ID_i32, ctx));
+            break;
+        case op_i32_atomic_load:
+            ATOMIC_LOAD(i32, 2);
+        case op_i64_atomic_load:
+            ATOMIC_LOAD(i64, 3);
+        case op_i32_atomic_load8_u:
+            ATOMIC_LOAD(i32, 0);
+        case op_i32_atomic_load16_u:
+            ATOMIC_LOAD(i32, 1);
+        case op_i64_atomic_load8_u:
+            ATOMIC_LOAD(i64, 0);
+        case op_i64_atomic_load16_u:
+            ATOMIC_LOAD(i64, 1);
+        case op_i64_atomic_load32_u:
+            ATOMIC_LOAD(i64, 2);
+        case op_i32_atomic_store:
+            ATOMIC_STORE(i32, 2);
+        case op_i64_atomic_store:
+            ATOMIC_STORE(i64, 3);
+        case op_i32_atomic_store8:
+            ATOMIC_STORE(i32, 0);
+        case op_i32_atomic_store16:
+            ATOMIC_STORE(i32, 1);
+        case op_i64_atomic_store8:
+            ATOMIC_STORE(i64, 0);
+        case op_i64_atomic_store16:
+            ATOMIC_STORE(i64, 1);
+        case op_i64_atomic_store32:
+            ATOMIC_STORE(i64, 2);
+        ATOMIC_RMW_GROUP(add)
+        ATOMIC_RMW_GROUP(sub)
+        ATOMIC_RMW_GROUP(and)
+        ATOMIC_RMW_GROUP(or)
+        ATOMIC_RMW_GROUP(xor)
+        ATOMIC_RMW_GROUP(xchg)
+        case op_i32_atomic_rmw_cmpxchg:
+            ATOMIC_CMPXCHG(i32, 2);
+        case op_i64_atomic_rmw_cmpxchg:
+            ATOMIC_CMPXCHG(i64, 3);
+        case op_i32_atomic_rmw8_cmpxchg_u:
+            ATOMIC_CMPXCHG(i32, 0);
+        case op_i32_atomic_rmw16_cmpxchg_u:
+            ATOMIC_CMPXCHG(i32, 1);
+        case op_i64_atomic_rmw8_cmpxchg_u:
+            ATOMIC_CMPXCHG(i64, 0);
+        case op_i64_atomic_rmw16_cmpxchg_u:
+            ATOMIC_CMPXCHG(i64, 1);
+        case op_i64_atomic_rmw32_cmpxchg_u:
+            ATOMIC_CMPXCHG(i64, 2);
+        default:
+            return err(e_invalid, "Unsupported opcode");
+    }
+#undef ATOMIC_RMW_GROUP
+#undef ATOMIC_CMPXCHG
+#undef ATOMIC_RMW
+#undef ATOMIC_STORE
+#undef ATOMIC_LOAD
+#undef ATOMIC_ALIGN
+    return ok_r;
+}
+
+static r validator_on_atomic_fence(void * payload, wasm_opcode_fe opcode, stream imm) {
+#if !SILVERFIR_ENABLE_THREADS
+    check_prep(r);
+    return err(e_invalid, "Atomic instructions are disabled");
+#else
+    return ok_r;
+#endif
 }
 
 static r validator_on_decode_end(void * payload) {
@@ -1244,31 +1907,16 @@ static r validator_on_decode_end(void * payload) {
 
     LOGI("%s", "validator end");
 
-    // Link the jump table. TODO: optimize it
+    // The jump table is already linked while the slots are patched, except for those
+    // pointing past the last slot.
     check(vec_shrink_to_fit_jump_table(jt));
-    for (u32 i = 0; i < vec_size_jump_table(jt); i++) {
-        jump_table * slot = vec_at_jump_table(jt, i);
-        if (slot->target_offset > 0) {
-            for (u32 j = i + 1; j < vec_size_jump_table(jt); j++) {
-                jump_table * next_slot = vec_at_jump_table(jt, j);
-                if (next_slot->pc > (slot->pc + slot->target_offset)) {
-                    slot->next_idx = (u16)j;
-                    break;
-                } else {
-                    continue;
-                }
-            }
-            continue;
-        } else {
-            for (i32 j = i; j >= 0; j--) {
-                jump_table * next_slot = vec_at_jump_table(jt, j);
-                if (next_slot->pc > (slot->pc + slot->target_offset)) {
-                    slot->next_idx = (u16)j;
-                } else {
-                    break;
-                }
-            }
-            continue;
+    check(vec_shrink_to_fit_jump_table_escape(&ctx->f->jt_escapes));
+#if SILVERFIR_STACK_SLOT_32
+    check(vec_shrink_to_fit_u8(&ctx->f->wide_operands));
+#endif
+    VEC_FOR_EACH(jt, jump_table, slot) {
+        if (slot->next_idx == vec_size_jump_table(jt)) {
+            slot->next_idx = JUMP_TABLE_IDX_INVALID;
         }
     }
 
@@ -1281,9 +1929,12 @@ static r validator_on_decode_end(void * payload) {
             LOGI("%s", "Jump table:");
             for (u32 i = 0; i < vec_size_jump_table(jt); i++) {
                 jump_table * tbl_item = vec_at_jump_table(jt, i);
-                u32 opcode_offset = (u32)(code.ptr - mod->wasm_bin.s.ptr + tbl_item->pc);
-                u32 target_offset = opcode_offset + tbl_item->target_offset;
-                LOGI("[%u] PC:%06X  TGT:%06X  Arity:%d   StackOffset:%d   Next:%d", i, opcode_offset, target_offset, tbl_item->arity, tbl_item->stack_offset, tbl_item->next_idx);
+                jump_table_escape offsets = jump_table_decode(tbl_item, ctx->f->jt_escapes._data);
+                // relative to the function if the code is decompressed.
+                size_t code_base = mod->code_cache ? 0 : (size_t)(code.ptr - mod->wasm_bin.s.ptr);
+                u32 opcode_offset = (u32)(code_base + *vec_at_u32(&ctx->jt_pcs, i));
+                u32 target_offset = opcode_offset + offsets.target_offset;
+                LOGI("[%u] PC:%06X  TGT:%06X  Arity:%d   StackOffset:%u   Next:%d", i, opcode_offset, target_offset, tbl_item->arity, offsets.stack_offset, tbl_item->next_idx);
             }
         }
     }
@@ -1310,6 +1961,8 @@ static const op_decoder_callbacks validator_callbacks = {
     .on_return = validator_on_return,
     .on_call = validator_on_call,
     .on_call_indirect = validator_on_call_indirect,
+    .on_return_call = validator_on_return_call,
+    .on_return_call_indirect = validator_on_return_call_indirect,
     .on_drop = validator_on_drop,
     .on_select = validator_on_select,
     .on_select_t = validator_on_select_t,
@@ -1356,17 +2009,62 @@ static const op_decoder_callbacks validator_callbacks = {
     .on_table_size = validator_on_table_size,
     .on_table_fill = validator_on_table_fill,
     .on_opcode_fd = validator_on_opcode_fd,
+#if SILVERFIR_ENABLE_SIMD
+    .on_simd_memory = validator_on_simd_memory,
+    .on_simd_memory_lane = validator_on_simd_memory_lane,
+    .on_v128_const = validator_on_v128_const,
+    .on_i8x16_shuffle = validator_on_i8x16_shuffle,
+    .on_simd_lane = validator_on_simd_lane,
+    .on_simd = validator_on_simd,
+#endif
+    .on_opcode_fe = validator_on_opcode_fe,
+    .on_atomic_memory = validator_on_atomic_memory,
+    .on_atomic_fence = validator_on_atomic_fence,
     .on_decode_end = validator_on_decode_end,
 };
 
+// The validator runs on every function, so it gets its own decoder where the callbacks
+// are resolved at compile time instead of going through the function pointers.
+#define OP_DECODER_NAME validator_decode
+#define OP_DECODER_PARAMS , void * payload
+#define callback(name, ...)                               \
+    do {                                                  \
+        if (validator_callbacks.name) {                   \
+            check(validator_callbacks.name(__VA_ARGS__)); \
+        }                                                 \
+    } while (0)
+#include "op_decoder_impl.h"
+
 r validate_func(module * mod, func * f) {
     assert(mod);
     assert(f);
 
     validator_context ctx = {0};
     ctx.mod = mod;
-    ctx.f = f;
-    r ret = decode_function(mod, f, &validator_callbacks, &ctx);
+    validator_context_reset(&ctx, f);
+    r ret = validator_decode(mod, f, &ctx);
+
+    validator_context_drop(&ctx);
+
+    return ret;
+}
+
+r validate_module(module * mod) {
+    assert(mod);
+
+    validator_context ctx = {0};
+    ctx.mod = mod;
+    r ret = ok_r;
+    VEC_FOR_EACH(&mod->funcs, func, fn) {
+        if (fn->linkage & linkage_imported) {
+            continue;
+        }
+        validator_context_reset(&ctx, fn);
+        ret = validator_decode(mod, fn, &ctx);
+        if (!is_ok(ret)) {
+            break;
+        }
+    }
 
     validator_context_drop(&ctx);
 
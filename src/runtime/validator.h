@@ -36,14 +36,22 @@ typedef enum blocktype {
 typedef struct ctrl_frame {
     blocktype type;
     func_type ftype;
-    vec_type_id start_types;
-    vec_type_id end_types;
     size_t height;
+    u32 slot_height; // the height in slots, see value_slot.
     bool unreachable;
-    // used by constructing the jump table
-    vec_u32 pending_jt_slots;
+    // used by constructing the jump table. The pending slots of a frame are chained
+    // through the validator's jt_links, so the frame doesn't own any storage.
+    u32 pending_jt_head;
+    // the "if" slot jumps to the else block, so it's tracked separately.
+    u32 if_jt_slot;
+    // loop only. The first jump table slot inside of the loop body.
+    u32 loop_jt_slot;
     u32 pc;
 } ctrl_frame;
 RESULT_TYPE_DECL(ctrl_frame)
 
 r validate_func(module * mod, func * f);
+
+// Validate all the non-imported functions of the module. The validator's internal
+// stacks are shared between functions so that it won't allocate once they're warmed up.
+r validate_module(module * mod);
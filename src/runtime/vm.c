@@ -19,9 +19,11 @@
 #include "interpreter.h"
 #include "list_impl.h"
 #include "module.h"
-#include "validator.h"
+#include "shared_memory.h"
 #include "vec_impl.h"
 
+#include <stdlib.h>
+
 LIST_IMPL_FOR_TYPE(module_inst)
 LIST_IMPL_FOR_TYPE(vm)
 
@@ -33,11 +35,77 @@ VEC_IMPL_FOR_TYPE(memory_inst)
 VEC_IMPL_FOR_TYPE(mem_addr)
 VEC_IMPL_FOR_TYPE(global_inst)
 VEC_IMPL_FOR_TYPE(glob_addr)
+VEC_IMPL_FOR_TYPE(memory_snapshot)
+
+// All the fixed-size parts of a module instance, in the order they are placed in the storage
+// block. The address tables come first as they are the hottest ones.
+#define FOR_EACH_MODULE_INST_STORAGE(macro)                       \
+    macro(f_addrs, func_addr, vec_size_func(&mod->funcs))          \
+    macro(g_addrs, glob_addr, vec_size_global(&mod->globals))      \
+    macro(m_addrs, mem_addr, vec_size_memory(&mod->memories))      \
+    macro(t_addrs, tab_addr, vec_size_table(&mod->tables))         \
+    macro(globals, global_inst, vec_size_global(&mod->globals))    \
+    macro(funcs, func_inst, vec_size_func(&mod->funcs))            \
+    macro(memories, memory_inst, vec_size_memory(&mod->memories))  \
+    macro(tables, table_inst, vec_size_table(&mod->tables))        \
+    macro(dropped_elements, u8, vec_size_element(&mod->elements)) \
+    macro(dropped_data, u8, vec_size_data(&mod->data))
+
+#define MODULE_INST_STORAGE_ALIGN (sizeof(u64))
+
+// offsets of each part in the storage block.
+typedef struct module_inst_layout {
+#define LAYOUT_OFFSET_FIELD(field, type, count) size_t field;
+    FOR_EACH_MODULE_INST_STORAGE(LAYOUT_OFFSET_FIELD)
+#undef LAYOUT_OFFSET_FIELD
+    size_t size;
+} module_inst_layout;
+
+static module_inst_layout module_inst_layout_of(module * mod) {
+    module_inst_layout layout = {0};
+#define LAYOUT_PLACE_FIELD(field, type, count)                                                                              \
+    layout.size = (layout.size + MODULE_INST_STORAGE_ALIGN - 1) / MODULE_INST_STORAGE_ALIGN * MODULE_INST_STORAGE_ALIGN; \
+    layout.field = layout.size;                                                                                            \
+    layout.size += sizeof(type) * (count);
+    FOR_EACH_MODULE_INST_STORAGE(LAYOUT_PLACE_FIELD)
+#undef LAYOUT_PLACE_FIELD
+    return layout;
+}
+
+// The size a memory can grow to in place, which is reserved upfront when it's mapped.
+static u64 memory_capacity(memory * mem) {
+    u32 shift = memory_page_shift(mem);
+    u64 max_pages = mem->lim.max;
+    if (memory_is64(mem) && (max_pages > SILVERFIR_MEMORY64_RESERVE >> shift)) {
+        max_pages = SILVERFIR_MEMORY64_RESERVE >> shift;
+    }
+    return max_pages << shift;
+}
+
+// A mapped memory is already zero past its size, so it's resized without touching the pages.
+static r memory_inst_resize(memory_inst * mem_inst, u64 pages) {
+    check_prep(r);
+    u32 shift = memory_page_shift(mem_inst->mem);
+    if ((pages > MEMORY64_SIZE_LIMIT >> shift) || ((pages << shift) > SIZE_MAX)) {
+        return err(e_general, "Memory is too large");
+    }
+    size_t size = (size_t)(pages << shift);
+    vec_u8 * mdata = &mem_inst->mdata;
+    if (mem_inst->mapped && (size <= mdata->_capacity)) {
+        if (size < vec_size_u8(mdata)) {
+            memset(mdata->_data + size, 0, vec_size_u8(mdata) - size);
+        }
+        mdata->_size = size;
+        return ok_r;
+    }
+    return vec_resize_u8(mdata, size);
+}
 
-// This function must only do simply initializations like resize the vectors and such.
+// This function must only do simply initializations like setting up the vectors and such.
 // Any complicated initialization that might involve self-referencing pointers must be
 // done after the linking. Therefore, except for the OOM it's unlikely to fail.
-static r module_inst_new(module * mod, module_inst * mod_inst) {
+// The memories are left empty if alloc_memories is false, for those which will be replaced anyway.
+static r module_inst_new(module * mod, module_inst * mod_inst, bool alloc_memories) {
     assert(mod);
     assert(mod_inst);
     check_prep(r);
@@ -46,11 +114,27 @@ static r module_inst_new(module * mod, module_inst * mod_inst) {
     mod_inst->mod = mod;
 
     // increase the refcount
-    mod->ref_count++;
+    s_atomic_inc32(&mod->ref_count);
+
+    // one zero-initialized block for everything, the vectors are fixed views into it.
+    module_inst_layout layout = module_inst_layout_of(mod);
+    if (layout.size) {
+        mod_inst->storage = array_calloc(u8, layout.size);
+        if (!mod_inst->storage) {
+            return err(e_general, "Failed to allocate the module instance");
+        }
+    }
+#define LAYOUT_BIND_FIELD(field, type, count)                                                   \
+    mod_inst->field = (vec_##type){                                                             \
+        ._size = (count),                                                                       \
+        ._capacity = (count),                                                                   \
+        ._data = (count) ? (type *)(mod_inst->storage + layout.field) : NULL,                   \
+        .fixed = true,                                                                          \
+    };
+    FOR_EACH_MODULE_INST_STORAGE(LAYOUT_BIND_FIELD)
+#undef LAYOUT_BIND_FIELD
 
     // we will leave the actual func_inst data filling to the linking stage.
-    check(vec_resize_func_inst(&mod_inst->funcs, vec_size_func(&mod->funcs)));
-    vec_set_fixed(&mod_inst->funcs, true);
     for (size_t i = 0; i < vec_size_func(&mod->funcs); i++) {
         func_addr f_inst = vec_at_func_inst(&mod_inst->funcs, i);
         func * fn = vec_at_func(&mod->funcs, i);
@@ -61,14 +145,12 @@ static r module_inst_new(module * mod, module_inst * mod_inst) {
     }
 
     // table contents will be initialized with element section.
-    check(vec_resize_table_inst(&mod_inst->tables, vec_size_table(&mod->tables)));
-    vec_set_fixed(&mod_inst->tables, true);
     for (size_t i = 0; i < vec_size_table(&mod->tables); i++) {
         tab_addr tab_inst = vec_at_table_inst(&mod_inst->tables, i);
         table * tab = vec_at_table(&mod->tables, i);
         tab_inst->tab = tab;
         if (i >= mod->imported_table_count) {
-            vec_resize_ref(&tab_inst->tdata, tab->lim.min);
+            check(vec_resize_ref(&tab_inst->tdata, tab->lim.min));
             // nullref is not zero, so it needs to be explicitly initialized.
             VEC_FOR_EACH(&tab_inst->tdata, ref, iter) {
                 *iter = nullref;
@@ -77,200 +159,307 @@ static r module_inst_new(module * mod, module_inst * mod_inst) {
     }
 
     // memory will be initialized with data section.
-    check(vec_resize_memory_inst(&mod_inst->memories, vec_size_memory(&mod->memories)));
-    vec_set_fixed(&mod_inst->memories, true);
     for (size_t i = 0; i < vec_size_memory(&mod->memories); i++) {
         mem_addr mem_inst = vec_at_memory_inst(&mod_inst->memories, i);
         memory * mem = vec_at_memory(&mod->memories, i);
         mem_inst->mem = mem;
+        // the shared ones are linked to the memory shared by all the instances of the module.
+        if (i >= mod->imported_mem_count && mem->lim.shared) {
+            unwrap(shared_memory_ptr, sm, shared_memory_get(mem));
+            mem_inst->shared = sm;
+            continue;
+        }
         // zero initialize the non-imported modules.
-        if (i >= mod->imported_mem_count) {
-            vec_resize_u8(&mem_inst->mdata, mem->lim.min * WASM_PAGE_SIZE);
+        if (i >= mod->imported_mem_count && alloc_memories) {
+            // the 64-bit ones grow in place in a reservation, if the address space can be reserved.
+            u64 capacity = memory_capacity(mem);
+            if (memory_is64(mem) && (capacity <= SIZE_MAX) && is_ok(mem_image_reserve((size_t)capacity, &mem_inst->mdata))) {
+                mem_inst->mapped = true;
+            }
+            check(memory_inst_resize(mem_inst, mem->lim.min));
         }
     }
     // glob
-    check(vec_resize_global_inst(&mod_inst->globals, vec_size_global(&mod->globals)));
-    vec_set_fixed(&mod_inst->globals, true);
     for (size_t i = 0; i < vec_size_global(&mod->globals); i++) {
         glob_addr glob_inst = vec_at_global_inst(&mod_inst->globals, i);
         global * glob = vec_at_global(&mod->globals, i);
         glob_inst->glob = glob;
     }
 
-    check(vec_resize_u8(&mod_inst->dropped_elements, vec_size_element(&mod->elements)));
-    vec_set_fixed(&mod_inst->dropped_elements, true);
-    check(vec_resize_u8(&mod_inst->dropped_data, vec_size_data(&mod->data)));
-    vec_set_fixed(&mod_inst->dropped_data, true);
+    return ok_r;
+}
 
-    // Initialize the tables for linking
-    vec_resize_func_addr(&mod_inst->f_addrs, vec_size_func(&mod->funcs));
-    vec_set_fixed(&mod_inst->f_addrs, true);
-    vec_resize_mem_addr(&mod_inst->m_addrs, vec_size_memory(&mod->memories));
-    vec_set_fixed(&mod_inst->m_addrs, true);
-    vec_resize_tab_addr(&mod_inst->t_addrs, vec_size_table(&mod->tables));
-    vec_set_fixed(&mod_inst->t_addrs, true);
-    vec_resize_glob_addr(&mod_inst->g_addrs, vec_size_global(&mod->globals));
-    vec_set_fixed(&mod_inst->g_addrs, true);
+// Resolve one import and append it to the plan.
+static r_link_slot link_plan_add(vm * vm, link_plan * plan, import_path path, external_kind kind, u32 idx) {
+    check_prep(r_link_slot);
 
-    return ok_r;
+    module_inst * target_mod_inst = vm_find_module_inst(vm, path.module);
+    if (!target_mod_inst) {
+        return err(e_invalid, "Imports: module instance not found");
+    }
+    module * target_mod = target_mod_inst->mod;
+    assert(target_mod);
+    export * exp = module_find_export(target_mod, path.field, kind);
+    if (!exp) {
+        switch (kind) {
+        case EXTERNAL_KIND_Function:
+            return err(e_invalid, "Imports: function not found");
+        case EXTERNAL_KIND_Global:
+            return err(e_invalid, "Imports: global not found");
+        case EXTERNAL_KIND_Memory:
+            return err(e_invalid, "Imports: memory not found");
+        default:
+            return err(e_invalid, "Imports: table not found");
+        }
+    }
+    u32 provider = 0;
+    while (provider < vec_size_str(&plan->provider_names) && !str_eq(*vec_at_str(&plan->provider_names, provider), path.module)) {
+        provider++;
+    }
+    if (provider == vec_size_str(&plan->provider_names)) {
+        check(vec_push_str(&plan->provider_names, path.module));
+        check(vec_push_module_ptr(&plan->providers, target_mod));
+        check(vec_push_u32(&plan->provider_serials, target_mod->serial));
+    }
+    link_slot slot = {
+        .kind = kind,
+        .idx = idx,
+        .provider = provider,
+        .external_idx = exp->external_idx,
+    };
+    check(vec_push_link_slot(&plan->slots, slot));
+    return ok(slot);
 }
 
-static r vm_link_module_inst(vm * vm, module_inst * mod_inst) {
-    assert(vm);
-    assert(mod_inst);
+static int link_slot_cmp(const void * a, const void * b) {
+    u32 lhs = ((const link_slot *)a)->provider;
+    u32 rhs = ((const link_slot *)b)->provider;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+// Resolve all the imports by their names and do the checks which only depend on the modules.
+static r link_plan_build(vm * vm, module * mod, link_plan * plan) {
     check_prep(r);
 
-    if (mod_inst->state != module_inst_uninitialized) {
-        return err(e_general, "Invalid module state");
-    }
-    module * mod = mod_inst->mod;
+    assert(!plan->ready);
     // functions
-    for (size_t i = 0; i < vec_size_func(&mod->funcs); i++) {
-        func_addr f_inst = vec_at_func_inst(&mod_inst->funcs, i);
-        func * f = f_inst->fn;
-        f_inst->mod_inst = mod_inst;
+    for (u32 i = 0; i < vec_size_func(&mod->funcs); i++) {
+        func * f = vec_at_func(&mod->funcs, i);
         if (!is_imported(f->linkage)) {
-            *vec_at_func_addr(&mod_inst->f_addrs, i) = f_inst;
             continue;
         }
-        module_inst * target_mod_inst = vm_find_module_inst(vm, f->path.module);
-        if (!target_mod_inst) {
-            return err(e_invalid, "Imports: module instance not found");
-        }
-        module * target_mod = target_mod_inst->mod;
-        assert(target_mod);
-        bool linked = false;
-        VEC_FOR_EACH(&target_mod->exports, export, exp) {
-            if ((exp->external_kind == EXTERNAL_KIND_Function) && (str_eq(exp->name, f->path.field))) {
-                func_addr tgt_f_addr = *vec_at_func_addr(&target_mod_inst->f_addrs, exp->external_idx);
-                func * tgt_f = tgt_f_addr->fn;
-                assert(is_exported(tgt_f->linkage));
-                // let's check the function signature
-                if (!func_type_eq(f->fn_type, tgt_f->fn_type)) {
-                    return err(e_invalid, "Function type mismatch");
-                }
-                *vec_at_func_addr(&mod_inst->f_addrs, i) = tgt_f_addr;
-                linked = true;
-                break;
-            }
-        }
-        if (!linked) {
-            return err(e_invalid, "Imports: function not found");
+        unwrap(link_slot, slot, link_plan_add(vm, plan, f->path, EXTERNAL_KIND_Function, i));
+        func * tgt_f = vec_at_func(&(*vec_at_module_ptr(&plan->providers, slot.provider))->funcs, slot.external_idx);
+        assert(is_exported(tgt_f->linkage));
+        // let's check the function signature
+        if (!func_type_eq(f->fn_type, tgt_f->fn_type)) {
+            return err(e_invalid, "Function type mismatch");
         }
     }
     // globals
-    for (size_t i = 0; i < vec_size_global(&mod->globals); i++) {
-        glob_addr g_inst = vec_at_global_inst(&mod_inst->globals, i);
-        global * g = g_inst->glob;
+    for (u32 i = 0; i < vec_size_global(&mod->globals); i++) {
+        global * g = vec_at_global(&mod->globals, i);
         if (!is_imported(g->linkage)) {
-            *vec_at_glob_addr(&mod_inst->g_addrs, i) = g_inst;
             continue;
         }
-        module_inst * target_mod_inst = vm_find_module_inst(vm, g->path.module);
-        if (!target_mod_inst) {
-            return err(e_invalid, "Imports: module instance not found");
-        }
-        module * target_mod = target_mod_inst->mod;
-        assert(target_mod);
-        bool linked = false;
-        VEC_FOR_EACH(&target_mod->exports, export, exp) {
-            if ((exp->external_kind == EXTERNAL_KIND_Global) && (str_eq(exp->name, g->path.field))) {
-                glob_addr tgt_g_addr = *vec_at_glob_addr(&target_mod_inst->g_addrs, exp->external_idx);
-                global * tgt_g = tgt_g_addr->glob;
-                assert(tgt_g);
-                assert(is_exported(tgt_g->linkage));
-                if (tgt_g->mut != g->mut) {
-                    return err(e_invalid, "Imported global value's mut flag doesn't match the target");
-                }
-                if (tgt_g->valtype != g->valtype) {
-                    return err(e_invalid, "Imported global value value type mismatch");
-                }
-                *vec_at_glob_addr(&mod_inst->g_addrs, i) = tgt_g_addr;
-                linked = true;
-                break;
-            }
+        unwrap(link_slot, slot, link_plan_add(vm, plan, g->path, EXTERNAL_KIND_Global, i));
+        global * tgt_g = vec_at_global(&(*vec_at_module_ptr(&plan->providers, slot.provider))->globals, slot.external_idx);
+        assert(is_exported(tgt_g->linkage));
+        if (tgt_g->mut != g->mut) {
+            return err(e_invalid, "Imported global value's mut flag doesn't match the target");
         }
-        if (!linked) {
-            return err(e_invalid, "Imports: global not found");
+        if (tgt_g->valtype != g->valtype) {
+            return err(e_invalid, "Imported global value value type mismatch");
         }
     }
     // mem
-    for (size_t i = 0; i < vec_size_memory(&mod->memories); i++) {
-        mem_addr mem_inst = vec_at_memory_inst(&mod_inst->memories, i);
-        memory * mem = mem_inst->mem;
+    for (u32 i = 0; i < vec_size_memory(&mod->memories); i++) {
+        memory * mem = vec_at_memory(&mod->memories, i);
         if (!is_imported(mem->linkage)) {
-            *vec_at_mem_addr(&mod_inst->m_addrs, i) = mem_inst;
             continue;
         }
-        module_inst * target_mod_inst = vm_find_module_inst(vm, mem->path.module);
-        if (!target_mod_inst) {
-            return err(e_invalid, "Imports: module instance not found");
-        }
-        module * target_mod = target_mod_inst->mod;
-        assert(target_mod);
-        bool linked = false;
-        VEC_FOR_EACH(&target_mod->exports, export, exp) {
-            if ((exp->external_kind == EXTERNAL_KIND_Memory) && (str_eq(exp->name, mem->path.field))) {
-                mem_addr tgt_m_addr = *vec_at_mem_addr(&target_mod_inst->m_addrs, exp->external_idx);
-                memory * tgt_m = tgt_m_addr->mem;
-                assert(tgt_m);
-                assert(is_exported(tgt_m->linkage));
-                assert(!(vec_size_u8(&tgt_m_addr->mdata) % WASM_PAGE_SIZE));
-                size_t tgt_curr_pages = vec_size_u8(&tgt_m_addr->mdata) / WASM_PAGE_SIZE;
-                if (mem->lim.min > tgt_curr_pages) {
-                    return err(e_invalid, "mem import's min length should be at most the imported mem's min length");
-                }
-                if (mem->lim.max < tgt_m->lim.max) {
-                    return err(e_invalid, "mem import's max length should be at least the imported mem's max length");
-                }
-                // so, if the target_m_inst is also imported, we will follow the link to the final destination.
-                *vec_at_mem_addr(&mod_inst->m_addrs, i) = tgt_m_addr;
-                linked = true;
-                break;
-            }
+        unwrap(link_slot, slot, link_plan_add(vm, plan, mem->path, EXTERNAL_KIND_Memory, i));
+        memory * tgt_m = vec_at_memory(&(*vec_at_module_ptr(&plan->providers, slot.provider))->memories, slot.external_idx);
+        assert(is_exported(tgt_m->linkage));
+        if (mem->lim.shared != tgt_m->lim.shared) {
+            return err(e_invalid, "Imported memory's shared flag doesn't match the target");
         }
-        if (!linked) {
-            return err(e_invalid, "Imports: memory not found");
+        if (mem->lim.is64 != tgt_m->lim.is64) {
+            return err(e_invalid, "Imported memory's index type doesn't match the target");
         }
     }
     // table
-    for (size_t i = 0; i < vec_size_table(&mod->tables); i++) {
-        tab_addr tab_inst = vec_at_table_inst(&mod_inst->tables, i);
-        table * tab = tab_inst->tab;
+    for (u32 i = 0; i < vec_size_table(&mod->tables); i++) {
+        table * tab = vec_at_table(&mod->tables, i);
         if (!is_imported(tab->linkage)) {
-            *vec_at_tab_addr(&mod_inst->t_addrs, i) = tab_inst;
             continue;
         }
-        module_inst * target_mod_inst = vm_find_module_inst(vm, tab->path.module);
-        if (!target_mod_inst) {
-            return err(e_invalid, "Imports: module instance not found");
-        }
-        module * target_mod = target_mod_inst->mod;
-        assert(target_mod);
-        bool linked = false;
-        VEC_FOR_EACH(&target_mod->exports, export, exp) {
-            if ((exp->external_kind == EXTERNAL_KIND_Table) && (str_eq(exp->name, tab->path.field))) {
-                tab_addr tgt_t_addr = *vec_at_tab_addr(&target_mod_inst->t_addrs, exp->external_idx);
-                table * tgt_t = tgt_t_addr->tab;
-                assert(is_exported(tgt_t->linkage));
-                if (tab->valtype != tgt_t->valtype) {
-                    return err(e_invalid, "table type mismatch");
-                }
-                if (tab->lim.min > tgt_t->lim.min) {
-                    return err(e_invalid, "table import's min length should be at most the imported table's min length");
-                }
-                if (tab->lim.max < tgt_t->lim.max) {
-                    return err(e_invalid, "table import's max length should be at least the imported table's max length");
-                }
-                *vec_at_tab_addr(&mod_inst->t_addrs, i) = tgt_t_addr;
-                linked = true;
-                break;
+        unwrap(link_slot, slot, link_plan_add(vm, plan, tab->path, EXTERNAL_KIND_Table, i));
+        table * tgt_t = vec_at_table(&(*vec_at_module_ptr(&plan->providers, slot.provider))->tables, slot.external_idx);
+        assert(is_exported(tgt_t->linkage));
+        if (tab->valtype != tgt_t->valtype) {
+            return err(e_invalid, "table type mismatch");
+        }
+    }
+    // group the slots so that each provider is looked up only once.
+    if (vec_size_link_slot(&plan->slots)) {
+        qsort(vec_at_link_slot(&plan->slots, 0), vec_size_link_slot(&plan->slots), sizeof(link_slot), link_slot_cmp);
+    }
+    plan->ready = true;
+    return ok_r;
+}
+
+// Link the imports by the plan. stale is set, with nothing linked, if the module instances
+// in the vm are not the ones the plan was built against.
+static r link_plan_apply(vm * vm, module_inst * mod_inst, link_plan * plan, bool * stale) {
+    check_prep(r);
+
+    assert(plan->ready);
+    *stale = false;
+    for (u32 p = 0; p < vec_size_module_ptr(&plan->providers); p++) {
+        module_inst * target_mod_inst = vm_find_module_inst(vm, *vec_at_str(&plan->provider_names, p));
+        if (!target_mod_inst || (target_mod_inst->mod != *vec_at_module_ptr(&plan->providers, p)) ||
+            (target_mod_inst->mod->serial != *vec_at_u32(&plan->provider_serials, p))) {
+            *stale = true;
+            return ok_r;
+        }
+    }
+    module_inst * target_mod_inst = NULL;
+    u32 provider = u32_MAX;
+    VEC_FOR_EACH(&plan->slots, link_slot, slot) {
+        if (slot->provider != provider) {
+            provider = slot->provider;
+            target_mod_inst = vm_find_module_inst(vm, *vec_at_str(&plan->provider_names, provider));
+            assert(target_mod_inst);
+        }
+        switch (slot->kind) {
+        case EXTERNAL_KIND_Function:
+            *vec_at_func_addr(&mod_inst->f_addrs, slot->idx) = *vec_at_func_addr(&target_mod_inst->f_addrs, slot->external_idx);
+            break;
+        case EXTERNAL_KIND_Global:
+            *vec_at_glob_addr(&mod_inst->g_addrs, slot->idx) = *vec_at_glob_addr(&target_mod_inst->g_addrs, slot->external_idx);
+            break;
+        case EXTERNAL_KIND_Memory: {
+            memory * mem = vec_at_memory(&mod_inst->mod->memories, slot->idx);
+            mem_addr tgt_m_addr = *vec_at_mem_addr(&target_mod_inst->m_addrs, slot->external_idx);
+            memory * tgt_m = tgt_m_addr->mem;
+            assert(tgt_m);
+            assert(is_exported(tgt_m->linkage));
+            if (memory_page_shift(mem) != memory_page_shift(tgt_m)) {
+                return err(e_invalid, "Imported memory's page size doesn't match the target");
+            }
+            size_t tgt_curr_pages = vec_size_u8(&tgt_m_addr->mdata) >> memory_page_shift(tgt_m);
+            if (mem->lim.min > tgt_curr_pages) {
+                return err(e_invalid, "mem import's min length should be at most the imported mem's min length");
+            }
+            if (mem->lim.max < tgt_m->lim.max) {
+                return err(e_invalid, "mem import's max length should be at least the imported mem's max length");
             }
+            // so, if the target_m_inst is also imported, we will follow the link to the final destination.
+            *vec_at_mem_addr(&mod_inst->m_addrs, slot->idx) = tgt_m_addr;
+            break;
         }
-        if (!linked) {
-            return err(e_invalid, "Imports: table not found");
+        case EXTERNAL_KIND_Table: {
+            table * tab = vec_at_table(&mod_inst->mod->tables, slot->idx);
+            tab_addr tgt_t_addr = *vec_at_tab_addr(&target_mod_inst->t_addrs, slot->external_idx);
+            table * tgt_t = tgt_t_addr->tab;
+            if (tab->lim.min > tgt_t->lim.min) {
+                return err(e_invalid, "table import's min length should be at most the imported table's min length");
+            }
+            if (tab->lim.max < tgt_t->lim.max) {
+                return err(e_invalid, "table import's max length should be at least the imported table's max length");
+            }
+            *vec_at_tab_addr(&mod_inst->t_addrs, slot->idx) = tgt_t_addr;
+            break;
+        }
+        default:
+            assert(0);
+        }
+    }
+    return ok_r;
+}
+
+// The frozen module is shared by the vms, possibly on other threads, so its plan is published
+// once and only read afterwards. A vm with other providers builds a plan of its own.
+static r link_frozen_module_inst(vm * vm, module_inst * mod_inst) {
+    check_prep(r);
+
+    module * mod = mod_inst->mod;
+    link_plan * shared = s_atomic_load_ptr(&mod->frozen_plan);
+    bool stale = false;
+    if (shared) {
+        check(link_plan_apply(vm, mod_inst, shared, &stale));
+        if (!stale) {
+            return ok_r;
+        }
+    }
+    link_plan * plan = array_calloc(link_plan, 1);
+    if (!plan) {
+        return err(e_general, "Failed to allocate the link plan");
+    }
+    r ret = link_plan_build(vm, mod, plan);
+    if (is_ok(ret)) {
+        ret = link_plan_apply(vm, mod_inst, plan, &stale);
+        assert(!stale);
+    }
+    // another vm can get there first, then this one is thrown away.
+    if (is_ok(ret) && !shared && s_atomic_cas_ptr(&mod->frozen_plan, NULL, plan)) {
+        return ok_r;
+    }
+    link_plan_clear(plan);
+    array_free(plan);
+    return ret;
+}
+
+static r vm_link_module_inst(vm * vm, module_inst * mod_inst) {
+    assert(vm);
+    assert(mod_inst);
+    check_prep(r);
+
+    if (mod_inst->state != module_inst_uninitialized) {
+        return err(e_general, "Invalid module state");
+    }
+    module * mod = mod_inst->mod;
+    // the module's own functions, globals, memories and tables.
+    for (size_t i = 0; i < vec_size_func(&mod->funcs); i++) {
+        func_addr f_inst = vec_at_func_inst(&mod_inst->funcs, i);
+        f_inst->mod_inst = mod_inst;
+        if (!is_imported(f_inst->fn->linkage)) {
+            *vec_at_func_addr(&mod_inst->f_addrs, i) = f_inst;
+        }
+    }
+    for (size_t i = 0; i < vec_size_global(&mod->globals); i++) {
+        glob_addr g_inst = vec_at_global_inst(&mod_inst->globals, i);
+        if (!is_imported(g_inst->glob->linkage)) {
+            *vec_at_glob_addr(&mod_inst->g_addrs, i) = g_inst;
+        }
+    }
+    for (size_t i = 0; i < vec_size_memory(&mod->memories); i++) {
+        mem_addr mem_inst = vec_at_memory_inst(&mod_inst->memories, i);
+        if (!is_imported(mem_inst->mem->linkage)) {
+            *vec_at_mem_addr(&mod_inst->m_addrs, i) = mem_inst->shared ? &mem_inst->shared->inst : mem_inst;
+        }
+    }
+    for (size_t i = 0; i < vec_size_table(&mod->tables); i++) {
+        tab_addr tab_inst = vec_at_table_inst(&mod_inst->tables, i);
+        if (!is_imported(tab_inst->tab->linkage)) {
+            *vec_at_tab_addr(&mod_inst->t_addrs, i) = tab_inst;
         }
     }
+    if (mod->frozen) {
+        return link_frozen_module_inst(vm, mod_inst);
+    }
+    // the imports, by the plan from the last time if the providers are the same.
+    bool stale = !mod->link_plan.ready;
+    if (!stale) {
+        check(link_plan_apply(vm, mod_inst, &mod->link_plan, &stale));
+    }
+    if (stale) {
+        module_link_plan_reset(mod);
+        check(link_plan_build(vm, mod, &mod->link_plan));
+        check(link_plan_apply(vm, mod_inst, &mod->link_plan, &stale));
+        assert(!stale);
+    }
     return ok_r;
 }
 
@@ -381,11 +570,12 @@ static r module_inst_init_data(module_inst * mod_inst) {
         // The "inst" should be pointing to the linked target memory instance.
         mem_addr m_addr = *vec_at_mem_addr(&mod_inst->m_addrs, d->memidx);
         unwrap(typed_value, val, interp_reduce_const_expr(mod_inst, stream_from(d->offset_expr), false));
-        if (val.type != TYPE_ID_i32) {
+        bool is64 = memory_is64(m_addr->mem);
+        if (val.type != (is64 ? TYPE_ID_i64 : TYPE_ID_i32)) {
             return err(e_invalid, "Incorrect data constexpr return type");
         }
-        u32 offset = (u32)(val.val.u_i32);
-        if (offset + str_len(d->bytes) > vec_size_u8(&m_addr->mdata)) {
+        u64 offset = is64 ? val.val.u_u64 : val.val.u_u32;
+        if ((offset > vec_size_u8(&m_addr->mdata)) || (str_len(d->bytes) > vec_size_u8(&m_addr->mdata) - offset)) {
             return err(e_invalid, "Invalid data section");
         }
         if (str_len(d->bytes)) {
@@ -422,62 +612,63 @@ static r module_inst_init(module_inst * mod_inst) {
     return ok_r;
 }
 
+i64 memory_inst_grow(memory_inst * mem_inst, u64 delta) {
+    assert(mem_inst);
+    if (mem_inst->shared) {
+        return delta > u32_MAX ? -1 : shared_memory_grow(mem_inst->shared, (u32)delta);
+    }
+    u64 pages = vec_size_u8(&mem_inst->mdata) >> memory_page_shift(mem_inst->mem);
+    if ((delta > mem_inst->mem->lim.max) || (pages + delta > mem_inst->mem->lim.max)) {
+        return -1;
+    }
+    if (!is_ok(memory_inst_resize(mem_inst, pages + delta))) {
+        return -1;
+    }
+    return (i64)pages;
+}
+
+static void memory_inst_release(memory_inst * mem_inst) {
+    if (mem_inst->mapped) {
+        mem_image_unmap(&mem_inst->mdata);
+        mem_inst->image_id = 0;
+        mem_inst->mapped = false;
+    } else {
+        vec_clear_u8(&mem_inst->mdata);
+    }
+}
+
 static void module_inst_drop(module_inst * mod_inst) {
     assert(mod_inst);
     assert(mod_inst->mod);
 
-    assert(mod_inst->mod->ref_count);
-    mod_inst->mod->ref_count--;
+    u32 ref_count = s_atomic_dec32(&mod_inst->mod->ref_count);
+    assert(ref_count != u32_MAX);
+    UNUSED(ref_count);
 
-    // func
-    vec_clear_func_inst(&mod_inst->funcs);
     // table
     VEC_FOR_EACH(&mod_inst->tables, table_inst, tab_inst) {
         vec_clear_ref(&tab_inst->tdata);
     }
-    vec_clear_table_inst(&mod_inst->tables);
     // memory
     VEC_FOR_EACH(&mod_inst->memories, memory_inst, mem_inst) {
-        vec_clear_u8(&mem_inst->mdata);
+        memory_inst_release(mem_inst);
     }
-    vec_clear_memory_inst(&mod_inst->memories);
-    vec_clear_mem_addr(&mod_inst->m_addrs);
-    // global
-    vec_clear_global_inst(&mod_inst->globals);
-    // dropped elem and data
-    vec_clear_u8(&mod_inst->dropped_elements);
-    vec_clear_u8(&mod_inst->dropped_data);
-    // drop the address table
-    vec_clear_func_addr(&mod_inst->f_addrs);
-    vec_clear_mem_addr(&mod_inst->m_addrs);
-    vec_clear_tab_addr(&mod_inst->t_addrs);
-    vec_clear_glob_addr(&mod_inst->g_addrs);
+    // everything else lives in the storage block.
+    array_free(mod_inst->storage);
+    *mod_inst = (module_inst){0};
 }
 
-r vm_instantiate_module(vm * vm, module * mod) {
+// Create the module instance in the vm and link it. On failure the half-instantiated
+// module instance is kept in the vm.
+static r vm_add_module_inst(vm * vm, module * mod, bool alloc_memories, module_inst ** out) {
     assert(vm);
     assert(mod);
+    assert(out);
     check_prep(r);
 
-    // if it's already instantiated, return it.
-    LIST_FOR_EACH(&vm->instances, module_inst, mod_inst) {
-        if (mod_inst->mod == mod) {
-            return ok_r;
-        }
-    }
-    // instantiate according to the https://webassembly.github.io/spec/core/exec/modules.html
-
-    // 1: validate the module
-    VEC_FOR_EACH(&mod->funcs, func, fn) {
-        if (fn->linkage & linkage_imported) {
-            continue;
-        }
-        check(validate_func(mod, fn));
-    }
-
     // 2: create module instances and allocate internal storage
     module_inst mod_ins = {0};
-    check(module_inst_new(mod, &mod_ins), {
+    check(module_inst_new(mod, &mod_ins, alloc_memories), {
         module_inst_drop(&mod_ins);
     });
     mod_ins.state = module_inst_uninitialized;
@@ -490,6 +681,11 @@ r vm_instantiate_module(vm * vm, module * mod) {
     });
     module_inst * new_mod_ins = list_back_module_inst(&vm->instances);
     assert(new_mod_ins);
+    VEC_FOR_EACH(&mod->names, vstr, n) {
+        check(str_map_put(&vm->instance_index, n->s, (uptr)new_mod_ins), {
+            new_mod_ins->state = module_inst_init_failed;
+        });
+    }
 
     // 3: link the module instance
     check(vm_link_module_inst(vm, new_mod_ins), {
@@ -498,9 +694,30 @@ r vm_instantiate_module(vm * vm, module * mod) {
         // module_inst_drop(new_mod_ins);
         // list_pop_module_inst(&vm->instances);
     });
+    *out = new_mod_ins;
+    return ok_r;
+}
+
+static r vm_instantiate_module_in(vm * vm, module * mod) {
+    check_prep(r);
+
+    // if it's already instantiated, return it.
+    LIST_FOR_EACH(&vm->instances, module_inst, mod_inst) {
+        if (mod_inst->mod == mod) {
+            return ok_r;
+        }
+    }
+    // instantiate according to the https://webassembly.github.io/spec/core/exec/modules.html
+
+    // 1: validate the module
+    check(module_validate(mod));
+
+    // 2 and 3
+    module_inst * new_mod_ins = NULL;
+    check(vm_add_module_inst(vm, mod, true, &new_mod_ins));
 
     // 4: initialize the globals/elements/etc and call the module.start if not empty
-    check(module_inst_init(&mod_ins), {
+    check(module_inst_init(new_mod_ins), {
         new_mod_ins->state = module_inst_init_failed;
     });
 
@@ -508,34 +725,351 @@ r vm_instantiate_module(vm * vm, module * mod) {
     return ok_r;
 }
 
+r vm_instantiate_module(vm * vm, module * mod) {
+    assert(vm);
+    assert(mod);
+
+    allocator * prev = alloc_enter(vm->thread.alloc);
+    r ret = vm_instantiate_module_in(vm, mod);
+    alloc_leave(prev);
+    return ret;
+}
+
+// Snapshots store the function references as function indexes of the instance. This is the
+// f_addrs sorted by address for the reverse lookup.
+typedef struct fref_slot {
+    ref fref;
+    u32 idx;
+} fref_slot;
+
+static int fref_slot_cmp(const void * a, const void * b) {
+    ref lhs = ((const fref_slot *)a)->fref;
+    ref rhs = ((const fref_slot *)b)->fref;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static r fref_to_idx(const fref_slot * slots, size_t count, ref fref, ref * out) {
+    check_prep(r);
+    if (fref == nullref) {
+        *out = nullref;
+        return ok_r;
+    }
+    fref_slot key = {.fref = fref};
+    const fref_slot * slot = slots ? bsearch(&key, slots, count, sizeof(fref_slot), fref_slot_cmp) : NULL;
+    if (!slot) {
+        return err(e_general, "Function reference from another module instance");
+    }
+    *out = slot->idx;
+    return ok_r;
+}
+
+static ref idx_to_fref(module_inst * mod_inst, ref idx) {
+    if (idx == nullref) {
+        return nullref;
+    }
+    return to_ref(*vec_at_func_addr(&mod_inst->f_addrs, (u32)idx));
+}
+
+static r snapshot_capture(module_inst * mod_inst, const fref_slot * slots, inst_snapshot * snap) {
+    check_prep(r);
+    module * mod = mod_inst->mod;
+
+    // memory
+    for (size_t i = mod->imported_mem_count; i < vec_size_memory_inst(&mod_inst->memories); i++) {
+        memory_inst * mem_inst = vec_at_memory_inst(&mod_inst->memories, i);
+        size_t size = vec_size_u8(&mem_inst->mdata);
+        str bytes = size ? s_pl(mem_inst->mdata._data, size) : (str){0};
+        memory_snapshot m_snap = {.image = MEM_IMAGE_NULL};
+        r_mem_image img = mem_image_new(bytes);
+        if (is_ok(img)) {
+            m_snap.image = img.value;
+        } else if (size) {
+            check(vec_resize_u8(&m_snap.bytes, size));
+            memcpy(vec_at_u8(&m_snap.bytes, 0), bytes.ptr, size);
+        }
+        check(vec_push_memory_snapshot(&snap->memories, m_snap), {
+            mem_image_drop(&m_snap.image);
+            vec_clear_u8(&m_snap.bytes);
+        });
+    }
+    // global
+    for (size_t i = mod->imported_global_count; i < vec_size_global_inst(&mod_inst->globals); i++) {
+        global_inst * g_inst = vec_at_global_inst(&mod_inst->globals, i);
+        value_u val = g_inst->gvalue;
+        if (g_inst->glob->valtype == TYPE_ID_funcref) {
+            check(fref_to_idx(slots, vec_size_func_addr(&mod_inst->f_addrs), val.u_ref, &val.u_ref));
+        }
+        check(vec_push_value_u(&snap->globals, val));
+    }
+    // table
+    VEC_FOR_EACH(&mod_inst->tables, table_inst, tab_inst) {
+        check(vec_push_u32(&snap->table_sizes, (u32)vec_size_ref(&tab_inst->tdata)));
+        VEC_FOR_EACH(&tab_inst->tdata, ref, iter) {
+            value_u val = {.u_ref = *iter};
+            if (tab_inst->tab->valtype == TYPE_ID_funcref) {
+                check(fref_to_idx(slots, vec_size_func_addr(&mod_inst->f_addrs), *iter, &val.u_ref));
+            }
+            check(vec_push_value_u(&snap->table_data, val));
+        }
+    }
+    // dropped elem and data
+    VEC_FOR_EACH(&mod_inst->dropped_elements, u8, dropped) {
+        check(vec_push_u8(&snap->dropped_elements, *dropped));
+    }
+    VEC_FOR_EACH(&mod_inst->dropped_data, u8, dropped) {
+        check(vec_push_u8(&snap->dropped_data, *dropped));
+    }
+    return ok_r;
+}
+
+r_inst_snapshot vm_snapshot_module_inst(module_inst * mod_inst) {
+    assert(mod_inst);
+    check_prep(r_inst_snapshot);
+
+    module * mod = mod_inst->mod;
+    assert(mod);
+    if (mod_inst->state != module_inst_ready) {
+        return err(e_general, "Module instance is not ready");
+    }
+    if (mod->imported_mem_count || mod->imported_table_count) {
+        return err(e_general, "Snapshot of a module importing memories or tables is not supported");
+    }
+    VEC_FOR_EACH(&mod->memories, memory, mem) {
+        if (mem->lim.shared) {
+            return err(e_general, "Snapshot of a module with shared memories is not supported");
+        }
+    }
+
+    size_t f_count = vec_size_func_addr(&mod_inst->f_addrs);
+    fref_slot * slots = NULL;
+    if (f_count) {
+        slots = array_calloc(fref_slot, f_count);
+        if (!slots) {
+            return err(e_general, "Failed to allocate the function lookup table");
+        }
+        for (size_t i = 0; i < f_count; i++) {
+            slots[i] = (fref_slot){.fref = to_ref(*vec_at_func_addr(&mod_inst->f_addrs, i)), .idx = (u32)i};
+        }
+        qsort(slots, f_count, sizeof(fref_slot), fref_slot_cmp);
+    }
+
+    inst_snapshot snap = {.mod = mod};
+    s_atomic_inc32(&mod->ref_count);
+    r ret = snapshot_capture(mod_inst, slots, &snap);
+    array_free(slots);
+    check(ret, inst_snapshot_drop(&snap));
+    return ok(snap);
+}
+
+void inst_snapshot_drop(inst_snapshot * snap) {
+    assert(snap);
+    if (!snap->mod) {
+        return;
+    }
+    u32 ref_count = s_atomic_dec32(&snap->mod->ref_count);
+    assert(ref_count != u32_MAX);
+    UNUSED(ref_count);
+    VEC_FOR_EACH(&snap->memories, memory_snapshot, m_snap) {
+        mem_image_drop(&m_snap->image);
+        vec_clear_u8(&m_snap->bytes);
+    }
+    vec_clear_memory_snapshot(&snap->memories);
+    vec_clear_value_u(&snap->globals);
+    vec_clear_u32(&snap->table_sizes);
+    vec_clear_value_u(&snap->table_data);
+    vec_clear_u8(&snap->dropped_elements);
+    vec_clear_u8(&snap->dropped_data);
+    *snap = (inst_snapshot){0};
+}
+
+static r memory_inst_restore(memory_inst * mem_inst, memory_snapshot * m_snap) {
+    check_prep(r);
+    mem_image * img = &m_snap->image;
+
+    // the pages written since the last restore are simply dropped.
+    if (mem_inst->image_id && (mem_inst->image_id == img->id)) {
+        return mem_image_reset(img, &mem_inst->mdata);
+    }
+    if (img->fd >= 0) {
+        // reserve up to the max so that the memory can grow in place.
+        u64 capacity = memory_capacity(mem_inst->mem);
+        vec_u8 mapped = {0};
+        if ((capacity <= SIZE_MAX) && is_ok(mem_image_map(img, (size_t)capacity, &mapped))) {
+            memory_inst_release(mem_inst);
+            mem_inst->mdata = mapped;
+            mem_inst->image_id = img->id;
+            mem_inst->mapped = true;
+            return ok_r;
+        }
+    }
+    // copy, if the image is not available or can't be mapped. A reservation is kept.
+    if (mem_inst->image_id) {
+        memory_inst_release(mem_inst);
+    }
+    size_t size = (img->fd >= 0) ? img->size : vec_size_u8(&m_snap->bytes);
+    check(memory_inst_resize(mem_inst, size >> memory_page_shift(mem_inst->mem)));
+    if (!size) {
+        return ok_r;
+    }
+    if (img->fd >= 0) {
+        check(mem_image_read(img, vec_at_u8(&mem_inst->mdata, 0)));
+    } else {
+        memcpy(vec_at_u8(&mem_inst->mdata, 0), vec_at_u8(&m_snap->bytes, 0), size);
+    }
+    return ok_r;
+}
+
+static r module_inst_restore(module_inst * mod_inst, inst_snapshot * snap) {
+    check_prep(r);
+    module * mod = mod_inst->mod;
+
+    // memory
+    for (size_t i = 0; i < vec_size_memory_snapshot(&snap->memories); i++) {
+        memory_inst * mem_inst = vec_at_memory_inst(&mod_inst->memories, mod->imported_mem_count + i);
+        check(memory_inst_restore(mem_inst, vec_at_memory_snapshot(&snap->memories, i)));
+    }
+    // global
+    for (size_t i = 0; i < vec_size_value_u(&snap->globals); i++) {
+        global_inst * g_inst = vec_at_global_inst(&mod_inst->globals, mod->imported_global_count + i);
+        value_u val = *vec_at_value_u(&snap->globals, i);
+        if (g_inst->glob->valtype == TYPE_ID_funcref) {
+            val.u_ref = idx_to_fref(mod_inst, val.u_ref);
+        }
+        g_inst->gvalue = val;
+    }
+    // table
+    size_t offset = 0;
+    for (size_t i = 0; i < vec_size_u32(&snap->table_sizes); i++) {
+        table_inst * tab_inst = vec_at_table_inst(&mod_inst->tables, i);
+        u32 size = *vec_at_u32(&snap->table_sizes, i);
+        check(vec_resize_ref(&tab_inst->tdata, size));
+        for (u32 j = 0; j < size; j++) {
+            ref val = vec_at_value_u(&snap->table_data, offset + j)->u_ref;
+            if (tab_inst->tab->valtype == TYPE_ID_funcref) {
+                val = idx_to_fref(mod_inst, val);
+            }
+            *vec_at_ref(&tab_inst->tdata, j) = val;
+        }
+        offset += size;
+    }
+    // dropped elem and data
+    if (vec_size_u8(&snap->dropped_elements)) {
+        memcpy(vec_at_u8(&mod_inst->dropped_elements, 0), vec_at_u8(&snap->dropped_elements, 0), vec_size_u8(&snap->dropped_elements));
+    }
+    if (vec_size_u8(&snap->dropped_data)) {
+        memcpy(vec_at_u8(&mod_inst->dropped_data, 0), vec_at_u8(&snap->dropped_data, 0), vec_size_u8(&snap->dropped_data));
+    }
+    return ok_r;
+}
+
+r vm_reset_module_inst(module_inst * mod_inst, inst_snapshot * snap) {
+    assert(mod_inst);
+    assert(snap);
+    check_prep(r);
+
+    if (mod_inst->mod != snap->mod) {
+        return err(e_general, "Snapshot of another module");
+    }
+    check(module_inst_restore(mod_inst, snap), {
+        mod_inst->state = module_inst_init_failed;
+    });
+    mod_inst->state = module_inst_ready;
+    return ok_r;
+}
+
+static r vm_instantiate_snapshot_in(vm * vm, inst_snapshot * snap) {
+    check_prep(r);
+
+    // if it's already instantiated, bring it back to the snapshot.
+    LIST_FOR_EACH(&vm->instances, module_inst, mod_inst) {
+        if (mod_inst->mod == snap->mod) {
+            return vm_reset_module_inst(mod_inst, snap);
+        }
+    }
+    // the module has been validated and initialized when the snapshot was taken, and the
+    // start function is not called again.
+    module_inst * new_mod_ins = NULL;
+    check(vm_add_module_inst(vm, snap->mod, false, &new_mod_ins));
+    return vm_reset_module_inst(new_mod_ins, snap);
+}
+
+r vm_instantiate_snapshot(vm * vm, inst_snapshot * snap) {
+    assert(vm);
+    assert(snap);
+    assert(snap->mod);
+
+    allocator * prev = alloc_enter(vm->thread.alloc);
+    r ret = vm_instantiate_snapshot_in(vm, snap);
+    alloc_leave(prev);
+    return ret;
+}
+
 void thread_reset(thread * t) {
     assert(t);
     vec_clear_typed_value(&t->results);
-    *t = (thread){0};
+    while (t->tail_frames) {
+        thread_tail_frame_free(t, t->tail_frames);
+    }
+    *t = (thread){
+        .budget = t->budget,
+        .on_preempt = t->on_preempt,
+        .preempt_payload = t->preempt_payload,
+        .alloc = t->alloc,
+        .stack_floor = t->stack_floor,
+    };
+}
+
+r thread_safepoint(thread * t) {
+    if (!t->on_preempt) {
+        t->budget = i32_MAX;
+        return ok_r;
+    }
+    return t->on_preempt(t);
+}
+
+tail_frame * thread_tail_frame_alloc(thread * t, u32 cap) {
+    assert(t);
+    tail_frame * frame = (tail_frame *)array_alloc(u8, sizeof(tail_frame) + sizeof(value_slot) * cap);
+    if (!frame) {
+        return NULL;
+    }
+    frame->prev = t->tail_frames;
+    frame->cap = cap;
+    t->tail_frames = frame;
+    return frame;
+}
+
+void thread_tail_frame_free(thread * t, tail_frame * frame) {
+    assert(t);
+    assert(frame);
+    // it's usually the innermost one, or the one right behind it when a frame is replaced.
+    tail_frame ** link = &t->tail_frames;
+    while (*link != frame) {
+        assert(*link);
+        link = &(*link)->prev;
+    }
+    *link = frame->prev;
+    array_free(frame);
 }
 
 void vm_drop(vm * vm) {
     LIST_FOR_EACH(&vm->instances, module_inst, mod_inst) {
-        assert(mod_inst->mod->ref_count);
+        assert(s_atomic_load32(&mod_inst->mod->ref_count));
         module_inst_drop(mod_inst);
     }
     list_clear_module_inst(&vm->instances);
+    str_map_clear(&vm->instance_index);
     thread_reset(&vm->thread);
 }
 
 module_inst * vm_find_module_inst(vm * vm, str name) {
     assert(vm);
 
-    module_inst * inst = NULL;
-    LIST_FOR_EACH(&vm->instances, module_inst, mod_inst) {
-        VEC_FOR_EACH(&mod_inst->mod->names, vstr, n) {
-            if (str_eq(n->s, name)) {
-                inst = mod_inst;
-                break;
-            }
-        }
+    uptr inst;
+    if (!str_map_get(&vm->instance_index, name, &inst)) {
+        return NULL;
     }
-    return inst;
+    return (module_inst *)inst;
 }
 
 static bool vm_owns_mod_inst(vm * vm, module_inst * mod_inst) {
@@ -558,14 +1092,11 @@ func_addr vm_find_module_func(vm * vm, module_inst * mod_inst, str func_name) {
     if (!vm_owns_mod_inst(vm, mod_inst) || mod_inst->state != module_inst_ready) {
         return NULL;
     }
-    module * mod = mod_inst->mod;
-    VEC_FOR_EACH(&mod->exports, export, exp) {
-        if (str_eq(func_name, exp->name) && (exp->external_kind == EXTERNAL_KIND_Function)) {
-            size_t func_idx = exp->external_idx;
-            return *vec_at_func_addr(&mod_inst->f_addrs, func_idx);
-        }
+    export * exp = module_find_export(mod_inst->mod, func_name, EXTERNAL_KIND_Function);
+    if (!exp) {
+        return NULL;
     }
-    return NULL;
+    return *vec_at_func_addr(&mod_inst->f_addrs, exp->external_idx);
 }
 
 glob_addr vm_find_module_global(vm * vm, module_inst * mod_inst, str glob_name) {
@@ -575,14 +1106,11 @@ glob_addr vm_find_module_global(vm * vm, module_inst * mod_inst, str glob_name)
     if (!vm_owns_mod_inst(vm, mod_inst)) {
         return NULL;
     }
-    module * mod = mod_inst->mod;
-    VEC_FOR_EACH(&mod->exports, export, exp) {
-        if (str_eq(glob_name, exp->name) && (exp->external_kind == EXTERNAL_KIND_Global)) {
-            size_t glob_idx = exp->external_idx;
-            return *vec_at_glob_addr(&mod_inst->g_addrs, glob_idx);
-        }
+    export * exp = module_find_export(mod_inst->mod, glob_name, EXTERNAL_KIND_Global);
+    if (!exp) {
+        return NULL;
     }
-    return NULL;
+    return *vec_at_glob_addr(&mod_inst->g_addrs, exp->external_idx);
 }
 
 func_addr vm_find_func(vm * vm, str mod_name, str func_name) {
@@ -16,7 +16,9 @@
 
 #pragma once
 
+#include "alloc.h"
 #include "list.h"
+#include "mem_image.h"
 #include "module.h"
 #include "stream.h"
 #include "vec.h"
@@ -49,10 +51,19 @@ typedef table_inst * tab_addr;
 VEC_DECL_FOR_TYPE(tab_addr)
 
 // mem
+struct shared_memory;
 typedef struct memory_inst {
     // mem pointer will always point to the memory struct in the same module.
     memory * mem;
     vec_u8 mdata;
+    // non-zero if the mdata is a copy-on-write mapping of a snapshot image (see mem_image.h).
+    u64 image_id;
+    // the mdata is mapped, either an image or a reservation, and the bytes past its size are
+    // always zero.
+    bool mapped;
+    // the shared memory this is part of, NULL for the regular memories. The instances don't
+    // own the shared memories, they only link to them. (see shared_memory.h)
+    struct shared_memory * shared;
 } memory_inst;
 VEC_DECL_FOR_TYPE(memory_inst)
 
@@ -83,6 +94,10 @@ typedef enum module_inst_state {
 typedef struct module_inst {
     module_inst_state state;
     module * mod;
+    // The fixed-size vectors below all point into this single block, which is laid out
+    // according to the module (see module_inst_layout in vm.c). Only the table and memory
+    // contents, which can grow, are allocated separately.
+    u8 * storage;
     vec_func_inst funcs;
     vec_table_inst tables;
     vec_u8 dropped_elements;
@@ -98,13 +113,37 @@ typedef struct module_inst {
 LIST_DECL_FOR_TYPE(module_inst)
 RESULT_TYPE_DECL(module_inst)
 
-// TODO: aligned 64bit stack is kinda wasteful.
+// A heap frame for the tail calls whose callee doesn't fit into the frame it replaces.
+typedef struct tail_frame {
+    struct tail_frame * prev;
+    u32 cap;
+    value_slot slots[];
+} tail_frame;
+
 typedef struct thread {
     bool trapped;
     u32 frame_depth;
     u32 stack_size;
+    // Preemption. The interpreters count down the budget at the safe points, which are the
+    // function entries and the backward branches, and call on_preempt once it runs out.
+    // on_preempt refills the budget, and an error from it aborts the call like a trap.
+    // They survive thread_reset.
+    i32 budget;
+    r (*on_preempt)(struct thread * t);
+    void * preempt_payload;
     // saved return value from the last run. It will be cleared out in the next function call.
     vec_typed_value results;
+    // the live tail call frames, innermost first. A frame frees its own when it returns, the
+    // ones left behind by a trap are freed by thread_reset.
+    tail_frame * tail_frames;
+    // the allocator of the vm, made current during the calls and the instantiations (see
+    // alloc.h). NULL keeps the current one. It survives thread_reset.
+    allocator * alloc;
+    // the lowest native stack address the frames may reach, 0 for no limit other than
+    // SILVERFIR_STACK_SIZE_LIMIT. It's set when the thread runs on a smaller stack than that,
+    // such as a fiber (see green_sched.h), so that a call fails instead of overrunning it.
+    // It survives thread_reset.
+    uptr stack_floor;
 } thread;
 
 struct runtime;
@@ -114,6 +153,8 @@ struct runtime;
 typedef struct vm {
     // the main instance is always the first element.
     list_module_inst instances;
+    // module name -> module_inst
+    str_map instance_index;
     thread thread;
     // point back to its owner
     struct runtime * rt;
@@ -150,9 +191,58 @@ func_addr vm_find_func(vm * vm, str mod_name, str func_name);
 
 thread * vm_get_thread(vm * vm);
 
+// Instance snapshots.
+// A snapshot holds the state of a fully initialized module instance, i.e. after the start
+// function, so that new instances of the same module, or a used instance, can be brought to
+// that state without evaluating the const exprs and calling the start function again. The
+// memories are copy-on-write images where supported, so it only costs the pages that are
+// written afterwards.
+// Only the state owned by the instance is captured, so modules importing memories or tables
+// are not supported. The function references are stored as function indexes and get
+// resolved against the instance being restored.
+typedef struct memory_snapshot {
+    mem_image image;
+    // a plain copy, only if the image is not available.
+    vec_u8 bytes;
+} memory_snapshot;
+VEC_DECL_FOR_TYPE(memory_snapshot)
+
+typedef struct inst_snapshot {
+    module * mod;
+    vec_memory_snapshot memories;
+    vec_value_u globals; // the non-imported globals only.
+    vec_u32 table_sizes;
+    vec_value_u table_data; // all the tables in one.
+    vec_u8 dropped_elements;
+    vec_u8 dropped_data;
+} inst_snapshot;
+RESULT_TYPE_DECL(inst_snapshot)
+
+// take a snapshot of a ready module instance. The module is kept alive until the snapshot is dropped.
+r_inst_snapshot vm_snapshot_module_inst(module_inst * mod_inst);
+
+void inst_snapshot_drop(inst_snapshot * snap);
+
+// instantiate the snapshot's module in the vm with the state of the snapshot.
+r vm_instantiate_snapshot(vm * vm, inst_snapshot * snap);
+
+// bring a used module instance back to the state of the snapshot.
+r vm_reset_module_inst(module_inst * mod_inst, inst_snapshot * snap);
+
+// grow the memory by delta pages, returns the previous size in pages or -1 if it can't grow.
+i64 memory_inst_grow(memory_inst * mem_inst, u64 delta);
+
 // Once a thread enters a trapped state, all furthur reducing attempts will fail until it's reset.
 void thread_reset(thread * t);
 
+// called by the interpreters when the budget runs out.
+r thread_safepoint(thread * t);
+
+// allocate a tail call frame with at least cap slots, returns NULL if it's out of memory.
+tail_frame * thread_tail_frame_alloc(thread * t, u32 cap);
+
+void thread_tail_frame_free(thread * t, tail_frame * frame);
+
 // drop all the internal store and stacks and then clear the vm
 void vm_drop(vm * vm);
 
@@ -0,0 +1,396 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vm_pool.h"
+
+#include "alloc.h"
+#include "interpreter.h"
+
+#define VM_POOL_DEQUE_MIN_CAPACITY (16)
+
+static r deque_push(vm_pool_deque * dq, vm_pool_job job) {
+    check_prep(r);
+    if (dq->count == dq->capacity) {
+        u32 capacity = dq->capacity ? dq->capacity * 2 : VM_POOL_DEQUE_MIN_CAPACITY;
+        vm_pool_job * jobs = array_alloc(vm_pool_job, capacity);
+        if (!jobs) {
+            return err(e_general, "Failed to allocate the job queue");
+        }
+        for (u32 i = 0; i < dq->count; i++) {
+            jobs[i] = dq->jobs[(dq->head + i) & (dq->capacity - 1)];
+        }
+        array_free(dq->jobs);
+        dq->jobs = jobs;
+        dq->head = 0;
+        dq->capacity = capacity;
+    }
+    dq->jobs[(dq->head + dq->count) & (dq->capacity - 1)] = job;
+    dq->count++;
+    return ok_r;
+}
+
+static bool deque_pop_front(vm_pool_deque * dq, vm_pool_job * job) {
+    if (!dq->count) {
+        return false;
+    }
+    *job = dq->jobs[dq->head];
+    dq->head = (dq->head + 1) & (dq->capacity - 1);
+    dq->count--;
+    return true;
+}
+
+static bool deque_pop_back(vm_pool_deque * dq, vm_pool_job * job) {
+    if (!dq->count) {
+        return false;
+    }
+    dq->count--;
+    *job = dq->jobs[(dq->head + dq->count) & (dq->capacity - 1)];
+    return true;
+}
+
+static r worker_vm_setup(vm_pool * pool, vm_pool_worker * w) {
+    check_prep(r);
+    w->main_inst = NULL;
+    for (u32 i = 0; i < pool->mod_count; i++) {
+        if (pool->snaps) {
+            check(vm_instantiate_snapshot(&w->v, &pool->snaps[i]));
+        } else {
+            check(vm_instantiate_module(&w->v, pool->mods[i]));
+        }
+    }
+    w->main_inst = list_back_module_inst(&w->v.instances);
+    return ok_r;
+}
+
+static void worker_vm_reset(vm_pool * pool, vm_pool_worker * w) {
+    thread_reset(&w->v.thread);
+    if (w->main_inst && pool->snaps) {
+        assert(list_size_module_inst(&w->v.instances) == pool->mod_count);
+        r ret = ok_r;
+        u32 i = 0;
+        LIST_FOR_EACH(&w->v.instances, module_inst, mod_inst) {
+            if (is_ok(ret)) {
+                ret = vm_reset_module_inst(mod_inst, &pool->snaps[i++]);
+            }
+        }
+        if (is_ok(ret)) {
+            return;
+        }
+    }
+    // start over.
+    vm_drop(&w->v);
+    if (!is_ok(worker_vm_setup(pool, w))) {
+        w->main_inst = NULL;
+    }
+}
+
+// own jobs first, then steal from the others.
+static bool worker_take_job(vm_pool_worker * w, vm_pool_job * job) {
+    vm_pool * pool = w->pool;
+    os_mutex_lock(&w->lock);
+    bool found = deque_pop_front(&w->deque, job);
+    os_mutex_unlock(&w->lock);
+    for (u32 i = 1; i < pool->worker_count && !found; i++) {
+        vm_pool_worker * victim = &pool->workers[(w->id + i) % pool->worker_count];
+        os_mutex_lock(&victim->lock);
+        found = deque_pop_back(&victim->deque, job);
+        os_mutex_unlock(&victim->lock);
+        if (found) {
+            w->jobs_stolen++;
+        }
+    }
+    if (found) {
+        s_atomic_dec32(&pool->queued);
+    }
+    return found;
+}
+
+static r worker_call(vm_pool_worker * w, vm_pool_job * job) {
+    check_prep(r);
+    if (!w->main_inst) {
+        vec_clear_typed_value(&job->args);
+        return err(e_general, "The vm of the worker is unavailable");
+    }
+    func_addr f_addr = vm_find_module_func(&w->v, w->main_inst, job->func_name);
+    if (!f_addr) {
+        vec_clear_typed_value(&job->args);
+        return err(e_general, "Function not found");
+    }
+    return interp_call_in_thread(&w->v.thread, f_addr, job->args);
+}
+
+static void worker_run_job(vm_pool_worker * w, vm_pool_job * job) {
+    vm_pool * pool = w->pool;
+    r ret = worker_call(w, job);
+    if (job->cb) {
+        job->cb(job->payload, ret, &w->v.thread.results);
+    }
+    worker_vm_reset(pool, w);
+    w->jobs_done++;
+
+    if (s_atomic_dec32(&pool->pending) == 0) {
+        os_mutex_lock(&pool->lock);
+        os_cond_broadcast(&pool->idle);
+        os_mutex_unlock(&pool->lock);
+    }
+}
+
+static void worker_main(void * arg) {
+    vm_pool_worker * w = (vm_pool_worker *)arg;
+    vm_pool * pool = w->pool;
+    while (true) {
+        vm_pool_job job;
+        if (worker_take_job(w, &job)) {
+            worker_run_job(w, &job);
+            continue;
+        }
+        // the submitter signals under the lock after the queued counter is increased, so
+        // the wakeup can't be missed.
+        os_mutex_lock(&pool->lock);
+        while (!pool->stopping && !s_atomic_load32(&pool->queued)) {
+            os_cond_wait(&pool->wake, &pool->lock);
+        }
+        bool stop = pool->stopping && !s_atomic_load32(&pool->queued);
+        os_mutex_unlock(&pool->lock);
+        if (stop) {
+            return;
+        }
+    }
+}
+
+static void vm_pool_stop(vm_pool * pool) {
+    os_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    os_cond_broadcast(&pool->wake);
+    os_mutex_unlock(&pool->lock);
+    for (u32 i = 0; i < pool->worker_count; i++) {
+        vm_pool_worker * w = &pool->workers[i];
+        if (w->pool) {
+            os_thread_join(w->thread);
+        }
+    }
+}
+
+static r vm_pool_prepare(vm_pool * pool, module ** mods, u32 mod_count) {
+    check_prep(r);
+
+    pool->mods = array_alloc(module *, mod_count);
+    if (!pool->mods) {
+        return err(e_general, "Failed to allocate the pool");
+    }
+    for (u32 i = 0; i < mod_count; i++) {
+        check(module_freeze(mods[i]));
+        pool->mods[i] = mods[i];
+    }
+    pool->mod_count = mod_count;
+
+    // snapshot the initialized instances so that the workers never run the start functions
+    // again. Any failure simply falls back to instantiating.
+    vm v = {0};
+    r ret = ok_r;
+    for (u32 i = 0; i < mod_count && is_ok(ret); i++) {
+        ret = vm_instantiate_module(&v, mods[i]);
+    }
+    // the same module can't be instantiated twice in a vm.
+    if (is_ok(ret) && (list_size_module_inst(&v.instances) == mod_count)) {
+        pool->snaps = array_calloc(inst_snapshot, mod_count);
+    }
+    if (pool->snaps) {
+        u32 i = 0;
+        LIST_FOR_EACH(&v.instances, module_inst, mod_inst) {
+            r_inst_snapshot snap = vm_snapshot_module_inst(mod_inst);
+            if (!is_ok(snap)) {
+                ret = to_r(snap);
+                break;
+            }
+            pool->snaps[i++] = snap.value;
+        }
+        if (!is_ok(ret)) {
+            for (u32 j = 0; j < mod_count; j++) {
+                inst_snapshot_drop(&pool->snaps[j]);
+            }
+            array_free(pool->snaps);
+            pool->snaps = NULL;
+        }
+    }
+    vm_drop(&v);
+    return ok_r;
+}
+
+r vm_pool_init(vm_pool * pool, module ** mods, u32 mod_count, u32 worker_count) {
+    assert(pool);
+    assert(mods);
+    check_prep(r);
+
+    if (!mod_count) {
+        return err(e_general, "No module for the pool");
+    }
+    *pool = (vm_pool){0};
+    os_mutex_init(&pool->lock);
+    os_cond_init(&pool->wake);
+    os_cond_init(&pool->idle);
+    pool->started = true;
+    check(vm_pool_prepare(pool, mods, mod_count), vm_pool_drop(pool));
+
+    if (!worker_count) {
+        worker_count = os_cpu_count();
+    }
+    pool->workers = array_calloc(vm_pool_worker, worker_count);
+    if (!pool->workers) {
+        vm_pool_drop(pool);
+        return err(e_general, "Failed to allocate the workers");
+    }
+    pool->worker_count = worker_count;
+    for (u32 i = 0; i < worker_count; i++) {
+        pool->workers[i].id = i;
+        os_mutex_init(&pool->workers[i].lock);
+    }
+    // set up all the vms before any thread starts, the workers steal from each other.
+    for (u32 i = 0; i < worker_count; i++) {
+        check(worker_vm_setup(pool, &pool->workers[i]), vm_pool_drop(pool));
+    }
+    for (u32 i = 0; i < worker_count; i++) {
+        vm_pool_worker * w = &pool->workers[i];
+        w->pool = pool;
+        if (!os_thread_start(&w->thread, worker_main, w)) {
+            w->pool = NULL;
+            vm_pool_drop(pool);
+            return err(e_general, "Failed to start the worker thread");
+        }
+    }
+    return ok_r;
+}
+
+r vm_pool_submit(vm_pool * pool, str func_name, vec_typed_value args, vm_pool_callback cb, void * payload) {
+    assert(pool);
+    check_prep(r);
+
+    os_mutex_lock(&pool->lock);
+    bool stopping = pool->stopping;
+    os_mutex_unlock(&pool->lock);
+    if (stopping) {
+        vec_clear_typed_value(&args);
+        return err(e_general, "The pool is stopping");
+    }
+    vm_pool_job job = {
+        .func_name = func_name,
+        .args = args,
+        .cb = cb,
+        .payload = payload,
+    };
+    vm_pool_worker * w = &pool->workers[s_atomic_inc32(&pool->next_worker) % pool->worker_count];
+    s_atomic_inc32(&pool->pending);
+    // counted before it can be taken, so that the workers never see the counter go below zero.
+    os_mutex_lock(&w->lock);
+    s_atomic_inc32(&pool->queued);
+    r ret = deque_push(&w->deque, job);
+    if (!is_ok(ret)) {
+        s_atomic_dec32(&pool->queued);
+    }
+    os_mutex_unlock(&w->lock);
+    if (!is_ok(ret)) {
+        s_atomic_dec32(&pool->pending);
+        vec_clear_typed_value(&args);
+        return ret;
+    }
+    os_mutex_lock(&pool->lock);
+    os_cond_signal(&pool->wake);
+    os_mutex_unlock(&pool->lock);
+    return ok_r;
+}
+
+void vm_pool_wait(vm_pool * pool) {
+    assert(pool);
+    os_mutex_lock(&pool->lock);
+    while (s_atomic_load32(&pool->pending)) {
+        os_cond_wait(&pool->idle, &pool->lock);
+    }
+    os_mutex_unlock(&pool->lock);
+}
+
+void vm_pool_drop(vm_pool * pool) {
+    assert(pool);
+    if (!pool->started) {
+        return;
+    }
+    vm_pool_stop(pool);
+    for (u32 i = 0; i < pool->worker_count; i++) {
+        vm_pool_worker * w = &pool->workers[i];
+        assert(!w->deque.count);
+        array_free(w->deque.jobs);
+        vm_drop(&w->v);
+        os_mutex_drop(&w->lock);
+    }
+    array_free(pool->workers);
+    if (pool->snaps) {
+        for (u32 i = 0; i < pool->mod_count; i++) {
+            inst_snapshot_drop(&pool->snaps[i]);
+        }
+        array_free(pool->snaps);
+    }
+    array_free(pool->mods);
+    os_cond_drop(&pool->idle);
+    os_cond_drop(&pool->wake);
+    os_mutex_drop(&pool->lock);
+    *pool = (vm_pool){0};
+}
+
+void vm_pool_future_init(vm_pool_future * f) {
+    assert(f);
+    *f = (vm_pool_future){0};
+    os_mutex_init(&f->lock);
+    os_cond_init(&f->cond);
+}
+
+static void future_complete(void * payload, r ret, vec_typed_value * results) {
+    vm_pool_future * f = (vm_pool_future *)payload;
+    os_mutex_lock(&f->lock);
+    f->ret = ret;
+    VEC_FOR_EACH(results, typed_value, v) {
+        if (is_ok(f->ret)) {
+            f->ret = vec_push_typed_value(&f->results, *v);
+        }
+    }
+    f->done = true;
+    os_cond_signal(&f->cond);
+    os_mutex_unlock(&f->lock);
+}
+
+r vm_pool_submit_future(vm_pool * pool, str func_name, vec_typed_value args, vm_pool_future * f) {
+    assert(f);
+    f->done = false;
+    f->ret = ok_r;
+    vec_popall_typed_value(&f->results);
+    return vm_pool_submit(pool, func_name, args, future_complete, f);
+}
+
+r vm_pool_future_wait(vm_pool_future * f) {
+    assert(f);
+    os_mutex_lock(&f->lock);
+    while (!f->done) {
+        os_cond_wait(&f->cond, &f->lock);
+    }
+    r ret = f->ret;
+    os_mutex_unlock(&f->lock);
+    return ret;
+}
+
+void vm_pool_future_drop(vm_pool_future * f) {
+    assert(f);
+    vec_clear_typed_value(&f->results);
+    os_cond_drop(&f->cond);
+    os_mutex_drop(&f->lock);
+}
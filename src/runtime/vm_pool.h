@@ -0,0 +1,118 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Work-stealing vm pool.
+// The pool owns a number of worker threads, each with a vm holding the instances of the same
+// modules, which are frozen so that they can be shared. A job calls an export of the main
+// module (the last one) with the given arguments. Jobs are queued to the workers round-robin,
+// and an idle worker steals from the others. After each job the instances are brought back
+// to their initial state, by the snapshots (see vm.h) if possible, otherwise by instantiating
+// the modules again.
+//
+// The callbacks are called on the worker threads.
+
+#pragma once
+
+#include "module.h"
+#include "os_thread.h"
+#include "result.h"
+#include "types.h"
+#include "vm.h"
+
+// results are only valid in the callback.
+typedef void (*vm_pool_callback)(void * payload, r ret, vec_typed_value * results);
+
+typedef struct vm_pool_job {
+    str func_name;
+    vec_typed_value args;
+    vm_pool_callback cb;
+    void * payload;
+} vm_pool_job;
+
+// a ring buffer, the owner takes the jobs from the front and the thieves from the back.
+typedef struct vm_pool_deque {
+    vm_pool_job * jobs;
+    u32 head;
+    u32 count;
+    u32 capacity;
+} vm_pool_deque;
+
+struct vm_pool;
+typedef struct vm_pool_worker {
+    struct vm_pool * pool;
+    u32 id;
+    os_thread thread;
+    // protects the deque.
+    os_mutex lock;
+    vm_pool_deque deque;
+    vm v;
+    // NULL if the vm can't be set up again after a job.
+    module_inst * main_inst;
+    // stats, only written by the worker.
+    u64 jobs_done;
+    u64 jobs_stolen;
+} vm_pool_worker;
+
+typedef struct vm_pool {
+    module ** mods;
+    u32 mod_count;
+    // one per module, NULL if any of them can't be snapshotted.
+    inst_snapshot * snaps;
+    vm_pool_worker * workers;
+    u32 worker_count;
+    // the counters are only accessed with the s_atomic_* functions.
+    u32 next_worker;
+    u32 queued; // in the deques
+    u32 pending; // submitted and not finished
+    os_mutex lock;
+    os_cond wake; // jobs queued or stopping
+    os_cond idle; // no pending jobs
+    bool stopping;
+    bool started;
+} vm_pool;
+
+// Freeze the modules and start the workers. The modules are instantiated in order in each vm,
+// so the imported ones go first. worker_count 0 means one per cpu.
+// The modules must outlive the pool.
+r vm_pool_init(vm_pool * pool, module ** mods, u32 mod_count, u32 worker_count);
+
+// Queue a call of the export func_name of the main module. The args are taken over like
+// interp_call_in_thread, and func_name must be valid until the callback is called.
+r vm_pool_submit(vm_pool * pool, str func_name, vec_typed_value args, vm_pool_callback cb, void * payload);
+
+// wait for all the submitted jobs to finish.
+void vm_pool_wait(vm_pool * pool);
+
+// finish the queued jobs, then stop the workers and release everything.
+void vm_pool_drop(vm_pool * pool);
+
+// A future, for the callers that'd rather wait for the result.
+typedef struct vm_pool_future {
+    os_mutex lock;
+    os_cond cond;
+    bool done;
+    r ret;
+    vec_typed_value results;
+} vm_pool_future;
+
+void vm_pool_future_init(vm_pool_future * f);
+
+r vm_pool_submit_future(vm_pool * pool, str func_name, vec_typed_value args, vm_pool_future * f);
+
+// block until the job is done, the results are in f->results.
+r vm_pool_future_wait(vm_pool_future * f);
+
+void vm_pool_future_drop(vm_pool_future * f);
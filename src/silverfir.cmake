@@ -21,20 +21,33 @@ list(APPEND silverfir_sources
     ${silverfir_src_dir}/common/opcode.c
     ${silverfir_src_dir}/common/wasm_format.c
     ${silverfir_src_dir}/host/host_modules.c
+    ${silverfir_src_dir}/interpreter/atomics.c
     ${silverfir_src_dir}/interpreter/const_expr_eval.c
     ${silverfir_src_dir}/interpreter/in_place_dt.c
     ${silverfir_src_dir}/interpreter/in_place_tco.c
     ${silverfir_src_dir}/interpreter/interpreter.c
+    ${silverfir_src_dir}/interpreter/simd.c
     ${silverfir_src_dir}/jit/ir_builder.c
+    ${silverfir_src_dir}/runtime/code_cache.c
+    ${silverfir_src_dir}/runtime/green_sched.c
+    ${silverfir_src_dir}/runtime/jt_cache.c
+    ${silverfir_src_dir}/runtime/mem_image.c
     ${silverfir_src_dir}/runtime/module.c
     ${silverfir_src_dir}/runtime/parser.c
     ${silverfir_src_dir}/runtime/runtime.c
+    ${silverfir_src_dir}/runtime/shared_memory.c
+    ${silverfir_src_dir}/runtime/side_table.c
+    ${silverfir_src_dir}/runtime/stack_depth.c
     ${silverfir_src_dir}/runtime/validator.c
     ${silverfir_src_dir}/runtime/vm.c
+    ${silverfir_src_dir}/runtime/vm_pool.c
+    ${silverfir_src_dir}/utils/alloc.c
     ${silverfir_src_dir}/utils/containers_impl.c
     ${silverfir_src_dir}/utils/logger.c
+    ${silverfir_src_dir}/utils/lz4.c
     ${silverfir_src_dir}/utils/sjson.c
     ${silverfir_src_dir}/utils/str.c
+    ${silverfir_src_dir}/utils/str_map.c
     ${silverfir_src_dir}/utils/utf8.c
     ${silverfir_src_dir}/utils/vstr.c
 )
@@ -0,0 +1,355 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "alloc.h"
+
+#include <string.h>
+
+// in front of every block, which keeps the rest aligned to ALLOC_ALIGN.
+typedef union alloc_header {
+    struct {
+        allocator * a;
+        size_t size; // of the whole block
+    } h;
+    u8 align[ALLOC_ALIGN];
+} alloc_header;
+STATIC_ASSERT(sizeof(alloc_header) == ALLOC_ALIGN, alloc_header_size);
+
+INLINE size_t block_size(size_t size) {
+    return (sizeof(alloc_header) + size + ALLOC_ALIGN - 1) & ~(size_t)(ALLOC_ALIGN - 1);
+}
+
+INLINE alloc_header * header_of(void * p) {
+    return (alloc_header *)p - 1;
+}
+
+#if SILVERFIR_SYSTEM_ALLOCATOR
+static void * system_alloc(allocator * a, size_t size) {
+    UNUSED(a);
+    return malloc(size);
+}
+
+static void * system_resize(allocator * a, void * p, size_t old_size, size_t size) {
+    UNUSED(a);
+    UNUSED(old_size);
+    return realloc(p, size);
+}
+
+static void system_free(allocator * a, void * p, size_t size) {
+    UNUSED(a);
+    UNUSED(size);
+    free(p);
+}
+
+allocator alloc_system = {
+    .alloc = system_alloc,
+    .resize = system_resize,
+    .free = system_free,
+};
+
+static THREAD_LOCAL allocator * current = &alloc_system;
+#else
+static THREAD_LOCAL allocator * current = NULL;
+#endif
+
+allocator * alloc_current(void) {
+    return current;
+}
+
+allocator * alloc_enter(allocator * a) {
+    allocator * prev = current;
+    if (a) {
+        current = a;
+    }
+    return prev;
+}
+
+void alloc_leave(allocator * prev) {
+    current = prev;
+}
+
+void * alloc_new_in(allocator * a, size_t size) {
+    if (!a || (size > SIZE_MAX - 2 * ALLOC_ALIGN)) {
+        return NULL;
+    }
+    size_t bsize = block_size(size);
+    alloc_header * h = a->alloc(a, bsize);
+    if (!h) {
+        return NULL;
+    }
+    h->h.a = a;
+    h->h.size = bsize;
+    return h + 1;
+}
+
+void * alloc_new(size_t size) {
+    return alloc_new_in(current, size);
+}
+
+void * alloc_zeroed(size_t count, size_t size) {
+    if (size && (count > SIZE_MAX / size)) {
+        return NULL;
+    }
+    void * p = alloc_new(count * size);
+    if (p) {
+        memset(p, 0, count * size);
+    }
+    return p;
+}
+
+void * alloc_resize(void * p, size_t size) {
+    if (!p) {
+        return alloc_new(size);
+    }
+    if (size > SIZE_MAX - 2 * ALLOC_ALIGN) {
+        return NULL;
+    }
+    alloc_header * h = header_of(p);
+    allocator * a = h->h.a;
+    size_t old_size = h->h.size;
+    size_t bsize = block_size(size);
+    if (a->resize) {
+        alloc_header * resized = a->resize(a, h, old_size, bsize);
+        if (resized) {
+            resized->h.size = bsize;
+            return resized + 1;
+        }
+    }
+    // move it within the same allocator.
+    void * moved = alloc_new_in(a, size);
+    if (!moved) {
+        return NULL;
+    }
+    size_t old_len = old_size - sizeof(alloc_header);
+    memcpy(moved, p, old_len < size ? old_len : size);
+    a->free(a, h, old_size);
+    return moved;
+}
+
+void alloc_free(void * p) {
+    if (!p) {
+        return;
+    }
+    alloc_header * h = header_of(p);
+    h->h.a->free(h->h.a, h, h->h.size);
+}
+
+// arena
+
+typedef struct arena_chunk {
+    struct arena_chunk * next;
+    size_t size;
+    size_t used;
+} arena_chunk;
+
+typedef struct alloc_arena {
+    allocator base;
+    allocator * parent;
+    size_t chunk_size;
+    // the newest one first, only the first one is allocated from.
+    arena_chunk * chunks;
+    // the last block, which can still grow or be taken back.
+    u8 * last;
+    size_t size;
+    os_mutex lock;
+} alloc_arena;
+
+// the blocks start at the first aligned address after the chunk header.
+#define ARENA_CHUNK_HEADER (block_size(sizeof(arena_chunk)) - sizeof(alloc_header))
+
+INLINE u8 * chunk_data(arena_chunk * c) {
+    return (u8 *)c + ARENA_CHUNK_HEADER;
+}
+
+static void * arena_alloc(allocator * a, size_t size) {
+    alloc_arena * arena = TO_WRAPPER(alloc_arena, base, a);
+    os_mutex_lock(&arena->lock);
+    arena_chunk * c = arena->chunks;
+    if (!c || (c->size - c->used < size)) {
+        size_t chunk_size = size > arena->chunk_size ? size : arena->chunk_size;
+        c = alloc_new_in(arena->parent, ARENA_CHUNK_HEADER + chunk_size);
+        if (!c) {
+            os_mutex_unlock(&arena->lock);
+            return NULL;
+        }
+        c->size = chunk_size;
+        c->used = 0;
+        c->next = arena->chunks;
+        arena->chunks = c;
+        arena->size += ARENA_CHUNK_HEADER + chunk_size;
+    }
+    u8 * p = chunk_data(c) + c->used;
+    c->used += size;
+    arena->last = p;
+    os_mutex_unlock(&arena->lock);
+    return p;
+}
+
+static void * arena_resize(allocator * a, void * p, size_t old_size, size_t size) {
+    alloc_arena * arena = TO_WRAPPER(alloc_arena, base, a);
+    os_mutex_lock(&arena->lock);
+    arena_chunk * c = arena->chunks;
+    if ((p != arena->last) || (c->size - c->used + old_size < size)) {
+        p = NULL;
+    } else {
+        c->used = c->used - old_size + size;
+    }
+    os_mutex_unlock(&arena->lock);
+    return p;
+}
+
+static void arena_free(allocator * a, void * p, size_t size) {
+    alloc_arena * arena = TO_WRAPPER(alloc_arena, base, a);
+    os_mutex_lock(&arena->lock);
+    // only the last one can be taken back, the rest goes with the arena.
+    if (p == arena->last) {
+        arena->chunks->used -= size;
+        arena->last = NULL;
+    }
+    os_mutex_unlock(&arena->lock);
+}
+
+allocator * alloc_arena_new(size_t chunk_size) {
+    alloc_arena * arena = alloc_new(sizeof(alloc_arena));
+    if (!arena) {
+        return NULL;
+    }
+    *arena = (alloc_arena){
+        .base = {
+            .alloc = arena_alloc,
+            .resize = arena_resize,
+            .free = arena_free,
+        },
+        .parent = current,
+        .chunk_size = (chunk_size + ALLOC_ALIGN - 1) & ~(size_t)(ALLOC_ALIGN - 1),
+    };
+    os_mutex_init(&arena->lock);
+    return &arena->base;
+}
+
+void alloc_arena_drop(allocator * a) {
+    if (!a) {
+        return;
+    }
+    alloc_arena * arena = TO_WRAPPER(alloc_arena, base, a);
+    arena_chunk * c = arena->chunks;
+    while (c) {
+        arena_chunk * next = c->next;
+        alloc_free(c);
+        c = next;
+    }
+    os_mutex_drop(&arena->lock);
+    alloc_free(arena);
+}
+
+size_t alloc_arena_size(allocator * a) {
+    alloc_arena * arena = TO_WRAPPER(alloc_arena, base, a);
+    os_mutex_lock(&arena->lock);
+    size_t size = arena->size;
+    os_mutex_unlock(&arena->lock);
+    return size;
+}
+
+// fixed buffer
+
+struct alloc_fixed_block {
+    size_t size;
+    struct alloc_fixed_block * next;
+};
+STATIC_ASSERT(sizeof(alloc_fixed_block) <= ALLOC_ALIGN, alloc_fixed_block_size);
+
+static void * fixed_alloc(allocator * a, size_t size) {
+    alloc_fixed * f = TO_WRAPPER(alloc_fixed, base, a);
+    os_mutex_lock(&f->lock);
+    u8 * p = NULL;
+    alloc_fixed_block ** link = &f->free_list;
+    for (alloc_fixed_block * b = *link; b; link = &b->next, b = b->next) {
+        if (b->size < size) {
+            continue;
+        }
+        // take the tail so the block stays where it is, the rest is always big enough for a
+        // block header because of the alignment.
+        if (b->size == size) {
+            *link = b->next;
+            p = (u8 *)b;
+        } else {
+            b->size -= size;
+            p = (u8 *)b + b->size;
+        }
+        f->used += size;
+        if (f->used > f->peak) {
+            f->peak = f->used;
+        }
+        break;
+    }
+    os_mutex_unlock(&f->lock);
+    return p;
+}
+
+static void fixed_free(allocator * a, void * p, size_t size) {
+    alloc_fixed * f = TO_WRAPPER(alloc_fixed, base, a);
+    alloc_fixed_block * block = (alloc_fixed_block *)p;
+    os_mutex_lock(&f->lock);
+    alloc_fixed_block * prev = NULL;
+    alloc_fixed_block * next = f->free_list;
+    while (next && (next < block)) {
+        prev = next;
+        next = next->next;
+    }
+    block->size = size;
+    block->next = next;
+    // merge with the neighbours.
+    if (next && ((u8 *)block + block->size == (u8 *)next)) {
+        block->size += next->size;
+        block->next = next->next;
+    }
+    if (prev && ((u8 *)prev + prev->size == (u8 *)block)) {
+        prev->size += block->size;
+        prev->next = block->next;
+    } else if (prev) {
+        prev->next = block;
+    } else {
+        f->free_list = block;
+    }
+    f->used -= size;
+    os_mutex_unlock(&f->lock);
+}
+
+void alloc_fixed_init(alloc_fixed * f, void * buf, size_t size) {
+    assert(f);
+    u8 * begin = (u8 *)(((uptr)buf + ALLOC_ALIGN - 1) & ~(uptr)(ALLOC_ALIGN - 1));
+    size_t skipped = (size_t)(begin - (u8 *)buf);
+    size = size > skipped ? (size - skipped) & ~(size_t)(ALLOC_ALIGN - 1) : 0;
+    *f = (alloc_fixed){
+        .base = {
+            .alloc = fixed_alloc,
+            .free = fixed_free,
+        },
+        .buf = begin,
+        .size = size,
+    };
+    os_mutex_init(&f->lock);
+    if (size) {
+        f->free_list = (alloc_fixed_block *)begin;
+        f->free_list->size = size;
+        f->free_list->next = NULL;
+    }
+}
+
+void alloc_fixed_drop(alloc_fixed * f) {
+    assert(f);
+    os_mutex_drop(&f->lock);
+}
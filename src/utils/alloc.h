@@ -14,15 +14,82 @@
  * limitations under the License.
  */
 
+// All the heap allocations go through an allocator. The current one is picked per OS thread
+// with alloc_enter(): a runtime makes its own current while it works on its modules and vms
+// (see runtime.h). Every block remembers the allocator it came from, so it's freed or resized
+// by that one no matter which is current then.
+//
+// There are three of them:
+//   the system one, malloc and free. It's the default, unless SILVERFIR_SYSTEM_ALLOCATOR is 0.
+//   an arena, which takes big chunks from another allocator and only frees them all at once in
+//   alloc_arena_drop(). Nothing fragments, and a module can have its own (see runtime.h).
+//   a fixed buffer given by the user, for the builds without a heap. It's a first-fit free list
+//   which merges the neighbours, so the memory used never goes beyond the buffer.
+// The vms of a runtime share its allocator while they run on different OS threads (see
+// vm_pool.h), so the arena and the fixed buffer take a lock of their own on every call.
+
 #pragma once
 
 #include "compiler.h"
+#include "os_thread.h"
 #include "silverfir.h"
+#include "types.h"
 
 #include <stdlib.h>
 
-#define array_realloc(type, p, new_size) realloc(p, new_size * sizeof(type))
-#define array_free(p) free(p)
-#define array_alloc(type, count) malloc(sizeof(type) * count)
-#define array_calloc(type, count) calloc(count, sizeof(type))
+// The allocators work on the whole blocks, sizes are multiples of ALLOC_ALIGN.
+#define ALLOC_ALIGN (16)
+
+typedef struct allocator {
+    // NULL if it runs out.
+    void * (*alloc)(struct allocator * a, size_t size);
+    // Resize a block in place, or return NULL to have it moved with alloc and free. Optional.
+    void * (*resize)(struct allocator * a, void * p, size_t old_size, size_t size);
+    void (*free)(struct allocator * a, void * p, size_t size);
+} allocator;
+
+#if SILVERFIR_SYSTEM_ALLOCATOR
+extern allocator alloc_system;
+#endif
+
+// The allocator of the calling thread, NULL if there's none.
+allocator * alloc_current(void);
+
+// Make a current unless it's NULL, and return the previous one for alloc_leave().
+allocator * alloc_enter(allocator * a);
+void alloc_leave(allocator * prev);
+
+void * alloc_new_in(allocator * a, size_t size);
+void * alloc_new(size_t size);
+void * alloc_zeroed(size_t count, size_t size);
+void * alloc_resize(void * p, size_t size);
+void alloc_free(void * p);
+
+// An arena taking chunks of chunk_size from the current allocator. NULL if it runs out.
+allocator * alloc_arena_new(size_t chunk_size);
+// Free all the chunks and the arena itself.
+void alloc_arena_drop(allocator * arena);
+// The bytes taken from the parent.
+size_t alloc_arena_size(allocator * arena);
+
+typedef struct alloc_fixed_block alloc_fixed_block;
+typedef struct alloc_fixed {
+    allocator base;
+    os_mutex lock;
+    u8 * buf;
+    size_t size;
+    // sorted by the address.
+    alloc_fixed_block * free_list;
+    size_t used;
+    size_t peak;
+} alloc_fixed;
+
+// Allocate from a user buffer, which must outlive everything allocated from it.
+void alloc_fixed_init(alloc_fixed * f, void * buf, size_t size);
+void alloc_fixed_drop(alloc_fixed * f);
+
+#define array_realloc(type, p, new_size) alloc_resize(p, (new_size) * sizeof(type))
+#define array_free(p) alloc_free(p)
+#define array_alloc(type, count) alloc_new(sizeof(type) * (count))
+#define array_calloc(type, count) alloc_zeroed(count, sizeof(type))
 #define array_alloca(type, count) alloca(sizeof(type) * count)
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// An intrusive LRU list over an array, linked by index. The entries are whatever the owner
+// keeps per index, they only need an lru_link member named lru. The list itself never
+// allocates, the owner allocates the entries and initializes every link with LRU_LINK_INIT.
+//      typedef struct my_entry { lru_link lru; ... } my_entry;
+//      LRU_IMPL_FOR_TYPE(my_entry)
+//      lru_list l = LRU_LIST_INIT;
+//      lru_push_front_my_entry(&l, entries, idx); // when it's loaded
+//      lru_touch_my_entry(&l, entries, idx);      // when it's used again
+//      while (over_budget && l.tail != idx) { lru_unlink_my_entry(&l, entries, l.tail); ... }
+
+#pragma once
+
+#include "compiler.h"
+#include "types.h"
+
+#define LRU_NONE u32_MAX
+
+typedef struct lru_link {
+    u32 prev;
+    u32 next;
+} lru_link;
+
+typedef struct lru_list {
+    // the most and the least recently used.
+    u32 head;
+    u32 tail;
+} lru_list;
+
+#define LRU_LINK_INIT ((lru_link){.prev = LRU_NONE, .next = LRU_NONE})
+#define LRU_LIST_INIT ((lru_list){.head = LRU_NONE, .tail = LRU_NONE})
+
+#define LRU_IMPL_FOR_TYPE(type)                                                    \
+    INLINE void lru_unlink_##type(lru_list * l, type * entries, u32 idx) {         \
+        lru_link * e = &entries[idx].lru;                                          \
+        if (e->prev != LRU_NONE) {                                                 \
+            entries[e->prev].lru.next = e->next;                                   \
+        } else {                                                                   \
+            l->head = e->next;                                                     \
+        }                                                                          \
+        if (e->next != LRU_NONE) {                                                 \
+            entries[e->next].lru.prev = e->prev;                                   \
+        } else {                                                                   \
+            l->tail = e->prev;                                                     \
+        }                                                                          \
+        *e = LRU_LINK_INIT;                                                        \
+    }                                                                              \
+    INLINE void lru_push_front_##type(lru_list * l, type * entries, u32 idx) {     \
+        lru_link * e = &entries[idx].lru;                                          \
+        e->prev = LRU_NONE;                                                        \
+        e->next = l->head;                                                         \
+        if (l->head != LRU_NONE) {                                                 \
+            entries[l->head].lru.prev = idx;                                       \
+        } else {                                                                   \
+            l->tail = idx;                                                         \
+        }                                                                          \
+        l->head = idx;                                                             \
+    }                                                                              \
+    /* move a linked entry to the front. */                                        \
+    INLINE void lru_touch_##type(lru_list * l, type * entries, u32 idx) {          \
+        if (l->head != idx) {                                                      \
+            lru_unlink_##type(l, entries, idx);                                    \
+            lru_push_front_##type(l, entries, idx);                                \
+        }                                                                          \
+    }
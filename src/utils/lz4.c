@@ -0,0 +1,193 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "lz4.h"
+
+#include "alloc.h"
+
+#include <string.h>
+
+#define LZ4_MIN_MATCH (4)
+// the last 5 bytes are always literals, and the last match starts 12 bytes before the end.
+#define LZ4_LAST_LITERALS (5)
+#define LZ4_MF_LIMIT (12)
+#define LZ4_MAX_OFFSET (65535)
+#define LZ4_HASH_LOG (12)
+#define LZ4_RUN_MASK (15)
+
+INLINE u32 read_u32(const u8 * p) {
+    u32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+INLINE u32 hash4(u32 v) {
+    return (v * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+// the part of a length that doesn't fit in the token.
+static u8 * write_length(u8 * op, size_t len) {
+    for (; len >= 255; len -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (u8)len;
+    return op;
+}
+
+static u8 * write_literals(u8 * op, const u8 * literals, size_t len, u8 * token) {
+    if (len >= LZ4_RUN_MASK) {
+        *token = LZ4_RUN_MASK << 4;
+        op = write_length(op, len - LZ4_RUN_MASK);
+    } else {
+        *token = (u8)(len << 4);
+    }
+    memcpy(op, literals, len);
+    return op + len;
+}
+
+r_size_t lz4_compress(str src, u8 * dst, size_t dst_cap) {
+    assert(dst);
+    check_prep(r_size_t);
+
+    size_t len = str_len(src);
+    if (dst_cap < lz4_compress_bound(len)) {
+        return err(e_general, "The output buffer is too small");
+    }
+    const u8 * base = src.ptr;
+    const u8 * end = base + len;
+    const u8 * anchor = base;
+    u8 * op = dst;
+    if (len > LZ4_MF_LIMIT) {
+        // the positions of the last 4 bytes seen with each hash.
+        u32 * table = array_calloc(u32, 1u << LZ4_HASH_LOG);
+        if (!table) {
+            return err(e_general, "Failed to allocate the hash table");
+        }
+        const u8 * match_start_limit = end - LZ4_MF_LIMIT;
+        const u8 * match_end_limit = end - LZ4_LAST_LITERALS;
+        const u8 * ip = base;
+        while (ip < match_start_limit) {
+            u32 h = hash4(read_u32(ip));
+            const u8 * ref = base + table[h];
+            table[h] = (u32)(ip - base);
+            if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || read_u32(ref) != read_u32(ip)) {
+                ip++;
+                continue;
+            }
+            size_t match_len = LZ4_MIN_MATCH;
+            while (ip + match_len < match_end_limit && ref[match_len] == ip[match_len]) {
+                match_len++;
+            }
+            while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+                match_len++;
+            }
+            u8 * token = op++;
+            op = write_literals(op, anchor, ip - anchor, token);
+            size_t offset = ip - ref;
+            *op++ = (u8)offset;
+            *op++ = (u8)(offset >> 8);
+            if (match_len - LZ4_MIN_MATCH >= LZ4_RUN_MASK) {
+                *token |= LZ4_RUN_MASK;
+                op = write_length(op, match_len - LZ4_MIN_MATCH - LZ4_RUN_MASK);
+            } else {
+                *token |= (u8)(match_len - LZ4_MIN_MATCH);
+            }
+            ip += match_len;
+            anchor = ip;
+        }
+        array_free(table);
+    }
+    // the last sequence has the literals only.
+    u8 * token = op++;
+    op = write_literals(op, anchor, end - anchor, token);
+    return ok((size_t)(op - dst));
+}
+
+static r_size_t read_length(const u8 ** ip, const u8 * end, size_t len) {
+    check_prep(r_size_t);
+    u8 b;
+    do {
+        if (*ip == end) {
+            return err(e_malformed, "Truncated compressed block");
+        }
+        b = *(*ip)++;
+        len += b;
+    } while (b == 255);
+    return ok(len);
+}
+
+r lz4_decompress(str src, u8 * dst, size_t dst_len) {
+    assert(dst);
+    check_prep(r);
+
+    const u8 * ip = src.ptr;
+    const u8 * end = ip + str_len(src);
+    u8 * op = dst;
+    u8 * op_end = dst + dst_len;
+    while (true) {
+        if (ip == end) {
+            return err(e_malformed, "Truncated compressed block");
+        }
+        u8 token = *ip++;
+        size_t literal_len = token >> 4;
+        if (literal_len == LZ4_RUN_MASK) {
+            unwrap(size_t, l, read_length(&ip, end, literal_len));
+            literal_len = l;
+        }
+        if (literal_len > (size_t)(end - ip) || literal_len > (size_t)(op_end - op)) {
+            return err(e_malformed, "Invalid literal length");
+        }
+        memcpy(op, ip, literal_len);
+        ip += literal_len;
+        op += literal_len;
+        if (ip == end) {
+            break;
+        }
+        if (end - ip < 2) {
+            return err(e_malformed, "Truncated compressed block");
+        }
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (!offset || offset > (size_t)(op - dst)) {
+            return err(e_malformed, "Invalid match offset");
+        }
+        size_t match_len = token & LZ4_RUN_MASK;
+        if (match_len == LZ4_RUN_MASK) {
+            unwrap(size_t, l, read_length(&ip, end, match_len));
+            match_len = l;
+        }
+        match_len += LZ4_MIN_MATCH;
+        if (match_len > (size_t)(op_end - op)) {
+            return err(e_malformed, "Invalid match length");
+        }
+        const u8 * ref = op - offset;
+        if (offset >= match_len) {
+            memcpy(op, ref, match_len);
+            op += match_len;
+        } else {
+            // overlapped, it repeats the last offset bytes.
+            for (size_t i = 0; i < match_len; i++) {
+                *op++ = ref[i];
+            }
+        }
+    }
+    if (op != op_end) {
+        return err(e_malformed, "Decompressed size mismatch");
+    }
+    return ok_r;
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// LZ4 block format codec.
+// Only the raw blocks, without the frame format. The compressor is a greedy single pass with a
+// small hash table, it's used offline so the ratio matters more than the speed. The decompressor
+// checks every length against both buffers so a corrupted block can't read or write out of them.
+
+#pragma once
+
+#include "result.h"
+#include "str.h"
+#include "types.h"
+
+// The largest compressed size of len bytes.
+INLINE size_t lz4_compress_bound(size_t len) {
+    return len + len / 255 + 16;
+}
+
+// Compress src into dst, which must have lz4_compress_bound() bytes. Returns the compressed size.
+r_size_t lz4_compress(str src, u8 * dst, size_t dst_cap);
+
+// Decompress a block that's exactly dst_len bytes when decompressed.
+r lz4_decompress(str src, u8 * dst, size_t dst_len);
@@ -91,3 +91,13 @@ INLINE bool str_is_null(str s) {
 INLINE size_t str_len(str s) {
     return s.len;
 }
+
+// FNV-1a
+INLINE u32 str_hash(str s) {
+    u32 hash = 2166136261u;
+    for (size_t i = 0; i < s.len; i++) {
+        hash ^= s.ptr[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "str_map.h"
+
+#include "vec_impl.h"
+
+VEC_IMPL_FOR_TYPE(str_map_entry)
+
+#define STR_MAP_MIN_CAPACITY (8)
+
+// where the key is, or the empty slot to put it in.
+static size_t str_map_probe(const str_map * m, str key) {
+    vec_str_map_entry * slots = (vec_str_map_entry *)&m->slots;
+    size_t mask = vec_size_str_map_entry(slots) - 1;
+    size_t i = str_hash(key) & mask;
+    while (true) {
+        const str_map_entry * e = vec_at_str_map_entry(slots, i);
+        if (!e->used || str_eq(e->key, key)) {
+            return i;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+static r str_map_rehash(str_map * m, size_t capacity) {
+    check_prep(r);
+    str_map new_map = {0};
+    check(vec_resize_str_map_entry(&new_map.slots, capacity));
+    memset(vec_at_str_map_entry(&new_map.slots, 0), 0, capacity * sizeof(str_map_entry));
+    VEC_FOR_EACH(&m->slots, str_map_entry, e) {
+        if (e->used) {
+            *vec_at_str_map_entry(&new_map.slots, str_map_probe(&new_map, e->key)) = *e;
+        }
+    }
+    new_map.count = m->count;
+    str_map_clear(m);
+    *m = new_map;
+    return ok_r;
+}
+
+r str_map_put(str_map * m, str key, uptr value) {
+    assert(m);
+    check_prep(r);
+
+    // keep the load factor under 1/2 so that the probing is short.
+    size_t capacity = vec_size_str_map_entry(&m->slots);
+    if ((m->count + 1) * 2 > capacity) {
+        check(str_map_rehash(m, capacity ? capacity * 2 : STR_MAP_MIN_CAPACITY));
+    }
+    str_map_entry * e = vec_at_str_map_entry(&m->slots, str_map_probe(m, key));
+    if (!e->used) {
+        e->key = key;
+        e->used = true;
+        m->count++;
+    }
+    e->value = value;
+    return ok_r;
+}
+
+bool str_map_get(const str_map * m, str key, uptr * value) {
+    assert(m);
+    assert(value);
+    if (!m->count) {
+        return false;
+    }
+    const str_map_entry * e = vec_at_str_map_entry((vec_str_map_entry *)&m->slots, str_map_probe(m, key));
+    if (!e->used) {
+        return false;
+    }
+    *value = e->value;
+    return true;
+}
+
+bool str_map_remove(str_map * m, str key) {
+    assert(m);
+    assert(!m->slots.fixed);
+    if (!m->count) {
+        return false;
+    }
+    size_t mask = vec_size_str_map_entry(&m->slots) - 1;
+    size_t i = str_map_probe(m, key);
+    str_map_entry * hole = vec_at_str_map_entry(&m->slots, i);
+    if (!hole->used) {
+        return false;
+    }
+    // backward shift deletion, so that we don't need tombstones.
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        str_map_entry * e = vec_at_str_map_entry(&m->slots, j);
+        if (!e->used) {
+            break;
+        }
+        // the entry can fill the hole only if the hole is not before its home slot.
+        size_t home = str_hash(e->key) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            *vec_at_str_map_entry(&m->slots, i) = *e;
+            i = j;
+        }
+    }
+    *vec_at_str_map_entry(&m->slots, i) = (str_map_entry){0};
+    m->count--;
+    return true;
+}
+
+void str_map_clear(str_map * m) {
+    assert(m);
+    if (!m->slots.fixed) {
+        vec_clear_str_map_entry(&m->slots);
+    }
+    *m = (str_map){0};
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A hash map with str keys, open addressing with linear probing.
+// The keys are NOT copied, so they must outlive the map, just like any other str.
+// The slots can also point to a static array (fixed), which is how the host module
+// descriptors embed their export index. The layout is the same as what trampo_gen.py
+// generates, so keep them in sync.
+
+#pragma once
+
+#include "result.h"
+#include "silverfir.h"
+#include "str.h"
+#include "types.h"
+#include "vec.h"
+
+typedef struct str_map_entry {
+    str key; // can be empty, e.g. wasm allows empty export names.
+    uptr value;
+    bool used;
+} str_map_entry;
+VEC_DECL_FOR_TYPE(str_map_entry)
+
+typedef struct str_map {
+    vec_str_map_entry slots; // the size is always zero or a power of two.
+    size_t count;
+} str_map;
+
+// insert a new key or overwrite the value of an existing one.
+r str_map_put(str_map * m, str key, uptr value);
+
+// returns false if the key is not found.
+bool str_map_get(const str_map * m, str key, uptr * value);
+
+// returns false if the key is not found.
+bool str_map_remove(str_map * m, str key);
+
+void str_map_clear(str_map * m);
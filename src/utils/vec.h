@@ -244,3 +244,114 @@ extern void vec_undefined(int, ...);
 
 #define VEC_DECL_FOR_TYPE(type) VEC_DECL_FOR_TYPE_BUILTIN(type, _)
 FOR_EACH_TYPE(VEC_DECL_FOR_TYPE_BUILTIN, _)
+
+// A small vector keeps the first n elements inside of the struct and only goes to the heap
+// when it grows beyond that, which suits the ones that usually hold a handful of elements.
+//      SVEC_DECL_FOR_TYPE(custom, 4)
+//      svec_custom cvec = {0};
+//      r result = svec_push_custom(&cvec, 0x1);
+// Since the inline elements move together with the struct, it can be copied or kept in
+// another vector like any other value, but the data pointer is taken with svec_data()
+// every time instead of being stored. There's no generic function names for it.
+#define SVEC_TYPE_DECL(type, n)                 \
+    typedef struct svec_##type {                \
+        size_t _size;                           \
+        size_t _capacity; /* of the heap. */    \
+        type * _heap;     /* NULL if inline. */ \
+        bool fixed;                             \
+        type _inline[n];                        \
+    } svec_##type;
+
+#define SVEC_INLINE_CAPACITY(v) (sizeof((v)->_inline) / sizeof((v)->_inline[0]))
+
+#define SVEC_DATA_DECL(type, _)                        \
+    INLINE type * svec_data_##type(svec_##type * v) {  \
+        return (v)->_heap ? (v)->_heap : (v)->_inline; \
+    }
+
+#define SVEC_CAPACITY_DECL(type, _)                                   \
+    INLINE size_t svec_capacity_##type(svec_##type * v) {             \
+        return (v)->_heap ? (v)->_capacity : SVEC_INLINE_CAPACITY(v); \
+    }
+
+#define SVEC_IS_VALID_DECL(type, _)                                                                                                                     \
+    INLINE bool svec_is_valid_##type(svec_##type * v) {                                                                                                 \
+        assert(v);                                                                                                                                      \
+        return ((v)->_heap) ? (((v)->_capacity > SVEC_INLINE_CAPACITY(v)) && ((v)->_capacity >= (v)->_size)) : ((v)->_size <= SVEC_INLINE_CAPACITY(v)); \
+    }
+
+// Same as the vec ones, except that shrink_to_fit moves the elements back inside of the
+// struct if they fit.
+#define SVEC_CLEAR_DECL(type, _) void svec_clear_##type(svec_##type * v);
+#define SVEC_RESERVE_DECL(type, _) r svec_reserve_##type(svec_##type * v, size_t capacity);
+#define SVEC_RESIZE_DECL(type, _) r svec_resize_##type(svec_##type * v, size_t new_size);
+#define SVEC_SHRINK_TO_FIT_DECL(type, _) r svec_shrink_to_fit_##type(svec_##type * v);
+
+// The slow path is out of line so that the push is as cheap as the vec one.
+#define SVEC_PUSH_DECL(type, _)                                               \
+    INLINE r svec_push_##type(svec_##type * v, type e) {                      \
+        assert(svec_is_valid_##type(v));                                      \
+        check_prep(r);                                                        \
+        if (unlikely((v)->_size == svec_capacity_##type(v))) {                \
+            size_t new_capacity = (size_t)((v)->_size * VEC_GROW_FACTOR) + 1; \
+            check(svec_reserve_##type(v, new_capacity));                      \
+        }                                                                     \
+        svec_data_##type(v)[(v)->_size] = e;                                  \
+        (v)->_size++;                                                         \
+        return ok_r;                                                          \
+    }
+
+#define SVEC_POP_DECL(type, _)                     \
+    INLINE void svec_pop_##type(svec_##type * v) { \
+        assert(svec_is_valid_##type(v));           \
+        assert((v)->_size);                        \
+        (v)->_size--;                              \
+    }
+
+#define SVEC_POPALL_DECL(type, _)                     \
+    INLINE void svec_popall_##type(svec_##type * v) { \
+        assert(svec_is_valid_##type(v));              \
+        (v)->_size = 0;                               \
+    }
+
+#define SVEC_SIZE_DECL(type, _)                       \
+    INLINE size_t svec_size_##type(svec_##type * v) { \
+        return (v)->_size;                            \
+    }
+
+// unchecked, the same as vec_at.
+#define SVEC_AT_DECL(type, _)                                   \
+    INLINE type * svec_at_##type(svec_##type * v, size_t idx) { \
+        assert(idx < (v)->_size);                               \
+        return svec_data_##type(v) + idx;                       \
+    }
+
+#define SVEC_BACK_DECL(type, _)                       \
+    INLINE type * svec_back_##type(svec_##type * v) { \
+        assert((v)->_size);                           \
+        return svec_data_##type(v) + (v)->_size - 1;  \
+    }
+
+#define svec_set_fixed(v, f) ((v)->fixed = f)
+
+// Unchecked!!
+#define SVEC_FOR_EACH(vec, type, iter)                                                                        \
+    for (type * iter = svec_data_##type(vec), *_end_##iter = iter + (vec)->_size; iter < _end_##iter; iter++)
+
+#define SVEC_DECL_FOR_TYPE(type, n)  \
+    UNUSED_FUNCTION_WARNING_PUSH     \
+    SVEC_TYPE_DECL(type, n)          \
+    SVEC_DATA_DECL(type, _)          \
+    SVEC_CAPACITY_DECL(type, _)      \
+    SVEC_IS_VALID_DECL(type, _)      \
+    SVEC_CLEAR_DECL(type, _)         \
+    SVEC_RESERVE_DECL(type, _)       \
+    SVEC_RESIZE_DECL(type, _)        \
+    SVEC_SHRINK_TO_FIT_DECL(type, _) \
+    SVEC_PUSH_DECL(type, _)          \
+    SVEC_POP_DECL(type, _)           \
+    SVEC_POPALL_DECL(type, _)        \
+    SVEC_SIZE_DECL(type, _)          \
+    SVEC_AT_DECL(type, _)            \
+    SVEC_BACK_DECL(type, _)          \
+    UNUSED_FUNCTION_WARNING_POP
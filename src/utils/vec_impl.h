@@ -154,3 +154,90 @@
     VEC_RESIZE_IMPL(type, _)
 
 #define VEC_IMPL_FOR_TYPE(type) VEC_IMPL_FOR_TYPE_BUILTIN(type, _)
+
+#define SVEC_CLEAR_IMPL(type, _)              \
+    void svec_clear_##type(svec_##type * v) { \
+        assert(svec_is_valid_##type(v));      \
+        if ((v)->_heap) {                     \
+            array_free((v)->_heap);           \
+        }                                     \
+        (v)->_heap = NULL;                    \
+        (v)->_capacity = 0;                   \
+        (v)->_size = 0;                       \
+        (v)->fixed = false;                   \
+    }
+
+// The inline elements are copied out the first time it goes to the heap.
+#define SVEC_RESERVE_IMPL(type, _)                                  \
+    r svec_reserve_##type(svec_##type * v, size_t reserve_size) {   \
+        assert(svec_is_valid_##type(v));                            \
+        check_prep(r);                                              \
+        if (reserve_size <= svec_capacity_##type(v)) {              \
+            return ok_r;                                            \
+        }                                                           \
+        if ((v)->fixed) {                                           \
+            return err(e_general, "vector is fixed");               \
+        }                                                           \
+        type * _data;                                               \
+        if ((v)->_heap) {                                           \
+            _data = array_realloc(type, (v)->_heap, reserve_size);  \
+            if (!_data) {                                           \
+                return err(e_general, "vector: realloc failed");    \
+            }                                                       \
+        } else {                                                    \
+            _data = array_alloc(type, reserve_size);                \
+            if (!_data) {                                           \
+                return err(e_general, "vector: out of memory");     \
+            }                                                       \
+            memcpy(_data, (v)->_inline, (v)->_size * sizeof(type)); \
+        }                                                           \
+        (v)->_capacity = reserve_size;                              \
+        (v)->_heap = _data;                                         \
+        return ok_r;                                                \
+    }
+
+#define SVEC_RESIZE_IMPL(type, _)                                                        \
+    r svec_resize_##type(svec_##type * v, size_t size) {                                 \
+        assert(svec_is_valid_##type(v));                                                 \
+        check_prep(r);                                                                   \
+        if (size <= (v)->_size) {                                                        \
+            (v)->_size = size;                                                           \
+            return ok_r;                                                                 \
+        }                                                                                \
+        check(svec_reserve_##type(v, size));                                             \
+        memset(svec_data_##type(v) + (v)->_size, 0, (size - (v)->_size) * sizeof(type)); \
+        (v)->_size = size;                                                               \
+        return ok_r;                                                                     \
+    }
+
+#define SVEC_SHRINK_TO_FIT_IMPL(type, _)                                 \
+    r svec_shrink_to_fit_##type(svec_##type * v) {                       \
+        assert(svec_is_valid_##type(v));                                 \
+        check_prep(r);                                                   \
+        if ((v)->fixed) {                                                \
+            return err(e_general, "vector is fixed");                    \
+        }                                                                \
+        if (!(v)->_heap || ((v)->_size == (v)->_capacity)) {             \
+            return ok_r;                                                 \
+        }                                                                \
+        if ((v)->_size <= SVEC_INLINE_CAPACITY(v)) {                     \
+            memcpy((v)->_inline, (v)->_heap, (v)->_size * sizeof(type)); \
+            array_free((v)->_heap);                                      \
+            (v)->_heap = NULL;                                           \
+            (v)->_capacity = 0;                                          \
+            return ok_r;                                                 \
+        }                                                                \
+        type * _data = array_realloc(type, (v)->_heap, (v)->_size);      \
+        if (!_data) {                                                    \
+            return err(e_general, "vector: realloc failed");             \
+        }                                                                \
+        (v)->_capacity = (v)->_size;                                     \
+        (v)->_heap = _data;                                              \
+        return ok_r;                                                     \
+    }
+
+#define SVEC_IMPL_FOR_TYPE(type)     \
+    SVEC_CLEAR_IMPL(type, _)         \
+    SVEC_RESERVE_IMPL(type, _)       \
+    SVEC_RESIZE_IMPL(type, _)        \
+    SVEC_SHRINK_TO_FIT_IMPL(type, _)
@@ -71,7 +71,7 @@ static r register_module_as(runner_ctx * ctx, str module_name, str as_name) {
         }
     }
     unwrap(vstr, newname, vstr_dup(as_name));
-    check(module_register_name(m, newname));
+    check(runtime_module_register_name(&ctx->rt, m, newname));
     return ok_r;
 }
 
@@ -250,6 +250,100 @@ static r_typed_value read_value(str val_type, str val) {
     return ok(tv);
 }
 
+#if SILVERFIR_ENABLE_SIMD
+static u32 v128_lane_size(str lane_type) {
+    if (str_eq(lane_type, s("i8"))) {
+        return 1;
+    } else if (str_eq(lane_type, s("i16"))) {
+        return 2;
+    } else if (str_eq(lane_type, s("i32")) || str_eq(lane_type, s("f32"))) {
+        return 4;
+    } else if (str_eq(lane_type, s("i64")) || str_eq(lane_type, s("f64"))) {
+        return 8;
+    }
+    return 0;
+}
+
+// v128 values come with a lane type and an array of lanes, each of them is encoded like
+// a scalar of the same type.
+static r_typed_value read_v128(json_object arg) {
+    check_prep(r_typed_value);
+    unwrap(json_string, lane_type, json_obj_get_string(arg, s("lane_type")));
+    unwrap(json_array, lanes, json_obj_get_array(arg, s("value")));
+    u32 lane_size = v128_lane_size(lane_type);
+    if (!lane_size) {
+        return err(e_general, "Invalid lane type");
+    }
+    str scalar_type = (lane_size < 4) ? s("i32") : lane_type;
+    typed_value tv = {.type = TYPE_ID_v128};
+    u32 idx = 0;
+    JSON_ARRAY_FOR_EACH(lanes, iter) {
+        if ((idx + 1) * lane_size > 16) {
+            return err(e_general, "Too many lanes");
+        }
+        unwrap(json_string, lane, json_val_as_string(*iter));
+        unwrap(typed_value, val, read_value(scalar_type, lane));
+        memcpy(&tv.val.u_v128.u8x16[idx * lane_size], &val.val, lane_size);
+        idx++;
+    }
+    if (idx * lane_size != 16) {
+        return err(e_general, "Too few lanes");
+    }
+    return ok(tv);
+}
+
+// compare lane by lane, so that every float lane can have its own nan pattern.
+static r check_v128_result(typed_value * tv, json_object arg) {
+    check_prep(r);
+    if (tv->type != TYPE_ID_v128) {
+        return err(e_general, "Incorrect v128 return value");
+    }
+    unwrap(typed_value, expected, read_v128(arg));
+    unwrap(json_string, lane_type, json_obj_get_string(arg, s("lane_type")));
+    unwrap(json_array, lanes, json_obj_get_array(arg, s("value")));
+    u32 lane_size = v128_lane_size(lane_type);
+    u32 idx = 0;
+    JSON_ARRAY_FOR_EACH(lanes, iter) {
+        unwrap(json_string, lane, json_val_as_string(*iter));
+        const u8 * actual = &tv->val.u_v128.u8x16[idx * lane_size];
+        bool canonical = str_eq(lane, s("nan:canonical"));
+        bool arithmetic = str_eq(lane, s("nan:arithmetic"));
+        if ((canonical || arithmetic) && (lane_size == 4)) {
+            u32 u;
+            memcpy(&u, actual, sizeof(u));
+            u32 expected_bits = canonical ? 0x7fffffffU : 0x7fc00000U;
+            if ((u & expected_bits) != 0x7fc00000U) {
+                return err(e_general, "Expecting a nan lane");
+            }
+        } else if ((canonical || arithmetic) && (lane_size == 8)) {
+            u64 u;
+            memcpy(&u, actual, sizeof(u));
+            u64 expected_bits = canonical ? 0x7fffffffffffffffULL : 0x7ff8000000000000ULL;
+            if ((u & expected_bits) != 0x7ff8000000000000ULL) {
+                return err(e_general, "Expecting a nan lane");
+            }
+        } else if (memcmp(actual, &expected.val.u_v128.u8x16[idx * lane_size], lane_size)) {
+            return err(e_general, "Incorrect v128 return value");
+        }
+        idx++;
+    }
+    return ok_r;
+}
+
+#else
+
+static r_typed_value read_v128(json_object arg) {
+    check_prep(r_typed_value);
+    return err(e_general, "SIMD is disabled");
+}
+
+static r check_v128_result(typed_value * tv, json_object arg) {
+    check_prep(r);
+    return err(e_general, "SIMD is disabled");
+}
+
+#endif // SILVERFIR_ENABLE_SIMD
+
 static r asserted_action(runner_ctx * ctx, json_object act, action_results expect, json_array * expected_returns) {
     check_prep(r);
     assert(ctx->last_module);
@@ -280,8 +374,15 @@ static r asserted_action(runner_ctx * ctx, json_object act, action_results expec
         JSON_ARRAY_FOR_EACH(args, iter) {
             unwrap(json_object, arg, json_val_as_object(*iter));
             unwrap(json_string, arg_type, json_obj_get_string(arg, s("type")));
-            unwrap(json_string, arg_value, json_obj_get_string(arg, s("value")));
-            unwrap(typed_value, tv, read_value(arg_type, arg_value));
+            typed_value tv;
+            if (str_eq(arg_type, s("v128"))) {
+                unwrap(typed_value, v, read_v128(arg));
+                tv = v;
+            } else {
+                unwrap(json_string, arg_value, json_obj_get_string(arg, s("value")));
+                unwrap(typed_value, v, read_value(arg_type, arg_value));
+                tv = v;
+            }
             check(vec_push_typed_value(&argv, tv), {
                 vec_clear_typed_value(&argv);
             });
@@ -342,6 +443,10 @@ static r asserted_action(runner_ctx * ctx, json_object act, action_results expec
             idx++;
             unwrap(json_object, arg, json_val_as_object(*iter));
             unwrap(json_string, arg_type, json_obj_get_string(arg, s("type")));
+            if (str_eq(arg_type, s("v128"))) {
+                check(check_v128_result(tv, arg));
+                continue;
+            }
             unwrap(json_string, arg_value, json_obj_get_string(arg, s("value")));
             unwrap(typed_value, expected, read_value(arg_type, arg_value));
             if (str_eq(arg_type, s("i32"))) {
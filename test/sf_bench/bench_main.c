@@ -0,0 +1,125 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Throughput of the vm pool, from one worker to one per cpu.
+// Usage: sf_bench [jobs] [loop count per job]
+
+#include "logger.h"
+#include "module.h"
+#include "os_thread.h"
+#include "result.h"
+#include "vm_pool.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define LOGW(fmt, ...) LOG_WARNING(log_channel_test, fmt, ##__VA_ARGS__)
+
+// (func (export "work") (param i32) (result i32) (local i32)
+//   (block (loop
+//     (br_if 1 (i32.eqz (local.get 0)))
+//     (local.set 1 (i32.add (local.get 1) (local.get 0)))
+//     (local.set 0 (i32.sub (local.get 0) (i32.const 1)))
+//     (br 0)))
+//   (local.get 1))
+static const u8 work_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x06, 0x01, 0x60, 0x01, 0x7f, 0x01, 0x7f,
+    0x03, 0x02, 0x01, 0x00,
+    0x07, 0x08, 0x01, 0x04, 0x77, 0x6f, 0x72, 0x6b, 0x00, 0x00,
+    0x0a, 0x23, 0x01, 0x21, 0x01, 0x01, 0x7f,
+    0x02, 0x40, 0x03, 0x40,
+    0x20, 0x00, 0x45, 0x0d, 0x01,
+    0x20, 0x01, 0x20, 0x00, 0x6a, 0x21, 0x01,
+    0x20, 0x00, 0x41, 0x01, 0x6b, 0x21, 0x00,
+    0x0c, 0x00, 0x0b, 0x0b,
+    0x20, 0x01, 0x0b,
+};
+
+static u32 s_failures = 0;
+
+static void on_done(void * payload, r ret, vec_typed_value * results) {
+    if (!is_ok(ret)) {
+        s_atomic_inc32(&s_failures);
+    }
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static r run(module * m, u32 workers, u32 jobs, i32 loop_count, double * seconds) {
+    check_prep(r);
+    module * mods[] = {m};
+    vm_pool pool;
+    check(vm_pool_init(&pool, mods, array_len(mods), workers));
+
+    double begin = now_seconds();
+    for (u32 i = 0; i < jobs; i++) {
+        vec_typed_value args = {0};
+        check(vec_push_typed_value(&args, (typed_value){.type = TYPE_ID_i32, .val.u_i32 = loop_count}), vm_pool_drop(&pool));
+        check(vm_pool_submit(&pool, s("work"), args, on_done, NULL), vm_pool_drop(&pool));
+    }
+    vm_pool_wait(&pool);
+    *seconds = now_seconds() - begin;
+
+    u64 stolen = 0;
+    for (u32 i = 0; i < pool.worker_count; i++) {
+        stolen += pool.workers[i].jobs_stolen;
+    }
+    printf("workers %2u: %10.0f jobs/s, %llu stolen\n", workers, jobs / *seconds, (unsigned long long)stolen);
+    vm_pool_drop(&pool);
+    return ok_r;
+}
+
+int main(int argc, char * argv[]) {
+    u32 jobs = argc > 1 ? (u32)strtoul(argv[1], NULL, 10) : 20000;
+    i32 loop_count = argc > 2 ? (i32)strtol(argv[2], NULL, 10) : 10000;
+
+    module m = {0};
+    r ret = module_init(&m, vs_pl(work_wasm, sizeof(work_wasm)), vs("bench"));
+    if (!is_ok(ret)) {
+        LOGW("Err: %s", ret.msg);
+        return 1;
+    }
+    u32 cpus = os_cpu_count();
+    printf("%u jobs, loop count %d, %u cpus\n", jobs, loop_count, cpus);
+    double base = 0;
+    for (u32 workers = 1; workers <= cpus; workers = (workers * 2 > cpus && workers != cpus) ? cpus : workers * 2) {
+        double seconds = 0;
+        ret = run(&m, workers, jobs, loop_count, &seconds);
+        if (!is_ok(ret)) {
+            break;
+        }
+        if (workers == 1) {
+            base = seconds;
+        }
+        printf("            speedup %.2fx\n", base / seconds);
+    }
+    if (is_ok(ret) && s_failures) {
+        ret.msg = "Some of the jobs failed";
+    }
+    module_drop(&m);
+    if (!is_ok(ret)) {
+        LOGW("Err: %s", ret.msg);
+        return 1;
+    }
+    return 0;
+}
@@ -99,7 +99,7 @@ int simple_runner(const char * wasm_file_name) {
     size_t read_size = fread(wasm_mem, sizeof(u8), size, fp);
     if (read_size != size) {
         fclose(fp);
-        free(wasm_mem);
+        array_free(wasm_mem);
         LOGW("Read failed");
         return 1;
     }
@@ -109,7 +109,7 @@ int simple_runner(const char * wasm_file_name) {
         LOGW("Err: %s", result.msg);
     }
     fclose(fp);
-    free(wasm_mem);
+    array_free(wasm_mem);
     return (!is_ok(result));
 }
 
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Validate a wasm binary offline and append the precomputed side tables to it.
+// See side_table.h for the format. With --compress the code section is compressed first,
+// see code_cache.h.
+// With --stack, print the worst-case stack depth of the exported functions instead, given the
+// native frame size of the interpreter. See stack_depth.h.
+
+#include "alloc.h"
+#include "code_cache.h"
+#include "logger.h"
+#include "module.h"
+#include "result.h"
+#include "side_table.h"
+#include "stack_depth.h"
+#include "validator.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOGI(fmt, ...) LOG_INFO(log_channel_test, fmt, ##__VA_ARGS__)
+#define LOGW(fmt, ...) LOG_WARNING(log_channel_test, fmt, ##__VA_ARGS__)
+
+static r write_file(const char * file_name, str bin, str section) {
+    check_prep(r);
+    FILE * fp = fopen(file_name, "wb");
+    if (!fp) {
+        return err(e_general, "fopen failed");
+    }
+    bool written = (fwrite(bin.ptr, sizeof(u8), str_len(bin), fp) == str_len(bin)) &&
+                   (fwrite(section.ptr, sizeof(u8), str_len(section), fp) == str_len(section));
+    fclose(fp);
+    if (!written) {
+        return err(e_general, "Write failed");
+    }
+    return ok_r;
+}
+
+r prep_module(const u8 * wasm_mem, size_t size, const char * out_file_name) {
+    assert(wasm_mem);
+    check_prep(r);
+
+    module m = {0};
+    check(module_init(&m, vs_pl(wasm_mem, size), vs("prep")), module_drop(&m));
+    if (!str_is_null(m.side_table_section)) {
+        module_drop(&m);
+        return err(e_general, "The side table section already exists");
+    }
+    check(validate_module(&m), module_drop(&m));
+    unwrap(vstr, section, side_table_section_build(&m, size), module_drop(&m));
+    module_drop(&m);
+
+    check(write_file(out_file_name, s_pl(wasm_mem, size), section.s), vstr_drop(&section));
+    LOGI("Side table size: %zu bytes", str_len(section.s));
+    vstr_drop(&section);
+    return ok_r;
+}
+
+r compress_module(const u8 * wasm_mem, size_t size, const char * out_file_name) {
+    assert(wasm_mem);
+    check_prep(r);
+
+    unwrap(vstr, packed, code_cache_compress_module(s_pl(wasm_mem, size)));
+    LOGI("Module size: %zu -> %zu bytes", size, str_len(packed.s));
+    check(prep_module(packed.s.ptr, str_len(packed.s), out_file_name), vstr_drop(&packed));
+    vstr_drop(&packed);
+    return ok_r;
+}
+
+r stack_report(const u8 * wasm_mem, size_t size, size_t frame_size) {
+    assert(wasm_mem);
+    check_prep(r);
+
+    module m = {0};
+    check(module_init(&m, vs_pl(wasm_mem, size), vs("prep")), module_drop(&m));
+    check(module_validate(&m), module_drop(&m));
+    vec_stack_depth report = {0};
+    check(stack_depth_analyze(&m, frame_size, &report), {
+        vec_clear_stack_depth(&report);
+        module_drop(&m);
+    });
+    printf("%-32s %12s %12s %8s\n", "export", "value bytes", "native bytes", "frames");
+    VEC_FOR_EACH(&report, stack_depth, d) {
+        printf("%-32.*s %12zu %12zu %8u%s%s%s\n", (int)str_len(d->name), d->name.ptr, d->value_bytes, d->native_bytes, d->frames,
+               d->recursive ? " recursive" : "", d->calls_import ? " calls_import" : "",
+               d->calls_unknown ? " calls_unknown" : "");
+    }
+    vec_clear_stack_depth(&report);
+    module_drop(&m);
+    return ok_r;
+}
+
+static u8 * read_file(const char * file_name, size_t * size) {
+    FILE * fp = fopen(file_name, "rb");
+    if (!fp) {
+        LOGW("fopen failed");
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    *size = ftell(fp);
+    if (!*size) {
+        fclose(fp);
+        LOGW("File is empty");
+        return NULL;
+    }
+    rewind(fp);
+    u8 * wasm_mem = array_alloc(u8, *size);
+    if (!wasm_mem) {
+        fclose(fp);
+        LOGW("OOM");
+        return NULL;
+    }
+    size_t read_size = fread(wasm_mem, sizeof(u8), *size, fp);
+    fclose(fp);
+    if (read_size != *size) {
+        array_free(wasm_mem);
+        LOGW("Read failed");
+        return NULL;
+    }
+    return wasm_mem;
+}
+
+int simple_prep(const char * wasm_file_name, const char * out_file_name, bool compress) {
+    assert(wasm_file_name);
+    assert(out_file_name);
+    size_t size = 0;
+    u8 * wasm_mem = read_file(wasm_file_name, &size);
+    if (!wasm_mem) {
+        return 1;
+    }
+
+    r result = compress ? compress_module(wasm_mem, size, out_file_name) : prep_module(wasm_mem, size, out_file_name);
+    if (!is_ok(result)) {
+        LOGW("Err: %s", result.msg);
+    }
+    array_free(wasm_mem);
+    return (!is_ok(result));
+}
+
+int simple_stack_report(const char * wasm_file_name, size_t frame_size) {
+    assert(wasm_file_name);
+    size_t size = 0;
+    u8 * wasm_mem = read_file(wasm_file_name, &size);
+    if (!wasm_mem) {
+        return 1;
+    }
+
+    r result = stack_report(wasm_mem, size, frame_size);
+    if (!is_ok(result)) {
+        LOGW("Err: %s", result.msg);
+    }
+    array_free(wasm_mem);
+    return (!is_ok(result));
+}
+
+int main(int argc, char * argv[]) {
+    log_channel_set_enabled(log_info, log_channel_test, true);
+    if (argc == 4 && !strcmp(argv[1], "--stack")) {
+        return simple_stack_report(argv[3], strtoul(argv[2], NULL, 10));
+    }
+    bool compress = argc > 1 && !strcmp(argv[1], "--compress");
+    if (argc - compress <= 2) {
+        LOGW("Usage: sf_prep [--compress] <wasm file> <output wasm file>");
+        LOGW("       sf_prep --stack <native frame size> <wasm file>");
+        return 1;
+    }
+    return simple_prep(argv[1 + compress], argv[2 + compress], compress);
+}
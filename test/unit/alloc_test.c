@@ -0,0 +1,195 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "alloc.h"
+#include "interpreter.h"
+#include "runtime.h"
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+
+static void alloc_test_fixed(void ** state) {
+    static u8 buf[1024 + 8];
+    alloc_fixed f;
+    // the start is aligned.
+    alloc_fixed_init(&f, buf + 8, 1024);
+    assert_int_equal((uptr)f.buf % ALLOC_ALIGN, 0);
+    size_t size = f.size;
+
+    void * p[4];
+    for (u32 i = 0; i < 4; i++) {
+        p[i] = alloc_new_in(&f.base, 100);
+        assert_non_null(p[i]);
+        memset(p[i], (int)i, 100);
+    }
+    assert_true(f.used >= 400);
+    // it's all in the buffer and never goes beyond.
+    assert_null(alloc_new_in(&f.base, size));
+    assert_true((u8 *)p[0] >= f.buf && (u8 *)p[0] < f.buf + f.size);
+
+    // the blocks are freed out of order and merged back into one.
+    alloc_free(p[1]);
+    alloc_free(p[3]);
+    alloc_free(p[0]);
+    p[1] = alloc_resize(p[2], 300);
+    assert_non_null(p[1]);
+    for (u32 i = 0; i < 100; i++) {
+        assert_int_equal(((u8 *)p[1])[i], 2);
+    }
+    alloc_free(p[1]);
+    assert_int_equal(f.used, 0);
+    assert_true(f.peak > 400);
+    void * all = alloc_new_in(&f.base, size - ALLOC_ALIGN);
+    assert_non_null(all);
+    alloc_free(all);
+    assert_int_equal(f.used, 0);
+    alloc_fixed_drop(&f);
+}
+
+static void alloc_test_arena(void ** state) {
+    allocator * arena = alloc_arena_new(1024);
+    assert_non_null(arena);
+
+    allocator * prev = alloc_enter(arena);
+    u8 * a = array_alloc(u8, 100);
+    assert_non_null(a);
+    // the last one grows in place.
+    u8 * b = array_realloc(u8, a, 200);
+    assert_ptr_equal(a, b);
+    // the rest goes to a new chunk, and the big ones get their own.
+    u8 * c = array_alloc(u8, 1000);
+    u8 * d = array_alloc(u8, 4000);
+    assert_non_null(c);
+    assert_non_null(d);
+    array_free(c);
+    array_free(b);
+    alloc_leave(prev);
+    assert_ptr_equal(alloc_current(), prev);
+
+    // freeing doesn't give anything back to the parent.
+    assert_true(alloc_arena_size(arena) >= 1024 * 2 + 4000);
+    alloc_arena_drop(arena);
+}
+
+// (memory 1)
+// (func (export "grow") (result i32) (memory.grow (i32.const 1)))
+static const u8 grow_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x05, 0x01, 0x60, 0x00, 0x01, 0x7f,
+    0x03, 0x02, 0x01, 0x00,
+    0x05, 0x03, 0x01, 0x00, 0x01,
+    0x07, 0x08, 0x01, 0x04, 0x67, 0x72, 0x6f, 0x77, 0x00, 0x00,
+    0x0a, 0x08, 0x01, 0x06, 0x00, 0x41, 0x01, 0x40, 0x00, 0x0b,
+};
+
+static void alloc_test_runtime(void ** state) {
+    // the memory grows from one page to two, and both are there while it's moved.
+    static u8 buf[512 * 1024];
+    alloc_fixed f;
+    alloc_fixed_init(&f, buf, sizeof(buf));
+    allocator * outside = alloc_current();
+
+    runtime rt = {.alloc = &f.base, .module_arena = true};
+    assert_true(is_ok(runtime_module_add(&rt, vs_pl(grow_wasm, sizeof(grow_wasm)), vs("grow"))));
+    module * m = runtime_module_find(&rt, s("grow"));
+    assert_non_null(m);
+    assert_non_null(m->arena);
+    assert_true(f.used >= alloc_arena_size(m->arena));
+
+    r_vm_ptr pvm = runtime_vm_new(&rt);
+    assert_true(is_ok(pvm));
+    assert_true(is_ok(vm_instantiate_module(pvm.value, m)));
+    size_t used = f.used;
+    assert_true(used > 64 * 1024);
+    func_addr grow = vm_find_func(pvm.value, s("grow"), s("grow"));
+    assert_non_null(grow);
+    assert_true(is_ok(interp_call_in_thread(vm_get_thread(pvm.value), grow, (vec_typed_value){0})));
+    assert_int_equal(vec_at_typed_value(&vm_get_thread(pvm.value)->results, 0)->val.u_i32, 1);
+    assert_true(f.used >= used + 64 * 1024);
+    assert_ptr_equal(alloc_current(), outside);
+
+    assert_true(is_ok(runtime_drop(&rt)));
+    assert_int_equal(f.used, 0);
+    alloc_fixed_drop(&f);
+}
+
+#define ALLOC_THREADS (4)
+#define ALLOC_ROUNDS (20000)
+
+typedef struct alloc_thread_ctx {
+    allocator * fixed;
+    allocator * arena;
+    u32 id;
+    bool failed;
+} alloc_thread_ctx;
+
+// Every block is filled with the thread's id, and it's still there when it's freed unless
+// another thread got the same bytes.
+static void alloc_thread_main(void * arg) {
+    alloc_thread_ctx * ctx = (alloc_thread_ctx *)arg;
+    for (u32 i = 0; i < ALLOC_ROUNDS; i++) {
+        size_t size = 16 + (i % 7) * 24;
+        u8 * p = alloc_new_in(ctx->fixed, size);
+        u8 * q = alloc_new_in(ctx->arena, size);
+        if (!p || !q) {
+            ctx->failed = true;
+            alloc_free(p);
+            alloc_free(q);
+            return;
+        }
+        memset(p, (int)ctx->id, size);
+        memset(q, (int)ctx->id, size);
+        for (size_t j = 0; j < size; j++) {
+            ctx->failed |= (p[j] != ctx->id) || (q[j] != ctx->id);
+        }
+        alloc_free(q);
+        alloc_free(p);
+    }
+}
+
+// The vms of a runtime share its allocator, and they can run on different OS threads.
+static void alloc_test_threads(void ** state) {
+    static u8 buf[256 * 1024];
+    alloc_fixed f;
+    alloc_fixed_init(&f, buf, sizeof(buf));
+    allocator * prev = alloc_enter(&f.base);
+    allocator * arena = alloc_arena_new(4096);
+    alloc_leave(prev);
+    assert_non_null(arena);
+
+    os_thread threads[ALLOC_THREADS];
+    alloc_thread_ctx ctx[ALLOC_THREADS];
+    for (u32 i = 0; i < ALLOC_THREADS; i++) {
+        ctx[i] = (alloc_thread_ctx){.fixed = &f.base, .arena = arena, .id = i + 1};
+        assert_true(os_thread_start(&threads[i], alloc_thread_main, &ctx[i]));
+    }
+    for (u32 i = 0; i < ALLOC_THREADS; i++) {
+        os_thread_join(threads[i]);
+        assert_false(ctx[i].failed);
+    }
+    alloc_arena_drop(arena);
+    assert_int_equal(f.used, 0);
+    alloc_fixed_drop(&f);
+}
+
+struct CMUnitTest alloc_tests[] = {
+    cmocka_unit_test(alloc_test_fixed),
+    cmocka_unit_test(alloc_test_arena),
+    cmocka_unit_test(alloc_test_runtime),
+    cmocka_unit_test(alloc_test_threads),
+};
+
+const size_t alloc_tests_count = array_len(alloc_tests);
@@ -0,0 +1,277 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "interpreter.h"
+#include "module.h"
+#include "os_thread.h"
+#include "shared_memory.h"
+#include "silverfir.h"
+#include "test_wasm.h"
+#include "types.h"
+#include "vm.h"
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+#include <string.h>
+
+// (memory 1 1 shared)
+// (func (export "add") (param i32)
+//   (block (loop
+//     (br_if 1 (i32.eqz (local.get 0)))
+//     (drop (i32.atomic.rmw.add (i32.const 0) (i32.const 1)))
+//     (local.set 0 (i32.sub (local.get 0) (i32.const 1)))
+//     (br 0))))
+// (func (export "wait") (param i32 i64) (result i32)
+//   (memory.atomic.wait32 (i32.const 4) (local.get 0) (local.get 1)))
+// (func (export "notify") (param i32) (result i32)
+//   (memory.atomic.notify (i32.const 4) (local.get 0)))
+// (func (export "get") (result i32)
+//   (i32.atomic.load (i32.const 0)))
+static const u8 atomics_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x14, 0x04,
+    0x60, 0x01, 0x7f, 0x00,
+    0x60, 0x02, 0x7f, 0x7e, 0x01, 0x7f,
+    0x60, 0x01, 0x7f, 0x01, 0x7f,
+    0x60, 0x00, 0x01, 0x7f,
+    0x03, 0x05, 0x04, 0x00, 0x01, 0x02, 0x03,
+    0x05, 0x04, 0x01, 0x03, 0x01, 0x01,
+    0x07, 0x1d, 0x04,
+    0x03, 0x61, 0x64, 0x64, 0x00, 0x00,
+    0x04, 0x77, 0x61, 0x69, 0x74, 0x00, 0x01,
+    0x06, 0x6e, 0x6f, 0x74, 0x69, 0x66, 0x79, 0x00, 0x02,
+    0x03, 0x67, 0x65, 0x74, 0x00, 0x03,
+    0x0a, 0x42, 0x04,
+    0x1f, 0x00, 0x02, 0x40, 0x03, 0x40,
+    0x20, 0x00, 0x45, 0x0d, 0x01,
+    0x41, 0x00, 0x41, 0x01, 0xfe, 0x1e, 0x02, 0x00, 0x1a,
+    0x20, 0x00, 0x41, 0x01, 0x6b, 0x21, 0x00,
+    0x0c, 0x00, 0x0b, 0x0b, 0x0b,
+    0x0c, 0x00, 0x41, 0x04, 0x20, 0x00, 0x20, 0x01, 0xfe, 0x01, 0x02, 0x00, 0x0b,
+    0x0a, 0x00, 0x41, 0x04, 0x20, 0x00, 0xfe, 0x00, 0x02, 0x00, 0x0b,
+    0x08, 0x00, 0x41, 0x00, 0xfe, 0x10, 0x02, 0x00, 0x0b,
+};
+
+// the memory limits flag, and the alignment of the i32.atomic.rmw.add.
+#define ATOMICS_WASM_MEM_FLAG_OFFSET (40)
+#define ATOMICS_WASM_ADD_ALIGN_OFFSET (94)
+
+#if SILVERFIR_ENABLE_THREADS
+
+#define ATOMICS_TEST_THREADS (4)
+#define ATOMICS_TEST_ADDS (20000)
+
+// (memory 1 65536 shared)
+// (func (export "grow") (param i32) (result i32) (memory.grow (local.get 0)))
+// (func (export "store") (param i32) (result i32) (i32.store (local.get 0) (local.get 0)) (local.get 0))
+// (func (export "load") (param i32) (result i32) (i32.load (local.get 0)))
+static const u8 shared_max_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x06, 0x01, 0x60, 0x01, 0x7f, 0x01, 0x7f,
+    0x03, 0x04, 0x03, 0x00, 0x00, 0x00,
+    0x05, 0x06, 0x01, 0x03, 0x01, 0x80, 0x80, 0x04,
+    0x07, 0x17, 0x03, 0x04, 0x67, 0x72, 0x6f, 0x77, 0x00, 0x00, 0x05, 0x73, 0x74, 0x6f, 0x72, 0x65, 0x00, 0x01, 0x04, 0x6c, 0x6f, 0x61, 0x64, 0x00, 0x02,
+    0x0a, 0x1c, 0x03, 0x06, 0x00, 0x20, 0x00, 0x40, 0x00, 0x0b, 0x0b, 0x00, 0x20, 0x00, 0x20, 0x00, 0x36, 0x02, 0x00, 0x20, 0x00, 0x0b, 0x07, 0x00, 0x20, 0x00, 0x28, 0x02, 0x00, 0x0b,
+};
+
+typedef struct atomics_test_worker {
+    vm * v;
+    const char * func_name;
+    u32 argc;
+    typed_value argv[2];
+    r ret;
+} atomics_test_worker;
+
+static void worker_main(void * arg) {
+    atomics_test_worker * w = (atomics_test_worker *)arg;
+    w->ret = test_call(w->v, "atomics", w->func_name, w->argc, w->argv);
+}
+
+static void atomics_test_rmw_threads(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(atomics_wasm, sizeof(atomics_wasm)), vs("atomics"))));
+    vm vms[ATOMICS_TEST_THREADS] = {0};
+    for (u32 i = 0; i < ATOMICS_TEST_THREADS; i++) {
+        assert_true(is_ok(vm_instantiate_module(&vms[i], &m)));
+    }
+    // one memory for all the instances.
+    mem_addr m0 = *vec_at_mem_addr(&vm_find_module_inst(&vms[0], s("atomics"))->m_addrs, 0);
+    assert_non_null(m0->shared);
+    for (u32 i = 1; i < ATOMICS_TEST_THREADS; i++) {
+        assert_ptr_equal(*vec_at_mem_addr(&vm_find_module_inst(&vms[i], s("atomics"))->m_addrs, 0), m0);
+    }
+
+    atomics_test_worker workers[ATOMICS_TEST_THREADS];
+    os_thread threads[ATOMICS_TEST_THREADS];
+    for (u32 i = 0; i < ATOMICS_TEST_THREADS; i++) {
+        workers[i] = (atomics_test_worker){
+            .v = &vms[i],
+            .func_name = "add",
+            .argc = 1,
+            .argv = {{.type = TYPE_ID_i32, .val.u_i32 = ATOMICS_TEST_ADDS}},
+        };
+        assert_true(os_thread_start(&threads[i], worker_main, &workers[i]));
+    }
+    for (u32 i = 0; i < ATOMICS_TEST_THREADS; i++) {
+        os_thread_join(threads[i]);
+        assert_true(is_ok(workers[i].ret));
+    }
+    assert_true(is_ok(test_call(&vms[0], "atomics", "get", 0, NULL)));
+    assert_int_equal(test_result_i32(&vms[0]), ATOMICS_TEST_THREADS * ATOMICS_TEST_ADDS);
+
+    for (u32 i = 0; i < ATOMICS_TEST_THREADS; i++) {
+        vm_drop(&vms[i]);
+    }
+    assert_true(is_ok(module_drop(&m)));
+}
+
+static void atomics_test_wait_notify(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(atomics_wasm, sizeof(atomics_wasm)), vs("atomics"))));
+    vm vms[2] = {0};
+    for (u32 i = 0; i < 2; i++) {
+        assert_true(is_ok(vm_instantiate_module(&vms[i], &m)));
+    }
+    typed_value wait_args[2] = {{.type = TYPE_ID_i32, .val.u_i32 = 1}, {.type = TYPE_ID_i64, .val.u_i64 = -1}};
+    typed_value one = {.type = TYPE_ID_i32, .val.u_i32 = 1};
+
+    // the value doesn't match.
+    assert_true(is_ok(test_call(&vms[0], "atomics", "wait", 2, wait_args)));
+    assert_int_equal(test_result_i32(&vms[0]), shared_wait_not_equal);
+    // nobody notifies.
+    wait_args[0].val.u_i32 = 0;
+    wait_args[1].val.u_i64 = 1000000;
+    assert_true(is_ok(test_call(&vms[0], "atomics", "wait", 2, wait_args)));
+    assert_int_equal(test_result_i32(&vms[0]), shared_wait_timed_out);
+    assert_true(is_ok(test_call(&vms[0], "atomics", "notify", 1, &one)));
+    assert_int_equal(test_result_i32(&vms[0]), 0);
+
+    // wait forever on another thread until notified.
+    atomics_test_worker waiter = {
+        .v = &vms[1],
+        .func_name = "wait",
+        .argc = 2,
+        .argv = {wait_args[0], {.type = TYPE_ID_i64, .val.u_i64 = -1}},
+    };
+    os_thread t;
+    assert_true(os_thread_start(&t, worker_main, &waiter));
+    i32 woken = 0;
+    while (!woken) {
+        assert_true(is_ok(test_call(&vms[0], "atomics", "notify", 1, &one)));
+        woken = test_result_i32(&vms[0]);
+    }
+    assert_int_equal(woken, 1);
+    os_thread_join(t);
+    assert_true(is_ok(waiter.ret));
+    assert_int_equal(test_result_i32(&vms[1]), shared_wait_ok);
+
+    for (u32 i = 0; i < 2; i++) {
+        vm_drop(&vms[i]);
+    }
+    assert_true(is_ok(module_drop(&m)));
+}
+
+// The whole 4 GiB is only reserved, the pages are there once they're written.
+static void atomics_test_max_memory(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(shared_max_wasm, sizeof(shared_max_wasm)), vs("atomics"))));
+    vm vms[2] = {0};
+    for (u32 i = 0; i < 2; i++) {
+        assert_true(is_ok(vm_instantiate_module(&vms[i], &m)));
+    }
+    mem_addr m0 = *vec_at_mem_addr(&vm_find_module_inst(&vms[0], s("atomics"))->m_addrs, 0);
+    assert_non_null(m0->shared);
+    const u8 * data = m0->mdata._data;
+    assert_int_equal(vec_size_u8(&m0->mdata), WASM_PAGE_SIZE);
+
+    assert_int_equal(test_call_i32(&vms[0], "atomics", "grow", 100), 1);
+    i32 addr = 100 * WASM_PAGE_SIZE;
+    assert_int_equal(test_call_i32(&vms[1], "atomics", "store", addr), addr);
+    assert_int_equal(test_call_i32(&vms[0], "atomics", "load", addr), addr);
+    assert_int_equal(test_call_i32(&vms[1], "atomics", "load", addr - 4), 0);
+    // it never moves.
+    assert_ptr_equal(m0->mdata._data, data);
+    assert_int_equal(test_call_i32(&vms[1], "atomics", "grow", 65536), -1);
+    assert_int_equal(vec_size_u8(&m0->mdata), 101 * WASM_PAGE_SIZE);
+
+    for (u32 i = 0; i < 2; i++) {
+        vm_drop(&vms[i]);
+    }
+    assert_true(is_ok(module_drop(&m)));
+}
+
+static void atomics_test_invalid(void ** state) {
+    u8 bin[sizeof(atomics_wasm)];
+
+    // atomic accesses must be naturally aligned.
+    memcpy(bin, atomics_wasm, sizeof(bin));
+    assert_int_equal(bin[ATOMICS_WASM_ADD_ALIGN_OFFSET], 0x02);
+    bin[ATOMICS_WASM_ADD_ALIGN_OFFSET] = 0x01;
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(bin, sizeof(bin)), vs("atomics"))));
+    assert_false(is_ok(module_validate(&m)));
+    module_drop(&m);
+
+    // a shared memory must have a max.
+    memcpy(bin, atomics_wasm, sizeof(bin));
+    assert_int_equal(bin[ATOMICS_WASM_MEM_FLAG_OFFSET], 0x03);
+    bin[ATOMICS_WASM_MEM_FLAG_OFFSET] = 0x02;
+    m = (module){0};
+    assert_false(is_ok(module_init(&m, vs_pl(bin, sizeof(bin)), vs("atomics"))));
+    module_drop(&m);
+
+    // the atomics work on an unshared memory too, but waiting on it traps.
+    memcpy(bin, atomics_wasm, sizeof(bin));
+    bin[ATOMICS_WASM_MEM_FLAG_OFFSET] = 0x01;
+    m = (module){0};
+    assert_true(is_ok(module_init(&m, vs_pl(bin, sizeof(bin)), vs("atomics"))));
+    vm v = {0};
+    assert_true(is_ok(vm_instantiate_module(&v, &m)));
+    typed_value three = {.type = TYPE_ID_i32, .val.u_i32 = 3};
+    assert_true(is_ok(test_call(&v, "atomics", "add", 1, &three)));
+    assert_true(is_ok(test_call(&v, "atomics", "get", 0, NULL)));
+    assert_int_equal(test_result_i32(&v), 3);
+    typed_value one = {.type = TYPE_ID_i32, .val.u_i32 = 1};
+    assert_true(is_ok(test_call(&v, "atomics", "notify", 1, &one)));
+    assert_int_equal(test_result_i32(&v), 0);
+    typed_value wait_args[2] = {{.type = TYPE_ID_i32, .val.u_i32 = 0}, {.type = TYPE_ID_i64, .val.u_i64 = 0}};
+    assert_false(is_ok(test_call(&v, "atomics", "wait", 2, wait_args)));
+    vm_drop(&v);
+    assert_true(is_ok(module_drop(&m)));
+}
+
+struct CMUnitTest atomics_tests[] = {
+    cmocka_unit_test(atomics_test_rmw_threads),
+    cmocka_unit_test(atomics_test_wait_notify),
+    cmocka_unit_test(atomics_test_max_memory),
+    cmocka_unit_test(atomics_test_invalid),
+};
+
+#else
+
+static void atomics_test_disabled(void ** state) {
+    module m = {0};
+    assert_false(is_ok(module_init(&m, vs_pl(atomics_wasm, sizeof(atomics_wasm)), vs("atomics"))));
+    module_drop(&m);
+}
+
+struct CMUnitTest atomics_tests[] = {
+    cmocka_unit_test(atomics_test_disabled),
+};
+
+#endif // SILVERFIR_ENABLE_THREADS
+
+const size_t atomics_tests_count = array_len(atomics_tests);
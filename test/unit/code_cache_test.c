@@ -0,0 +1,276 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "code_cache.h"
+#include "green_sched.h"
+#include "interpreter.h"
+#include "jt_cache.h"
+#include "module.h"
+#include "test_wasm.h"
+#include "types.h"
+#include "vm.h"
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+
+// nested_loops_wasm (see test_wasm.h), both functions start with 32 nops so that they compress.
+// (func $sum (export "sum") (param i32) (result i32) (local i32)
+//   (nop) ...
+//   (loop (local.set 1 (i32.add (local.get 1) (local.get 0)))
+//         (br_if 0 (local.tee 0 (i32.sub (local.get 0) (i32.const 1)))))
+//   (local.get 1))
+// (func (export "outer") (param i32) (result i32) (local i32)
+//   (nop) ...
+//   (block (loop (br_if 1 (i32.eqz (local.get 0)))
+//     (local.set 1 (i32.add (local.get 1) (call $sum (local.get 0))))
+//     (local.set 0 (i32.sub (local.get 0) (i32.const 1)))
+//     (br 0)))
+//   (local.get 1))
+static const u8 padded_loops_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x06, 0x01, 0x60, 0x01, 0x7f, 0x01, 0x7f,
+    0x03, 0x03, 0x02, 0x00, 0x00,
+    0x07, 0x0f, 0x02, 0x03, 0x73, 0x75, 0x6d, 0x00, 0x00, 0x05, 0x6f, 0x75, 0x74, 0x65, 0x72, 0x00, 0x01,
+    0x0a, 0x7f, 0x02,
+    0x39, 0x01, 0x01, 0x7f,
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x03, 0x40, 0x20, 0x01, 0x20, 0x00, 0x6a, 0x21, 0x01, 0x20, 0x00, 0x41, 0x01, 0x6b, 0x22, 0x00, 0x0d, 0x00, 0x0b, 0x20, 0x01, 0x0b,
+    0x43, 0x01, 0x01, 0x7f,
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x02, 0x40, 0x03, 0x40, 0x20, 0x00, 0x45, 0x0d, 0x01, 0x20, 0x01, 0x20, 0x00, 0x10, 0x00, 0x6a, 0x21, 0x01, 0x20, 0x00, 0x41, 0x01, 0x6b, 0x21, 0x00, 0x0c, 0x00, 0x0b, 0x0b, 0x20, 0x01, 0x0b,
+};
+
+// padded_loops_wasm with a third function, it starts with 32 nops as well.
+// (func (export "triple") (param i32) (result i32)
+//   (nop) ...
+//   (i32.mul (local.get 0) (i32.const 3)))
+static const u8 padded_triple_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x06, 0x01, 0x60, 0x01, 0x7f, 0x01, 0x7f,
+    0x03, 0x04, 0x03, 0x00, 0x00, 0x00,
+    0x07, 0x18, 0x03, 0x03, 0x73, 0x75, 0x6d, 0x00, 0x00, 0x05, 0x6f, 0x75, 0x74, 0x65, 0x72, 0x00, 0x01,
+    0x06, 0x74, 0x72, 0x69, 0x70, 0x6c, 0x65, 0x00, 0x02,
+    0x0a, 0xa7, 0x01, 0x03,
+    0x39, 0x01, 0x01, 0x7f,
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x03, 0x40, 0x20, 0x01, 0x20, 0x00, 0x6a, 0x21, 0x01, 0x20, 0x00, 0x41, 0x01, 0x6b, 0x22, 0x00, 0x0d, 0x00, 0x0b, 0x20, 0x01, 0x0b,
+    0x43, 0x01, 0x01, 0x7f,
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x02, 0x40, 0x03, 0x40, 0x20, 0x00, 0x45, 0x0d, 0x01, 0x20, 0x01, 0x20, 0x00, 0x10, 0x00, 0x6a, 0x21, 0x01, 0x20, 0x00, 0x41, 0x01, 0x6b, 0x21, 0x00, 0x0c, 0x00, 0x0b, 0x0b, 0x20, 0x01, 0x0b,
+    0x27, 0x00,
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x20, 0x00, 0x41, 0x03, 0x6c, 0x0b,
+};
+
+// the body sizes of sum and outer, locals included.
+#define SUM_BODY_BYTES (0x39)
+#define OUTER_BODY_BYTES (0x43)
+// the jump table of outer, see jt_cache_test.
+#define OUTER_JT_BYTES (2 * sizeof(jump_table))
+
+static vstr compress(const u8 * wasm, size_t size) {
+    r_vstr ret = code_cache_compress_module(s_pl(wasm, size));
+    assert_true(is_ok(ret));
+    return ret.value;
+}
+
+static void code_cache_test_fits(void ** state) {
+    vstr packed = compress(padded_loops_wasm, sizeof(padded_loops_wasm));
+    assert_true(str_len(packed.s) < sizeof(padded_loops_wasm));
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(packed.s.ptr, str_len(packed.s)), vs("code_cache"))));
+    assert_non_null(m.code_cache);
+    // nothing is decompressed after the parsing, but the locals are there.
+    VEC_FOR_EACH(&m.funcs, func, fn) {
+        assert_null(fn->code.ptr);
+        assert_int_equal(fn->local_count, 2);
+    }
+    vm v = {0};
+    assert_true(is_ok(vm_instantiate_module(&v, &m)));
+    // the validator has decompressed both.
+    code_cache_stats stats = code_cache_get_stats(&m);
+    assert_int_equal(stats.budget, SILVERFIR_CODE_CACHE_SIZE);
+    assert_int_equal(stats.used, SUM_BODY_BYTES + OUTER_BODY_BYTES);
+    assert_int_equal(stats.loads, 2);
+
+    // 3 + 2 + 1 + 2 + 1 + 1
+    assert_int_equal(test_call_i32(&v, "code_cache", "outer", 3), 10);
+    stats = code_cache_get_stats(&m);
+    assert_int_equal(stats.loads, 2);
+    assert_int_equal(stats.evictions, 0);
+    // outer, then the three calls of sum and outer after each of them.
+    assert_int_equal(stats.hits, 1 + 3 + 3);
+
+    vm_drop(&v);
+    assert_true(is_ok(module_drop(&m)));
+    vstr_drop(&packed);
+}
+
+static void code_cache_test_evict(void ** state) {
+    vstr packed = compress(padded_loops_wasm, sizeof(padded_loops_wasm));
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(packed.s.ptr, str_len(packed.s)), vs("code_cache"))));
+    // only one of them fits.
+    assert_true(is_ok(code_cache_set_budget(&m, OUTER_BODY_BYTES)));
+    vm v = {0};
+    assert_true(is_ok(vm_instantiate_module(&v, &m)));
+    code_cache_stats stats = code_cache_get_stats(&m);
+    assert_int_equal(stats.loads, 2);
+    assert_int_equal(stats.evictions, 1);
+
+    assert_int_equal(test_call_i32(&v, "code_cache", "outer", 3), 10);
+    stats = code_cache_get_stats(&m);
+    assert_true(stats.used <= OUTER_BODY_BYTES);
+    // sum evicts outer, and outer evicts sum when it gets back.
+    assert_int_equal(stats.loads, 2 + 3 + 3);
+    assert_int_equal(stats.evictions, 1 + 3 + 3);
+    assert_int_equal(stats.hits, 1);
+
+    // an empty budget still keeps the code in use.
+    assert_true(is_ok(code_cache_set_budget(&m, 0)));
+    assert_int_equal(test_call_i32(&v, "code_cache", "outer", 4), 20);
+    assert_true(code_cache_get_stats(&m).used <= OUTER_BODY_BYTES);
+
+    vm_drop(&v);
+    assert_true(is_ok(module_drop(&m)));
+    vstr_drop(&packed);
+}
+
+static void code_cache_test_in_place(void ** state) {
+    vstr packed = compress(nested_loops_wasm, nested_loops_wasm_size);
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(packed.s.ptr, str_len(packed.s)), vs("code_cache"))));
+    assert_non_null(m.code_cache);
+    // the bodies are stored as is, and run from the binary.
+    VEC_FOR_EACH(&m.funcs, func, fn) {
+        assert_true(fn->code.ptr > packed.s.ptr && fn->code.ptr < packed.s.ptr + str_len(packed.s));
+    }
+    vm v = {0};
+    assert_true(is_ok(vm_instantiate_module(&v, &m)));
+    assert_int_equal(test_call_i32(&v, "code_cache", "outer", 3), 10);
+    code_cache_stats stats = code_cache_get_stats(&m);
+    assert_int_equal(stats.loads, 0);
+    assert_int_equal(stats.used, 0);
+
+    vm_drop(&v);
+    assert_true(is_ok(module_drop(&m)));
+    vstr_drop(&packed);
+}
+
+// The bodies are carved out of one region, and the resident ones move down to make room.
+static void code_cache_test_region(void ** state) {
+    vstr packed = compress(padded_triple_wasm, sizeof(padded_triple_wasm));
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(packed.s.ptr, str_len(packed.s)), vs("code_cache"))));
+    // the blocks of sum and outer with their 8-byte headers, 72 + 80 bytes, fill it up.
+    assert_true(is_ok(code_cache_set_budget(&m, 152)));
+    vm v = {0};
+    // triple evicts sum, and outer is moved to the start to make room at the end.
+    assert_true(is_ok(vm_instantiate_module(&v, &m)));
+    code_cache_stats stats = code_cache_get_stats(&m);
+    assert_int_equal(stats.loads, 3);
+    assert_int_equal(stats.evictions, 1);
+    assert_int_equal(stats.compactions, 1);
+    func * outer = vec_at_func(&m.funcs, 1);
+    assert_ptr_equal(outer->code.ptr - m.code_cache->entries[1].code_offset, m.code_cache->region + 8);
+
+    // the moved outer still runs, and sum evicts triple.
+    assert_int_equal(test_call_i32(&v, "code_cache", "outer", 3), 10);
+    assert_int_equal(test_call_i32(&v, "code_cache", "triple", 5), 15);
+    assert_int_equal(test_call_i32(&v, "code_cache", "outer", 4), 20);
+    stats = code_cache_get_stats(&m);
+    assert_true(stats.compactions > 1);
+    VEC_FOR_EACH(&m.funcs, func, fn) {
+        if (fn->code.ptr) {
+            assert_true(fn->code.ptr > m.code_cache->region && fn->code.ptr < m.code_cache->region + 152);
+        }
+    }
+
+    vm_drop(&v);
+    assert_true(is_ok(module_drop(&m)));
+    vstr_drop(&packed);
+}
+
+static void on_done(void * payload, r ret, vec_typed_value * results) {
+    assert_true(is_ok(ret));
+    assert_int_equal(vec_size_typed_value(results), 1);
+    *(i32 *)payload = vec_at_typed_value(results, 0)->val.u_i32;
+}
+
+// The green threads switch at the loops, so the others evict the code of the suspended ones.
+// The jump tables are budgeted too, they're acquired after the code.
+static void code_cache_test_green_threads(void ** state) {
+    vstr packed = compress(padded_loops_wasm, sizeof(padded_loops_wasm));
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(packed.s.ptr, str_len(packed.s)), vs("code_cache"))));
+    assert_true(is_ok(code_cache_set_budget(&m, OUTER_BODY_BYTES)));
+    assert_true(is_ok(jt_cache_enable(&m, OUTER_JT_BYTES)));
+    vm vms[4] = {0};
+    i32 results[4] = {0};
+    green_sched s;
+    assert_true(is_ok(green_sched_init(&s, 1, 0, 0)));
+    for (u32 i = 0; i < array_len(vms); i++) {
+        assert_true(is_ok(vm_instantiate_module(&vms[i], &m)));
+        vec_typed_value args = {0};
+        assert_true(is_ok(vec_push_typed_value(&args, (typed_value){.type = TYPE_ID_i32, .val.u_i32 = 20 + i})));
+        func_addr f = vm_find_func(&vms[i], s("code_cache"), s("outer"));
+        assert_true(is_ok(green_sched_spawn(&s, &vms[i], f, args, on_done, &results[i])));
+    }
+    assert_true(is_ok(green_sched_run(&s)));
+    green_sched_drop(&s);
+    for (u32 i = 0; i < array_len(vms); i++) {
+        i32 n = 20 + i;
+        assert_int_equal(results[i], n * (n + 1) * (n + 2) / 6);
+        vm_drop(&vms[i]);
+    }
+    assert_true(code_cache_get_stats(&m).evictions > 0);
+    assert_true(is_ok(module_drop(&m)));
+    vstr_drop(&packed);
+}
+
+static void code_cache_test_malformed(void ** state) {
+    vstr packed = compress(padded_loops_wasm, sizeof(padded_loops_wasm));
+    module m = {0};
+    // the last body is cut.
+    assert_false(is_ok(module_init(&m, vs_pl(packed.s.ptr, str_len(packed.s) - 1), vs("code_cache"))));
+    assert_true(is_ok(module_drop(&m)));
+
+    // the code can't be compressed twice.
+    assert_false(is_ok(code_cache_compress_module(packed.s)));
+
+    // the calls change the module.
+    m = (module){0};
+    assert_true(is_ok(module_init(&m, vs_pl(packed.s.ptr, str_len(packed.s)), vs("code_cache"))));
+    assert_false(is_ok(module_freeze(&m)));
+    assert_true(is_ok(module_drop(&m)));
+    vstr_drop(&packed);
+}
+
+struct CMUnitTest code_cache_tests[] = {
+    cmocka_unit_test(code_cache_test_fits),
+    cmocka_unit_test(code_cache_test_evict),
+    cmocka_unit_test(code_cache_test_in_place),
+    cmocka_unit_test(code_cache_test_region),
+    cmocka_unit_test(code_cache_test_green_threads),
+    cmocka_unit_test(code_cache_test_malformed),
+};
+
+const size_t code_cache_tests_count = array_len(code_cache_tests);
@@ -0,0 +1,222 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "green_sched.h"
+#include "interpreter.h"
+#include "module.h"
+#include "types.h"
+#include "vm.h"
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+
+// (func (export "work") (param i32) (result i32) (local i32)
+//   (block (loop
+//     (br_if 1 (i32.eqz (local.get 0)))
+//     (local.set 1 (i32.add (local.get 1) (local.get 0)))
+//     (local.set 0 (i32.sub (local.get 0) (i32.const 1)))
+//     (br 0)))
+//   (local.get 1))
+static const u8 work_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x06, 0x01, 0x60, 0x01, 0x7f, 0x01, 0x7f,
+    0x03, 0x02, 0x01, 0x00,
+    0x07, 0x08, 0x01, 0x04, 0x77, 0x6f, 0x72, 0x6b, 0x00, 0x00,
+    0x0a, 0x23, 0x01, 0x21, 0x01, 0x01, 0x7f,
+    0x02, 0x40, 0x03, 0x40,
+    0x20, 0x00, 0x45, 0x0d, 0x01,
+    0x20, 0x01, 0x20, 0x00, 0x6a, 0x21, 0x01,
+    0x20, 0x00, 0x41, 0x01, 0x6b, 0x21, 0x00,
+    0x0c, 0x00, 0x0b, 0x0b,
+    0x20, 0x01, 0x0b,
+};
+
+// (func (export "deep") (param i32) (result i32) (local i64 x 1000)
+//   (if (result i32) (i32.eqz (local.get 0))
+//     (then (i32.const 0))
+//     (else (i32.add (call 0 (i32.sub (local.get 0) (i32.const 1))) (i32.const 1)))))
+// Every frame keeps the 1000 locals of the next one, about 8k.
+static const u8 deep_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x06, 0x01, 0x60, 0x01, 0x7f, 0x01, 0x7f,
+    0x03, 0x02, 0x01, 0x00,
+    0x07, 0x08, 0x01, 0x04, 0x64, 0x65, 0x65, 0x70, 0x00, 0x00,
+    0x0a, 0x1a, 0x01, 0x18, 0x01, 0xe8, 0x07, 0x7e,
+    0x20, 0x00, 0x45, 0x04, 0x7f, 0x41, 0x00,
+    0x05, 0x20, 0x00, 0x41, 0x01, 0x6b, 0x10, 0x00, 0x41, 0x01, 0x6a, 0x0b,
+    0x0b,
+};
+
+#define GREEN_TEST_VM_COUNT (16)
+
+typedef struct green_test_ctx {
+    u32 finished[GREEN_TEST_VM_COUNT];
+    u32 finished_count;
+    u32 failed_count;
+} green_test_ctx;
+
+typedef struct green_test_job {
+    green_test_ctx * ctx;
+    u32 id;
+    u32 n;
+} green_test_job;
+
+static void on_done(void * payload, r ret, vec_typed_value * results) {
+    green_test_job * job = (green_test_job *)payload;
+    if (!is_ok(ret)) {
+        job->ctx->failed_count++;
+        return;
+    }
+    assert_int_equal(vec_size_typed_value(results), 1);
+    assert_int_equal(vec_at_typed_value(results, 0)->val.u_u32, (u32)((u64)job->n * (job->n + 1) / 2));
+    job->ctx->finished[job->ctx->finished_count++] = job->id;
+}
+
+static vec_typed_value work_args(u32 n) {
+    vec_typed_value args = {0};
+    assert_true(is_ok(vec_push_typed_value(&args, (typed_value){.type = TYPE_ID_i32, .val.u_i32 = (i32)n})));
+    return args;
+}
+
+static void green_sched_test_interleave(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(work_wasm, sizeof(work_wasm)), vs("work"))));
+    vm vms[GREEN_TEST_VM_COUNT] = {0};
+    green_test_job jobs[GREEN_TEST_VM_COUNT];
+    green_test_ctx ctx = {0};
+
+    green_sched s;
+    assert_true(is_ok(green_sched_init(&s, 64, 0, 0)));
+    for (u32 i = 0; i < GREEN_TEST_VM_COUNT; i++) {
+        assert_true(is_ok(vm_instantiate_module(&vms[i], &m)));
+        func_addr f = vm_find_func(&vms[i], s("work"), s("work"));
+        assert_non_null(f);
+        // the later ones have less to do.
+        jobs[i] = (green_test_job){.ctx = &ctx, .id = i, .n = 20000 - i * 1000};
+        assert_true(is_ok(green_sched_spawn(&s, &vms[i], f, work_args(jobs[i].n), on_done, &jobs[i])));
+    }
+    assert_true(is_ok(green_sched_run(&s)));
+    assert_int_equal(ctx.failed_count, 0);
+    assert_int_equal(ctx.finished_count, GREEN_TEST_VM_COUNT);
+    // they ran side by side, so the shortest one is done first.
+    for (u32 i = 0; i < GREEN_TEST_VM_COUNT; i++) {
+        assert_int_equal(ctx.finished[i], GREEN_TEST_VM_COUNT - 1 - i);
+    }
+    assert_true(s.switches > GREEN_TEST_VM_COUNT * 100);
+    // the fibers are reused.
+    assert_int_equal(s.thread_count, GREEN_TEST_VM_COUNT);
+    ctx.finished_count = 0;
+    jobs[0].n = 10;
+    assert_true(is_ok(green_sched_spawn(&s, &vms[0], vm_find_func(&vms[0], s("work"), s("work")), work_args(10), on_done, &jobs[0])));
+    assert_true(is_ok(green_sched_run(&s)));
+    assert_int_equal(s.thread_count, GREEN_TEST_VM_COUNT);
+    green_sched_drop(&s);
+
+    // the vms can be used directly again.
+    func_addr f = vm_find_func(&vms[1], s("work"), s("work"));
+    assert_true(is_ok(interp_call_in_thread(&vms[1].thread, f, work_args(100))));
+    assert_int_equal(vec_at_typed_value(&vms[1].thread.results, 0)->val.u_i32, 5050);
+
+    for (u32 i = 0; i < GREEN_TEST_VM_COUNT; i++) {
+        vm_drop(&vms[i]);
+    }
+    module_drop(&m);
+}
+
+static void green_sched_test_cancel(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(work_wasm, sizeof(work_wasm)), vs("work"))));
+    vm vms[2] = {0};
+    green_test_job jobs[2];
+    green_test_ctx ctx = {0};
+
+    green_sched s;
+    assert_true(is_ok(green_sched_init(&s, 0, 0, 0)));
+    for (u32 i = 0; i < 2; i++) {
+        assert_true(is_ok(vm_instantiate_module(&vms[i], &m)));
+        func_addr f = vm_find_func(&vms[i], s("work"), s("work"));
+        jobs[i] = (green_test_job){.ctx = &ctx, .id = i, .n = 0x7fffffff};
+        assert_true(is_ok(green_sched_spawn(&s, &vms[i], f, work_args(jobs[i].n), on_done, &jobs[i])));
+    }
+    // one green thread per vm.
+    func_addr f = vm_find_func(&vms[0], s("work"), s("work"));
+    assert_false(is_ok(green_sched_spawn(&s, &vms[0], f, work_args(1), on_done, &jobs[0])));
+
+    green_sched_drop(&s);
+    assert_int_equal(ctx.failed_count, 2);
+    assert_int_equal(ctx.finished_count, 0);
+    assert_true(vms[0].thread.trapped);
+    assert_null(vms[0].thread.on_preempt);
+
+    for (u32 i = 0; i < 2; i++) {
+        vm_drop(&vms[i]);
+    }
+    module_drop(&m);
+}
+
+static void on_deep_done(void * payload, r ret, vec_typed_value * results) {
+    green_test_job * job = (green_test_job *)payload;
+    if (!is_ok(ret)) {
+        assert_true(err_is(ret.msg, e_exhaustion));
+        job->ctx->failed_count++;
+        return;
+    }
+    assert_int_equal(vec_at_typed_value(results, 0)->val.u_u32, job->n);
+    job->ctx->finished[job->ctx->finished_count++] = job->id;
+}
+
+// A call that doesn't fit into the fiber stack fails instead of running over it.
+static void green_sched_test_stack_limit(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(deep_wasm, sizeof(deep_wasm)), vs("deep"))));
+    vm v = {0};
+    assert_true(is_ok(vm_instantiate_module(&v, &m)));
+    func_addr f = vm_find_func(&v, s("deep"), s("deep"));
+    assert_non_null(f);
+    green_test_job jobs[2];
+    green_test_ctx ctx = {0};
+
+    green_sched s;
+    assert_false(is_ok(green_sched_init(&s, 0, 0, GREEN_SCHED_STACK_RESERVE)));
+    assert_true(is_ok(green_sched_init(&s, 0, 0, 256 * 1024)));
+    // well within both SILVERFIR_STACK_FRAME_LIMIT and SILVERFIR_STACK_SIZE_LIMIT, but it
+    // takes about 400k of stack.
+    jobs[0] = (green_test_job){.ctx = &ctx, .id = 0, .n = 50};
+    assert_true(is_ok(green_sched_spawn(&s, &v, f, work_args(jobs[0].n), on_deep_done, &jobs[0])));
+    assert_true(is_ok(green_sched_run(&s)));
+    assert_int_equal(ctx.failed_count, 1);
+    assert_true(v.thread.trapped);
+    // the fiber and the vm are still good.
+    thread_reset(&v.thread);
+    jobs[1] = (green_test_job){.ctx = &ctx, .id = 1, .n = 5};
+    assert_true(is_ok(green_sched_spawn(&s, &v, f, work_args(jobs[1].n), on_deep_done, &jobs[1])));
+    assert_true(is_ok(green_sched_run(&s)));
+    assert_int_equal(ctx.finished_count, 1);
+    assert_int_equal(s.thread_count, 1);
+    green_sched_drop(&s);
+    assert_int_equal(v.thread.stack_floor, 0);
+
+    vm_drop(&v);
+    module_drop(&m);
+}
+
+struct CMUnitTest green_sched_tests[] = {
+    cmocka_unit_test(green_sched_test_interleave),
+    cmocka_unit_test(green_sched_test_cancel),
+    cmocka_unit_test(green_sched_test_stack_limit),
+};
+
+const size_t green_sched_tests_count = array_len(green_sched_tests);
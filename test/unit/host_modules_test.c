@@ -0,0 +1,80 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host_modules.h"
+#include "interpreter.h"
+#include "runtime.h"
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+
+#ifdef SILVERFIR_ENABLE_SPECTEST
+static void host_modules_test_spectest(void ** state) {
+    r_module m = host_mod_new(s("spectest"));
+    assert_true(is_ok(m));
+    module mod = m.value;
+    assert_true(mod.is_static);
+    assert_int_equal(vec_size_func(&mod.funcs), 7);
+    assert_int_equal(vec_size_export(&mod.exports), 13);
+    VEC_FOR_EACH(&mod.funcs, func, fn) {
+        assert_non_null(fn->tr);
+        assert_non_null(fn->host_func);
+        assert_int_equal(fn->local_count, fn->fn_type.param_count);
+    }
+    // the export index is generated too.
+    VEC_FOR_EACH(&mod.exports, export, exp) {
+        assert_ptr_equal(module_find_export(&mod, exp->name, exp->external_kind), exp);
+    }
+    assert_null(module_find_export(&mod, s("print"), EXTERNAL_KIND_Global));
+    assert_null(module_find_export(&mod, s("not_exported"), EXTERNAL_KIND_Function));
+    // the descriptor is shared, dropping a module must not touch it.
+    func * first = vec_at_func(&mod.funcs, 0);
+    assert_true(is_ok(module_drop(&mod)));
+    m = host_mod_new(s("spectest"));
+    assert_true(is_ok(m));
+    assert_ptr_equal(vec_at_func(&m.value.funcs, 0), first);
+
+    runtime rt = {0};
+    assert_true(is_ok(runtime_module_add_mod(&rt, m.value)));
+    module * pm = runtime_module_find(&rt, s("spectest"));
+    assert_non_null(pm);
+    r_vm_ptr pvm = runtime_vm_new(&rt);
+    assert_true(is_ok(pvm));
+    assert_true(is_ok(vm_instantiate_module(pvm.value, pm)));
+
+    func_addr f_addr = vm_find_func(pvm.value, s("spectest"), s("print_i32"));
+    assert_non_null(f_addr);
+    vec_typed_value args = {0};
+    assert_true(is_ok(vec_push_typed_value(&args, (typed_value){.type = TYPE_ID_i32, .val.u_i32 = 42})));
+    assert_true(is_ok(interp_call_in_thread(vm_get_thread(pvm.value), f_addr, args)));
+
+    assert_true(is_ok(runtime_drop(&rt)));
+}
+#endif
+
+static void host_modules_test_not_found(void ** state) {
+    r_module m = host_mod_new(s("not_a_host_module"));
+    assert_false(is_ok(m));
+}
+
+struct CMUnitTest host_modules_tests[] = {
+#ifdef SILVERFIR_ENABLE_SPECTEST
+    cmocka_unit_test(host_modules_test_spectest),
+#endif
+    cmocka_unit_test(host_modules_test_not_found),
+};
+
+const size_t host_modules_tests_count = array_len(host_modules_tests);
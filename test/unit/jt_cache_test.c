@@ -0,0 +1,141 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "green_sched.h"
+#include "interpreter.h"
+#include "jt_cache.h"
+#include "module.h"
+#include "test_wasm.h"
+#include "types.h"
+#include "vm.h"
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+
+// the jump table sizes of sum and outer.
+#define SUM_JT_BYTES (1 * sizeof(jump_table))
+#define OUTER_JT_BYTES (2 * sizeof(jump_table))
+
+static void jt_cache_test_fits(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(nested_loops_wasm, nested_loops_wasm_size), vs("jt_cache"))));
+    assert_true(is_ok(jt_cache_enable(&m, 1024)));
+    vm v = {0};
+    assert_true(is_ok(vm_instantiate_module(&v, &m)));
+    // nothing is kept after the validation.
+    jt_cache_stats stats = jt_cache_get_stats(&m);
+    assert_int_equal(stats.used, 0);
+    VEC_FOR_EACH(&m.funcs, func, fn) {
+        assert_int_equal(vec_size_jump_table(&fn->jt), 0);
+    }
+
+    // 3 + 2 + 1 + 2 + 1 + 1
+    assert_int_equal(test_call_i32(&v, "jt_cache", "outer", 3), 10);
+    stats = jt_cache_get_stats(&m);
+    assert_int_equal(stats.budget, 1024);
+    assert_int_equal(stats.used, SUM_JT_BYTES + OUTER_JT_BYTES);
+    assert_int_equal(stats.rebuilds, 2);
+    assert_int_equal(stats.evictions, 0);
+    // the second and the third call of sum, and outer after each of them.
+    assert_int_equal(stats.hits, 5);
+
+    vm_drop(&v);
+    assert_true(is_ok(module_drop(&m)));
+}
+
+static void jt_cache_test_evict(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(nested_loops_wasm, nested_loops_wasm_size), vs("jt_cache"))));
+    // only one of them fits.
+    assert_true(is_ok(jt_cache_enable(&m, OUTER_JT_BYTES)));
+    vm v = {0};
+    assert_true(is_ok(vm_instantiate_module(&v, &m)));
+
+    assert_int_equal(test_call_i32(&v, "jt_cache", "outer", 3), 10);
+    jt_cache_stats stats = jt_cache_get_stats(&m);
+    assert_true(stats.used <= OUTER_JT_BYTES);
+    // sum evicts outer, and outer evicts sum when it gets back.
+    assert_int_equal(stats.rebuilds, 1 + 3 + 3);
+    assert_int_equal(stats.evictions, 3 + 3);
+    assert_int_equal(stats.hits, 0);
+
+    // too late to change it.
+    assert_false(is_ok(jt_cache_enable(&m, 0)));
+    vm_drop(&v);
+    assert_true(is_ok(module_drop(&m)));
+
+    // an empty budget still keeps the table in use.
+    m = (module){0};
+    assert_true(is_ok(module_init(&m, vs_pl(nested_loops_wasm, nested_loops_wasm_size), vs("jt_cache"))));
+    assert_true(is_ok(jt_cache_enable(&m, 0)));
+    vm v2 = {0};
+    assert_true(is_ok(vm_instantiate_module(&v2, &m)));
+    assert_int_equal(test_call_i32(&v2, "jt_cache", "outer", 4), 20);
+    assert_int_equal(jt_cache_get_stats(&m).used, OUTER_JT_BYTES);
+    vm_drop(&v2);
+    assert_true(is_ok(module_drop(&m)));
+}
+
+static void on_done(void * payload, r ret, vec_typed_value * results) {
+    assert_true(is_ok(ret));
+    assert_int_equal(vec_size_typed_value(results), 1);
+    *(i32 *)payload = vec_at_typed_value(results, 0)->val.u_i32;
+}
+
+// The green threads switch at the loops, so the others evict the tables of the suspended ones.
+static void jt_cache_test_green_threads(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(nested_loops_wasm, nested_loops_wasm_size), vs("jt_cache"))));
+    assert_true(is_ok(jt_cache_enable(&m, OUTER_JT_BYTES)));
+    vm vms[4] = {0};
+    i32 results[4] = {0};
+    green_sched s;
+    assert_true(is_ok(green_sched_init(&s, 1, 0, 0)));
+    for (u32 i = 0; i < array_len(vms); i++) {
+        assert_true(is_ok(vm_instantiate_module(&vms[i], &m)));
+        vec_typed_value args = {0};
+        assert_true(is_ok(vec_push_typed_value(&args, (typed_value){.type = TYPE_ID_i32, .val.u_i32 = 20 + i})));
+        func_addr f = vm_find_func(&vms[i], s("jt_cache"), s("outer"));
+        assert_true(is_ok(green_sched_spawn(&s, &vms[i], f, args, on_done, &results[i])));
+    }
+    assert_true(is_ok(green_sched_run(&s)));
+    green_sched_drop(&s);
+    for (u32 i = 0; i < array_len(vms); i++) {
+        i32 n = 20 + i;
+        assert_int_equal(results[i], n * (n + 1) * (n + 2) / 6);
+        vm_drop(&vms[i]);
+    }
+    assert_true(jt_cache_get_stats(&m).evictions > 0);
+    assert_true(is_ok(module_drop(&m)));
+}
+
+static void jt_cache_test_freeze(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(nested_loops_wasm, nested_loops_wasm_size), vs("jt_cache"))));
+    assert_true(is_ok(jt_cache_enable(&m, 1024)));
+    // the calls change the module.
+    assert_false(is_ok(module_freeze(&m)));
+    assert_true(is_ok(module_drop(&m)));
+}
+
+struct CMUnitTest jt_cache_tests[] = {
+    cmocka_unit_test(jt_cache_test_fits),
+    cmocka_unit_test(jt_cache_test_evict),
+    cmocka_unit_test(jt_cache_test_green_threads),
+    cmocka_unit_test(jt_cache_test_freeze),
+};
+
+const size_t jt_cache_tests_count = array_len(jt_cache_tests);
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "lz4.h"
+#include "types.h"
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+
+static void round_trip(const u8 * data, size_t len, size_t * compressed_size) {
+    size_t cap = lz4_compress_bound(len);
+    u8 * compressed = malloc(cap);
+    u8 * out = malloc(len + 1);
+    assert_non_null(compressed);
+    assert_non_null(out);
+    r_size_t ret = lz4_compress(s_pl(data, len), compressed, cap);
+    assert_true(is_ok(ret));
+    assert_true(ret.value <= cap);
+    assert_true(is_ok(lz4_decompress(s_pl(compressed, ret.value), out, len)));
+    assert_memory_equal(out, data, len);
+    // the size must match exactly.
+    assert_false(is_ok(lz4_decompress(s_pl(compressed, ret.value), out, len + 1)));
+    if (len) {
+        assert_false(is_ok(lz4_decompress(s_pl(compressed, ret.value), out, len - 1)));
+    }
+    *compressed_size = ret.value;
+    free(compressed);
+    free(out);
+}
+
+static void lz4_test_round_trip(void ** state) {
+    u8 data[4096];
+    size_t size;
+    // too short to have a match.
+    for (u32 i = 0; i < 12; i++) {
+        data[i] = (u8)i;
+    }
+    round_trip(data, 12, &size);
+    assert_int_equal(size, 13);
+
+    // long runs, the match lengths take more than one byte.
+    memset(data, 0, sizeof(data));
+    round_trip(data, sizeof(data), &size);
+    assert_true(size < 32);
+
+    // a repeated pattern with an overlapped match.
+    for (u32 i = 0; i < sizeof(data); i++) {
+        data[i] = (u8)(i % 7);
+    }
+    round_trip(data, sizeof(data), &size);
+    assert_true(size < 64);
+
+    // noise, the literal lengths take more than one byte.
+    u32 seed = 12345;
+    for (u32 i = 0; i < sizeof(data); i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (u8)(seed >> 16);
+    }
+    round_trip(data, sizeof(data), &size);
+    assert_true(size <= lz4_compress_bound(sizeof(data)));
+
+    // noise with repeated blocks.
+    memcpy(data + 1024, data, 1024);
+    memcpy(data + 3000, data + 100, 500);
+    round_trip(data, sizeof(data), &size);
+    assert_true(size < sizeof(data) - 1024);
+}
+
+static void lz4_test_malformed(void ** state) {
+    u8 out[16];
+    // 4 literals, then a match with a zero offset.
+    static const u8 zero_offset[] = {0x40, 'a', 'b', 'c', 'd', 0x00, 0x00};
+    assert_false(is_ok(lz4_decompress(s_pl(zero_offset, sizeof(zero_offset)), out, 8)));
+    // the offset points before the output.
+    static const u8 far_offset[] = {0x40, 'a', 'b', 'c', 'd', 0x05, 0x00};
+    assert_false(is_ok(lz4_decompress(s_pl(far_offset, sizeof(far_offset)), out, 8)));
+    // the literals go past the input.
+    static const u8 truncated[] = {0x50, 'a', 'b', 'c', 'd'};
+    assert_false(is_ok(lz4_decompress(s_pl(truncated, sizeof(truncated)), out, 5)));
+    // the match goes past the output.
+    static const u8 too_long[] = {0x4f, 'a', 'b', 'c', 'd', 0x04, 0x00, 0x10};
+    assert_false(is_ok(lz4_decompress(s_pl(too_long, sizeof(too_long)), out, sizeof(out))));
+    // and a valid one, abcd repeated.
+    static const u8 valid[] = {0x44, 'a', 'b', 'c', 'd', 0x04, 0x00, 0x00};
+    assert_true(is_ok(lz4_decompress(s_pl(valid, sizeof(valid)), out, 12)));
+    assert_memory_equal(out, "abcdabcdabcd", 12);
+}
+
+struct CMUnitTest lz4_tests[] = {
+    cmocka_unit_test(lz4_test_round_trip),
+    cmocka_unit_test(lz4_test_malformed),
+};
+
+const size_t lz4_tests_count = array_len(lz4_tests);
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "interpreter.h"
+#include "module.h"
+#include "test_wasm.h"
+#include "types.h"
+#include "vm.h"
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+
+// (memory i64 1 70000)
+// (data (i64.const 16) "\2a")
+// (func (export "load") (param i64) (result i64) (i64.load (local.get 0)))
+// (func (export "store") (param i64 i64) (i64.store (local.get 0) (local.get 1)))
+// (func (export "size") (result i64) (memory.size))
+// (func (export "grow") (param i64) (result i64) (memory.grow (local.get 0)))
+// (func (export "load_off") (param i64) (result i64) (i64.load offset=0x100000000 (local.get 0)))
+static const u8 memory64_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x0f, 0x03, 0x60, 0x01, 0x7e, 0x01, 0x7e, 0x60, 0x02, 0x7e, 0x7e, 0x00, 0x60, 0x00, 0x01, 0x7e,
+    0x03, 0x06, 0x05, 0x00, 0x01, 0x02, 0x00, 0x00,
+    0x05, 0x06, 0x01, 0x05, 0x01, 0xf0, 0xa2, 0x04,
+    0x07, 0x29, 0x05,
+    0x04, 0x6c, 0x6f, 0x61, 0x64, 0x00, 0x00,
+    0x05, 0x73, 0x74, 0x6f, 0x72, 0x65, 0x00, 0x01,
+    0x04, 0x73, 0x69, 0x7a, 0x65, 0x00, 0x02,
+    0x04, 0x67, 0x72, 0x6f, 0x77, 0x00, 0x03,
+    0x08, 0x6c, 0x6f, 0x61, 0x64, 0x5f, 0x6f, 0x66, 0x66, 0x00, 0x04,
+    0x0a, 0x2b, 0x05,
+    0x07, 0x00, 0x20, 0x00, 0x29, 0x03, 0x00, 0x0b,
+    0x09, 0x00, 0x20, 0x00, 0x20, 0x01, 0x37, 0x03, 0x00, 0x0b,
+    0x04, 0x00, 0x3f, 0x00, 0x0b,
+    0x06, 0x00, 0x20, 0x00, 0x40, 0x00, 0x0b,
+    0x0b, 0x00, 0x20, 0x00, 0x29, 0x03, 0x80, 0x80, 0x80, 0x80, 0x10, 0x0b,
+    0x0b, 0x07, 0x01, 0x00, 0x42, 0x10, 0x0b, 0x01, 0x2a,
+};
+
+// (memory i64 1)
+// (func (drop (i32.load (i32.const 0))))
+static const u8 i32_address_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x04, 0x01, 0x60, 0x00, 0x00,
+    0x03, 0x02, 0x01, 0x00,
+    0x05, 0x03, 0x01, 0x04, 0x01,
+    0x0a, 0x0a, 0x01, 0x08, 0x00, 0x41, 0x00, 0x28, 0x02, 0x00, 0x1a, 0x0b,
+};
+
+static void memory64_test_load_store(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(memory64_wasm, sizeof(memory64_wasm)), vs("memory64"))));
+    vm v = {0};
+    assert_true(is_ok(vm_instantiate_module(&v, &m)));
+    memory_inst * mem = *vec_at_mem_addr(&vm_find_module_inst(&v, s("memory64"))->m_addrs, 0);
+    assert_true(memory_is64(mem->mem));
+
+    // the data segment with an i64 offset
+    assert_true(is_ok(test_call(&v, "memory64", "load", TEST_ARGS(test_i64(16)))));
+    assert_int_equal(test_result_i64(&v), 0x2a);
+    assert_true(is_ok(test_call(&v, "memory64", "store", TEST_ARGS(test_i64(8), test_i64(0x0123456789abcdefull)))));
+    assert_true(is_ok(test_call(&v, "memory64", "load", TEST_ARGS(test_i64(8)))));
+    assert_int_equal(test_result_i64(&v), 0x0123456789abcdefull);
+
+    assert_true(is_ok(test_call(&v, "memory64", "size", 0, NULL)));
+    assert_int_equal(test_result_i64(&v), 1);
+    // beyond the max
+    assert_true(is_ok(test_call(&v, "memory64", "grow", TEST_ARGS(test_i64(70000)))));
+    assert_int_equal(test_result_i64(&v), (u64)-1);
+    assert_true(is_ok(test_call(&v, "memory64", "grow", TEST_ARGS(test_i64(1)))));
+    assert_int_equal(test_result_i64(&v), 1);
+    assert_true(is_ok(test_call(&v, "memory64", "size", 0, NULL)));
+    assert_int_equal(test_result_i64(&v), 2);
+
+    // addresses and offsets that don't fit in 32 bits must trap rather than wrap around.
+    test_expect_trap(&v, test_call(&v, "memory64", "load", TEST_ARGS(test_i64(0x100000000ull))));
+    test_expect_trap(&v, test_call(&v, "memory64", "load", TEST_ARGS(test_i64(UINT64_MAX - 4))));
+    test_expect_trap(&v, test_call(&v, "memory64", "load_off", TEST_ARGS(test_i64(0))));
+    test_expect_trap(&v, test_call(&v, "memory64", "store", TEST_ARGS(test_i64(UINT64_MAX), test_i64(0))));
+    assert_true(is_ok(test_call(&v, "memory64", "load", TEST_ARGS(test_i64(8)))));
+    assert_int_equal(test_result_i64(&v), 0x0123456789abcdefull);
+
+    vm_drop(&v);
+    assert_true(is_ok(module_drop(&m)));
+}
+
+static void memory64_test_beyond_4g(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(memory64_wasm, sizeof(memory64_wasm)), vs("memory64"))));
+    vm v = {0};
+    assert_true(is_ok(vm_instantiate_module(&v, &m)));
+    memory_inst * mem = *vec_at_mem_addr(&vm_find_module_inst(&v, s("memory64"))->m_addrs, 0);
+    // without the reservation it would really allocate 4GiB.
+    if (mem->mapped) {
+        assert_true(is_ok(test_call(&v, "memory64", "grow", TEST_ARGS(test_i64(WASM_MEM_MAX_PAGES)))));
+        assert_int_equal(test_result_i64(&v), 1);
+        assert_true(is_ok(test_call(&v, "memory64", "store", TEST_ARGS(test_i64(0x100000008ull), test_i64(42)))));
+        assert_true(is_ok(test_call(&v, "memory64", "load_off", TEST_ARGS(test_i64(8)))));
+        assert_int_equal(test_result_i64(&v), 42);
+        assert_true(is_ok(test_call(&v, "memory64", "load", TEST_ARGS(test_i64(8)))));
+        assert_int_equal(test_result_i64(&v), 0);
+    }
+    vm_drop(&v);
+    assert_true(is_ok(module_drop(&m)));
+}
+
+static void memory64_test_i32_address(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(i32_address_wasm, sizeof(i32_address_wasm)), vs("memory64"))));
+    r ret = module_validate(&m);
+    assert_false(is_ok(ret));
+    assert_true(err_is(ret.msg, e_invalid));
+    assert_true(is_ok(module_drop(&m)));
+}
+
+struct CMUnitTest memory64_tests[] = {
+    cmocka_unit_test(memory64_test_load_store),
+    cmocka_unit_test(memory64_test_beyond_4g),
+    cmocka_unit_test(memory64_test_i32_address),
+};
+
+const size_t memory64_tests_count = array_len(memory64_tests);
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "interpreter.h"
+#include "module.h"
+#include "test_wasm.h"
+#include "types.h"
+#include "vm.h"
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+
+// (memory 6000 6100 (pagesize 1))
+// (data (i32.const 5999) "\2a")
+// (func (export "size") (result i32) (memory.size))
+// (func (export "grow") (param i32) (result i32) (memory.grow (local.get 0)))
+// (func (export "load8") (param i32) (result i32) (i32.load8_u (local.get 0)))
+static const u8 byte_pages_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x0a, 0x02, 0x60, 0x00, 0x01, 0x7f, 0x60, 0x01, 0x7f, 0x01, 0x7f,
+    0x03, 0x04, 0x03, 0x00, 0x01, 0x01,
+    0x05, 0x07, 0x01, 0x09, 0xf0, 0x2e, 0xd4, 0x2f, 0x00,
+    0x07, 0x17, 0x03,
+    0x04, 0x73, 0x69, 0x7a, 0x65, 0x00, 0x00,
+    0x04, 0x67, 0x72, 0x6f, 0x77, 0x00, 0x01,
+    0x05, 0x6c, 0x6f, 0x61, 0x64, 0x38, 0x00, 0x02,
+    0x0a, 0x15, 0x03,
+    0x04, 0x00, 0x3f, 0x00, 0x0b,
+    0x06, 0x00, 0x20, 0x00, 0x40, 0x00, 0x0b,
+    0x07, 0x00, 0x20, 0x00, 0x2d, 0x00, 0x00, 0x0b,
+    0x0b, 0x08, 0x01, 0x00, 0x41, 0xef, 0x2e, 0x0b, 0x01, 0x2a,
+};
+
+// (memory 1 (pagesize 256))
+static const u8 invalid_page_size_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x05, 0x04, 0x01, 0x08, 0x01, 0x08,
+};
+
+static void page_size_test_byte_pages(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(byte_pages_wasm, sizeof(byte_pages_wasm)), vs("page_size"))));
+    vm v = {0};
+    assert_true(is_ok(vm_instantiate_module(&v, &m)));
+    memory_inst * mem = *vec_at_mem_addr(&vm_find_module_inst(&v, s("page_size"))->m_addrs, 0);
+    // exactly what's declared, not rounded up to 64KiB.
+    assert_int_equal(vec_size_u8(&mem->mdata), 6000);
+
+    assert_true(is_ok(test_call(&v, "page_size", "load8", TEST_ARGS(test_i32(5999)))));
+    assert_int_equal(test_result_i32(&v), 42);
+    test_expect_trap(&v, test_call(&v, "page_size", "load8", TEST_ARGS(test_i32(6000))));
+
+    assert_true(is_ok(test_call(&v, "page_size", "size", 0, NULL)));
+    assert_int_equal(test_result_i32(&v), 6000);
+    assert_true(is_ok(test_call(&v, "page_size", "grow", TEST_ARGS(test_i32(100)))));
+    assert_int_equal(test_result_i32(&v), 6000);
+    assert_int_equal(vec_size_u8(&mem->mdata), 6100);
+    assert_true(is_ok(test_call(&v, "page_size", "load8", TEST_ARGS(test_i32(6099)))));
+    assert_int_equal(test_result_i32(&v), 0);
+    // beyond the max
+    assert_true(is_ok(test_call(&v, "page_size", "grow", TEST_ARGS(test_i32(1)))));
+    assert_int_equal(test_result_i32(&v), -1);
+    assert_true(is_ok(test_call(&v, "page_size", "size", 0, NULL)));
+    assert_int_equal(test_result_i32(&v), 6100);
+
+    vm_drop(&v);
+    assert_true(is_ok(module_drop(&m)));
+}
+
+static void page_size_test_invalid(void ** state) {
+    module m = {0};
+    r ret = module_init(&m, vs_pl(invalid_page_size_wasm, sizeof(invalid_page_size_wasm)), vs("page_size"));
+    assert_false(is_ok(ret));
+    assert_true(err_is(ret.msg, e_invalid));
+    module_drop(&m);
+}
+
+struct CMUnitTest page_size_tests[] = {
+    cmocka_unit_test(page_size_test_byte_pages),
+    cmocka_unit_test(page_size_test_invalid),
+};
+
+const size_t page_size_tests_count = array_len(page_size_tests);
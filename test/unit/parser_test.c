@@ -43,6 +43,40 @@ static void parser_test_full_module(void ** state) {
     module_drop(&m);
 }
 
+// (func (param i32) (result i64) (local i32 i32) (local i64) (local 0 f32) (local 10000 i64) (local f64)
+//   (local.get 10003))
+static const u8 grouped_locals_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x06, 0x01, 0x60, 0x01, 0x7f, 0x01, 0x7e,
+    0x03, 0x02, 0x01, 0x00,
+    0x0a, 0x12, 0x01, 0x10, 0x05, 0x02, 0x7f, 0x01, 0x7e, 0x00, 0x7d, 0x90, 0x4e, 0x7e, 0x01, 0x7c, 0x20, 0x93, 0x4e, 0x0b,
+};
+
+static void parser_test_local_groups(void ** state) {
+    u8 bin[sizeof(grouped_locals_wasm)];
+    memcpy(bin, grouped_locals_wasm, sizeof(bin));
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(bin, sizeof(bin)), vs("test"))));
+    func * fn = vec_at_func(&m.funcs, 0);
+    assert_int_equal(fn->local_count, 1 + 2 + 1 + 10000 + 1);
+    // the empty group is dropped and the i64 ones are merged.
+    assert_int_equal(svec_size_local_group(&fn->local_groups), 3);
+    assert_int_equal(func_local_type(fn, 1), TYPE_ID_i32);
+    assert_int_equal(func_local_type(fn, 2), TYPE_ID_i32);
+    assert_int_equal(func_local_type(fn, 3), TYPE_ID_i64);
+    assert_int_equal(func_local_type(fn, 10003), TYPE_ID_i64);
+    assert_int_equal(func_local_type(fn, 10004), TYPE_ID_f64);
+    assert_true(is_ok(module_validate(&m)));
+    module_drop(&m);
+
+    // local.get 10004 is the f64.
+    bin[sizeof(bin) - 3] = 0x94;
+    m = (module){0};
+    assert_true(is_ok(module_init(&m, vs_pl(bin, sizeof(bin)), vs("test"))));
+    assert_false(is_ok(module_validate(&m)));
+    module_drop(&m);
+}
+
 // static void parser_test_load_file(void ** state) {
 //     FILE * fp = fopen("rustwasm.wasm", "rb");
 //     assert_non_null(fp);
@@ -69,6 +103,7 @@ struct CMUnitTest parser_tests[] = {
     // cmocka_unit_test(parser_test_load_file),
     cmocka_unit_test(parser_test_magic_mismatch),
     cmocka_unit_test(parser_test_full_module),
+    cmocka_unit_test(parser_test_local_groups),
 };
 
 const size_t parser_tests_count = array_len(parser_tests);
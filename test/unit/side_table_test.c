@@ -0,0 +1,175 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "alloc.h"
+#include "hello_wasm.h"
+#include "module.h"
+#include "side_table.h"
+#include "types.h"
+#include "validator.h"
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+#include <string.h>
+
+// (func (export "f") (param i64 i32) (result i64)
+//   (select (local.get 0) (i64.const 1) (local.get 1)) (drop (local.get 0)))
+// the operands of the drop and the untyped select are two slots with SILVERFIR_STACK_SLOT_32.
+static const u8 wide_operands_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x07, 0x01, 0x60, 0x02, 0x7e, 0x7f, 0x01, 0x7e,
+    0x03, 0x02, 0x01, 0x00,
+    0x07, 0x05, 0x01, 0x01, 0x66, 0x00, 0x00,
+    0x0a, 0x0e, 0x01,
+    0x0c, 0x00, 0x20, 0x00, 0x42, 0x01, 0x20, 0x01, 0x1b, 0x20, 0x00, 0x1a, 0x0b,
+};
+
+// the binary with the side table appended, placed at buf + offset.
+static u8 * build_prepped(u8 * buf, size_t offset, const u8 * wasm, size_t wasm_size, size_t * size) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(wasm, wasm_size), vs("test"))));
+    assert_true(is_ok(validate_module(&m)));
+    r_vstr section = side_table_section_build(&m, wasm_size);
+    assert_true(is_ok(section));
+    module_drop(&m);
+
+    u8 * p = buf + offset;
+    memcpy(p, wasm, wasm_size);
+    memcpy(p + wasm_size, section.value.s.ptr, str_len(section.value.s));
+    *size = wasm_size + str_len(section.value.s);
+    vstr_drop(&section.value);
+    return p;
+}
+
+static void compare_with_validator(module * m, const u8 * wasm, size_t wasm_size) {
+    module ref = {0};
+    assert_true(is_ok(module_init(&ref, vs_pl(wasm, wasm_size), vs("ref"))));
+    assert_true(is_ok(validate_module(&ref)));
+    assert_int_equal(vec_size_func(&m->funcs), vec_size_func(&ref.funcs));
+    for (u32 i = 0; i < vec_size_func(&ref.funcs); i++) {
+        func * expected = vec_at_func(&ref.funcs, i);
+        func * actual = vec_at_func(&m->funcs, i);
+        assert_int_equal(actual->stack_size_max, expected->stack_size_max);
+        assert_int_equal(vec_size_jump_table(&actual->jt), vec_size_jump_table(&expected->jt));
+        if (vec_size_jump_table(&expected->jt)) {
+            assert_memory_equal(vec_at_jump_table(&actual->jt, 0),
+                vec_at_jump_table(&expected->jt, 0),
+                vec_size_jump_table(&expected->jt) * sizeof(jump_table));
+        }
+        assert_int_equal(vec_size_jump_table_escape(&actual->jt_escapes), vec_size_jump_table_escape(&expected->jt_escapes));
+        if (vec_size_jump_table_escape(&expected->jt_escapes)) {
+            assert_memory_equal(vec_at_jump_table_escape(&actual->jt_escapes, 0),
+                vec_at_jump_table_escape(&expected->jt_escapes, 0),
+                vec_size_jump_table_escape(&expected->jt_escapes) * sizeof(jump_table_escape));
+        }
+#if SILVERFIR_STACK_SLOT_32
+        assert_int_equal(vec_size_u8(&actual->wide_operands), vec_size_u8(&expected->wide_operands));
+        if (vec_size_u8(&expected->wide_operands)) {
+            assert_memory_equal(vec_at_u8(&actual->wide_operands, 0),
+                vec_at_u8(&expected->wide_operands, 0),
+                vec_size_u8(&expected->wide_operands));
+        }
+#endif
+    }
+    module_drop(&ref);
+}
+
+static void side_table_test_load(void ** state) {
+    u8 * buf = array_alloc(u8, hello_wasm_size + 0x10000);
+    assert_non_null(buf);
+    size_t size = 0;
+    u8 * bin = build_prepped(buf, 0, hello_wasm, hello_wasm_size, &size);
+
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(bin, size), vs("test"))));
+    assert_false(str_is_null(m.side_table_section));
+    assert_true(is_ok(side_table_load(&m)));
+    assert_true(m.side_table_loaded);
+    compare_with_validator(&m, hello_wasm, hello_wasm_size);
+    if (is_little_endian()) {
+        // used in place.
+        assert_true(m.jt_borrowed);
+        VEC_FOR_EACH(&m.funcs, func, fn) {
+            if (vec_size_jump_table(&fn->jt)) {
+                u8 * p = (u8 *)vec_at_jump_table(&fn->jt, 0);
+                assert_true(p >= bin && p < bin + size);
+            }
+        }
+    }
+    module_drop(&m);
+    array_free(buf);
+}
+
+static void side_table_test_load_unaligned(void ** state) {
+    u8 * buf = array_alloc(u8, hello_wasm_size + 0x10000);
+    assert_non_null(buf);
+    size_t size = 0;
+    u8 * bin = build_prepped(buf, 1, hello_wasm, hello_wasm_size, &size);
+
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(bin, size), vs("test"))));
+    assert_true(is_ok(side_table_load(&m)));
+    // the tables are copied.
+    assert_false(m.jt_borrowed);
+    compare_with_validator(&m, hello_wasm, hello_wasm_size);
+    module_drop(&m);
+    array_free(buf);
+}
+
+static void side_table_test_checksum_mismatch(void ** state) {
+    u8 * buf = array_alloc(u8, hello_wasm_size + 0x10000);
+    assert_non_null(buf);
+    size_t size = 0;
+    u8 * bin = build_prepped(buf, 0, hello_wasm, hello_wasm_size, &size);
+
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(bin, size), vs("test"))));
+    // flip one byte in the code section.
+    ((u8 *)m.code_section.ptr)[str_len(m.code_section) - 2] ^= 0xff;
+    r ret = side_table_load(&m);
+    assert_false(is_ok(ret));
+    assert_false(m.side_table_loaded);
+    module_drop(&m);
+    array_free(buf);
+}
+
+// the operand widths of the drops and the selects are kept in the table too.
+static void side_table_test_operand_widths(void ** state) {
+    u8 * buf = array_alloc(u8, sizeof(wide_operands_wasm) + 0x100);
+    assert_non_null(buf);
+    for (size_t offset = 0; offset < 2; offset++) {
+        size_t size = 0;
+        u8 * bin = build_prepped(buf, offset, wide_operands_wasm, sizeof(wide_operands_wasm), &size);
+        module m = {0};
+        assert_true(is_ok(module_init(&m, vs_pl(bin, size), vs("test"))));
+        assert_true(is_ok(side_table_load(&m)));
+        compare_with_validator(&m, wide_operands_wasm, sizeof(wide_operands_wasm));
+#if SILVERFIR_STACK_SLOT_32
+        assert_true(vec_size_u8(&vec_at_func(&m.funcs, 0)->wide_operands) > 0);
+#endif
+        module_drop(&m);
+    }
+    array_free(buf);
+}
+
+struct CMUnitTest side_table_tests[] = {
+    cmocka_unit_test(side_table_test_load),
+    cmocka_unit_test(side_table_test_load_unaligned),
+    cmocka_unit_test(side_table_test_checksum_mismatch),
+    cmocka_unit_test(side_table_test_operand_widths),
+};
+
+const size_t side_table_tests_count = array_len(side_table_tests);
@@ -0,0 +1,334 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "interpreter.h"
+#include "module.h"
+#include "opcode.h"
+#include "silverfir.h"
+#include "test_wasm.h"
+#include "types.h"
+#include "vec.h"
+#include "vm.h"
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+#include <math.h>
+#include <string.h>
+
+#if SILVERFIR_ENABLE_SIMD
+
+// (memory 1)
+// (func (export "f") (param v128 v128) (result <result_type>) <body>)
+// the body is short enough for one-byte sizes.
+static void build_module(vec_u8 * bin, u8 result_type, const u8 * body, size_t body_len) {
+    static const u8 header[] = {
+        0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    };
+    const u8 types[] = {0x01, 0x07, 0x01, 0x60, 0x02, 0x7b, 0x7b, 0x01, result_type};
+    static const u8 sections[] = {
+        0x03, 0x02, 0x01, 0x00,             // function section
+        0x05, 0x03, 0x01, 0x00, 0x01,       // memory section
+        0x07, 0x05, 0x01, 0x01, 0x66, 0x00, 0x00, // export section
+    };
+    assert_true(body_len + 4 < 0x80);
+    test_emit_bytes(bin, header, sizeof(header));
+    test_emit_bytes(bin, types, sizeof(types));
+    test_emit_bytes(bin, sections, sizeof(sections));
+    test_emit(bin, 0x0a);
+    test_emit(bin, (u8)(body_len + 4));
+    test_emit(bin, 0x01);
+    test_emit(bin, (u8)(body_len + 2));
+    test_emit(bin, 0x00); // no locals
+    test_emit_bytes(bin, body, body_len);
+    test_emit(bin, op_end);
+}
+
+// run f(a, b) and return the only result.
+static r_typed_value run(u8 result_type, const u8 * body, size_t body_len, v128 a, v128 b) {
+    vec_u8 bin = {0};
+    build_module(&bin, result_type, body, body_len);
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(vec_at_u8(&bin, 0), vec_size_u8(&bin)), vs("simd"))));
+    vm v = {0};
+    assert_true(is_ok(vm_instantiate_module(&v, &m)));
+    func_addr f = vm_find_func(&v, s("simd"), s("f"));
+    assert_non_null(f);
+    vec_typed_value args = {0};
+    assert_true(is_ok(vec_push_typed_value(&args, (typed_value){.type = TYPE_ID_v128, .val.u_v128 = a})));
+    assert_true(is_ok(vec_push_typed_value(&args, (typed_value){.type = TYPE_ID_v128, .val.u_v128 = b})));
+    r ret = interp_call_in_thread(&v.thread, f, args);
+    r_typed_value result = {.msg = ret.msg};
+    if (is_ok(ret)) {
+        assert_int_equal(vec_size_typed_value(&v.thread.results), 1);
+        result.value = *vec_at_typed_value(&v.thread.results, 0);
+    }
+    vm_drop(&v);
+    assert_true(is_ok(module_drop(&m)));
+    vec_clear_u8(&bin);
+    return result;
+}
+
+// f(a, b) = a <op> b
+static v128 binop(u8 op, v128 a, v128 b) {
+    const u8 body[] = {op_local_get, 0x00, op_local_get, 0x01, op_prefix_fd, op, 0x01};
+    r_typed_value ret = run(0x7b, body, sizeof(body) - (op < 0x80), a, b);
+    assert_true(is_ok(ret));
+    assert_int_equal(ret.value.type, TYPE_ID_v128);
+    return ret.value.val.u_v128;
+}
+
+// f(a, b) = <op> a
+static v128 unop(u8 op, v128 a) {
+    const u8 body[] = {op_local_get, 0x00, op_prefix_fd, op, 0x01};
+    r_typed_value ret = run(0x7b, body, sizeof(body) - (op < 0x80), a, (v128){0});
+    assert_true(is_ok(ret));
+    return ret.value.val.u_v128;
+}
+
+static bool validates(u8 result_type, const u8 * body, size_t body_len) {
+    vec_u8 bin = {0};
+    build_module(&bin, result_type, body, body_len);
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(vec_at_u8(&bin, 0), vec_size_u8(&bin)), vs("simd"))));
+    bool valid = is_ok(module_validate(&m));
+    module_drop(&m);
+    vec_clear_u8(&bin);
+    return valid;
+}
+
+static void simd_test_integer(void ** state) {
+    v128 a = {.i8x16 = {100, -100, 127, -128, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12}};
+    v128 b = {.i8x16 = {100, -100, 1, -1, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12}};
+    v128 res = binop(op_i8x16_add_sat_s, a, b);
+    assert_int_equal(res.i8x16[0], 127);
+    assert_int_equal(res.i8x16[1], -128);
+    assert_int_equal(res.i8x16[2], 127);
+    assert_int_equal(res.i8x16[3], -128);
+    assert_int_equal(res.i8x16[15], 24);
+    res = binop(op_i8x16_add, a, b);
+    assert_int_equal(res.i8x16[0], -56);
+    res = binop(op_i8x16_gt_s, a, b);
+    assert_int_equal(res.u8x16[0], 0x00);
+    assert_int_equal(res.u8x16[2], 0xff);
+    assert_int_equal(res.u8x16[3], 0x00);
+    res = unop(op_i8x16_abs, a);
+    assert_int_equal(res.i8x16[1], 100);
+    assert_int_equal(res.i8x16[3], -128);
+
+    v128 c = {.i16x8 = {-32768, 32767, 300, -300, 2, 3, -4, 5}};
+    v128 d = {.i16x8 = {-32768, 32767, 2, 2, 2, 3, 4, 5}};
+    res = binop(op_i16x8_q15mulr_sat_s, c, d);
+    assert_int_equal(res.i16x8[0], 32767);
+    assert_int_equal(res.i16x8[1], 32766);
+    res = binop(op_i8x16_narrow_i16x8_u, c, d);
+    assert_int_equal(res.u8x16[0], 0);
+    assert_int_equal(res.u8x16[1], 255);
+    assert_int_equal(res.u8x16[2], 255);
+    assert_int_equal(res.u8x16[3], 0);
+    assert_int_equal(res.u8x16[4], 2);
+    res = binop(op_i32x4_dot_i16x8_s, c, d);
+    assert_int_equal(res.i32x4[0], 0x7fff0001);
+    assert_int_equal(res.i32x4[1], 600 - 600);
+    assert_int_equal(res.i32x4[2], 4 + 9);
+    assert_int_equal(res.i32x4[3], -16 + 25);
+    res = binop(op_i32x4_extmul_high_i16x8_s, c, d);
+    assert_int_equal(res.i32x4[2], -16);
+
+    v128 e = {.u64x2 = {0x100000001ULL, u64_MAX}};
+    v128 f = {.u64x2 = {0x100000001ULL, 2}};
+    res = binop(op_i64x2_mul, e, f);
+    assert_true(res.u64x2[0] == 0x200000001ULL);
+    assert_true(res.u64x2[1] == u64_MAX - 1);
+
+    // i8x16.bitmask returns an i32
+    const u8 bitmask[] = {op_local_get, 0x00, op_prefix_fd, op_i8x16_bitmask};
+    r_typed_value ret = run(0x7f, bitmask, sizeof(bitmask), a, b);
+    assert_true(is_ok(ret));
+    assert_int_equal(ret.value.val.u_i32, 0x000a);
+}
+
+static void simd_test_float(void ** state) {
+    f32 nan = NAN;
+    v128 a = {.f32x4 = {-0.f, 1.f, nan, 2.5f}};
+    v128 b = {.f32x4 = {0.f, -1.f, 1.f, -2.5f}};
+    v128 res = binop(op_f32x4_min, a, b);
+    assert_true(res.u32x4[0] == 0x80000000U);
+    assert_true(res.f32x4[1] == -1.f);
+    assert_true(isnan(res.f32x4[2]));
+    res = binop(op_f32x4_max, a, b);
+    assert_true(res.u32x4[0] == 0);
+    assert_true(isnan(res.f32x4[2]));
+    // pmin is b < a ? b : a
+    res = binop(op_f32x4_pmin, a, b);
+    assert_true(res.u32x4[0] == 0x80000000U);
+    assert_true(isnan(res.f32x4[2]));
+    res = binop(op_f32x4_lt, a, b);
+    assert_int_equal(res.u32x4[0], 0);
+    assert_int_equal(res.u32x4[2], 0);
+    assert_int_equal(res.u32x4[3], 0);
+    res = binop(op_f32x4_ne, a, b);
+    assert_int_equal(res.u32x4[0], 0);
+    assert_int_equal(res.u32x4[2], u32_MAX);
+    res = unop(op_f32x4_nearest, (v128){.f32x4 = {2.5f, -3.5f, 0.4f, -0.4f}});
+    assert_true(res.f32x4[0] == 2.f);
+    assert_true(res.f32x4[1] == -4.f);
+    assert_true(res.u32x4[3] == 0x80000000U);
+    res = unop(op_f32x4_neg, a);
+    assert_true(res.u32x4[0] == 0);
+    // the rounding ops quiet a signaling nan
+    res = unop(op_f32x4_ceil, (v128){.u32x4 = {0x7fa00000U, 0xffa00000U, 0x7fc00000U, 0x3fc00000U}});
+    assert_true((res.u32x4[0] & 0x7fc00000U) == 0x7fc00000U);
+    assert_true((res.u32x4[1] & 0x7fc00000U) == 0x7fc00000U);
+    assert_true(res.u32x4[2] == 0x7fc00000U);
+    assert_true(res.f32x4[3] == 2.f);
+    res = unop(op_f64x2_trunc, (v128){.u64x2 = {0x7ff4000000000000ULL, 0xbff8000000000000ULL}});
+    assert_true((res.u64x2[0] & 0x7ff8000000000000ULL) == 0x7ff8000000000000ULL);
+    assert_true(res.f64x2[1] == -1.);
+
+    res = unop(op_i32x4_trunc_sat_f32x4_u, (v128){.f32x4 = {-3.f, nan, 5e9f, 7.9f}});
+    assert_int_equal(res.u32x4[0], 0);
+    assert_int_equal(res.u32x4[1], 0);
+    assert_int_equal(res.u32x4[2], u32_MAX);
+    assert_int_equal(res.u32x4[3], 7);
+    res = unop(op_i32x4_trunc_sat_f64x2_s_zero, (v128){.f64x2 = {-3e10, 42.9}});
+    assert_int_equal(res.i32x4[0], i32_MIN);
+    assert_int_equal(res.i32x4[1], 42);
+    assert_int_equal(res.i32x4[2], 0);
+    assert_int_equal(res.i32x4[3], 0);
+
+    v128 c = {.f64x2 = {1.5, -0.}};
+    v128 d = {.f64x2 = {-1.5, 0.}};
+    res = binop(op_f64x2_pmax, c, d);
+    assert_true(res.f64x2[0] == 1.5);
+    assert_true(res.u64x2[1] == 0x8000000000000000ULL);
+    res = binop(op_f64x2_max, c, d);
+    assert_true(res.u64x2[1] == 0);
+}
+
+static void simd_test_lanes(void ** state) {
+    v128 a = {.u8x16 = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15}};
+    v128 b = {.u8x16 = {16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31}};
+
+    // the indexes out of range pick zero.
+    v128 idx = {.u8x16 = {15, 0, 16, 255, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 128}};
+    v128 res = binop(op_i8x16_swizzle, a, idx);
+    assert_int_equal(res.u8x16[0], 15);
+    assert_int_equal(res.u8x16[1], 0);
+    assert_int_equal(res.u8x16[2], 0);
+    assert_int_equal(res.u8x16[3], 0);
+    assert_int_equal(res.u8x16[4], 1);
+    assert_int_equal(res.u8x16[15], 0);
+
+    const u8 shuffle[] = {
+        op_local_get, 0x00, op_local_get, 0x01, op_prefix_fd, op_i8x16_shuffle,
+        31, 0, 30, 1, 29, 2, 28, 3, 27, 4, 26, 5, 25, 6, 24, 7,
+    };
+    r_typed_value ret = run(0x7b, shuffle, sizeof(shuffle), a, b);
+    assert_true(is_ok(ret));
+    assert_int_equal(ret.value.val.u_v128.u8x16[0], 31);
+    assert_int_equal(ret.value.val.u_v128.u8x16[1], 0);
+    assert_int_equal(ret.value.val.u_v128.u8x16[15], 7);
+
+    // (i16x8.extract_lane_s 7 (i16x8.replace_lane 7 (local.get 0) (i32.const -1)))
+    const u8 lanes[] = {
+        op_local_get, 0x00, op_i32_const, 0x7f, op_prefix_fd, op_i16x8_replace_lane, 7,
+        op_prefix_fd, op_i16x8_extract_lane_s, 7,
+    };
+    ret = run(0x7f, lanes, sizeof(lanes), a, b);
+    assert_true(is_ok(ret));
+    assert_int_equal(ret.value.val.u_i32, -1);
+}
+
+static void simd_test_memory(void ** state) {
+    // (v128.store (i32.const 8) (local.get 0))
+    // (v128.load32_lane 3 (i32.const 8) (v128.load64_splat (i32.const 16))) ;; pick the first i32
+    const u8 body[] = {
+        op_i32_const, 0x08, op_local_get, 0x00, op_prefix_fd, op_v128_store, 0x04, 0x00,
+        op_i32_const, 0x08,
+        op_i32_const, 0x10, op_prefix_fd, op_v128_load64_splat, 0x03, 0x00,
+        op_prefix_fd, op_v128_load32_lane, 0x02, 0x00, 0x03,
+    };
+    v128 a = {.u32x4 = {0x11111111, 0x22222222, 0x33333333, 0x44444444}};
+    r_typed_value ret = run(0x7b, body, sizeof(body), a, (v128){0});
+    assert_true(is_ok(ret));
+    v128 res = ret.value.val.u_v128;
+    assert_int_equal(res.u32x4[0], 0x33333333);
+    assert_int_equal(res.u32x4[1], 0x44444444);
+    assert_int_equal(res.u32x4[2], 0x33333333);
+    assert_int_equal(res.u32x4[3], 0x11111111);
+
+    // the last byte is out of the memory.
+    const u8 oob[] = {
+        op_i32_const, 0xf1, 0xff, 0x03, op_prefix_fd, op_v128_load, 0x00, 0x00,
+    };
+    ret = run(0x7b, oob, sizeof(oob), a, (v128){0});
+    assert_false(is_ok(ret));
+}
+
+static void simd_test_invalid(void ** state) {
+    const u8 good_lane[] = {op_local_get, 0x00, op_prefix_fd, op_i32x4_extract_lane, 3};
+    assert_true(validates(0x7f, good_lane, sizeof(good_lane)));
+    const u8 bad_lane[] = {op_local_get, 0x00, op_prefix_fd, op_i32x4_extract_lane, 4};
+    assert_false(validates(0x7f, bad_lane, sizeof(bad_lane)));
+
+    const u8 good_align[] = {op_i32_const, 0x00, op_prefix_fd, op_v128_load32_splat, 0x02, 0x00};
+    assert_true(validates(0x7b, good_align, sizeof(good_align)));
+    const u8 bad_align[] = {op_i32_const, 0x00, op_prefix_fd, op_v128_load32_splat, 0x03, 0x00};
+    assert_false(validates(0x7b, bad_align, sizeof(bad_align)));
+
+    const u8 bad_shuffle[] = {
+        op_local_get, 0x00, op_local_get, 0x01, op_prefix_fd, op_i8x16_shuffle,
+        32, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    };
+    assert_false(validates(0x7b, bad_shuffle, sizeof(bad_shuffle)));
+
+    // type mismatch: i32x4.add on an i32
+    const u8 bad_type[] = {op_local_get, 0x00, op_i32_const, 0x00, op_prefix_fd, 0xae, 0x01};
+    assert_false(validates(0x7b, bad_type, sizeof(bad_type)));
+
+    // unassigned opcode
+    const u8 unknown[] = {op_local_get, 0x00, op_prefix_fd, 0x9a, 0x01};
+    assert_false(validates(0x7b, unknown, sizeof(unknown)));
+}
+
+struct CMUnitTest simd_tests[] = {
+    cmocka_unit_test(simd_test_integer),
+    cmocka_unit_test(simd_test_float),
+    cmocka_unit_test(simd_test_lanes),
+    cmocka_unit_test(simd_test_memory),
+    cmocka_unit_test(simd_test_invalid),
+};
+
+#else
+
+// v128 is rejected like any unknown type.
+static void simd_test_disabled(void ** state) {
+    static const u8 bin[] = {
+        0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+        0x01, 0x05, 0x01, 0x60, 0x01, 0x7b, 0x00,
+    };
+    module m = {0};
+    assert_false(is_ok(module_init(&m, vs_pl(bin, sizeof(bin)), vs("simd"))));
+    module_drop(&m);
+}
+
+struct CMUnitTest simd_tests[] = {
+    cmocka_unit_test(simd_test_disabled),
+};
+
+#endif // SILVERFIR_ENABLE_SIMD
+
+const size_t simd_tests_count = array_len(simd_tests);
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "interpreter.h"
+#include "module.h"
+#include "types.h"
+#include "vm.h"
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+
+// (memory (export "mem") 1 2)
+// (global $g (mut i32) (i32.const 0))
+// (func $init (i32.store (i32.const 0) (i32.const 42)) (global.set $g (i32.const 7)))
+// (func (export "get") (result i32) (i32.load (i32.const 0)))
+// (start $init)
+// (data (i32.const 16) "abc")
+static const u8 snapshot_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x08, 0x02, 0x60, 0x00, 0x00, 0x60, 0x00, 0x01, 0x7f,
+    0x03, 0x03, 0x02, 0x00, 0x01,
+    0x05, 0x04, 0x01, 0x01, 0x01, 0x02,
+    0x06, 0x06, 0x01, 0x7f, 0x01, 0x41, 0x00, 0x0b,
+    0x07, 0x0d, 0x02, 0x03, 0x6d, 0x65, 0x6d, 0x02, 0x00, 0x03, 0x67, 0x65, 0x74, 0x00, 0x01,
+    0x08, 0x01, 0x00,
+    0x0a, 0x17, 0x02,
+    0x0d, 0x00, 0x41, 0x00, 0x41, 0x2a, 0x36, 0x02, 0x00, 0x41, 0x07, 0x24, 0x00, 0x0b,
+    0x07, 0x00, 0x41, 0x00, 0x28, 0x02, 0x00, 0x0b,
+    0x0b, 0x09, 0x01, 0x00, 0x41, 0x10, 0x0b, 0x03, 0x61, 0x62, 0x63,
+};
+
+static void assert_initial_state(module_inst * mod_inst) {
+    memory_inst * mem_inst = vec_at_memory_inst(&mod_inst->memories, 0);
+    assert_int_equal(vec_size_u8(&mem_inst->mdata), WASM_PAGE_SIZE);
+    assert_int_equal(*vec_at_u8(&mem_inst->mdata, 0), 42);
+    assert_memory_equal(vec_at_u8(&mem_inst->mdata, 16), "abc", 3);
+    assert_int_equal(*vec_at_u8(&mem_inst->mdata, WASM_PAGE_SIZE - 1), 0);
+    assert_int_equal(vec_at_global_inst(&mod_inst->globals, 0)->gvalue.u_i32, 7);
+}
+
+static void dirty(module_inst * mod_inst) {
+    memory_inst * mem_inst = vec_at_memory_inst(&mod_inst->memories, 0);
+    *vec_at_u8(&mem_inst->mdata, 0) = 1;
+    *vec_at_u8(&mem_inst->mdata, 16) = 'x';
+    *vec_at_u8(&mem_inst->mdata, WASM_PAGE_SIZE - 1) = 0xff;
+    // memory.grow
+    assert_true(is_ok(vec_resize_u8(&mem_inst->mdata, 2 * WASM_PAGE_SIZE)));
+    *vec_at_u8(&mem_inst->mdata, WASM_PAGE_SIZE) = 0xff;
+    vec_at_global_inst(&mod_inst->globals, 0)->gvalue.u_i32 = 0;
+}
+
+static void snapshot_test_reset(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(snapshot_wasm, sizeof(snapshot_wasm)), vs("test"))));
+    vm v = {0};
+    assert_true(is_ok(vm_instantiate_module(&v, &m)));
+    module_inst * mod_inst = vm_find_module_inst(&v, s("test"));
+    assert_non_null(mod_inst);
+    assert_initial_state(mod_inst);
+
+    r_inst_snapshot snap = vm_snapshot_module_inst(mod_inst);
+    assert_true(is_ok(snap));
+    // the first reset replaces the memory, the following ones only drop the dirty pages.
+    for (u32 i = 0; i < 3; i++) {
+        dirty(mod_inst);
+        assert_true(is_ok(vm_reset_module_inst(mod_inst, &snap.value)));
+        assert_initial_state(mod_inst);
+        // the grown area must be zeroed again.
+        memory_inst * mem_inst = vec_at_memory_inst(&mod_inst->memories, 0);
+        assert_true(is_ok(vec_resize_u8(&mem_inst->mdata, 2 * WASM_PAGE_SIZE)));
+        assert_int_equal(*vec_at_u8(&mem_inst->mdata, WASM_PAGE_SIZE), 0);
+        assert_true(is_ok(vec_resize_u8(&mem_inst->mdata, WASM_PAGE_SIZE)));
+    }
+
+    vm_drop(&v);
+    inst_snapshot_drop(&snap.value);
+    assert_int_equal(m.ref_count, 0);
+    module_drop(&m);
+}
+
+static void snapshot_test_instantiate(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(snapshot_wasm, sizeof(snapshot_wasm)), vs("test"))));
+    vm v1 = {0};
+    assert_true(is_ok(vm_instantiate_module(&v1, &m)));
+    module_inst * src = vm_find_module_inst(&v1, s("test"));
+    assert_non_null(src);
+    r_inst_snapshot snap = vm_snapshot_module_inst(src);
+    assert_true(is_ok(snap));
+    // changes after the snapshot don't matter.
+    dirty(src);
+
+    vm v2 = {0};
+    assert_true(is_ok(vm_instantiate_snapshot(&v2, &snap.value)));
+    module_inst * mod_inst = vm_find_module_inst(&v2, s("test"));
+    assert_non_null(mod_inst);
+    assert_int_equal(mod_inst->state, module_inst_ready);
+    assert_initial_state(mod_inst);
+
+    func_addr get = vm_find_module_func(&v2, mod_inst, s("get"));
+    assert_non_null(get);
+    vec_typed_value argv = {0};
+    assert_true(is_ok(interp_call_in_thread(&v2.thread, get, argv)));
+    assert_int_equal(vec_size_typed_value(&v2.thread.results), 1);
+    assert_int_equal(vec_at_typed_value(&v2.thread.results, 0)->val.u_i32, 42);
+
+    // the instances don't share the memory.
+    *vec_at_u8(&vec_at_memory_inst(&mod_inst->memories, 0)->mdata, 16) = 'y';
+    assert_int_equal(*vec_at_u8(&vec_at_memory_inst(&src->memories, 0)->mdata, 16), 'x');
+
+    vm_drop(&v2);
+    vm_drop(&v1);
+    inst_snapshot_drop(&snap.value);
+    module_drop(&m);
+}
+
+struct CMUnitTest snapshot_tests[] = {
+    cmocka_unit_test(snapshot_test_reset),
+    cmocka_unit_test(snapshot_test_instantiate),
+};
+
+const size_t snapshot_tests_count = array_len(snapshot_tests);
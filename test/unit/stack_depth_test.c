@@ -0,0 +1,195 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "module.h"
+#include "stack_depth.h"
+#include "types.h"
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+
+// (type $v (func (result i32)))
+// (type $i (func (param i32) (result i32)))
+// (import "env" "h" (func $h (type $v)))
+// (table 1 funcref)
+// (elem (i32.const 0) $leaf)
+// (func $leaf (type $i) (i32.add (local.get 0) (i32.const 1)))
+// (func $main (type $v) (local i32 i32) (call $leaf (i32.const 5)))
+// (func $rec (type $i) (call $rec (local.get 0)))
+// (func $ind (type $v) (call_indirect (type $i) (i32.const 1) (i32.const 0)))
+// (func $tail (type $i) (return_call $tail (local.get 0)))
+// (func $callh (type $v) (call $h))
+// and all of them are exported with their names.
+static const u8 calls_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x0a, 0x02, 0x60, 0x00, 0x01, 0x7f, 0x60, 0x01, 0x7f, 0x01, 0x7f,
+    0x02, 0x09, 0x01, 0x03, 0x65, 0x6e, 0x76, 0x01, 0x68, 0x00, 0x00,
+    0x03, 0x07, 0x06, 0x01, 0x00, 0x01, 0x00, 0x01, 0x00,
+    0x04, 0x04, 0x01, 0x70, 0x00, 0x01,
+    0x07, 0x2e, 0x07, 0x04, 0x6c, 0x65, 0x61, 0x66, 0x00, 0x01, 0x04, 0x6d, 0x61, 0x69, 0x6e, 0x00, 0x02, 0x03, 0x72, 0x65, 0x63, 0x00, 0x03, 0x03, 0x69, 0x6e, 0x64, 0x00, 0x04, 0x04, 0x74, 0x61, 0x69, 0x6c, 0x00, 0x05, 0x05, 0x63, 0x61, 0x6c, 0x6c, 0x68, 0x00, 0x06, 0x01, 0x68, 0x00, 0x00,
+    0x09, 0x07, 0x01, 0x00, 0x41, 0x00, 0x0b, 0x01, 0x01,
+    0x0a, 0x2f, 0x06, 0x07, 0x00, 0x20, 0x00, 0x41, 0x01, 0x6a, 0x0b, 0x08, 0x01, 0x02, 0x7f, 0x41, 0x05, 0x10, 0x01, 0x0b, 0x06, 0x00, 0x20, 0x00, 0x10, 0x03, 0x0b, 0x09, 0x00, 0x41, 0x01, 0x41, 0x00, 0x11, 0x01, 0x00, 0x0b, 0x06, 0x00, 0x20, 0x00, 0x12, 0x05, 0x0b, 0x04, 0x00, 0x10, 0x00, 0x0b,
+};
+
+#define FRAME_SIZE (100)
+#define SLOT (sizeof(value_slot))
+
+static stack_depth * find_depth(vec_stack_depth * report, const char * name) {
+    VEC_FOR_EACH(report, stack_depth, d) {
+        if (str_eq(d->name, s_p(name))) {
+            return d;
+        }
+    }
+    fail();
+    return NULL;
+}
+
+INLINE size_t frame_bytes(func * fn) {
+    return FRAME_SIZE + fn->stack_size_max * SLOT;
+}
+
+static void stack_depth_test_calls(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(calls_wasm, sizeof(calls_wasm)), vs("calls"))));
+    assert_true(is_ok(module_validate(&m)));
+    vec_stack_depth report = {0};
+    assert_true(is_ok(stack_depth_analyze(&m, FRAME_SIZE, &report)));
+    assert_int_equal(vec_size_stack_depth(&report), 7);
+    func * leaf = vec_at_func(&m.funcs, 1);
+    func * main = vec_at_func(&m.funcs, 2);
+    func * ind = vec_at_func(&m.funcs, 4);
+    func * tail = vec_at_func(&m.funcs, 5);
+
+    stack_depth * d = find_depth(&report, "leaf");
+    assert_int_equal(d->frames, 1);
+    assert_int_equal(d->native_bytes, SLOT + frame_bytes(leaf));
+    assert_int_equal(d->value_bytes, (1 + leaf->stack_size_max) * SLOT);
+    assert_false(d->recursive || d->calls_import);
+
+    // the locals of leaf are in the operand stack of main.
+    d = find_depth(&report, "main");
+    assert_int_equal(d->frames, 2);
+    assert_int_equal(d->native_bytes, 2 * SLOT + frame_bytes(main) + frame_bytes(leaf));
+    assert_int_equal(d->value_bytes, (2 + main->stack_size_max + leaf->stack_size_max) * SLOT);
+    assert_false(d->recursive || d->calls_import);
+
+    // but not for an indirect call.
+    d = find_depth(&report, "ind");
+    assert_int_equal(d->frames, 2);
+    assert_int_equal(d->native_bytes, SLOT + frame_bytes(ind) + frame_bytes(leaf));
+    assert_int_equal(d->value_bytes, (1 + ind->stack_size_max + 1 + leaf->stack_size_max) * SLOT);
+    assert_false(d->recursive || d->calls_unknown);
+
+    d = find_depth(&report, "rec");
+    assert_true(d->recursive);
+
+    // a tail call runs in the same frame, so it's bounded.
+    d = find_depth(&report, "tail");
+    assert_false(d->recursive);
+    assert_int_equal(d->frames, 1);
+    assert_int_equal(d->native_bytes, SLOT + frame_bytes(tail));
+
+    d = find_depth(&report, "callh");
+    assert_true(d->calls_import);
+    assert_int_equal(d->frames, 1);
+    d = find_depth(&report, "h");
+    assert_true(d->calls_import);
+    assert_int_equal(d->frames, 0);
+
+    vec_clear_stack_depth(&report);
+    assert_true(is_ok(module_drop(&m)));
+}
+
+// (type $i (func (param i32) (result i32)))
+// (import "env" "t" (table 1 funcref))
+// (func $ind (export "ind") (type $i) (call_indirect (type $i) (local.get 0) (i32.const 0)))
+// (func $tail (export "tail") (type $i) (return_call_indirect (type $i) (local.get 0) (i32.const 0)))
+// (func $main (export "main") (type $i) (call $ind (local.get 0)))
+static const u8 imported_table_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x06, 0x01, 0x60, 0x01, 0x7f, 0x01, 0x7f,
+    0x02, 0x0b, 0x01, 0x03, 0x65, 0x6e, 0x76, 0x01, 0x74, 0x01, 0x70, 0x00, 0x01,
+    0x03, 0x04, 0x03, 0x00, 0x00, 0x00,
+    0x07, 0x15, 0x03, 0x03, 0x69, 0x6e, 0x64, 0x00, 0x00, 0x04, 0x74, 0x61, 0x69, 0x6c, 0x00, 0x01, 0x04, 0x6d, 0x61, 0x69, 0x6e, 0x00, 0x02,
+    0x0a, 0x1c, 0x03, 0x09, 0x00, 0x20, 0x00, 0x41, 0x00, 0x11, 0x00, 0x00, 0x0b, 0x09, 0x00, 0x20, 0x00, 0x41, 0x00, 0x13, 0x00, 0x00, 0x0b, 0x06, 0x00, 0x20, 0x00, 0x10, 0x00, 0x0b,
+};
+
+// The same with (table (export "t") 1 funcref) instead of the import.
+static const u8 exported_table_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x06, 0x01, 0x60, 0x01, 0x7f, 0x01, 0x7f,
+    0x03, 0x04, 0x03, 0x00, 0x00, 0x00,
+    0x04, 0x04, 0x01, 0x70, 0x00, 0x01,
+    0x07, 0x19, 0x04, 0x03, 0x69, 0x6e, 0x64, 0x00, 0x00, 0x04, 0x74, 0x61, 0x69, 0x6c, 0x00, 0x01, 0x04, 0x6d, 0x61, 0x69, 0x6e, 0x00, 0x02, 0x01, 0x74, 0x01, 0x00,
+    0x0a, 0x1c, 0x03, 0x09, 0x00, 0x20, 0x00, 0x41, 0x00, 0x11, 0x00, 0x00, 0x0b, 0x09, 0x00, 0x20, 0x00, 0x41, 0x00, 0x13, 0x00, 0x00, 0x0b, 0x06, 0x00, 0x20, 0x00, 0x10, 0x00, 0x0b,
+};
+
+static void check_unknown_callees(const u8 * wasm, size_t size) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(wasm, size), vs("shared"))));
+    assert_true(is_ok(module_validate(&m)));
+    vec_stack_depth report = {0};
+    assert_true(is_ok(stack_depth_analyze(&m, FRAME_SIZE, &report)));
+    assert_true(find_depth(&report, "ind")->calls_unknown);
+    assert_true(find_depth(&report, "tail")->calls_unknown);
+    // and the callers of them.
+    assert_true(find_depth(&report, "main")->calls_unknown);
+    vec_clear_stack_depth(&report);
+    assert_true(is_ok(module_drop(&m)));
+}
+
+// Anything can be put into the table by the host or another module, even if the module has
+// no function of the type.
+static void stack_depth_test_shared_table(void ** state) {
+    check_unknown_callees(imported_table_wasm, sizeof(imported_table_wasm));
+    check_unknown_callees(exported_table_wasm, sizeof(exported_table_wasm));
+}
+
+// (type $r (func (param funcref)))
+// (type $v (func))
+// (table 1 funcref)
+// (func $store (export "store") (type $r) (table.set 0 (i32.const 0) (local.get 0)))
+// (func $run (export "run") (type $v) (call_indirect (type $v) (i32.const 0)))
+static const u8 table_set_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x08, 0x02, 0x60, 0x01, 0x70, 0x00, 0x60, 0x00, 0x00,
+    0x03, 0x03, 0x02, 0x00, 0x01,
+    0x04, 0x04, 0x01, 0x70, 0x00, 0x01,
+    0x07, 0x0f, 0x02, 0x05, 0x73, 0x74, 0x6f, 0x72, 0x65, 0x00, 0x00, 0x03, 0x72, 0x75, 0x6e, 0x00, 0x01,
+    0x0a, 0x12, 0x02, 0x08, 0x00, 0x41, 0x00, 0x20, 0x00, 0x26, 0x00, 0x0b, 0x07, 0x00, 0x41, 0x00, 0x11, 0x01, 0x00, 0x0b,
+};
+
+// The table is private and there's no element segment, but store puts a funcref from the
+// caller into it, so run can even call itself.
+static void stack_depth_test_written_table(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(table_set_wasm, sizeof(table_set_wasm)), vs("written"))));
+    assert_true(is_ok(module_validate(&m)));
+    vec_stack_depth report = {0};
+    assert_true(is_ok(stack_depth_analyze(&m, FRAME_SIZE, &report)));
+    assert_true(find_depth(&report, "run")->calls_unknown);
+    assert_false(find_depth(&report, "store")->calls_unknown);
+    vec_clear_stack_depth(&report);
+    assert_true(is_ok(module_drop(&m)));
+}
+
+struct CMUnitTest stack_depth_tests[] = {
+    cmocka_unit_test(stack_depth_test_calls),
+    cmocka_unit_test(stack_depth_test_shared_table),
+    cmocka_unit_test(stack_depth_test_written_table),
+};
+
+const size_t stack_depth_tests_count = array_len(stack_depth_tests);
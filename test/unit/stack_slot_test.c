@@ -0,0 +1,191 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "interpreter.h"
+#include "module.h"
+#include "opcode.h"
+#include "test_wasm.h"
+#include "types.h"
+#include "vm.h"
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+
+// (global (export "g") (mut i64) (i64.const 100))
+// (func (export "mix") (param i32 i64 f64) (result i64 f64 i32) (local f32 i64 i32)
+//   (local.set 4 (call 1 (local.get 1) (i32.const 5)))
+//   (block (result i64) (f64.const 9) (i32.const 1) (local.get 4) (br 0))
+//   (global.set 0 (i64.add (global.get 0)))
+//   (drop (i64.const 7))
+//   (global.get 0)
+//   (select (f64.mul (local.get 2) (f64.const 2)) (f64.const -1) (local.get 0))
+//   (i32.add (local.tee 5 (i32.add (local.get 0) (i32.wrap_i64 (local.get 1)))) (i32.trunc_f32_s (local.get 3))))
+// (func (export "add") (param i64 i32) (result i64) (i64.add (local.get 0) (i64.extend_i32_s (local.get 1))))
+// (func (export "sum") (param i64) (result i64) (local i64)
+//   (loop (local.set 1 (i64.add (local.get 1) (local.get 0)))
+//         (br_if 0 (i64.ne (local.tee 0 (i64.sub (local.get 0) (i64.const 1))) (i64.const 0))))
+//   (local.get 1))
+static const u8 stack_slot_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x15, 0x03, 0x60, 0x03, 0x7f, 0x7e, 0x7c, 0x03, 0x7e, 0x7c, 0x7f, 0x60, 0x02, 0x7e, 0x7f, 0x01, 0x7e, 0x60, 0x01, 0x7e, 0x01, 0x7e,
+    0x03, 0x04, 0x03, 0x00, 0x01, 0x02,
+    0x06, 0x07, 0x01, 0x7e, 0x01, 0x42, 0xe4, 0x00, 0x0b,
+    0x07, 0x17, 0x04, 0x03, 0x6d, 0x69, 0x78, 0x00, 0x00, 0x03, 0x61, 0x64, 0x64, 0x00, 0x01, 0x03, 0x73, 0x75, 0x6d, 0x00, 0x02, 0x01, 0x67, 0x03, 0x00,
+    0x0a, 0x78, 0x03,
+    0x50, 0x03, 0x01, 0x7d, 0x01, 0x7e, 0x01, 0x7f, 0x20, 0x01, 0x41, 0x05, 0x10, 0x01, 0x21, 0x04, 0x02, 0x7e, 0x44, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x22, 0x40, 0x41, 0x01, 0x20, 0x04, 0x0c, 0x00, 0x0b, 0x23, 0x00, 0x7c, 0x24, 0x00, 0x42, 0x07, 0x1a, 0x23, 0x00, 0x20, 0x02, 0x44, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0xa2, 0x44, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf0, 0xbf, 0x20, 0x00, 0x1b, 0x20, 0x00, 0x20, 0x01, 0xa7, 0x6a, 0x22, 0x05, 0x20, 0x03, 0xa8, 0x6a, 0x0b,
+    0x08, 0x00, 0x20, 0x00, 0x20, 0x01, 0xac, 0x7c, 0x0b,
+    0x1c, 0x01, 0x01, 0x7e, 0x03, 0x40, 0x20, 0x01, 0x20, 0x00, 0x7c, 0x21, 0x01, 0x20, 0x00, 0x42, 0x01, 0x7d, 0x22, 0x00, 0x42, 0x00, 0x52, 0x0d, 0x00, 0x0b, 0x20, 0x01, 0x0b,
+};
+
+static r call_mix(vm * v, i32 a, i64 b, f64 c) {
+    func_addr f = vm_find_func(v, s("slots"), s("mix"));
+    assert_non_null(f);
+    vec_typed_value args = {0};
+    assert_true(is_ok(vec_push_typed_value(&args, (typed_value){.type = TYPE_ID_i32, .val.u_i32 = a})));
+    assert_true(is_ok(vec_push_typed_value(&args, (typed_value){.type = TYPE_ID_i64, .val.u_i64 = b})));
+    assert_true(is_ok(vec_push_typed_value(&args, (typed_value){.type = TYPE_ID_f64, .val.u_f64 = c})));
+    return interp_call_in_thread(&v->thread, f, args);
+}
+
+static typed_value * result_at(vm * v, u32 idx) {
+    assert_true(idx < vec_size_typed_value(&v->thread.results));
+    return vec_at_typed_value(&v->thread.results, idx);
+}
+
+// The 64-bit values take two slots when SILVERFIR_STACK_SLOT_32 is on, which the same code has to
+// handle everywhere: locals, calls, branches, globals, drop and select.
+static void stack_slot_test_mixed(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(stack_slot_wasm, sizeof(stack_slot_wasm)), vs("slots"))));
+    vm v = {0};
+    assert_true(is_ok(vm_instantiate_module(&v, &m)));
+
+    assert_true(is_ok(call_mix(&v, 1, 10, 3.5)));
+    assert_int_equal(vec_size_typed_value(&v.thread.results), 3);
+    assert_int_equal(result_at(&v, 0)->val.u_i64, 115);
+    assert_true(result_at(&v, 1)->val.u_f64 == 7.0);
+    assert_int_equal(result_at(&v, 2)->val.u_i32, 11);
+
+    assert_true(is_ok(call_mix(&v, 0, -20, 3.5)));
+    assert_int_equal(result_at(&v, 0)->val.u_i64, 100);
+    assert_true(result_at(&v, 1)->val.u_f64 == -1.0);
+    assert_int_equal(result_at(&v, 2)->val.u_i32, -20);
+    glob_addr g = vm_find_module_global(&v, vm_find_module_inst(&v, s("slots")), s("g"));
+    assert_non_null(g);
+    assert_int_equal(g->gvalue.u_i64, 100);
+
+    func_addr sum = vm_find_func(&v, s("slots"), s("sum"));
+    vec_typed_value args = {0};
+    assert_true(is_ok(vec_push_typed_value(&args, (typed_value){.type = TYPE_ID_i64, .val.u_i64 = 10})));
+    assert_true(is_ok(interp_call_in_thread(&v.thread, sum, args)));
+    assert_int_equal(result_at(&v, 0)->val.u_i64, 55);
+
+    vm_drop(&v);
+    assert_true(is_ok(module_drop(&m)));
+}
+
+static void stack_slot_test_layout(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(stack_slot_wasm, sizeof(stack_slot_wasm)), vs("slots"))));
+    assert_true(is_ok(module_validate(&m)));
+    u32 wide = SLOTS_OF(i64);
+
+    func * mix = vec_at_func(&m.funcs, 0);
+    assert_int_equal(func_param_slots(mix), 1 + 2 * wide);
+    assert_int_equal(func_result_slots(mix), 1 + 2 * wide);
+    assert_int_equal(func_local_slots(mix), 3 + 3 * wide);
+    // only the br, the drop and the select of the 64-bit values are marked by their pc.
+    assert_int_equal(vec_size_jump_table(&mix->jt), 1);
+#if SILVERFIR_STACK_SLOT_32
+    u32 marked = 0;
+    for (u32 i = 0; i < str_len(mix->code); i++) {
+        marked += func_wide_operand(mix->wide_operands._data, i);
+    }
+    assert_int_equal(marked, 2);
+#endif
+    // the f64 and the i32 are left behind by the br.
+    jump_table * br = vec_at_jump_table(&mix->jt, 0);
+    assert_int_equal(br->arity, wide);
+    assert_int_equal(br->stack_offset, wide + 1);
+
+    // two i64s after the extend.
+    func * add = vec_at_func(&m.funcs, 1);
+    assert_int_equal(add->stack_size_max, 2 * wide);
+    assert_true(is_ok(module_drop(&m)));
+}
+
+// (func (export "drops") (result i64)
+//   (i64.const 9)
+//   (drop (i64.const 1)) (drop (i32.const 1)) ... drop_count times each
+//   (i64.add (select (i64.const 5) (i64.const 6) (i32.const 0))))
+// More drops than a function can have jump table slots, which they must not take.
+static void build_drops_module(vec_u8 * bin, u32 drop_count) {
+    static const u8 header[] = {
+        0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+        0x01, 0x05, 0x01, 0x60, 0x00, 0x01, 0x7e,                   // type section
+        0x03, 0x02, 0x01, 0x00,                                     // function section
+        0x07, 0x09, 0x01, 0x05, 0x64, 0x72, 0x6f, 0x70, 0x73, 0x00, 0x00, // export section
+    };
+    static const u8 drops[] = {op_i64_const, 0x01, op_drop, op_i32_const, 0x01, op_drop};
+    static const u8 tail[] = {
+        op_i64_const, 0x05, op_i64_const, 0x06, op_i32_const, 0x00, op_select, op_i64_add, op_end,
+    };
+    vec_u8 body = {0};
+    test_emit(&body, 0x00); // no locals
+    test_emit(&body, op_i64_const);
+    test_emit(&body, 0x09);
+    for (u32 i = 0; i < drop_count; i++) {
+        test_emit_bytes(&body, drops, sizeof(drops));
+    }
+    test_emit_bytes(&body, tail, sizeof(tail));
+
+    vec_u8 code = {0};
+    test_emit(&code, 0x01);
+    test_emit_vu32(&code, (u32)vec_size_u8(&body));
+    test_emit_bytes(&code, vec_at_u8(&body, 0), vec_size_u8(&body));
+    vec_clear_u8(&body);
+
+    test_emit_bytes(bin, header, sizeof(header));
+    test_emit(bin, 0x0a);
+    test_emit_vu32(bin, (u32)vec_size_u8(&code));
+    test_emit_bytes(bin, vec_at_u8(&code, 0), vec_size_u8(&code));
+    vec_clear_u8(&code);
+}
+
+static void stack_slot_test_many_drops(void ** state) {
+    vec_u8 bin = {0};
+    build_drops_module(&bin, JUMP_TABLE_IDX_INVALID + 1000);
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(vec_at_u8(&bin, 0), vec_size_u8(&bin)), vs("drops"))));
+    assert_true(is_ok(module_validate(&m)));
+    assert_int_equal(vec_size_jump_table(&vec_at_func(&m.funcs, 0)->jt), 0);
+
+    vm v = {0};
+    assert_true(is_ok(vm_instantiate_module(&v, &m)));
+    assert_true(is_ok(test_call(&v, "drops", "drops", 0, NULL)));
+    assert_int_equal(test_result_i64(&v), 15);
+    vm_drop(&v);
+    assert_true(is_ok(module_drop(&m)));
+    vec_clear_u8(&bin);
+}
+
+struct CMUnitTest stack_slot_tests[] = {
+    cmocka_unit_test(stack_slot_test_mixed),
+    cmocka_unit_test(stack_slot_test_layout),
+    cmocka_unit_test(stack_slot_test_many_drops),
+};
+
+const size_t stack_slot_tests_count = array_len(stack_slot_tests);
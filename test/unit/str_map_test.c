@@ -0,0 +1,78 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "str_map.h"
+#include "types.h"
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+#include <stdio.h>
+
+#define KEY_COUNT 1000
+
+static void str_map_test_basic(void ** state) {
+    str_map m = {0};
+    uptr v = 0;
+    assert_false(str_map_get(&m, s("a"), &v));
+    assert_true(is_ok(str_map_put(&m, s("a"), 1)));
+    assert_true(is_ok(str_map_put(&m, STR_NULL, 2)));
+    assert_true(str_map_get(&m, s("a"), &v));
+    assert_int_equal(v, 1);
+    assert_true(str_map_get(&m, STR_NULL, &v));
+    assert_int_equal(v, 2);
+    // overwrite
+    assert_true(is_ok(str_map_put(&m, s("a"), 3)));
+    assert_true(str_map_get(&m, s("a"), &v));
+    assert_int_equal(v, 3);
+    assert_int_equal(m.count, 2);
+    assert_true(str_map_remove(&m, s("a")));
+    assert_false(str_map_remove(&m, s("a")));
+    assert_false(str_map_get(&m, s("a"), &v));
+    assert_int_equal(m.count, 1);
+    str_map_clear(&m);
+}
+
+static void str_map_test_stress(void ** state) {
+    static char keys[KEY_COUNT][16];
+    str_map m = {0};
+    for (u32 i = 0; i < KEY_COUNT; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "key_%u", i);
+        assert_true(is_ok(str_map_put(&m, s_p(keys[i]), i)));
+    }
+    assert_int_equal(m.count, KEY_COUNT);
+    // remove every third key, the rest must still be reachable after the backward shifts.
+    for (u32 i = 0; i < KEY_COUNT; i += 3) {
+        assert_true(str_map_remove(&m, s_p(keys[i])));
+    }
+    for (u32 i = 0; i < KEY_COUNT; i++) {
+        uptr v = 0;
+        bool found = str_map_get(&m, s_p(keys[i]), &v);
+        if (i % 3) {
+            assert_true(found);
+            assert_int_equal(v, i);
+        } else {
+            assert_false(found);
+        }
+    }
+    str_map_clear(&m);
+}
+
+struct CMUnitTest str_map_tests[] = {
+    cmocka_unit_test(str_map_test_basic),
+    cmocka_unit_test(str_map_test_stress),
+};
+
+const size_t str_map_tests_count = array_len(str_map_tests);
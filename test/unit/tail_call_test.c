@@ -0,0 +1,118 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "interpreter.h"
+#include "module.h"
+#include "types.h"
+#include "vm.h"
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+
+// (type $t (func (param i32) (result i32)))
+// (table 1 funcref)
+// (elem (i32.const 0) $count_indirect)
+// (func $count (export "count") (type $t)
+//   (if (result i32) (i32.eqz (local.get 0))
+//     (then (i32.const 42))
+//     (else (return_call $count (i32.sub (local.get 0) (i32.const 1))))))
+// (func $count_indirect (export "count_indirect") (type $t)
+//   (if (result i32) (i32.eqz (local.get 0))
+//     (then (i32.const 42))
+//     (else (return_call_indirect (type $t) (i32.sub (local.get 0) (i32.const 1)) (i32.const 0)))))
+// (func $ping (export "ping") (type $t)
+//   (if (result i32) (i32.eqz (local.get 0))
+//     (then (i32.const 42))
+//     (else (return_call $pong (i32.sub (local.get 0) (i32.const 1))))))
+// ;; doesn't fit into ping's frame, and checks that its locals are zeroed on every entry.
+// (func $pong (type $t) (local i64 i64 ... 64 of them)
+//   (if (i32.eqz (i64.eqz (local.get 1))) (then unreachable))
+//   (local.set 1 (i64.const 7))
+//   (return_call $ping (local.get 0)))
+static const u8 tail_call_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x0a, 0x02, 0x60, 0x01, 0x7f, 0x01, 0x7f, 0x60, 0x00, 0x01, 0x7e,
+    0x03, 0x05, 0x04, 0x00, 0x00, 0x00, 0x00,
+    0x04, 0x04, 0x01, 0x70, 0x00, 0x01,
+    0x07, 0x21, 0x03,
+    0x05, 0x63, 0x6f, 0x75, 0x6e, 0x74, 0x00, 0x00,
+    0x0e, 0x63, 0x6f, 0x75, 0x6e, 0x74, 0x5f, 0x69, 0x6e, 0x64, 0x69, 0x72, 0x65, 0x63, 0x74, 0x00, 0x01,
+    0x04, 0x70, 0x69, 0x6e, 0x67, 0x00, 0x02,
+    0x09, 0x07, 0x01, 0x00, 0x41, 0x00, 0x0b, 0x01, 0x01,
+    0x0a, 0x52, 0x04,
+    0x12, 0x00, 0x20, 0x00, 0x45, 0x04, 0x7f, 0x41, 0x2a, 0x05, 0x20, 0x00, 0x41, 0x01, 0x6b, 0x12, 0x00, 0x0b, 0x0b,
+    0x15, 0x00, 0x20, 0x00, 0x45, 0x04, 0x7f, 0x41, 0x2a, 0x05, 0x20, 0x00, 0x41, 0x01, 0x6b, 0x41, 0x00, 0x13, 0x00, 0x00, 0x0b, 0x0b,
+    0x12, 0x00, 0x20, 0x00, 0x45, 0x04, 0x7f, 0x41, 0x2a, 0x05, 0x20, 0x00, 0x41, 0x01, 0x6b, 0x12, 0x03, 0x0b, 0x0b,
+    0x14, 0x01, 0x40, 0x7e, 0x20, 0x01, 0x50, 0x45, 0x04, 0x40, 0x00, 0x0b, 0x42, 0x07, 0x21, 0x01, 0x20, 0x00, 0x12, 0x02, 0x0b,
+};
+
+// (func (param i32) (result i32) (return_call 1))
+// (func (result i64) (i64.const 0))
+static const u8 result_mismatch_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x0a, 0x02, 0x60, 0x01, 0x7f, 0x01, 0x7f, 0x60, 0x00, 0x01, 0x7e,
+    0x03, 0x03, 0x02, 0x00, 0x01,
+    0x0a, 0x0b, 0x02, 0x04, 0x00, 0x12, 0x01, 0x0b, 0x04, 0x00, 0x42, 0x00, 0x0b,
+};
+
+// way more than SILVERFIR_STACK_FRAME_LIMIT
+#define TAIL_CALL_DEPTH (100000)
+
+static void call_i32(vm * v, const char * name, i32 arg, i32 expected) {
+    func_addr f = vm_find_func(v, s("tail_call"), s_p(name));
+    assert_non_null(f);
+    vec_typed_value args = {0};
+    assert_true(is_ok(vec_push_typed_value(&args, (typed_value){.type = TYPE_ID_i32, .val.u_i32 = arg})));
+    r ret = interp_call_in_thread(&v->thread, f, args);
+    assert_true(is_ok(ret));
+    assert_int_equal(vec_size_typed_value(&v->thread.results), 1);
+    assert_int_equal(vec_at_typed_value(&v->thread.results, 0)->val.u_i32, expected);
+    assert_int_equal(v->thread.frame_depth, 0);
+    assert_int_equal(v->thread.stack_size, 0);
+    assert_null(v->thread.tail_frames);
+}
+
+static void tail_call_test_deep(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(tail_call_wasm, sizeof(tail_call_wasm)), vs("tail_call"))));
+    vm v = {0};
+    assert_true(is_ok(vm_instantiate_module(&v, &m)));
+
+    call_i32(&v, "count", 0, 42);
+    call_i32(&v, "count", TAIL_CALL_DEPTH, 42);
+    call_i32(&v, "count_indirect", TAIL_CALL_DEPTH, 42);
+    // ping and pong swap between the frame it's called with and a heap frame.
+    call_i32(&v, "ping", TAIL_CALL_DEPTH, 42);
+
+    vm_drop(&v);
+    assert_true(is_ok(module_drop(&m)));
+}
+
+static void tail_call_test_result_mismatch(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(result_mismatch_wasm, sizeof(result_mismatch_wasm)), vs("tail_call"))));
+    r ret = module_validate(&m);
+    assert_false(is_ok(ret));
+    assert_true(err_is(ret.msg, e_invalid));
+    assert_true(is_ok(module_drop(&m)));
+}
+
+struct CMUnitTest tail_call_tests[] = {
+    cmocka_unit_test(tail_call_test_deep),
+    cmocka_unit_test(tail_call_test_result_mismatch),
+};
+
+const size_t tail_call_tests_count = array_len(tail_call_tests);
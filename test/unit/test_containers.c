@@ -20,5 +20,6 @@
 #include "vec_impl.h"
 
 VEC_IMPL_FOR_TYPE(t1)
+SVEC_IMPL_FOR_TYPE(t1)
 
 LIST_IMPL_FOR_TYPE(t1)
@@ -25,5 +25,6 @@ typedef struct t1 {
 } t1;
 
 VEC_DECL_FOR_TYPE(t1)
+SVEC_DECL_FOR_TYPE(t1, 4)
 
 LIST_DECL_FOR_TYPE(t1)
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "test_wasm.h"
+
+#include "interpreter.h"
+
+#include <string.h>
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+
+const u8 nested_loops_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x06, 0x01, 0x60, 0x01, 0x7f, 0x01, 0x7f,
+    0x03, 0x03, 0x02, 0x00, 0x00,
+    0x07, 0x0f, 0x02, 0x03, 0x73, 0x75, 0x6d, 0x00, 0x00, 0x05, 0x6f, 0x75, 0x74, 0x65, 0x72, 0x00, 0x01,
+    0x0a, 0x3f, 0x02,
+    0x19, 0x01, 0x01, 0x7f, 0x03, 0x40, 0x20, 0x01, 0x20, 0x00, 0x6a, 0x21, 0x01, 0x20, 0x00, 0x41, 0x01, 0x6b, 0x22, 0x00, 0x0d, 0x00, 0x0b, 0x20, 0x01, 0x0b,
+    0x23, 0x01, 0x01, 0x7f, 0x02, 0x40, 0x03, 0x40, 0x20, 0x00, 0x45, 0x0d, 0x01, 0x20, 0x01, 0x20, 0x00, 0x10, 0x00, 0x6a, 0x21, 0x01, 0x20, 0x00, 0x41, 0x01, 0x6b, 0x21, 0x00, 0x0c, 0x00, 0x0b, 0x0b, 0x20, 0x01, 0x0b,
+};
+const size_t nested_loops_wasm_size = sizeof(nested_loops_wasm);
+
+void test_emit(vec_u8 * v, u8 b) {
+    assert_true(is_ok(vec_push_u8(v, b)));
+}
+
+void test_emit_vu32(vec_u8 * v, u32 val) {
+    do {
+        u8 b = val & 0x7f;
+        val >>= 7;
+        test_emit(v, val ? (b | 0x80) : b);
+    } while (val);
+}
+
+void test_emit_bytes(vec_u8 * v, const u8 * bytes, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        test_emit(v, bytes[i]);
+    }
+}
+
+r test_call(vm * v, const char * mod_name, const char * func_name, u32 argc, const typed_value * argv) {
+    func_addr f = vm_find_func(v, s_p(mod_name), s_p(func_name));
+    assert_non_null(f);
+    vec_typed_value args = {0};
+    for (u32 i = 0; i < argc; i++) {
+        assert_true(is_ok(vec_push_typed_value(&args, argv[i])));
+    }
+    return interp_call_in_thread(&v->thread, f, args);
+}
+
+i32 test_call_i32(vm * v, const char * mod_name, const char * func_name, i32 arg) {
+    assert_true(is_ok(test_call(v, mod_name, func_name, TEST_ARGS(test_i32(arg)))));
+    return test_result_i32(v);
+}
+
+i32 test_result_i32(vm * v) {
+    assert_int_equal(vec_size_typed_value(&v->thread.results), 1);
+    typed_value * res = vec_at_typed_value(&v->thread.results, 0);
+    assert_int_equal(res->type, TYPE_ID_i32);
+    return res->val.u_i32;
+}
+
+u64 test_result_i64(vm * v) {
+    assert_int_equal(vec_size_typed_value(&v->thread.results), 1);
+    typed_value * res = vec_at_typed_value(&v->thread.results, 0);
+    assert_int_equal(res->type, TYPE_ID_i64);
+    return res->val.u_u64;
+}
+
+void test_expect_trap(vm * v, r ret) {
+    assert_false(is_ok(ret));
+    assert_true(v->thread.trapped);
+    thread_reset(&v->thread);
+}
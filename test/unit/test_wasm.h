@@ -0,0 +1,69 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The small wasm modules and the helpers shared by the unit tests.
+
+#pragma once
+
+#include "compiler.h"
+#include "result.h"
+#include "types.h"
+#include "vec.h"
+#include "vm.h"
+
+// (func $sum (export "sum") (param i32) (result i32) (local i32)
+//   (loop (local.set 1 (i32.add (local.get 1) (local.get 0)))
+//         (br_if 0 (local.tee 0 (i32.sub (local.get 0) (i32.const 1)))))
+//   (local.get 1))
+// (func (export "outer") (param i32) (result i32) (local i32)
+//   (block (loop (br_if 1 (i32.eqz (local.get 0)))
+//     (local.set 1 (i32.add (local.get 1) (call $sum (local.get 0))))
+//     (local.set 0 (i32.sub (local.get 0) (i32.const 1)))
+//     (br 0)))
+//   (local.get 1))
+// outer(n) is the sum of sum(n) ... sum(1).
+extern const u8 nested_loops_wasm[];
+extern const size_t nested_loops_wasm_size;
+
+INLINE typed_value test_i32(i32 val) {
+    return (typed_value){.type = TYPE_ID_i32, .val.u_i32 = val};
+}
+
+INLINE typed_value test_i64(u64 val) {
+    return (typed_value){.type = TYPE_ID_i64, .val.u_u64 = val};
+}
+
+// Append to a module being built by hand, the allocation must succeed.
+void test_emit(vec_u8 * v, u8 b);
+void test_emit_vu32(vec_u8 * v, u32 val);
+void test_emit_bytes(vec_u8 * v, const u8 * bytes, size_t len);
+
+// The argc and argv of test_call from a list of values, e.g. TEST_ARGS(test_i32(1), test_i32(2)).
+#define TEST_ARGS(...) \
+    (u32)(sizeof((typed_value[]){__VA_ARGS__}) / sizeof(typed_value)), ((typed_value[]){__VA_ARGS__})
+
+// Call an exported function of a module in the vm, the results are left in the thread.
+r test_call(vm * v, const char * mod_name, const char * func_name, u32 argc, const typed_value * argv);
+
+// Call a function that takes an i32 and returns one, the call must succeed.
+i32 test_call_i32(vm * v, const char * mod_name, const char * func_name, i32 arg);
+
+// The only result of the last call.
+i32 test_result_i32(vm * v);
+u64 test_result_i64(vm * v);
+
+// The call must trap. The thread is reset afterwards, which is required after a trap.
+void test_expect_trap(vm * v, r ret);
@@ -30,8 +30,26 @@
     macro(sjson)                        \
     macro(smath)                        \
     macro(stream)                       \
+    macro(str_map)                      \
     macro(option)                       \
-    macro(mem)
+    macro(mem)                          \
+    macro(host_modules)                 \
+    macro(side_table)                   \
+    macro(snapshot)                     \
+    macro(validator)                    \
+    macro(vm)                           \
+    macro(green_sched)                  \
+    macro(atomics)                      \
+    macro(simd)                         \
+    macro(tail_call)                    \
+    macro(memory64)                     \
+    macro(page_size)                    \
+    macro(stack_slot)                   \
+    macro(jt_cache)                     \
+    macro(lz4)                          \
+    macro(code_cache)                   \
+    macro(alloc)                        \
+    macro(stack_depth)
 // disabled atm.
 //    macro(runtime)
 
@@ -0,0 +1,248 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "logger.h"
+#include "module.h"
+#include "op_decoder.h"
+#include "opcode.h"
+#include "test_wasm.h"
+#include "types.h"
+#include "validator.h"
+#include "vec.h"
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+
+#define LOGW(fmt, ...) LOG_WARNING(log_channel_test, fmt, ##__VA_ARGS__)
+
+#if defined(NDEBUG)
+    #define ENABLE_VALIDATOR_PERFTEST
+#endif
+
+#if defined(ENABLE_VALIDATOR_PERFTEST)
+    #include <time.h>
+#endif
+
+// A single "() -> ()" function with lots of short and long, forward and backward branches.
+static void build_branchy_module(vec_u8 * bin, u32 iterations) {
+    static const u8 header[] = {
+        0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, // magic and version
+        0x01, 0x04, 0x01, 0x60, 0x00, 0x00,             // type section
+        0x03, 0x02, 0x01, 0x00,                         // function section
+    };
+    static const u8 iteration[] = {
+        op_block, 0x40,
+        op_loop, 0x40,
+        op_i32_const, 0x00, op_br_if, 0x01,                         // forward, short
+        op_i32_const, 0x00, op_br_if, 0x00,                         // backward
+        op_i32_const, 0x00, op_br_if, 0x02,                         // forward, out of the outer block
+        op_i32_const, 0x00, op_br_table, 0x02, 0x00, 0x01, 0x01,    // both directions
+        op_end,
+        op_end,
+        op_i32_const, 0x00, op_if, 0x40, op_br, 0x00, op_else, op_nop, op_end,
+    };
+    vec_u8 body = {0};
+    test_emit(&body, 0x00); // no locals
+    test_emit(&body, op_block);
+    test_emit(&body, 0x40);
+    for (u32 i = 0; i < iterations; i++) {
+        test_emit_bytes(&body, iteration, sizeof(iteration));
+    }
+    test_emit(&body, op_end);
+    test_emit(&body, op_end);
+
+    vec_u8 code = {0};
+    test_emit(&code, 0x01);
+    test_emit_vu32(&code, (u32)vec_size_u8(&body));
+    test_emit_bytes(&code, vec_at_u8(&body, 0), vec_size_u8(&body));
+    vec_clear_u8(&body);
+
+    test_emit_bytes(bin, header, sizeof(header));
+    test_emit(bin, 0x0a);
+    test_emit_vu32(bin, (u32)vec_size_u8(&code));
+    test_emit_bytes(bin, vec_at_u8(&code, 0), vec_size_u8(&code));
+    vec_clear_u8(&code);
+}
+
+// The jump table slots don't keep the pc, so decode the function again to find the pc of each
+// slot the same way as the validator.
+static r collect_pc(void * payload, stream imm) {
+    check_prep(r);
+    check(vec_push_u32((vec_u32 *)payload, (u32)(imm.p - imm.s.ptr)));
+    return ok_r;
+}
+
+static r collect_if_pc(void * payload, wasm_opcode opcode, stream imm, func_type type) {
+    return (opcode == op_if) ? collect_pc(payload, imm) : ok_r;
+}
+
+static r collect_else_pc(void * payload, wasm_opcode opcode, stream imm) {
+    return collect_pc(payload, imm);
+}
+
+static r collect_br_pc(void * payload, wasm_opcode opcode, stream imm, u8 lth) {
+    return collect_pc(payload, imm);
+}
+
+// br_table has one slot per target, all pointing to the end of the instruction.
+static r collect_br_table_pc(void * payload, wasm_opcode opcode, stream imm) {
+    check_prep(r);
+    unwrap(u32, table_len, stream_read_vu32(&imm));
+    for (u32 i = 0; i < table_len + 1; i++) {
+        unwrap_drop(u32, stream_read_vu32(&imm));
+    }
+    for (u32 i = 0; i < table_len + 1; i++) {
+        check(collect_pc(payload, imm));
+    }
+    return ok_r;
+}
+
+static const op_decoder_callbacks pc_collector_callbacks = {
+    .on_block = collect_if_pc,
+    .on_else = collect_else_pc,
+    .on_br_or_if = collect_br_pc,
+    .on_br_table = collect_br_table_pc,
+};
+
+// The first slot whose pc is greater than the branch target, by binary search.
+static u16 expected_next_idx(vec_u32 * pcs, i32 target_offset, u32 i) {
+    u32 target = *vec_at_u32(pcs, i) + target_offset;
+    size_t lo = 0;
+    size_t hi = vec_size_u32(pcs);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (*vec_at_u32(pcs, mid) > target) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    if ((lo == vec_size_u32(pcs)) || ((target_offset <= 0) && (lo > i))) {
+        return JUMP_TABLE_IDX_INVALID;
+    }
+    return (u16)lo;
+}
+
+static void validator_test_branch_stress(void ** state) {
+    const u32 iterations = 5000;
+    vec_u8 bin = {0};
+    build_branchy_module(&bin, iterations);
+
+    module m = {0};
+    r ret = module_init(&m, vs_pl(vec_at_u8(&bin, 0), vec_size_u8(&bin)), vs("test"));
+    assert_true(is_ok(ret));
+    // validate twice, the second run must not append to the jump table.
+    ret = validate_module(&m);
+    assert_true(is_ok(ret));
+    ret = validate_module(&m);
+    assert_true(is_ok(ret));
+
+    func * f = vec_at_func(&m.funcs, 0);
+    vec_jump_table * jt = &f->jt;
+    assert_int_equal(vec_size_jump_table(jt), iterations * 9);
+    vec_u32 pcs = {0};
+    assert_true(is_ok(decode_function(&m, f, &pc_collector_callbacks, &pcs)));
+    assert_int_equal(vec_size_u32(&pcs), vec_size_jump_table(jt));
+    // the branches out of the outer block are too far for a slot.
+    assert_true(vec_size_jump_table_escape(&f->jt_escapes) > 0);
+    for (u32 i = 0; i < vec_size_jump_table(jt); i++) {
+        jump_table * slot = vec_at_jump_table(jt, i);
+        if (slot->target_offset == JUMP_TABLE_ESCAPE) {
+            assert_true(slot->stack_offset < vec_size_jump_table_escape(&f->jt_escapes));
+        }
+        i32 target_offset = jump_table_decode(slot, f->jt_escapes._data).target_offset;
+        u32 pc = *vec_at_u32(&pcs, i);
+        if (i) {
+            assert_true(*vec_at_u32(&pcs, i - 1) <= pc);
+        }
+        u32 target = pc + target_offset;
+        if (target_offset > 0) {
+            // forward targets are right after an end or an else.
+            u8 op = f->code.ptr[target - 1];
+            assert_true(op == op_end || op == op_else);
+        } else {
+            // backward targets are right after the loop blocktype.
+            assert_int_equal(f->code.ptr[target - 2], op_loop);
+        }
+        assert_int_equal(slot->next_idx, expected_next_idx(&pcs, target_offset, i));
+    }
+    vec_clear_u32(&pcs);
+
+    module_drop(&m);
+    vec_clear_u8(&bin);
+}
+
+static void validator_test_jump_table_overflow(void ** state) {
+    vec_u8 bin = {0};
+    build_branchy_module(&bin, (JUMP_TABLE_IDX_INVALID / 9) + 1);
+
+    module m = {0};
+    r ret = module_init(&m, vs_pl(vec_at_u8(&bin, 0), vec_size_u8(&bin)), vs("test"));
+    assert_true(is_ok(ret));
+    ret = validate_module(&m);
+    assert_false(is_ok(ret));
+    assert_true(err_is(ret.msg, e_exhaustion));
+
+    module_drop(&m);
+    vec_clear_u8(&bin);
+}
+
+#if defined(ENABLE_VALIDATOR_PERFTEST)
+static double elapsed_ns(const struct timespec * start) {
+    struct timespec current;
+    timespec_get(&current, TIME_UTC);
+    return ((double)current.tv_sec * 1e9 + current.tv_nsec) - ((double)start->tv_sec * 1e9 + start->tv_nsec);
+}
+
+// The time per branch stays the same as the function grows, if nothing in the validator is
+// superlinear in the number of branches.
+static void validator_test_branch_performance(void ** state) {
+    static const u32 iterations[] = {500, 2000, 7000};
+    for (u32 i = 0; i < array_len(iterations); i++) {
+        vec_u8 bin = {0};
+        build_branchy_module(&bin, iterations[i]);
+        module m = {0};
+        assert_true(is_ok(module_init(&m, vs_pl(vec_at_u8(&bin, 0), vec_size_u8(&bin)), vs("test"))));
+        func * f = vec_at_func(&m.funcs, 0);
+
+        struct timespec start;
+        timespec_get(&start, TIME_UTC);
+        u32 runs = 0;
+        double duration_ns = 0;
+        do {
+            assert_true(is_ok(validate_func(&m, f)));
+            runs++;
+            duration_ns = elapsed_ns(&start);
+        } while (duration_ns < 1e9);
+        size_t branches = vec_size_jump_table(&f->jt);
+        LOGW("validate_func with %zu branches: %.0f ns/op, %.1f ns per branch", branches,
+             duration_ns / runs, duration_ns / runs / (double)branches);
+
+        module_drop(&m);
+        vec_clear_u8(&bin);
+    }
+}
+#endif
+
+struct CMUnitTest validator_tests[] = {
+    cmocka_unit_test(validator_test_branch_stress),
+    cmocka_unit_test(validator_test_jump_table_overflow),
+#if defined(ENABLE_VALIDATOR_PERFTEST)
+    cmocka_unit_test(validator_test_branch_performance),
+#endif
+};
+
+const size_t validator_tests_count = array_len(validator_tests);
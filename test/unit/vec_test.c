@@ -241,12 +241,61 @@ static void vec_test_custom(void ** state) {
     assert_int_equal(v._capacity, 0);
 }
 
+static void vec_test_small(void ** state) {
+    svec_t1 v = {0};
+    for (u32 i = 0; i < 4; i++) {
+        assert_true(is_ok(svec_push_t1(&v, (t1){.a = i, .b = -(i32)i})));
+    }
+    // still inline, and a copy takes the elements with it.
+    assert_null(v._heap);
+    assert_int_equal(svec_capacity_t1(&v), 4);
+    svec_t1 copy = v;
+    svec_at_t1(&v, 0)->a = 100;
+    assert_int_equal(svec_at_t1(&copy, 0)->a, 0);
+    assert_int_equal(svec_back_t1(&copy)->b, -3);
+
+    // spills to the heap
+    assert_true(is_ok(svec_push_t1(&v, (t1){.a = 4, .b = -4})));
+    assert_non_null(v._heap);
+    assert_int_equal(svec_size_t1(&v), 5);
+    assert_int_equal(svec_at_t1(&v, 0)->a, 100);
+    u32 sum = 0;
+    SVEC_FOR_EACH(&v, t1, t) {
+        sum += t->a;
+    }
+    assert_int_equal(sum, 100 + 1 + 2 + 3 + 4);
+
+    // and goes back if it fits
+    svec_pop_t1(&v);
+    svec_pop_t1(&v);
+    assert_true(is_ok(svec_shrink_to_fit_t1(&v)));
+    assert_null(v._heap);
+    assert_int_equal(svec_size_t1(&v), 3);
+    assert_int_equal(svec_at_t1(&v, 2)->b, -2);
+
+    // no growing once it's fixed
+    assert_true(is_ok(svec_resize_t1(&v, 4)));
+    assert_int_equal(svec_at_t1(&v, 3)->a, 0);
+    svec_set_fixed(&v, true);
+    assert_false(is_ok(svec_push_t1(&v, (t1){0})));
+    assert_int_equal(svec_size_t1(&v), 4);
+
+    svec_clear_t1(&v);
+    assert_int_equal(svec_size_t1(&v), 0);
+    assert_true(is_ok(svec_reserve_t1(&v, 10)));
+    assert_non_null(v._heap);
+    assert_int_equal(svec_capacity_t1(&v), 10);
+    svec_clear_t1(&v);
+    assert_null(v._heap);
+}
+
 struct CMUnitTest vec_tests[] = {
     cmocka_unit_test(vec_test1),
     cmocka_unit_test(vec_test2),
     cmocka_unit_test(vec_test3),
     cmocka_unit_test(vec_test4),
     cmocka_unit_test(vec_test_custom),
+    cmocka_unit_test(vec_test_small),
 };
 
 const size_t vec_tests_count = array_len(vec_tests);
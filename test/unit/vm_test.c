@@ -0,0 +1,311 @@
+/*
+ * Copyright 2022 Bai Ming
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "interpreter.h"
+#include "module.h"
+#include "types.h"
+#include "vm.h"
+#include "vm_pool.h"
+
+#include <cmocka.h>
+#include <cmocka_private.h>
+
+#if defined(_MSC_VER)
+    #include <process.h>
+    #include <windows.h>
+typedef HANDLE test_thread;
+    #define TEST_THREAD_FUNC(name, arg) static unsigned __stdcall name(void * arg)
+    #define TEST_THREAD_RETURN return 0
+static bool test_thread_start(test_thread * t, unsigned(__stdcall * fn)(void *), void * arg) {
+    *t = (HANDLE)_beginthreadex(NULL, 0, fn, arg, 0, NULL);
+    return *t != 0;
+}
+static void test_thread_join(test_thread t) {
+    WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+}
+#else
+    #include <pthread.h>
+typedef pthread_t test_thread;
+    #define TEST_THREAD_FUNC(name, arg) static void * name(void * arg)
+    #define TEST_THREAD_RETURN return NULL
+static bool test_thread_start(test_thread * t, void * (*fn)(void *), void * arg) {
+    return pthread_create(t, NULL, fn, arg) == 0;
+}
+static void test_thread_join(test_thread t) {
+    pthread_join(t, NULL);
+}
+#endif
+
+// (func (export "f") (result i32) (i32.const 5))
+// (memory (export "mem") 1)
+// (global (export "g") i32 (i32.const 3))
+static const u8 provider_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x05, 0x01, 0x60, 0x00, 0x01, 0x7f,
+    0x03, 0x02, 0x01, 0x00,
+    0x05, 0x03, 0x01, 0x00, 0x01,
+    0x06, 0x06, 0x01, 0x7f, 0x00, 0x41, 0x03, 0x0b,
+    0x07, 0x0f, 0x03, 0x01, 0x66, 0x00, 0x00, 0x03, 0x6d, 0x65, 0x6d, 0x02, 0x00, 0x01, 0x67, 0x03, 0x00,
+    0x0a, 0x06, 0x01, 0x04, 0x00, 0x41, 0x05, 0x0b,
+};
+
+// (import "p" "f" (func $f (result i32)))
+// (import "p" "mem" (memory 1))
+// (import "p" "g" (global $g i32))
+// (func (export "call") (result i32) (i32.add (call $f) (global.get $g)))
+static const u8 consumer_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x05, 0x01, 0x60, 0x00, 0x01, 0x7f,
+    0x02, 0x17, 0x03,
+    0x01, 0x70, 0x01, 0x66, 0x00, 0x00,
+    0x01, 0x70, 0x03, 0x6d, 0x65, 0x6d, 0x02, 0x00, 0x01,
+    0x01, 0x70, 0x01, 0x67, 0x03, 0x7f, 0x00,
+    0x03, 0x02, 0x01, 0x00,
+    0x07, 0x08, 0x01, 0x04, 0x63, 0x61, 0x6c, 0x6c, 0x00, 0x01,
+    0x0a, 0x09, 0x01, 0x07, 0x00, 0x10, 0x00, 0x23, 0x00, 0x6a, 0x0b,
+};
+
+// (global $g (mut i32) (i32.const 0))
+// (func (export "bump") (result i32) (global.set $g (i32.add (global.get $g) (i32.const 1))) (global.get $g))
+static const u8 counter_wasm[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x05, 0x01, 0x60, 0x00, 0x01, 0x7f,
+    0x03, 0x02, 0x01, 0x00,
+    0x06, 0x06, 0x01, 0x7f, 0x01, 0x41, 0x00, 0x0b,
+    0x07, 0x08, 0x01, 0x04, 0x62, 0x75, 0x6d, 0x70, 0x00, 0x00,
+    0x0a, 0x0d, 0x01, 0x0b, 0x00, 0x23, 0x00, 0x41, 0x01, 0x6a, 0x24, 0x00, 0x23, 0x00, 0x0b,
+};
+
+static void instantiate_and_call(module * provider, module * consumer) {
+    vm v = {0};
+    assert_true(is_ok(vm_instantiate_module(&v, provider)));
+    assert_true(is_ok(vm_instantiate_module(&v, consumer)));
+    module_inst * mod_inst = vm_find_module_inst(&v, s("c"));
+    assert_non_null(mod_inst);
+    func_addr call = vm_find_module_func(&v, mod_inst, s("call"));
+    assert_non_null(call);
+    vec_typed_value argv = {0};
+    assert_true(is_ok(interp_call_in_thread(&v.thread, call, argv)));
+    assert_int_equal(vec_at_typed_value(&v.thread.results, 0)->val.u_i32, 8);
+    // the imported memory is the provider's.
+    module_inst * provider_inst = vm_find_module_inst(&v, s("p"));
+    assert_ptr_equal(*vec_at_mem_addr(&mod_inst->m_addrs, 0), vec_at_memory_inst(&provider_inst->memories, 0));
+    vm_drop(&v);
+}
+
+static void vm_test_link_plan(void ** state) {
+    module provider = {0};
+    module consumer = {0};
+    assert_true(is_ok(module_init(&provider, vs_pl(provider_wasm, sizeof(provider_wasm)), vs("p"))));
+    assert_true(is_ok(module_init(&consumer, vs_pl(consumer_wasm, sizeof(consumer_wasm)), vs("c"))));
+
+    instantiate_and_call(&provider, &consumer);
+    link_plan * plan = &consumer.link_plan;
+    assert_true(plan->ready);
+    assert_int_equal(vec_size_module_ptr(&plan->providers), 1);
+    assert_ptr_equal(*vec_at_module_ptr(&plan->providers, 0), &provider);
+    assert_int_equal(vec_size_link_slot(&plan->slots), 3);
+
+    // the same providers, the plan is reused as is.
+    link_slot * slots = vec_at_link_slot(&plan->slots, 0);
+    instantiate_and_call(&provider, &consumer);
+    assert_true(plan->ready);
+    assert_ptr_equal(vec_at_link_slot(&plan->slots, 0), slots);
+
+    // another module under the same name, the plan is built again.
+    module other = {0};
+    assert_true(is_ok(module_init(&other, vs_pl(provider_wasm, sizeof(provider_wasm)), vs("p"))));
+    instantiate_and_call(&other, &consumer);
+    assert_true(plan->ready);
+    assert_ptr_equal(*vec_at_module_ptr(&plan->providers, 0), &other);
+    assert_int_equal(vec_size_link_slot(&plan->slots), 3);
+
+    // nor is a new module at the same address.
+    u32 serial = other.serial;
+    assert_true(is_ok(module_drop(&other)));
+    other = (module){0};
+    assert_true(is_ok(module_init(&other, vs_pl(provider_wasm, sizeof(provider_wasm)), vs("p"))));
+    assert_int_not_equal(other.serial, serial);
+    instantiate_and_call(&other, &consumer);
+    assert_int_equal(*vec_at_u32(&plan->provider_serials, 0), other.serial);
+
+    module_drop(&other);
+    module_drop(&consumer);
+    module_drop(&provider);
+}
+
+static void vm_test_link_plan_missing_provider(void ** state) {
+    module consumer = {0};
+    assert_true(is_ok(module_init(&consumer, vs_pl(consumer_wasm, sizeof(consumer_wasm)), vs("c"))));
+    vm v = {0};
+    assert_false(is_ok(vm_instantiate_module(&v, &consumer)));
+    assert_false(consumer.link_plan.ready);
+    vm_drop(&v);
+    module_drop(&consumer);
+}
+
+typedef struct shared_module_job {
+    module * provider;
+    module * consumer;
+    u32 iterations;
+    u32 failures;
+} shared_module_job;
+
+// cmocka asserts are not thread-safe, so the workers only count the failures.
+TEST_THREAD_FUNC(shared_module_worker, arg) {
+    shared_module_job * job = (shared_module_job *)arg;
+    for (u32 i = 0; i < job->iterations; i++) {
+        vm v = {0};
+        bool good = is_ok(vm_instantiate_module(&v, job->provider)) && is_ok(vm_instantiate_module(&v, job->consumer));
+        module_inst * mod_inst = good ? vm_find_module_inst(&v, s("c")) : NULL;
+        func_addr call = mod_inst ? vm_find_module_func(&v, mod_inst, s("call")) : NULL;
+        vec_typed_value argv = {0};
+        good = call && is_ok(interp_call_in_thread(&v.thread, call, argv)) &&
+               (vec_at_typed_value(&v.thread.results, 0)->val.u_i32 == 8);
+        if (!good) {
+            job->failures++;
+        }
+        vm_drop(&v);
+    }
+    TEST_THREAD_RETURN;
+}
+
+static void vm_test_shared_module_mt(void ** state) {
+    module provider = {0};
+    module consumer = {0};
+    assert_true(is_ok(module_init(&provider, vs_pl(provider_wasm, sizeof(provider_wasm)), vs("p"))));
+    assert_true(is_ok(module_init(&consumer, vs_pl(consumer_wasm, sizeof(consumer_wasm)), vs("c"))));
+    assert_true(is_ok(module_freeze(&provider)));
+    assert_true(is_ok(module_freeze(&consumer)));
+    assert_false(is_ok(module_register_name(&consumer, vs("other"))));
+
+    shared_module_job jobs[8];
+    test_thread threads[array_len(jobs)];
+    for (u32 i = 0; i < array_len(jobs); i++) {
+        jobs[i] = (shared_module_job){.provider = &provider, .consumer = &consumer, .iterations = 500};
+        assert_true(test_thread_start(&threads[i], shared_module_worker, &jobs[i]));
+    }
+    for (u32 i = 0; i < array_len(jobs); i++) {
+        test_thread_join(threads[i]);
+        assert_int_equal(jobs[i].failures, 0);
+    }
+    assert_int_equal(provider.ref_count, 0);
+    assert_int_equal(consumer.ref_count, 0);
+    // one plan is shared by all the vms.
+    assert_false(consumer.link_plan.ready);
+    link_plan * plan = consumer.frozen_plan;
+    assert_non_null(plan);
+    assert_true(plan->ready);
+    assert_ptr_equal(*vec_at_module_ptr(&plan->providers, 0), &provider);
+
+    // and kept for the vms with another provider, which link by their own plans.
+    module other = {0};
+    assert_true(is_ok(module_init(&other, vs_pl(provider_wasm, sizeof(provider_wasm)), vs("p"))));
+    instantiate_and_call(&other, &consumer);
+    assert_ptr_equal(consumer.frozen_plan, plan);
+    assert_ptr_equal(*vec_at_module_ptr(&plan->providers, 0), &provider);
+    instantiate_and_call(&provider, &consumer);
+    assert_ptr_equal(consumer.frozen_plan, plan);
+    assert_true(is_ok(module_drop(&other)));
+
+    assert_true(is_ok(module_drop(&consumer)));
+    assert_true(is_ok(module_drop(&provider)));
+}
+
+typedef struct pool_counter {
+    u32 calls;
+    u32 failures;
+} pool_counter;
+
+static void pool_counter_callback(void * payload, r ret, vec_typed_value * results) {
+    pool_counter * c = (pool_counter *)payload;
+    // the global is reset after every job, so it's always the first bump.
+    if (!is_ok(ret) || (vec_size_typed_value(results) != 1) || (vec_at_typed_value(results, 0)->val.u_i32 != 1)) {
+        s_atomic_inc32(&c->failures);
+    }
+    s_atomic_inc32(&c->calls);
+}
+
+static void vm_test_pool_reset(void ** state) {
+    module m = {0};
+    assert_true(is_ok(module_init(&m, vs_pl(counter_wasm, sizeof(counter_wasm)), vs("counter"))));
+    module * mods[] = {&m};
+    vm_pool pool;
+    assert_true(is_ok(vm_pool_init(&pool, mods, array_len(mods), 4)));
+    assert_true(m.frozen);
+    assert_non_null(pool.snaps);
+
+    pool_counter counter = {0};
+    for (u32 i = 0; i < 1000; i++) {
+        assert_true(is_ok(vm_pool_submit(&pool, s("bump"), ARG_NULL(), pool_counter_callback, &counter)));
+    }
+    vm_pool_wait(&pool);
+    assert_int_equal(counter.calls, 1000);
+    assert_int_equal(counter.failures, 0);
+    u64 done = 0;
+    for (u32 i = 0; i < pool.worker_count; i++) {
+        done += pool.workers[i].jobs_done;
+    }
+    assert_int_equal(done, 1000);
+
+    vm_pool_drop(&pool);
+    assert_int_equal(m.ref_count, 0);
+    assert_true(is_ok(module_drop(&m)));
+}
+
+static void vm_test_pool_future(void ** state) {
+    module provider = {0};
+    module consumer = {0};
+    assert_true(is_ok(module_init(&provider, vs_pl(provider_wasm, sizeof(provider_wasm)), vs("p"))));
+    assert_true(is_ok(module_init(&consumer, vs_pl(consumer_wasm, sizeof(consumer_wasm)), vs("c"))));
+    module * mods[] = {&provider, &consumer};
+    vm_pool pool;
+    assert_true(is_ok(vm_pool_init(&pool, mods, array_len(mods), 2)));
+
+    vm_pool_future futures[16];
+    for (u32 i = 0; i < array_len(futures); i++) {
+        vm_pool_future_init(&futures[i]);
+        assert_true(is_ok(vm_pool_submit_future(&pool, s("call"), ARG_NULL(), &futures[i])));
+    }
+    for (u32 i = 0; i < array_len(futures); i++) {
+        assert_true(is_ok(vm_pool_future_wait(&futures[i])));
+        assert_int_equal(vec_size_typed_value(&futures[i].results), 1);
+        assert_int_equal(vec_at_typed_value(&futures[i].results, 0)->val.u_i32, 8);
+    }
+    // the error is passed to the future, and the worker keeps working.
+    assert_true(is_ok(vm_pool_submit_future(&pool, s("missing"), ARG_NULL(), &futures[0])));
+    assert_false(is_ok(vm_pool_future_wait(&futures[0])));
+    assert_true(is_ok(vm_pool_submit_future(&pool, s("call"), ARG_NULL(), &futures[0])));
+    assert_true(is_ok(vm_pool_future_wait(&futures[0])));
+    for (u32 i = 0; i < array_len(futures); i++) {
+        vm_pool_future_drop(&futures[i]);
+    }
+
+    vm_pool_drop(&pool);
+    assert_true(is_ok(module_drop(&consumer)));
+    assert_true(is_ok(module_drop(&provider)));
+}
+
+struct CMUnitTest vm_tests[] = {
+    cmocka_unit_test(vm_test_link_plan),
+    cmocka_unit_test(vm_test_link_plan_missing_provider),
+    cmocka_unit_test(vm_test_shared_module_mt),
+    cmocka_unit_test(vm_test_pool_reset),
+    cmocka_unit_test(vm_test_pool_future),
+};
+
+const size_t vm_tests_count = array_len(vm_tests);